@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cmath>
+#include <cstdio>
+
+// Minimal checks for the host tests: failures are printed and counted, main returns the count
+
+inline int& HostCheckFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            HostCheckFailures()++; \
+        } \
+    } while (0)
+
+#define CHECK_NEAR(actual, expected, tolerance) \
+    do { \
+        double actual_ = (actual), expected_ = (expected); \
+        if (!(std::fabs(actual_ - expected_) <= (tolerance))) { \
+            std::printf("%s:%d: %s = %g, expected %g +- %g\n", __FILE__, __LINE__, #actual, actual_, expected_, \
+                (double)(tolerance)); \
+            HostCheckFailures()++; \
+        } \
+    } while (0)
+
+#define HOST_TEST_MAIN(...) \
+    int main() { \
+        void (*tests[])() = {__VA_ARGS__}; \
+        for (auto test : tests) { \
+            test(); \
+        } \
+        std::printf("%s\n", HostCheckFailures() == 0 ? "PASS" : "FAIL"); \
+        return HostCheckFailures(); \
+    }
@@ -0,0 +1,12 @@
+#pragma once
+// Scheduled work runs inline on the host
+#include <functional>
+
+class Application {
+public:
+    static Application& GetInstance() {
+        static Application instance;
+        return instance;
+    }
+    void Schedule(std::function<void()> callback) { callback(); }
+};
@@ -0,0 +1,404 @@
+#pragma once
+// The part of cJSON the tested code uses: building, printing, parsing and reading trees.
+// Same node layout and output format as cJSON, not its speed
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <strings.h>
+
+#define cJSON_False (1 << 0)
+#define cJSON_True (1 << 1)
+#define cJSON_NULL (1 << 2)
+#define cJSON_Number (1 << 3)
+#define cJSON_String (1 << 4)
+#define cJSON_Array (1 << 5)
+#define cJSON_Object (1 << 6)
+
+typedef struct cJSON {
+    struct cJSON* next;
+    struct cJSON* prev;
+    struct cJSON* child;
+    int type;
+    char* valuestring;
+    int valueint;
+    double valuedouble;
+    char* string;
+} cJSON;
+
+inline void cJSON_Delete(cJSON* item);
+
+#define cJSON_ArrayForEach(element, array) \
+    for (element = (array != NULL) ? (array)->child : NULL; element != NULL; element = element->next)
+
+namespace cjson_stub {
+
+inline char* Duplicate(const char* s, size_t len) {
+    char* copy = (char*)std::malloc(len + 1);
+    std::memcpy(copy, s, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+inline cJSON* NewItem(int type) {
+    cJSON* item = (cJSON*)std::calloc(1, sizeof(cJSON));
+    item->type = type;
+    return item;
+}
+
+inline void PrintString(const char* s, std::string& out) {
+    out += '"';
+    for (; *s != '\0'; s++) {
+        unsigned char c = (unsigned char)*s;
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\b': out += "\\b"; break;
+        case '\f': out += "\\f"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (c < 0x20) {
+                char escape[8];
+                std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+                out += escape;
+            } else {
+                out += (char)c;
+            }
+        }
+    }
+    out += '"';
+}
+
+inline void Print(const cJSON* item, std::string& out) {
+    char number[32];
+    switch (item->type) {
+    case cJSON_False: out += "false"; break;
+    case cJSON_True: out += "true"; break;
+    case cJSON_NULL: out += "null"; break;
+    case cJSON_Number:
+        if (item->valuedouble == (double)item->valueint) {
+            std::snprintf(number, sizeof(number), "%d", item->valueint);
+        } else {
+            std::snprintf(number, sizeof(number), "%1.15g", item->valuedouble);
+        }
+        out += number;
+        break;
+    case cJSON_String: PrintString(item->valuestring, out); break;
+    case cJSON_Array:
+    case cJSON_Object:
+        out += item->type == cJSON_Array ? '[' : '{';
+        for (const cJSON* child = item->child; child != nullptr; child = child->next) {
+            if (child != item->child) {
+                out += ',';
+            }
+            if (item->type == cJSON_Object) {
+                PrintString(child->string, out);
+                out += ':';
+            }
+            Print(child, out);
+        }
+        out += item->type == cJSON_Array ? ']' : '}';
+        break;
+    }
+}
+
+inline void Append(cJSON* parent, cJSON* item) {
+    if (parent->child == nullptr) {
+        parent->child = item;
+        item->prev = item;  // cJSON keeps the last child in the first child's prev
+        return;
+    }
+    cJSON* last = parent->child->prev;
+    last->next = item;
+    item->prev = last;
+    parent->child->prev = item;
+}
+
+struct Parser {
+    const char* p;
+    const char* end;
+
+    void SkipSpace() {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+            p++;
+        }
+    }
+
+    bool Literal(const char* word) {
+        size_t len = std::strlen(word);
+        if ((size_t)(end - p) < len || std::strncmp(p, word, len) != 0) {
+            return false;
+        }
+        p += len;
+        return true;
+    }
+
+    bool Hex4(unsigned& value) {
+        if (end - p < 4) {
+            return false;
+        }
+        value = 0;
+        for (int i = 0; i < 4; i++, p++) {
+            char c = *p;
+            value <<= 4;
+            if (c >= '0' && c <= '9') value |= c - '0';
+            else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') value |= c - 'A' + 10;
+            else return false;
+        }
+        return true;
+    }
+
+    bool String(std::string& out) {
+        p++;    // Opening quote
+        while (p < end && *p != '"') {
+            if (*p != '\\') {
+                out += *p++;
+                continue;
+            }
+            if (++p == end) {
+                return false;
+            }
+            char c = *p++;
+            switch (c) {
+            case '"': case '\\': case '/': out += c; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                unsigned cp;
+                if (!Hex4(cp)) {
+                    return false;
+                }
+                if (cp >= 0xd800 && cp < 0xdc00) {
+                    unsigned low;
+                    if (!Literal("\\u") || !Hex4(low) || low < 0xdc00 || low >= 0xe000) {
+                        return false;
+                    }
+                    cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                }
+                if (cp < 0x80) {
+                    out += (char)cp;
+                } else if (cp < 0x800) {
+                    out += (char)(0xc0 | (cp >> 6));
+                    out += (char)(0x80 | (cp & 0x3f));
+                } else if (cp < 0x10000) {
+                    out += (char)(0xe0 | (cp >> 12));
+                    out += (char)(0x80 | ((cp >> 6) & 0x3f));
+                    out += (char)(0x80 | (cp & 0x3f));
+                } else {
+                    out += (char)(0xf0 | (cp >> 18));
+                    out += (char)(0x80 | ((cp >> 12) & 0x3f));
+                    out += (char)(0x80 | ((cp >> 6) & 0x3f));
+                    out += (char)(0x80 | (cp & 0x3f));
+                }
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+        if (p == end) {
+            return false;
+        }
+        p++;    // Closing quote
+        return true;
+    }
+
+    cJSON* Value(int depth) {
+        SkipSpace();
+        if (p == end || depth > 100) {
+            return nullptr;
+        }
+        if (*p == '"') {
+            std::string s;
+            if (!String(s)) {
+                return nullptr;
+            }
+            cJSON* item = NewItem(cJSON_String);
+            item->valuestring = Duplicate(s.data(), s.size());
+            return item;
+        }
+        if (*p == '{' || *p == '[') {
+            bool object = *p++ == '{';
+            char close = object ? '}' : ']';
+            cJSON* item = NewItem(object ? cJSON_Object : cJSON_Array);
+            SkipSpace();
+            if (p < end && *p == close) {
+                p++;
+                return item;
+            }
+            while (true) {
+                std::string key;
+                if (object) {
+                    SkipSpace();
+                    if (p == end || *p != '"' || !String(key)) {
+                        break;
+                    }
+                    SkipSpace();
+                    if (p == end || *p++ != ':') {
+                        break;
+                    }
+                }
+                cJSON* child = Value(depth + 1);
+                if (child == nullptr) {
+                    break;
+                }
+                if (object) {
+                    child->string = Duplicate(key.data(), key.size());
+                }
+                Append(item, child);
+                SkipSpace();
+                if (p < end && *p == ',') {
+                    p++;
+                    continue;
+                }
+                if (p < end && *p == close) {
+                    p++;
+                    return item;
+                }
+                break;
+            }
+            cJSON_Delete(item);
+            return nullptr;
+        }
+        if (Literal("true")) {
+            return NewItem(cJSON_True);
+        }
+        if (Literal("false")) {
+            return NewItem(cJSON_False);
+        }
+        if (Literal("null")) {
+            return NewItem(cJSON_NULL);
+        }
+        char* number_end = nullptr;
+        std::string number(p, std::min<size_t>(end - p, 64));
+        double value = std::strtod(number.c_str(), &number_end);
+        if (number_end == number.c_str()) {
+            return nullptr;
+        }
+        p += number_end - number.c_str();
+        cJSON* item = NewItem(cJSON_Number);
+        item->valuedouble = value;
+        item->valueint = (int)value;
+        return item;
+    }
+};
+
+} // namespace cjson_stub
+
+inline void cJSON_Delete(cJSON* item) {
+    while (item != nullptr) {
+        cJSON* next = item->next;
+        cJSON_Delete(item->child);
+        std::free(item->valuestring);
+        std::free(item->string);
+        std::free(item);
+        item = next;
+    }
+}
+
+inline void cJSON_free(void* p) { std::free(p); }
+
+inline cJSON* cJSON_CreateObject() { return cjson_stub::NewItem(cJSON_Object); }
+inline cJSON* cJSON_CreateArray() { return cjson_stub::NewItem(cJSON_Array); }
+
+inline cJSON* cJSON_CreateString(const char* s) {
+    cJSON* item = cjson_stub::NewItem(cJSON_String);
+    item->valuestring = cjson_stub::Duplicate(s, std::strlen(s));
+    return item;
+}
+
+inline cJSON* cJSON_CreateNumber(double n) {
+    cJSON* item = cjson_stub::NewItem(cJSON_Number);
+    item->valuedouble = n;
+    item->valueint = (int)n;
+    return item;
+}
+
+inline cJSON* cJSON_CreateBool(bool b) { return cjson_stub::NewItem(b ? cJSON_True : cJSON_False); }
+
+inline bool cJSON_AddItemToArray(cJSON* array, cJSON* item) {
+    if (array == nullptr || item == nullptr) {
+        return false;
+    }
+    cjson_stub::Append(array, item);
+    return true;
+}
+
+inline bool cJSON_AddItemToObject(cJSON* object, const char* name, cJSON* item) {
+    if (object == nullptr || item == nullptr) {
+        return false;
+    }
+    std::free(item->string);
+    item->string = cjson_stub::Duplicate(name, std::strlen(name));
+    cjson_stub::Append(object, item);
+    return true;
+}
+
+inline cJSON* cJSON_AddStringToObject(cJSON* object, const char* name, const char* s) {
+    cJSON* item = cJSON_CreateString(s);
+    cJSON_AddItemToObject(object, name, item);
+    return item;
+}
+
+inline cJSON* cJSON_AddNumberToObject(cJSON* object, const char* name, double n) {
+    cJSON* item = cJSON_CreateNumber(n);
+    cJSON_AddItemToObject(object, name, item);
+    return item;
+}
+
+inline cJSON* cJSON_AddBoolToObject(cJSON* object, const char* name, bool b) {
+    cJSON* item = cJSON_CreateBool(b);
+    cJSON_AddItemToObject(object, name, item);
+    return item;
+}
+
+inline char* cJSON_PrintUnformatted(const cJSON* item) {
+    std::string out;
+    cjson_stub::Print(item, out);
+    return cjson_stub::Duplicate(out.data(), out.size());
+}
+
+inline cJSON* cJSON_Parse(const char* text) {
+    cjson_stub::Parser parser{text, text + std::strlen(text)};
+    cJSON* item = parser.Value(0);
+    parser.SkipSpace();
+    if (item != nullptr && parser.p != parser.end) {
+        cJSON_Delete(item);
+        return nullptr;
+    }
+    return item;
+}
+
+inline cJSON* cJSON_GetObjectItem(const cJSON* object, const char* name) {
+    if (object == nullptr || object->type != cJSON_Object) {
+        return nullptr;
+    }
+    for (cJSON* child = object->child; child != nullptr; child = child->next) {
+        if (strcasecmp(child->string, name) == 0) {
+            return child;
+        }
+    }
+    return nullptr;
+}
+
+inline int cJSON_GetArraySize(const cJSON* array) {
+    int size = 0;
+    for (const cJSON* child = array != nullptr ? array->child : nullptr; child != nullptr; child = child->next) {
+        size++;
+    }
+    return size;
+}
+
+inline bool cJSON_IsBool(const cJSON* item) { return item != nullptr && (item->type & (cJSON_True | cJSON_False)); }
+inline bool cJSON_IsTrue(const cJSON* item) { return item != nullptr && item->type == cJSON_True; }
+inline bool cJSON_IsNumber(const cJSON* item) { return item != nullptr && item->type == cJSON_Number; }
+inline bool cJSON_IsString(const cJSON* item) { return item != nullptr && item->type == cJSON_String; }
+inline bool cJSON_IsObject(const cJSON* item) { return item != nullptr && item->type == cJSON_Object; }
+inline bool cJSON_IsArray(const cJSON* item) { return item != nullptr && item->type == cJSON_Array; }
@@ -0,0 +1,6 @@
+#pragma once
+// Logging is dropped on the host
+#define ESP_LOGE(tag, ...) do { (void)(tag); } while (0)
+#define ESP_LOGW(tag, ...) do { (void)(tag); } while (0)
+#define ESP_LOGI(tag, ...) do { (void)(tag); } while (0)
+#define ESP_LOGD(tag, ...) do { (void)(tag); } while (0)
@@ -0,0 +1,3 @@
+#pragma once
+// Only the handle type, nothing on the host starts a timer
+typedef struct esp_timer* esp_timer_handle_t;
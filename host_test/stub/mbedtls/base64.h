@@ -0,0 +1,5 @@
+#pragma once
+// Declared for ImageContent, no host test streams an image
+#include <cstddef>
+
+int mbedtls_base64_encode(unsigned char* dst, size_t dlen, size_t* olen, const unsigned char* src, size_t slen);
@@ -0,0 +1,2 @@
+#pragma once
+// Host builds have no Kconfig, every option is off
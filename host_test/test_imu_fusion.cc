@@ -0,0 +1,204 @@
+// Replays a simulated 60 s rotation through ImuFusion and compares the estimate with the truth.
+// The sensors see the true attitude plus gyroscope bias and white noise on every axis.
+#include "host_check.h"
+#include "iot/things/imu_fusion.h"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+using iot::ImuFusion;
+
+namespace {
+
+constexpr float kSampleRate = 200.0f;          // MPU6050 FIFO rate
+constexpr float kDt = 1.0f / kSampleRate;
+constexpr float kGyroBias[3] = {0.02f, -0.01f, 0.015f};    // rad/s, about 1 deg/s
+constexpr float kEarthField[3] = {0.4f, 0.0f, -0.3f};      // x north, z up, dipping down
+
+struct Quat {
+    double w = 1, x = 0, y = 0, z = 0;
+};
+
+Quat Multiply(const Quat& a, const Quat& b) {
+    return {a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z,
+            a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+            a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+            a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w};
+}
+
+Quat Normalized(Quat q) {
+    double n = std::sqrt(q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z);
+    return {q.w / n, q.x / n, q.y / n, q.z / n};
+}
+
+// Earth frame vector seen from the body of a body to earth rotation
+void ToBody(const Quat& q, const float earth[3], float body[3]) {
+    Quat v{0, earth[0], earth[1], earth[2]};
+    Quat conj{q.w, -q.x, -q.y, -q.z};
+    Quat r = Multiply(Multiply(conj, v), q);
+    body[0] = (float)r.x;
+    body[1] = (float)r.y;
+    body[2] = (float)r.z;
+}
+
+// Angle between the true and the estimated attitude, all three axes
+double AttitudeError(const Quat& truth, const ImuFusion::Quaternion& estimate) {
+    Quat conj{truth.w, -truth.x, -truth.y, -truth.z};
+    Quat e = Multiply(conj, Quat{estimate.w, estimate.x, estimate.y, estimate.z});
+    return 2.0 * std::acos(std::min(1.0, std::fabs(e.w))) * ImuFusion::kRadToDeg;
+}
+
+// Angle between the true and the estimated gravity direction, ignores the yaw
+double TiltError(const Quat& truth, const ImuFusion::Quaternion& estimate) {
+    const float up[3] = {0, 0, 1};
+    float a[3], b[3];
+    ToBody(truth, up, a);
+    ToBody(Quat{estimate.w, estimate.x, estimate.y, estimate.z}, up, b);
+    double dot = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    return std::acos(std::min(1.0, dot)) * ImuFusion::kRadToDeg;
+}
+
+struct ReplayResult {
+    double max_tilt_error = 0;      // deg, after the settle time
+    double max_attitude_error = 0;  // deg, after the settle time
+    double final_attitude_error = 0;
+};
+
+/**
+ * @param rotate Turn the body with a mix of slow sines (peak about 45 deg/s), else keep it still
+ * @param use_magnetometer Feed the magnetometer into the filter
+ * @param decimation Fuse every N samples with the mean rate, as IMU_FUSION_DECIMATION does
+ */
+ReplayResult Replay(bool rotate, bool use_magnetometer, int decimation, float seconds = 60.0f) {
+    std::mt19937 rng(42);
+    std::normal_distribution<float> gyro_noise(0.0f, 0.005f);
+    std::normal_distribution<float> accel_noise(0.0f, 0.01f);
+    std::normal_distribution<float> mag_noise(0.0f, 0.01f);
+    const float up[3] = {0, 0, 1};
+
+    ImuFusion fusion;
+    Quat truth;
+    ReplayResult result;
+    float gyro_sum[3] = {};
+    int pending = 0;
+    int steps = (int)(seconds * kSampleRate);
+    for (int i = 0; i < steps; i++) {
+        float t = i * kDt;
+        float rate[3] = {0, 0, 0};
+        if (rotate) {
+            rate[0] = 0.8f * std::sin(0.5f * t);
+            rate[1] = 0.6f * std::cos(0.3f * t);
+            rate[2] = 0.4f * std::sin(0.2f * t);
+        }
+        // True attitude, integrated finer than the sample rate
+        for (int k = 0; k < 10; k++) {
+            double h = kDt / 10.0 * 0.5;
+            Quat d{1, rate[0] * h, rate[1] * h, rate[2] * h};
+            truth = Normalized(Multiply(truth, d));
+        }
+
+        float accel[3], mag[3];
+        ToBody(truth, up, accel);
+        ToBody(truth, kEarthField, mag);
+        for (int axis = 0; axis < 3; axis++) {
+            accel[axis] += accel_noise(rng);
+            mag[axis] += mag_noise(rng);
+            gyro_sum[axis] += rate[axis] + kGyroBias[axis] + gyro_noise(rng);
+        }
+        if (++pending < decimation) {
+            continue;
+        }
+        fusion.Update(accel[0], accel[1], accel[2],
+            gyro_sum[0] / pending, gyro_sum[1] / pending, gyro_sum[2] / pending,
+            use_magnetometer ? mag[0] : 0.0f, use_magnetometer ? mag[1] : 0.0f, use_magnetometer ? mag[2] : 0.0f,
+            kDt * pending);
+        pending = 0;
+        gyro_sum[0] = gyro_sum[1] = gyro_sum[2] = 0.0f;
+
+        if (t >= 5.0f) {
+            result.max_tilt_error = std::max(result.max_tilt_error, TiltError(truth, fusion.quaternion()));
+            result.max_attitude_error = std::max(result.max_attitude_error, AttitudeError(truth, fusion.quaternion()));
+        }
+        result.final_attitude_error = AttitudeError(truth, fusion.quaternion());
+    }
+    return result;
+}
+
+void TestStartsFromTheMeasuredGravity() {
+    ImuFusion fusion;
+    // Rolled 30 degrees: gravity moves from z towards y
+    float s = std::sin(30.0f * ImuFusion::kDegToRad), c = std::cos(30.0f * ImuFusion::kDegToRad);
+    fusion.Update(0.0f, s, c, 0, 0, 0, 0, 0, 0, kDt);
+    CHECK_NEAR(fusion.roll(), 30.0, 0.5);
+    CHECK_NEAR(fusion.pitch(), 0.0, 0.5);
+}
+
+void TestTracksTiltWhileRotating() {
+    auto result = Replay(true, false, 1);
+    std::printf("tilt error rotating: %.2f deg max\n", result.max_tilt_error);
+    CHECK(result.max_tilt_error < 3.0);
+}
+
+void TestMagnetometerHoldsTheHeading() {
+    auto with_mag = Replay(true, true, 1);
+    auto without_mag = Replay(true, false, 1);
+    std::printf("attitude error rotating: %.2f deg with magnetometer, %.2f deg without\n",
+        with_mag.max_attitude_error, without_mag.max_attitude_error);
+    CHECK(with_mag.max_attitude_error < 5.0);
+    // Without it the yaw integrates the gyroscope bias
+    CHECK(without_mag.max_attitude_error > 2 * with_mag.max_attitude_error);
+}
+
+void TestLearnsTheGyroscopeBiasAtRest() {
+    // The integral term needs a while to cancel the bias, then the heading stops drifting
+    auto result = Replay(false, true, 1);
+    std::printf("attitude error at rest with 1 deg/s gyro bias: %.2f deg max, %.2f deg after 60 s\n",
+        result.max_attitude_error, result.final_attitude_error);
+    CHECK(result.max_attitude_error < 2.0);
+    CHECK(result.final_attitude_error < 0.5);
+}
+
+void TestDecimatedFusionKeepsTheAccuracy() {
+    // 50 Hz steps, the default on the ESP32-C3 which has no FPU
+    auto result = Replay(true, true, 4);
+    std::printf("attitude error rotating, fused at 50 Hz: %.2f deg max\n", result.max_attitude_error);
+    CHECK(result.max_attitude_error < 5.0);
+}
+
+void TestLinearAccelerationRemovesGravity() {
+    ImuFusion fusion;
+    for (int i = 0; i < 400; i++) {
+        fusion.Update(0.0f, 0.0f, 1.0f, 0, 0, 0, 0, 0, 0, kDt);
+    }
+    float lx, ly, lz;
+    fusion.LinearAcceleration(0.2f, 0.0f, 1.0f, lx, ly, lz);
+    CHECK_NEAR(lx, 0.2, 0.01);
+    CHECK_NEAR(ly, 0.0, 0.01);
+    CHECK_NEAR(lz, 0.0, 0.01);
+}
+
+// Cost of one Update on the host, the on-device figure is in the IMU stats log
+void BenchmarkUpdate() {
+    const int kSteps = 1000000;
+    for (bool use_magnetometer : {false, true}) {
+        ImuFusion fusion;
+        float sink = 0.0f;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < kSteps; i++) {
+            float phase = (i & 1023) * 0.001f;
+            fusion.Update(phase, 0.1f, 1.0f, 0.01f, phase, 0.02f,
+                use_magnetometer ? 0.4f : 0.0f, use_magnetometer ? phase : 0.0f, use_magnetometer ? -0.3f : 0.0f, kDt);
+            sink += fusion.quaternion().w;
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / kSteps;
+        std::printf("Update %s magnetometer: %.1f ns\n", use_magnetometer ? "with" : "without", ns);
+        CHECK(std::isfinite(sink));
+    }
+}
+
+} // namespace
+
+HOST_TEST_MAIN(TestStartsFromTheMeasuredGravity, TestTracksTiltWhileRotating, TestMagnetometerHoldsTheHeading,
+    TestLearnsTheGyroscopeBiasAtRest, TestDecimatedFusionKeepsTheAccuracy, TestLinearAccelerationRemovesGravity,
+    BenchmarkUpdate)
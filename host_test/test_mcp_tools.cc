@@ -0,0 +1,312 @@
+// McpToolRegistry with about 100 tools shaped like the device's: tools/call lookup by name and the
+// tools/list cursor walk, checked page by page against the old linear scan that ran cJSON per request.
+// Ends with the cost of both paths. cJSON is the host stub, so the old path only shows its shape here
+#include "host_check.h"
+#include "mcp_server.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+size_t allocations = 0;
+
+} // namespace
+
+void* operator new(size_t size) {
+    allocations++;
+    if (void* p = std::malloc(size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+const char* const kGroups[] = {"motor", "servo", "camera", "imu", "us", "light", "audio", "screen", "system", "vision"};
+const int kToolsPerGroup = 10;
+
+McpTool* MakeTool(const std::string& group, int i) {
+    std::string name = "self." + group + ".action_" + std::to_string(i);
+    std::string description = "Action " + std::to_string(i) + " of the " + group + " group.\n"
+        "Use this tool when the user asks to change or read the " + group + " state, "
+        "the arguments are checked against their ranges before the call.";
+    PropertyList properties;
+    switch (i % 4) {
+    case 1:
+        properties = PropertyList({Property("x", kPropertyTypeInteger, -100, 100),
+            Property("y", kPropertyTypeInteger, -100, 100)});
+        break;
+    case 2:
+        properties = PropertyList({Property("question", kPropertyTypeString)});
+        break;
+    case 3:
+        properties = PropertyList({Property("enabled", kPropertyTypeBoolean, true),
+            Property("level", kPropertyTypeInteger, 50, 0, 100)});
+        break;
+    }
+    auto tool = new McpTool(name, description, properties, [](const PropertyList&) -> ReturnValue { return true; });
+    // Every tenth tool is for the user only, like reboot and upgrade
+    tool->set_user_only(i == 9);
+    return tool;
+}
+
+// Registers the tools in both the registry and the plain list the old paths scan
+struct Tools {
+    McpToolRegistry registry;
+    std::vector<McpTool*> list;
+
+    Tools() {
+        for (const char* group : kGroups) {
+            for (int i = 0; i < kToolsPerGroup; i++) {
+                auto tool = MakeTool(group, i);
+                CHECK(registry.Add(tool));
+                list.push_back(tool);
+            }
+        }
+    }
+};
+
+// McpTool::to_json before the descriptor was cached, run for every tool of every tools/list
+std::string OldToolJson(const McpTool& tool) {
+    std::vector<std::string> required = tool.properties().GetRequired();
+
+    cJSON *json = cJSON_CreateObject();
+    cJSON_AddStringToObject(json, "name", tool.name().c_str());
+    cJSON_AddStringToObject(json, "description", tool.description().c_str());
+
+    cJSON *input_schema = cJSON_CreateObject();
+    cJSON_AddStringToObject(input_schema, "type", "object");
+
+    cJSON *properties = cJSON_Parse(tool.properties().to_json().c_str());
+    cJSON_AddItemToObject(input_schema, "properties", properties);
+
+    if (!required.empty()) {
+        cJSON *required_array = cJSON_CreateArray();
+        for (const auto& property : required) {
+            cJSON_AddItemToArray(required_array, cJSON_CreateString(property.c_str()));
+        }
+        cJSON_AddItemToObject(input_schema, "required", required_array);
+    }
+
+    cJSON_AddItemToObject(json, "inputSchema", input_schema);
+
+    if (tool.user_only()) {
+        cJSON *annotations = cJSON_CreateObject();
+        cJSON *audience = cJSON_CreateArray();
+        cJSON_AddItemToArray(audience, cJSON_CreateString("user"));
+        cJSON_AddItemToObject(annotations, "audience", audience);
+        cJSON_AddItemToObject(json, "annotations", annotations);
+    }
+
+    char *json_str = cJSON_PrintUnformatted(json);
+    std::string result(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(json);
+    return result;
+}
+
+// McpServer::GetToolsList before the registry: scans to the cursor and serializes every listed tool
+bool OldToolsList(const std::vector<McpTool*>& tools, const std::string& cursor, bool list_user_only_tools,
+    std::string& json) {
+    const int max_payload_size = 8000;
+    json = "{\"tools\":[";
+
+    bool found_cursor = cursor.empty();
+    auto it = tools.begin();
+    std::string next_cursor = "";
+
+    while (it != tools.end()) {
+        if (!found_cursor) {
+            if ((*it)->name() == cursor) {
+                found_cursor = true;
+            } else {
+                ++it;
+                continue;
+            }
+        }
+
+        if (!list_user_only_tools && (*it)->user_only()) {
+            ++it;
+            continue;
+        }
+
+        std::string tool_json = OldToolJson(**it) + ",";
+        if (json.length() + tool_json.length() + 30 > max_payload_size) {
+            next_cursor = (*it)->name();
+            break;
+        }
+
+        json += tool_json;
+        ++it;
+    }
+
+    if (json.back() == ',') {
+        json.pop_back();
+    }
+    if (json.back() == '[' && !tools.empty()) {
+        return false;
+    }
+    if (next_cursor.empty()) {
+        json += "]}";
+    } else {
+        json += "],\"nextCursor\":\"" + next_cursor + "\"}";
+    }
+    return true;
+}
+
+McpTool* OldFind(const std::vector<McpTool*>& tools, const std::string& name) {
+    auto it = std::find_if(tools.begin(), tools.end(), [&name](const McpTool* tool) { return tool->name() == name; });
+    return it != tools.end() ? *it : nullptr;
+}
+
+std::string NextCursor(const std::string& page) {
+    cJSON* json = cJSON_Parse(page.c_str());
+    auto next_cursor = cJSON_GetObjectItem(json, "nextCursor");
+    std::string cursor = cJSON_IsString(next_cursor) ? next_cursor->valuestring : "";
+    cJSON_Delete(json);
+    return cursor;
+}
+
+Tools& GetTools() {
+    static Tools tools;
+    return tools;
+}
+
+void TestDescriptorsMatchOldSerialization() {
+    for (auto tool : GetTools().list) {
+        CHECK(tool->to_json() == OldToolJson(*tool));
+    }
+    CHECK(GetTools().list[9]->to_json().find("\"annotations\":{\"audience\":[\"user\"]}") != std::string::npos);
+    CHECK(GetTools().list[1]->to_json().find("\"required\":[\"x\",\"y\"]") != std::string::npos);
+}
+
+void TestCursorWalkMatchesOldPages() {
+    auto& tools = GetTools();
+    for (bool with_user : {false, true}) {
+        std::string cursor, json, old_json, error;
+        int pages = 0, listed = 0;
+        do {
+            CHECK(tools.registry.GetToolsList(cursor, with_user, json, error));
+            CHECK(OldToolsList(tools.list, cursor, with_user, old_json));
+            CHECK(json == old_json);
+            CHECK(json.size() <= 8000);
+
+            cJSON* page = cJSON_Parse(json.c_str());
+            CHECK(page != nullptr);
+            listed += cJSON_GetArraySize(cJSON_GetObjectItem(page, "tools"));
+            cJSON_Delete(page);
+            cursor = NextCursor(json);
+            pages++;
+        } while (!cursor.empty() && pages < 100);
+        CHECK(pages > 1);
+        CHECK(listed == (with_user ? 100 : 90));
+    }
+}
+
+void TestLookupAndErrors() {
+    auto& tools = GetTools();
+    CHECK(tools.registry.Find("self.camera.action_2") == tools.list[22]);
+    CHECK(tools.registry.Find("self.camera.action_10") == nullptr);
+
+    // A duplicate name is refused and stays with the caller
+    McpTool* duplicate = MakeTool("motor", 0);
+    CHECK(!tools.registry.Add(duplicate));
+    delete duplicate;
+
+    std::string json, error;
+    CHECK(!tools.registry.GetToolsList("self.nothing", false, json, error));
+    CHECK(error == "Unknown cursor: self.nothing");
+
+    // A cursor that is a tool name but not a page start is paginated from that tool
+    CHECK(tools.registry.GetToolsList("self.servo.action_3", false, json, error));
+    std::string old_json;
+    CHECK(OldToolsList(tools.list, "self.servo.action_3", false, old_json));
+    CHECK(json == old_json);
+}
+
+// AddCommonTools puts the common tools before the ones boards registered
+void TestCommonToolsGoFirst() {
+    McpToolRegistry registry;
+    registry.Add(MakeTool("board", 1));
+    auto original = registry.TakeAll();
+    CHECK(registry.Find("self.board.action_1") == nullptr);
+    registry.Add(MakeTool("common", 2));
+    registry.Append(original);
+
+    std::string json, error;
+    CHECK(registry.GetToolsList("", false, json, error));
+    CHECK(json.find("self.common.action_2") < json.find("self.board.action_1"));
+    CHECK(registry.Find("self.board.action_1") == original[0]);
+}
+
+// The full tools/list cursor walk and a tools/call lookup of every tool, old path against the registry
+void BenchmarkToolsListAndCall() {
+    const int kWalks = 200;
+    const int kLookupRounds = 2000;
+    auto& tools = GetTools();
+    std::string json, error;
+
+    auto walk = [&](bool old_path) {
+        std::string cursor;
+        do {
+            if (old_path) {
+                OldToolsList(tools.list, cursor, true, json);
+            } else {
+                tools.registry.GetToolsList(cursor, true, json, error);
+            }
+            size_t at = json.rfind("\"nextCursor\":\"");
+            cursor = at == std::string::npos ? "" : json.substr(at + 14, json.size() - at - 16);
+        } while (!cursor.empty());
+    };
+
+    size_t start_allocations = allocations;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kWalks; i++) {
+        walk(true);
+    }
+    auto middle = std::chrono::steady_clock::now();
+    size_t old_allocations = allocations - start_allocations;
+    for (int i = 0; i < kWalks; i++) {
+        walk(false);
+    }
+    auto end = std::chrono::steady_clock::now();
+    size_t new_allocations = allocations - start_allocations - old_allocations;
+    double old_us = std::chrono::duration<double, std::micro>(middle - start).count() / kWalks;
+    double new_us = std::chrono::duration<double, std::micro>(end - middle).count() / kWalks;
+    std::printf("tools/list walk of %zu tools: old %.1f us, %zu allocations; registry %.1f us, %zu allocations\n",
+        tools.list.size(), old_us, old_allocations / kWalks, new_us, new_allocations / kWalks);
+
+    std::vector<std::string> names;
+    for (auto tool : tools.list) {
+        names.push_back(tool->name());
+    }
+    size_t found = 0;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kLookupRounds; i++) {
+        for (const auto& name : names) {
+            found += OldFind(tools.list, name) != nullptr;
+        }
+    }
+    middle = std::chrono::steady_clock::now();
+    for (int i = 0; i < kLookupRounds; i++) {
+        for (const auto& name : names) {
+            found += tools.registry.Find(name) != nullptr;
+        }
+    }
+    end = std::chrono::steady_clock::now();
+    double lookups = (double)kLookupRounds * names.size();
+    std::printf("tools/call lookup: old %.1f ns, registry %.1f ns per call\n",
+        std::chrono::duration<double, std::nano>(middle - start).count() / lookups,
+        std::chrono::duration<double, std::nano>(end - middle).count() / lookups);
+    CHECK(found == 2 * lookups);
+    CHECK(new_us < old_us);
+}
+
+} // namespace
+
+HOST_TEST_MAIN(TestDescriptorsMatchOldSerialization, TestCursorWalkMatchesOldPages, TestLookupAndErrors,
+    TestCommonToolsGoFirst, BenchmarkToolsListAndCall)
@@ -0,0 +1,122 @@
+// JsonToMsgPack / MsgPackToJson on a corpus of the control and MCP messages the device exchanges.
+// Checks exact encodings and round trips, then prints the wire size and the transcoding time per message.
+#include "host_check.h"
+#include "protocols/msgpack_codec.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Messages as the device builds them: compact JSON, integers, no whitespace
+const char* const kCorpus[] = {
+    R"({"session_id":"8f1c2a","type":"listen","state":"start","mode":"auto"})",
+    R"({"session_id":"8f1c2a","type":"listen","state":"stop"})",
+    R"({"session_id":"8f1c2a","type":"listen","state":"detect","text":"你好小智"})",
+    R"({"session_id":"8f1c2a","type":"abort","reason":"wake_word_detected"})",
+    R"({"session_id":"8f1c2a","type":"mcp","payload":{"jsonrpc":"2.0","id":7,"result":{"content":[{"type":"text","text":"true"}],"isError":false}}})",
+    R"({"session_id":"8f1c2a","type":"mcp","payload":{"jsonrpc":"2.0","id":8,"result":{"content":[{"type":"text","text":"{\"front\":42.5,\"rear\":-1}"}],"isError":false}}})",
+    R"({"session_id":"8f1c2a","type":"mcp","payload":{"jsonrpc":"2.0","id":2,"result":{"tools":[)"
+    R"({"name":"self.motor.move","description":"Drive the vehicle, x and y are the joystick direction","inputSchema":{"type":"object","properties":{"x":{"type":"integer","minimum":-100,"maximum":100},"y":{"type":"integer","minimum":-100,"maximum":100}},"required":["x","y"]}},)"
+    R"({"name":"self.servo.set_angle","description":"Set a servo angle in degrees","inputSchema":{"type":"object","properties":{"channel":{"type":"integer","minimum":0,"maximum":15},"angle":{"type":"integer","minimum":0,"maximum":180}},"required":["channel","angle"]}},)"
+    R"({"name":"self.camera.take_photo","description":"Take a photo and explain it","inputSchema":{"type":"object","properties":{"question":{"type":"string"}},"required":["question"]}}],)"
+    R"("nextCursor":""}}})",
+    R"({"type":"hello","version":3,"features":{"mcp":true,"msgpack":true},"transport":"websocket","audio_params":{"format":"opus","sample_rate":16000,"channels":1,"frame_duration":60}})",
+};
+
+std::string Hex(const std::string& bytes) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex;
+    for (unsigned char c : bytes) {
+        hex += digits[c >> 4];
+        hex += digits[c & 15];
+    }
+    return hex;
+}
+
+std::string Encode(const std::string& json) {
+    std::string out;
+    CHECK(JsonToMsgPack(json.data(), json.size(), out));
+    return out;
+}
+
+std::string Decode(const std::string& msgpack) {
+    std::string out;
+    CHECK(MsgPackToJson(reinterpret_cast<const uint8_t*>(msgpack.data()), msgpack.size(), out));
+    return out;
+}
+
+void TestEncodings() {
+    // fixmap 1, fixstr "a", positive fixint 1
+    CHECK(Hex(Encode(R"({"a":1})")) == "81a16101");
+    // fixarray: negative fixint, uint8, int8, nil, true, false
+    CHECK(Hex(Encode("[-1,200,-100,null,true,false]")) == "96ffccc8d09cc0c3c2");
+    // Whitespace is not part of the encoding
+    CHECK(Encode(" { \"a\" : [ 1 , 2 ] } ") == Encode(R"({"a":[1,2]})"));
+    // Escapes are decoded into the string
+    CHECK(Hex(Encode(R"("a\"é")")) == "a461" "22c3a9");
+}
+
+void TestCorpusRoundTrips() {
+    for (const char* json : kCorpus) {
+        std::string decoded = Decode(Encode(json));
+        CHECK(decoded == json);
+        if (decoded != json) {
+            std::printf("  %s\n  %s\n", json, decoded.c_str());
+        }
+    }
+}
+
+void TestInvalidInput() {
+    std::string out;
+    CHECK(!JsonToMsgPack("{\"a\":", 5, out));
+    CHECK(!JsonToMsgPack("{\"a\" 1}", 7, out));
+    CHECK(!JsonToMsgPack("[1,2", 4, out));
+    // Truncated map, then bin 8 which JSON can not express
+    const uint8_t truncated[] = {0x82, 0xa1, 0x61, 0x01};
+    CHECK(!MsgPackToJson(truncated, sizeof(truncated), out));
+    const uint8_t bin[] = {0xc4, 0x01, 0x00};
+    CHECK(!MsgPackToJson(bin, sizeof(bin), out));
+}
+
+// Wire size and transcoding time over the corpus. The JSON text is built either way, so encoding
+// is extra work on send and decoding is extra work before the usual text path on receive
+void BenchmarkCorpus() {
+    const int kRounds = 20000;
+    std::vector<std::string> corpus(std::begin(kCorpus), std::end(kCorpus));
+    std::vector<std::string> encoded;
+    size_t json_bytes = 0, msgpack_bytes = 0;
+    for (const auto& json : corpus) {
+        encoded.push_back(Encode(json));
+        json_bytes += json.size();
+        msgpack_bytes += encoded.back().size();
+    }
+    std::printf("corpus: %zu bytes JSON, %zu bytes MessagePack (%.0f%%)\n", json_bytes, msgpack_bytes,
+        msgpack_bytes * 100.0 / json_bytes);
+
+    std::string out;
+    out.reserve(4096);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kRounds; i++) {
+        for (const auto& json : corpus) {
+            JsonToMsgPack(json.data(), json.size(), out);
+        }
+    }
+    auto middle = std::chrono::steady_clock::now();
+    for (int i = 0; i < kRounds; i++) {
+        for (const auto& msgpack : encoded) {
+            MsgPackToJson(reinterpret_cast<const uint8_t*>(msgpack.data()), msgpack.size(), out);
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    double messages = (double)kRounds * corpus.size();
+    std::printf("encode: %.0f ns, decode: %.0f ns per message, added to building and parsing the JSON text\n",
+        std::chrono::duration<double, std::nano>(middle - start).count() / messages,
+        std::chrono::duration<double, std::nano>(end - middle).count() / messages);
+    CHECK(msgpack_bytes < json_bytes);
+}
+
+} // namespace
+
+HOST_TEST_MAIN(TestEncodings, TestCorpusRoundTrips, TestInvalidInput, BenchmarkCorpus)
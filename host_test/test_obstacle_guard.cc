@@ -0,0 +1,154 @@
+// Replays simulated approaches to a wall through ObstacleGuard and checks where the vehicle stops.
+// The vehicle drives at a fixed duty scaled by the guard, pings arrive at 20 Hz with noise,
+// missing echoes and spurious close echoes, and the motors brake with a limited deceleration.
+#include "host_check.h"
+#include "hardware/obstacle_guard.h"
+
+#include <random>
+
+namespace {
+
+constexpr int64_t kPingIntervalUs = 50000;     // 20 Hz per sensor
+constexpr float kStartDistanceCm = 200.0f;
+constexpr float kAccelerationCmS2 = 300.0f;    // Braking and speeding up of the motors
+constexpr int kSeeds = 50;
+
+struct TraceOptions {
+    float speed_cm_s = 60.0f;       // At full duty
+    float noise_cm = 0.5f;
+    float dropout = 0.1f;           // Pings without an echo
+    float spike = 0.05f;            // Spurious echo at spike_cm
+    float spike_cm = 5.0f;
+};
+
+struct TraceResult {
+    float closest_cm = INFINITY;    // Smallest gap to the wall during the run
+    bool stopped = false;           // The guard reported a stop at the end
+};
+
+// Default thresholds, the same as the Kconfig defaults
+ObstacleThresholds DefaultThresholds() {
+    return ObstacleThresholds();
+}
+
+// Full duty speeds to replay, the wheel plant in test_wheel_control tops out at 70 cm/s
+constexpr float kSpeeds[] = {30.0f, 60.0f, 100.0f};
+
+TraceResult Replay(const TraceOptions& options, unsigned seed,
+                   const ObstacleThresholds& thresholds = DefaultThresholds()) {
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> noise(0.0f, options.noise_cm);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+    ObstacleGuard guard(thresholds);
+    TraceResult result;
+    float gap = kStartDistanceCm;
+    float speed = options.speed_cm_s;
+    const int64_t step_us = 1000;
+    int64_t next_ping_us = std::uniform_int_distribution<int64_t>(0, kPingIntervalUs)(rng);
+    for (int64_t now = 0; now < 10000000; now += step_us) {
+        if (now >= next_ping_us) {
+            next_ping_us += kPingIntervalUs;
+            float measured = gap + noise(rng);
+            float r = uniform(rng);
+            if (r < options.dropout) {
+                measured = 0.0f;
+            } else if (r < options.dropout + options.spike) {
+                measured = options.spike_cm;
+            }
+            guard.Add(measured, now);
+            guard.Update(now);
+        }
+
+        // The motors follow the limited duty with a bounded acceleration
+        float target = options.speed_cm_s * guard.scale();
+        float dv = kAccelerationCmS2 * step_us / 1e6f;
+        speed = speed > target ? std::max(target, speed - dv) : std::min(target, speed + dv);
+        gap -= speed * step_us / 1e6f;
+        result.closest_cm = std::min(result.closest_cm, gap);
+        if (gap <= 0.0f) {
+            break;
+        }
+    }
+    result.stopped = guard.scale() == 0.0f;
+    return result;
+}
+
+// Worst closest gap over all seeds, every trace has to end stopped in front of the wall
+float WorstGap(const TraceOptions& options, const ObstacleThresholds& thresholds = DefaultThresholds()) {
+    float worst = INFINITY;
+    for (unsigned seed = 1; seed <= kSeeds; seed++) {
+        auto result = Replay(options, seed, thresholds);
+        CHECK(result.stopped);
+        worst = std::min(worst, result.closest_cm);
+    }
+    return worst;
+}
+
+void TestStopsBeforeTheStopDistance() {
+    const float stop = DefaultThresholds().stop_distance_cm;
+    for (float speed : kSpeeds) {
+        TraceOptions options;
+        options.speed_cm_s = speed;
+        float worst = WorstGap(options);
+        std::printf("%5.0f cm/s with outliers: worst gap %.1f cm over %d traces\n", speed, worst, kSeeds);
+        CHECK(worst >= stop);
+    }
+}
+
+void TestCleanTraces() {
+    const float stop = DefaultThresholds().stop_distance_cm;
+    for (float speed : kSpeeds) {
+        TraceOptions options;
+        options.speed_cm_s = speed;
+        options.dropout = 0.0f;
+        options.spike = 0.0f;
+        float worst = WorstGap(options);
+        std::printf("%5.0f cm/s without outliers: worst gap %.1f cm\n", speed, worst);
+        CHECK(worst >= stop);
+    }
+}
+
+void TestSingleOutliersDoNotLimit() {
+    ObstacleGuard guard;
+    int64_t now = 0;
+    const float pings[] = {150.0f, 150.0f, 5.0f, 150.0f, 0.0f, 150.0f, 0.0f, 0.0f, 150.0f};
+    for (float ping : pings) {
+        guard.Add(ping, now);
+        CHECK(guard.Update(now) == ObstacleState::kClear);
+        now += kPingIntervalUs;
+    }
+}
+
+void TestObstacleGoneReleasesTheStop() {
+    ObstacleGuard guard;
+    int64_t now = 0;
+    for (int i = 0; i < 5; i++, now += kPingIntervalUs) {
+        guard.Add(8.0f, now);
+        guard.Update(now);
+    }
+    CHECK(guard.state() == ObstacleState::kStop);
+    // Nothing in range from now on: held for a few lost pings, then released
+    guard.Add(0.0f, now);
+    CHECK(guard.Update(now) == ObstacleState::kStop);
+    for (int i = 0; i < 4; i++) {
+        now += kPingIntervalUs;
+        guard.Add(0.0f, now);
+        guard.Update(now);
+    }
+    CHECK(guard.state() == ObstacleState::kClear);
+    CHECK(guard.scale() == 1.0f);
+}
+
+void TestStaleSensorHoldsMinimumDuty() {
+    ObstacleGuard guard;
+    guard.Add(150.0f, 0);
+    CHECK(guard.Update(0) == ObstacleState::kClear);
+    CHECK(guard.Update(guard.thresholds().sample_timeout_us + 1) == ObstacleState::kStale);
+    CHECK_NEAR(guard.scale(), guard.thresholds().min_scale, 1e-6);
+}
+
+} // namespace
+
+HOST_TEST_MAIN(TestStopsBeforeTheStopDistance, TestCleanTraces, TestSingleOutliersDoNotLimit,
+    TestObstacleGoneReleasesTheStop, TestStaleSensorHoldsMinimumDuty)
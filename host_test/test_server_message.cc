@@ -0,0 +1,139 @@
+// ServerMessageScanner on frames shaped like the server's: a spoken turn of tts/stt/llm messages,
+// escaped and non-ASCII text, and the frames that must fall back to cJSON. Ends with the scan cost per frame.
+#include "host_check.h"
+#include "protocols/server_message.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace {
+
+size_t allocations = 0;
+
+} // namespace
+
+void* operator new(size_t size) {
+    allocations++;
+    if (void* p = std::malloc(size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+// One conversation turn as the server sends it
+const char* const kTurn[] = {
+    R"({"type":"stt","text":"今天天气怎么样","session_id":"8f1c2a"})",
+    R"({"type":"llm","text":"😊","emotion":"happy","session_id":"8f1c2a"})",
+    R"({"type":"tts","state":"start","sample_rate":24000,"session_id":"8f1c2a"})",
+    R"({"type":"tts","state":"sentence_start","text":"今天是晴天，","session_id":"8f1c2a"})",
+    R"({"type":"tts","state":"sentence_start","text":"最高气温二十五度。","session_id":"8f1c2a"})",
+    R"({"type":"tts","state":"sentence_start","text":"适合出门散步。","session_id":"8f1c2a"})",
+    R"({"type":"tts","state":"stop","session_id":"8f1c2a"})",
+};
+
+bool Scan(ServerMessageScanner& scanner, const std::string& frame, ServerMessage& message) {
+    return scanner.Scan(frame.data(), frame.size(), message);
+}
+
+void TestConversationTurn() {
+    ServerMessageScanner scanner;
+    ServerMessage message;
+    CHECK(Scan(scanner, kTurn[0], message));
+    CHECK(message.type == kServerMessageStt);
+    CHECK(message.text == "今天天气怎么样");
+
+    CHECK(Scan(scanner, kTurn[1], message));
+    CHECK(message.type == kServerMessageLlm);
+    CHECK(message.emotion == "happy");
+
+    CHECK(Scan(scanner, kTurn[2], message));
+    CHECK(message.type == kServerMessageTts && message.tts_state == kTtsStateStart);
+    CHECK(message.text.empty());
+
+    CHECK(Scan(scanner, kTurn[4], message));
+    CHECK(message.tts_state == kTtsStateSentenceStart);
+    CHECK(message.text == "最高气温二十五度。");
+
+    CHECK(Scan(scanner, kTurn[6], message));
+    CHECK(message.tts_state == kTtsStateStop);
+}
+
+void TestViewsPointIntoTheFrame() {
+    ServerMessageScanner scanner;
+    ServerMessage message;
+    std::string frame = kTurn[3];
+    CHECK(Scan(scanner, frame, message));
+    CHECK(message.text.data() >= frame.data() && message.text.data() < frame.data() + frame.size());
+}
+
+void TestEscapedText() {
+    ServerMessageScanner scanner;
+    ServerMessage message;
+    CHECK(Scan(scanner, R"({"type":"tts","state":"sentence_start","text":"He said \"hi\"\n你好 😀"})",
+        message));
+    CHECK(message.text == "He said \"hi\"\n你好 😀");
+
+    // Key order does not matter and nested values are skipped
+    CHECK(Scan(scanner, R"( { "extra" : {"text":"no","list":[1,"}",3]}, "text" : "yes", "type" : "stt" } )",
+        message));
+    CHECK(message.type == kServerMessageStt);
+    CHECK(message.text == "yes");
+}
+
+void TestPongTimestamp() {
+    ServerMessageScanner scanner;
+    ServerMessage message;
+    CHECK(Scan(scanner, R"({"type":"pong","timestamp":4294967})", message));
+    CHECK(message.type == kServerMessagePong);
+    CHECK(message.timestamp == 4294967);
+}
+
+void TestColdMessagesFallBack() {
+    ServerMessageScanner scanner;
+    ServerMessage message;
+    CHECK(!Scan(scanner, R"({"type":"hello","transport":"websocket","audio_params":{"sample_rate":24000}})", message));
+    CHECK(!Scan(scanner, R"({"session_id":"8f1c2a","type":"mcp","payload":{"jsonrpc":"2.0","id":1}})", message));
+    CHECK(!Scan(scanner, R"({"session_id":"8f1c2a"})", message));
+    // Malformed frames are left to cJSON, which reports them
+    CHECK(!Scan(scanner, R"({"type":"tts","text":"unterminated})", message));
+    CHECK(!Scan(scanner, R"({"type":"tts","text":"bad \x escape"})", message));
+    CHECK(!Scan(scanner, R"(["type","tts"])", message));
+    CHECK(!Scan(scanner, "", message));
+}
+
+// Scan cost over the turn above, the frames are copied once so every scan reads from the heap like a received frame
+void BenchmarkTurn() {
+    const int kRounds = 200000;
+    std::vector<std::string> frames(std::begin(kTurn), std::end(kTurn));
+    frames.push_back(R"({"type":"tts","state":"sentence_start","text":"今天是晴天，"})");
+    ServerMessageScanner scanner;
+    ServerMessage message;
+    size_t text_bytes = 0;
+    size_t start_allocations = allocations;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kRounds; i++) {
+        for (const auto& frame : frames) {
+            if (scanner.Scan(frame.data(), frame.size(), message)) {
+                text_bytes += message.text.size();
+            }
+        }
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() /
+        (kRounds * frames.size());
+    std::printf("scan: %.1f ns per frame, %zu allocations\n", ns, allocations - start_allocations);
+    CHECK(allocations == start_allocations);
+    CHECK(text_bytes > 0);
+}
+
+} // namespace
+
+HOST_TEST_MAIN(TestConversationTurn, TestViewsPointIntoTheFrame, TestEscapedText, TestPongTimestamp,
+    TestColdMessagesFallBack, BenchmarkTurn)
@@ -0,0 +1,184 @@
+// ThingManager state reports and Thing value tracking with Things shaped like the vehicle's:
+// IMU, ultrasonic, servo and motor. Ends with the cost of a delta report against the old string diff.
+#include "host_check.h"
+#include "iot/thing_manager.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <map>
+#include <new>
+
+using namespace iot;
+
+namespace {
+
+size_t allocations = 0;
+
+} // namespace
+
+void* operator new(size_t size) {
+    allocations++;
+    if (void* p = std::malloc(size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+// Number properties read from plain members, like the in-tree Things
+class FakeThing : public Thing {
+public:
+    int values[22] = {};
+    bool running = false;
+    int getter_calls = 0;
+
+    FakeThing(const char* name, int count) : Thing(name, "fake") {
+        for (int i = 0; i < count; i++) {
+            properties_.AddNumberProperty("p" + std::to_string(i), "value", [this, i]() {
+                getter_calls++;
+                return values[i];
+            });
+        }
+        properties_.AddBooleanProperty("running", "running", [this]() { return running; });
+    }
+
+    Property& property(const std::string& name) { return properties_[name]; }
+};
+
+struct Fleet {
+    FakeThing imu{"imu", 22};
+    FakeThing us{"UltrasonicSensor", 2};
+    FakeThing servo{"Servo", 3};
+    FakeThing motor{"Motor", 7};
+
+    Fleet() {
+        auto& manager = ThingManager::GetInstance();
+        if (manager.GetThings().empty()) {
+            manager.AddThing(&imu);
+            manager.AddThing(&us);
+            manager.AddThing(&servo);
+            manager.AddThing(&motor);
+        }
+    }
+};
+
+// The manager is a singleton, every test works on the same Things
+Fleet& GetFleet() {
+    static Fleet fleet;
+    return fleet;
+}
+
+void TestDeltaReportsOnlyChangedProperties() {
+    auto& fleet = GetFleet();
+    auto& manager = ThingManager::GetInstance();
+    std::string json;
+    manager.GetStatesJson(json, false);
+    CHECK(json.find("\"name\":\"imu\"") != std::string::npos);
+    CHECK(json.find("\"p21\":0") != std::string::npos);
+
+    CHECK(!manager.GetStatesJson(json, true));
+    CHECK(json == "[]");
+
+    fleet.motor.values[1] = 120;
+    CHECK(manager.GetStatesJson(json, true));
+    CHECK(json == "[{\"name\":\"Motor\",\"state\":{\"p1\":120}}]");
+    CHECK(!manager.GetStatesJson(json, true));
+}
+
+void TestTrackedPropertyWaitsForMarkChanged() {
+    auto& fleet = GetFleet();
+    auto& manager = ThingManager::GetInstance();
+    auto& property = fleet.servo.property("p0");
+    property.set_change_tracked(true);
+    std::string json;
+    manager.GetStatesJson(json, true);
+
+    // Changed without telling the property: not read, not reported
+    fleet.servo.values[0] = 90;
+    int calls = fleet.servo.getter_calls;
+    CHECK(!manager.GetStatesJson(json, true));
+    CHECK(fleet.servo.getter_calls == calls + 2);   // p1 and p2 are still polled
+
+    property.MarkChanged();
+    CHECK(manager.GetStatesJson(json, true));
+    CHECK(json == "[{\"name\":\"Servo\",\"state\":{\"p0\":90}}]");
+    property.set_change_tracked(false);
+}
+
+void TestSetValueCountsOnlyChanges() {
+    auto& us = GetFleet().us;
+    us.SetValue("front_distance", 42.0f);
+    uint32_t version = us.values_version();
+    us.SetValue("front_distance", 42.0f);
+    CHECK(us.values_version() == version);
+    us.SetValue("front_distance", 41.5f);
+    CHECK(us.values_version() == version + 1);
+
+    // No echo is stored as NAN, which never compares equal
+    us.SetValue("front_distance", NAN);
+    us.SetValue("front_distance", NAN);
+    CHECK(us.values_version() == version + 2);
+    float value;
+    CHECK(us.FindValue("front_distance", value) && std::isnan(value));
+}
+
+void TestFindThingByName() {
+    auto& fleet = GetFleet();
+    auto& manager = ThingManager::GetInstance();
+    CHECK(manager.FindThingByName("Motor") == &fleet.motor);
+    CHECK(manager.FindThingByName("motor") == nullptr);
+}
+
+// Delta report cost with the four Things registered, against building every Thing's state string and
+// comparing it with the last one, which is what GetStatesJson(delta) used to do
+void BenchmarkDeltaReport() {
+    auto& fleet = GetFleet();
+    auto& manager = ThingManager::GetInstance();
+    const int kCalls = 200000;
+    std::string json;
+    json.reserve(2048);
+    manager.GetStatesJson(json, true);
+
+    auto measure = [&](const char* label, auto&& body) {
+        size_t start_allocations = allocations;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < kCalls; i++) {
+            body(i);
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / kCalls;
+        double allocs = (double)(allocations - start_allocations) / kCalls;
+        std::printf("%-22s %7.1f ns, %5.2f allocations per report\n", label, ns, allocs);
+        return allocs;
+    };
+
+    double allocs = measure("delta, no change", [&](int) { manager.GetStatesJson(json, true); });
+    CHECK(allocs == 0.0);
+    allocs = measure("delta, one change", [&](int i) {
+        fleet.imu.values[i % 22] = i;
+        manager.GetStatesJson(json, true);
+    });
+    CHECK(allocs == 0.0);
+
+    std::map<std::string, std::string> last_states;
+    measure("string diff, no change", [&](int) {
+        json = "[";
+        for (auto thing : manager.GetThings()) {
+            auto state = thing->GetStateJson();
+            auto it = last_states.find(thing->name());
+            if (it != last_states.end() && it->second == state) {
+                continue;
+            }
+            last_states[thing->name()] = state;
+            json += state + ",";
+        }
+        json += "]";
+    });
+}
+
+} // namespace
+
+HOST_TEST_MAIN(TestDeltaReportsOnlyChangedProperties, TestTrackedPropertyWaitsForMarkChanged,
+    TestSetValueCountsOnlyChanges, TestFindThingByName, BenchmarkDeltaReport)
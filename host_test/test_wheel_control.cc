@@ -0,0 +1,177 @@
+// WheelSpeedPid, WheelSpeedEstimator and DifferentialDrive against a simulated DC motor and encoder
+
+#include "host_check.h"
+#include "iot/things/wheel_control.h"
+
+using namespace iot;
+
+namespace {
+
+constexpr float kRateHz = 100.0f;               // CONFIG_MOTOR_CONTROL_RATE_HZ
+constexpr float kDt = 1.0f / kRateHz;
+constexpr float kMmPerCount = 3.14159265f * 65.0f / 1320.0f;    // 65 mm wheel, 1320 counts per rev
+
+// First-order DC motor: full duty at 7.4 V reaches 700 mm/s without load, static friction below 30 duty
+struct MotorPlant {
+    float volts = 7.4f;
+    float load = 0.0f;          // mm/s lost to the load at any duty
+    float speed = 0.0f;
+    double position_mm = 0.0;
+    long counted = 0;
+
+    int32_t Step(float duty, float dt) {
+        float drive = std::fabs(duty) < 30.0f ? 0.0f : duty / 255.0f * 700.0f * volts / 7.4f;
+        float target = drive == 0.0f ? 0.0f : drive - std::copysign(load, drive);
+        if (drive != 0.0f && std::signbit(target) != std::signbit(drive)) {
+            target = 0.0f;
+        }
+        constexpr float kTau = 0.08f;
+        float substep = dt / 10.0f;
+        for (int i = 0; i < 10; i++) {
+            speed += (target - speed) * substep / kTau;
+            position_mm += speed * substep;
+        }
+        long counts = static_cast<long>(std::floor(position_mm / kMmPerCount));
+        int32_t delta = static_cast<int32_t>(counts - counted);
+        counted = counts;
+        return delta;
+    }
+};
+
+// Runs the PID for `seconds` and returns the mean measured speed over the last half second
+float RunClosedLoop(MotorPlant& plant, WheelSpeedPid& pid, WheelSpeedEstimator& estimator, float setpoint,
+                    float seconds, float* max_speed = nullptr) {
+    int steps = static_cast<int>(seconds * kRateHz);
+    int tail = static_cast<int>(0.5f * kRateHz);
+    float duty = 0.0f;
+    double sum = 0.0;
+    for (int i = 0; i < steps; i++) {
+        float measured = estimator.Update(plant.Step(duty, kDt), kDt);
+        duty = pid.Update(setpoint, measured, kDt);
+        if (i >= steps - tail) {
+            sum += plant.speed;
+        }
+        if (max_speed) {
+            *max_speed = std::max(*max_speed, plant.speed);
+        }
+    }
+    return static_cast<float>(sum / tail);
+}
+
+float RunOpenLoop(MotorPlant& plant, float duty, float seconds) {
+    for (int i = 0; i < static_cast<int>(seconds * kRateHz); i++) {
+        plant.Step(duty, kDt);
+    }
+    return plant.speed;
+}
+
+void TestHoldsSpeedAcrossVoltageAndLoad() {
+    const float kVolts[] = {7.4f, 6.0f};
+    const float kLoads[] = {0.0f, 80.0f};
+    float closed_min = 1e9f, closed_max = -1e9f;
+    float open_min = 1e9f, open_max = -1e9f;
+    for (float volts : kVolts) {
+        for (float load : kLoads) {
+            MotorPlant plant;
+            plant.volts = volts;
+            plant.load = load;
+            WheelSpeedPid pid;
+            WheelSpeedEstimator estimator(kMmPerCount, 20.0f);
+            float speed = RunClosedLoop(plant, pid, estimator, 300.0f, 3.0f);
+            CHECK_NEAR(speed, 300.0f, 10.0f);
+            closed_min = std::min(closed_min, speed);
+            closed_max = std::max(closed_max, speed);
+
+            // The same feed-forward duty without feedback
+            MotorPlant open;
+            open.volts = volts;
+            open.load = load;
+            float open_speed = RunOpenLoop(open, 0.35f * 300.0f + 40.0f, 3.0f);
+            open_min = std::min(open_min, open_speed);
+            open_max = std::max(open_max, open_speed);
+        }
+    }
+    std::printf("300 mm/s over battery and load: closed loop %.0f..%.0f, open loop %.0f..%.0f\n",
+        closed_min, closed_max, open_min, open_max);
+    CHECK(closed_max - closed_min < 20.0f);
+    CHECK(open_max - open_min > 100.0f);
+}
+
+void TestSaturationDoesNotWindUp() {
+    MotorPlant plant;
+    WheelSpeedPid pid;
+    WheelSpeedEstimator estimator(kMmPerCount, 20.0f);
+    RunClosedLoop(plant, pid, estimator, 900.0f, 2.0f);     // Out of reach, output saturated
+    CHECK(std::fabs(pid.integral()) <= pid.config().max_duty);
+
+    float peak = 0.0f;
+    MotorPlant settled = plant;
+    float speed = RunClosedLoop(settled, pid, estimator, 200.0f, 1.0f, &peak);
+    CHECK_NEAR(speed, 200.0f, 10.0f);
+
+    // Settles within 0.3 s of the step without undershooting far below the new setpoint
+    MotorPlant step = plant;
+    WheelSpeedPid pid2;
+    WheelSpeedEstimator estimator2(kMmPerCount, 20.0f);
+    RunClosedLoop(step, pid2, estimator2, 900.0f, 2.0f);
+    float min_speed = 1e9f;
+    float settle_time = -1.0f;
+    float duty = pid2.output();
+    for (int i = 0; i < static_cast<int>(1.0f * kRateHz); i++) {
+        float measured = estimator2.Update(step.Step(duty, kDt), kDt);
+        duty = pid2.Update(200.0f, measured, kDt);
+        min_speed = std::min(min_speed, step.speed);
+        if (settle_time < 0.0f && std::fabs(step.speed - 200.0f) < 15.0f) {
+            settle_time = (i + 1) * kDt;
+        }
+    }
+    CHECK(settle_time > 0.0f && settle_time < 0.3f);
+    CHECK(min_speed > 150.0f);
+}
+
+void TestZeroSetpointReleasesTheWheel() {
+    WheelSpeedPid pid;
+    pid.Update(300.0f, 100.0f, kDt);
+    CHECK(pid.integral() != 0.0f);
+    CHECK(pid.Update(0.0f, 250.0f, kDt) == 0.0f);
+    CHECK(pid.integral() == 0.0f);
+}
+
+void TestEstimatorFollowsCounts() {
+    WheelSpeedEstimator estimator(kMmPerCount, 0.0f);
+    // 3 counts per 10 ms
+    CHECK_NEAR(estimator.Update(3, kDt), 3 * kMmPerCount / kDt, 1e-3);
+    CHECK_NEAR(estimator.Update(-3, kDt), -3 * kMmPerCount / kDt, 1e-3);
+}
+
+void TestDriveKeepsTheCurveWhenSaturated() {
+    DifferentialDrive drive(130.0f, 600.0f, 0.0f);
+    WheelSpeeds speeds = drive.Compute(600.0f, 2.0f);
+    CHECK_NEAR(std::max(std::fabs(speeds.left), std::fabs(speeds.right)), 600.0f, 1e-3);
+    // Turn radius linear / angular is kept
+    float linear, angular;
+    drive.BodyVelocity(speeds, linear, angular);
+    CHECK_NEAR(linear / angular, 600.0f / 2.0f, 1e-2);
+}
+
+void TestDriveRampsBothWheelsTogether() {
+    DifferentialDrive drive(130.0f, 600.0f, 1500.0f);
+    WheelSpeeds last;
+    for (int i = 0; i < 20; i++) {
+        const WheelSpeeds& setpoint = drive.Update(400.0f, 1.0f, kDt);
+        CHECK(std::fabs(setpoint.left - last.left) <= 1500.0f * kDt + 1e-3f);
+        CHECK(std::fabs(setpoint.right - last.right) <= 1500.0f * kDt + 1e-3f);
+        last = setpoint;
+    }
+    // Ratio of the wheels is that of the target throughout the ramp
+    WheelSpeeds target = drive.Compute(400.0f, 1.0f);
+    CHECK_NEAR(last.left / last.right, target.left / target.right, 1e-3);
+
+    drive.Reset();
+    CHECK(drive.setpoint().left == 0.0f && drive.setpoint().right == 0.0f);
+}
+
+} // namespace
+
+HOST_TEST_MAIN(TestHoldsSpeedAcrossVoltageAndLoad, TestSaturationDoesNotWindUp, TestZeroSetpointReleasesTheWheel,
+               TestEstimatorFollowsCounts, TestDriveKeepsTheCurveWhenSaturated, TestDriveRampsBothWheelsTogether)
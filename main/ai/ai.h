@@ -28,6 +28,7 @@ public:
     void Stop() override;
     bool IsRunning() const override;
     const char* GetName() const override;
+    std::vector<const char*> GetDependencies() const override { return {"Web"}; }
     
     // AI功能方法
     std::string ProcessSpeechQuery(const std::string& speech_input);
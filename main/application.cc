@@ -4,6 +4,7 @@
 #include <nvs_flash.h>
 
 #include "application.h"
+#include "trace.h"
 #include "web/web.h"
 #include "boards/common/board.h"
 #include "multiplexer.h"
@@ -228,6 +229,8 @@ void Application::Initialize() {
 }
 
 void Application::Run() {
+    main_task_handle_ = xTaskGetCurrentTaskHandle();
+
     const EventBits_t ALL_EVENTS = 
         MAIN_EVENT_SCHEDULE |
         MAIN_EVENT_SEND_AUDIO |
@@ -247,51 +250,53 @@ void Application::Run() {
         auto bits = xEventGroupWaitBits(event_group_, ALL_EVENTS, pdTRUE, pdFALSE, portMAX_DELAY);
 
         if (bits & MAIN_EVENT_ERROR) {
+            TRACE_SCOPE("main:error");
             SetDeviceState(kDeviceStateIdle);
             Alert(Lang::Strings::ERROR, last_error_message_.c_str(), "circle_xmark", Lang::Sounds::OGG_EXCLAMATION);
         }
 
         if (bits & MAIN_EVENT_NETWORK_CONNECTED) {
+            TRACE_SCOPE("main:network_connected");
             HandleNetworkConnectedEvent();
         }
 
         if (bits & MAIN_EVENT_NETWORK_DISCONNECTED) {
+            TRACE_SCOPE("main:network_disconnected");
             HandleNetworkDisconnectedEvent();
         }
 
         if (bits & MAIN_EVENT_ACTIVATION_DONE) {
+            TRACE_SCOPE("main:activation_done");
             HandleActivationDoneEvent();
         }
 
         if (bits & MAIN_EVENT_STATE_CHANGED) {
+            TRACE_SCOPE("main:state_changed");
             HandleStateChangedEvent();
         }
 
         if (bits & MAIN_EVENT_TOGGLE_CHAT) {
+            TRACE_SCOPE("main:toggle_chat");
             HandleToggleChatEvent();
         }
 
         if (bits & MAIN_EVENT_START_LISTENING) {
+            TRACE_SCOPE("main:start_listening");
             HandleStartListeningEvent();
         }
 
         if (bits & MAIN_EVENT_STOP_LISTENING) {
+            TRACE_SCOPE("main:stop_listening");
             HandleStopListeningEvent();
         }
 
-        if (bits & MAIN_EVENT_SEND_AUDIO) {
-            while (auto packet = audio_service_.PopPacketFromSendQueue()) {
-                if (protocol_ && !protocol_->SendAudio(std::move(packet))) {
-                    break;
-                }
-            }
-        }
-
         if (bits & MAIN_EVENT_WAKE_WORD_DETECTED) {
+            TRACE_SCOPE("main:wake_word_detected");
             HandleWakeWordDetectedEvent();
         }
 
         if (bits & MAIN_EVENT_VAD_CHANGE) {
+            TRACE_SCOPE("main:vad_change");
             if (GetDeviceState() == kDeviceStateListening) {
                 auto led = Board::GetInstance().GetLed();
                 led->OnStateChanged();
@@ -299,16 +304,26 @@ void Application::Run() {
         }
 
         if (bits & MAIN_EVENT_SCHEDULE) {
-            std::unique_lock<std::mutex> lock(mutex_);
-            auto tasks = std::move(main_tasks_);
-            lock.unlock();
-            for (auto& task : tasks) {
-                task();
+            TRACE_SCOPE("main:schedule");
+            // Bound the normal lane per wakeup so audio and other events are not starved by a burst
+            const size_t kMaxNormalTasksPerWakeup = 8;
+            if (main_tasks_.RunPending(kMaxNormalTasksPerWakeup)) {
+                xEventGroupSetBits(event_group_, MAIN_EVENT_SCHEDULE);
             }
         }
 
+        // After scheduled tasks, so control and MCP replies go out before queued audio
+        if (bits & MAIN_EVENT_SEND_AUDIO) {
+            TRACE_SCOPE("main:send_audio");
+            HandleSendAudioEvent();
+        }
+
         if (bits & MAIN_EVENT_CLOCK_TICK) {
+            TRACE_SCOPE("main:clock_tick");
             clock_ticks_++;
+            if (protocol_) {
+                protocol_->UpdateMetrics();
+            }
             auto display = Board::GetInstance().GetDisplay();
             display->UpdateStatusBar();
         
@@ -320,6 +335,29 @@ void Application::Run() {
     }
 }
 
+void Application::HandleSendAudioEvent() {
+    // Send a bounded batch per wakeup, other events get a turn before the rest of a backlog
+    const size_t kMaxPacketsPerWakeup = 8;
+    std::vector<std::unique_ptr<AudioStreamPacket>> packets;
+    packets.reserve(kMaxPacketsPerWakeup);
+    if (protocol_ && protocol_->IsStreaming()) {
+        // Left in the queue, the streaming task sets the event again when its message is out
+        return;
+    }
+    size_t remaining = audio_service_.PopPacketsFromSendQueue(packets, kMaxPacketsPerWakeup);
+    for (size_t i = 0; i < packets.size(); i++) {
+        if (protocol_ && !protocol_->SendAudio(std::move(packets[i]))) {
+            // The protocol counts the failed packet as dropped. The rest waits in the queue for the next
+            // encoded packet to retry, and ages out as stale if the link stays down
+            audio_service_.RequeueSendPackets(packets, i + 1);
+            return;
+        }
+    }
+    if (remaining > 0) {
+        xEventGroupSetBits(event_group_, MAIN_EVENT_SEND_AUDIO);
+    }
+}
+
 void Application::HandleNetworkConnectedEvent() {
     ESP_LOGI(TAG, "Network connected");
     auto state = GetDeviceState();
@@ -536,13 +574,16 @@ void Application::InitializeProtocol() {
     auto codec = board.GetAudioCodec();
     display->SetStatus(Lang::Strings::LOADING_PROTOCOL);
 
-    if (ota_->HasMqttConfig()) {
-        protocol_ = std::make_unique<MqttProtocol>();
-    } else if (ota_->HasWebsocketConfig()) {
-        protocol_ = std::make_unique<WebsocketProtocol>();
-    } else {
-        ESP_LOGW(TAG, "No protocol specified in the OTA config, using MQTT");
-        protocol_ = std::make_unique<MqttProtocol>();
+    {
+        std::lock_guard<std::mutex> lock(protocol_mutex_);
+        if (ota_->HasMqttConfig()) {
+            protocol_ = std::make_unique<MqttProtocol>();
+        } else if (ota_->HasWebsocketConfig()) {
+            protocol_ = std::make_unique<WebsocketProtocol>();
+        } else {
+            ESP_LOGW(TAG, "No protocol specified in the OTA config, using MQTT");
+            protocol_ = std::make_unique<MqttProtocol>();
+        }
     }
 
     protocol_->OnConnected([this]() {
@@ -574,56 +615,52 @@ void Application::InitializeProtocol() {
             auto display = Board::GetInstance().GetDisplay();
             display->SetChatMessage("system", "");
             SetDeviceState(kDeviceStateIdle);
-        });
+        }, kSchedulePriorityCritical);
     });
     
+    protocol_->OnIncomingMessage([this](const ServerMessage& message) {
+        TRACE_SCOPE("protocol:message");
+        HandleServerMessage(message);
+    });
+
     protocol_->OnIncomingJson([this, display](const cJSON* root) {
+        TRACE_SCOPE("protocol:json");
         // Parse JSON data
         auto type = cJSON_GetObjectItem(root, "type");
-        if (strcmp(type->valuestring, "tts") == 0) {
+        if (strcmp(type->valuestring, "tts") == 0 || strcmp(type->valuestring, "stt") == 0 ||
+            strcmp(type->valuestring, "llm") == 0) {
+            // Hot messages normally take the in-situ path, this is only reached if scanning gave up
+            ServerMessage message;
             auto state = cJSON_GetObjectItem(root, "state");
-            if (strcmp(state->valuestring, "start") == 0) {
-                Schedule([this]() {
-                    aborted_ = false;
-                    SetDeviceState(kDeviceStateSpeaking);
-                });
-            } else if (strcmp(state->valuestring, "stop") == 0) {
-                Schedule([this]() {
-                    if (GetDeviceState() == kDeviceStateSpeaking) {
-                        if (listening_mode_ == kListeningModeManualStop) {
-                            SetDeviceState(kDeviceStateIdle);
-                        } else {
-                            SetDeviceState(kDeviceStateListening);
-                        }
+            auto text = cJSON_GetObjectItem(root, "text");
+            auto emotion = cJSON_GetObjectItem(root, "emotion");
+            if (type->valuestring[0] == 't') {
+                message.type = kServerMessageTts;
+                if (cJSON_IsString(state)) {
+                    if (strcmp(state->valuestring, "start") == 0) {
+                        message.tts_state = kTtsStateStart;
+                    } else if (strcmp(state->valuestring, "stop") == 0) {
+                        message.tts_state = kTtsStateStop;
+                    } else if (strcmp(state->valuestring, "sentence_start") == 0) {
+                        message.tts_state = kTtsStateSentenceStart;
                     }
-                });
-            } else if (strcmp(state->valuestring, "sentence_start") == 0) {
-                auto text = cJSON_GetObjectItem(root, "text");
-                if (cJSON_IsString(text)) {
-                    ESP_LOGI(TAG, "<< %s", text->valuestring);
-                    Schedule([this, display, message = std::string(text->valuestring)]() {
-                        display->SetChatMessage("assistant", message.c_str());
-                    });
                 }
+            } else if (type->valuestring[0] == 's') {
+                message.type = kServerMessageStt;
+            } else {
+                message.type = kServerMessageLlm;
             }
-        } else if (strcmp(type->valuestring, "stt") == 0) {
-            auto text = cJSON_GetObjectItem(root, "text");
             if (cJSON_IsString(text)) {
-                ESP_LOGI(TAG, ">> %s", text->valuestring);
-                Schedule([this, display, message = std::string(text->valuestring)]() {
-                    display->SetChatMessage("user", message.c_str());
-                });
+                message.text = text->valuestring;
             }
-        } else if (strcmp(type->valuestring, "llm") == 0) {
-            auto emotion = cJSON_GetObjectItem(root, "emotion");
             if (cJSON_IsString(emotion)) {
-                Schedule([this, display, emotion_str = std::string(emotion->valuestring)]() {
-                    display->SetEmotion(emotion_str.c_str());
-                });
+                message.emotion = emotion->valuestring;
             }
+            HandleServerMessage(message);
         } else if (strcmp(type->valuestring, "mcp") == 0) {
             auto payload = cJSON_GetObjectItem(root, "payload");
-            if (cJSON_IsObject(payload)) {
+            // An object, or an array for a JSON-RPC batch
+            if (cJSON_IsObject(payload) || cJSON_IsArray(payload)) {
                 McpServer::GetInstance().ParseMessage(payload);
             }
         } else if (strcmp(type->valuestring, "system") == 0) {
@@ -724,6 +761,9 @@ void Application::InitializeProtocol() {
             }
             extern void SetHardwareManager(HardwareManager* manager);
             SetHardwareManager(hardware_manager_);
+#if CONFIG_SENSOR_HISTORY_MEMORY_KB > 0
+            hardware_manager_->StartHistorySampling(1000);
+#endif
         } else {
             ESP_LOGE(TAG, "Hardware Manager initialization failed: %s", esp_err_to_name(hw_ret));
         }
@@ -732,10 +772,10 @@ void Application::InitializeProtocol() {
 #if defined(CONFIG_ENABLE_WEB_SERVER)
     auto& manager = ComponentManager::GetInstance();
     if (manager.GetComponent("Web") == nullptr) {
+        // Started by StartComponents() together with the components that depend on it
         Web* web = new Web(8080);
         if (web) {
             manager.RegisterComponent(web);
-            web->Start();
         }
     }
 #endif
@@ -745,6 +785,52 @@ void Application::InitializeProtocol() {
     StartComponents();
 }
 
+void Application::HandleServerMessage(const ServerMessage& message) {
+    auto display = Board::GetInstance().GetDisplay();
+    switch (message.type) {
+        case kServerMessageTts:
+            if (message.tts_state == kTtsStateStart) {
+                Schedule([this]() {
+                    aborted_ = false;
+                    SetDeviceState(kDeviceStateSpeaking);
+                }, kSchedulePriorityCritical);
+            } else if (message.tts_state == kTtsStateStop) {
+                Schedule([this]() {
+                    if (GetDeviceState() == kDeviceStateSpeaking) {
+                        if (listening_mode_ == kListeningModeManualStop) {
+                            SetDeviceState(kDeviceStateIdle);
+                        } else {
+                            SetDeviceState(kDeviceStateListening);
+                        }
+                    }
+                }, kSchedulePriorityCritical);
+            } else if (message.tts_state == kTtsStateSentenceStart && !message.text.empty()) {
+                ESP_LOGI(TAG, "<< %.*s", (int)message.text.size(), message.text.data());
+                Schedule([display, text = std::string(message.text)]() {
+                    display->SetChatMessage("assistant", text.c_str());
+                });
+            }
+            break;
+        case kServerMessageStt:
+            if (!message.text.empty()) {
+                ESP_LOGI(TAG, ">> %.*s", (int)message.text.size(), message.text.data());
+                Schedule([display, text = std::string(message.text)]() {
+                    display->SetChatMessage("user", text.c_str());
+                });
+            }
+            break;
+        case kServerMessageLlm:
+            if (!message.emotion.empty()) {
+                Schedule([display, emotion = std::string(message.emotion)]() {
+                    display->SetEmotion(emotion.c_str());
+                });
+            }
+            break;
+        default:
+            break;
+    }
+}
+
 void Application::ShowActivationCode(const std::string& code, const std::string& message) {
     struct digit_sound {
         char digit;
@@ -993,11 +1079,8 @@ void Application::HandleStateChangedEvent() {
     }
 }
 
-void Application::Schedule(std::function<void()>&& callback) {
-    {
-        std::lock_guard<std::mutex> lock(mutex_);
-        main_tasks_.push_back(std::move(callback));
-    }
+void Application::Schedule(MainTask&& callback, SchedulePriority priority) {
+    main_tasks_.Push(std::move(callback), priority);
     xEventGroupSetBits(event_group_, MAIN_EVENT_SCHEDULE);
 }
 
@@ -1020,7 +1103,10 @@ void Application::Reboot() {
     if (protocol_ && protocol_->IsAudioChannelOpened()) {
         protocol_->CloseAudioChannel();
     }
-    protocol_.reset();
+    {
+        std::lock_guard<std::mutex> lock(protocol_mutex_);
+        protocol_.reset();
+    }
     audio_service_.Stop();
 
     vTaskDelay(pdMS_TO_TICKS(1000));
@@ -1115,13 +1201,13 @@ void Application::WakeWordInvoke(const std::string& wake_word) {
     } else if (state == kDeviceStateSpeaking) {
         Schedule([this]() {
             AbortSpeaking(kAbortReasonNone);
-        });
+        }, kSchedulePriorityCritical);
     } else if (state == kDeviceStateListening) {   
         Schedule([this]() {
             if (protocol_) {
                 protocol_->CloseAudioChannel();
             }
-        });
+        }, kSchedulePriorityCritical);
     }
 }
 
@@ -1142,13 +1228,65 @@ bool Application::CanEnterSleepMode() {
     return true;
 }
 
+std::string Application::GetProtocolMetricsJson() {
+    std::string json;
+    {
+        // Called from the web and MCP tasks while the main task may reset protocol_
+        std::lock_guard<std::mutex> lock(protocol_mutex_);
+        if (!protocol_) {
+            return "null";
+        }
+        json = protocol_->GetMetricsJson();
+    }
+    auto statistics = audio_service_.GetSendQueueStatistics();
+    // Extend the protocol metrics object with the uplink queue counters
+    json.pop_back();
+    json += ",\"send_queue_depth\":" + std::to_string(statistics.depth);
+    json += ",\"send_queue_stale_dropped\":" + std::to_string(statistics.stale_dropped);
+    json += ",\"send_queue_overflow_dropped\":" + std::to_string(statistics.overflow_dropped);
+    json += ",\"send_queue_requeued\":" + std::to_string(statistics.requeued);
+    json += "}";
+    return json;
+}
+
 void Application::SendMcpMessage(const std::string& payload) {
     // Always schedule to run in main task for thread safety
     Schedule([this, payload = std::move(payload)]() {
         if (protocol_) {
             protocol_->SendMcpMessage(payload);
         }
-    });
+    }, kSchedulePriorityCritical);
+}
+
+void Application::SendMcpMessageStream(std::function<bool(const Protocol::MessageWriter& write)> payload) {
+    // The payload is produced during the send, which can take a while for a photo.
+    // MCP workers stream on their own task, the main task hands the message to a short-lived one.
+    if (xTaskGetCurrentTaskHandle() != main_task_handle_) {
+        StreamMcpMessage(payload);
+        return;
+    }
+    auto job = new std::function<bool(const Protocol::MessageWriter& write)>(std::move(payload));
+    BaseType_t ret = xTaskCreate([](void* arg) {
+        auto job = static_cast<std::function<bool(const Protocol::MessageWriter& write)>*>(arg);
+        Application::GetInstance().StreamMcpMessage(*job);
+        delete job;
+        vTaskDelete(NULL);
+    }, "mcp_stream", 4096 * 2, job, 2, nullptr);
+    if (ret != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create MCP stream task");
+        delete job;
+    }
+}
+
+void Application::StreamMcpMessage(const std::function<bool(const Protocol::MessageWriter& write)>& payload) {
+    {
+        std::lock_guard<std::mutex> lock(protocol_mutex_);
+        if (protocol_ && !protocol_->SendMcpMessageStream(payload)) {
+            ESP_LOGE(TAG, "Failed to stream MCP message");
+        }
+    }
+    // Audio held back during the stream
+    xEventGroupSetBits(event_group_, MAIN_EVENT_SEND_AUDIO);
 }
 
 // Component management methods
@@ -1162,8 +1300,6 @@ void Application::InitializeComponents() {
 #ifdef CONFIG_ENABLE_MOTOR_CONTROLLER
         // Initialize move controller (包含电机和舵机控制)
         ESP_LOGI(TAG, "Initializing move controller (高优先级)");
-        // 给Thing初始化一点时间
-        vTaskDelay(pdMS_TO_TICKS(100));
 #endif
 
         // ===== 步骤2: 然后初始化其他非关键的IoT Things =====
@@ -1193,9 +1329,6 @@ void Application::InitializeComponents() {
         ESP_LOGI(TAG, "Initializing servo controller");
 #endif
 
-        // 等待所有IoT组件初始化完成
-        ESP_LOGI(TAG, "等待100ms让IoT组件初始化完成");
-        vTaskDelay(pdMS_TO_TICKS(100));
 #endif // IOT协议启用
 
         // Initialize vision components
@@ -1254,143 +1387,11 @@ void Application::StartComponents() {
                 component->IsRunning() ? "yes" : "no");
     }
     
-    // 步骤1：优先启动IOT类型组件，因为其他组件可能依赖它们
-    ESP_LOGI(TAG, "步骤1: 优先启动IOT组件");
-    for (auto* component : manager.GetComponents()) {
-        if (!component || !component->GetName()) continue;
-        
-        if (component->GetType() == COMPONENT_TYPE_IOT && !component->IsRunning()) {
-            try {
-                ESP_LOGI(TAG, "启动IOT组件: %s", component->GetName());
-                bool started = component->Start();
-                if (!started) {
-                    ESP_LOGE(TAG, "Failed to start IOT component: %s", component->GetName());
-                } else {
-                    ESP_LOGI(TAG, "IOT component %s started successfully", component->GetName());
-                }
-            } catch (const std::exception& e) {
-                ESP_LOGE(TAG, "Exception while starting IOT component: %s", e.what());
-            }
-        }
+    // 组件按GetDependencies()声明的顺序在启动任务上并行启动，不再占用主任务
+    // 启动时间线可以从系统信息的boot_timeline字段查看
+    if (!manager.StartAllAsync()) {
+        ESP_LOGW(TAG, "Previous component startup still running, skipped");
     }
-    
-    // 等待一小段时间，确保IoT组件完全启动
-    ESP_LOGI(TAG, "等待100ms让IOT组件完全初始化");
-    vTaskDelay(pdMS_TO_TICKS(100));
-    
-    // Start all remaining components
-    // Use try/catch to prevent crashes from propagating
-    ESP_LOGI(TAG, "步骤2: 启动所有其他组件");
-    for (auto* component : manager.GetComponents()) {
-        if (!component) {
-            ESP_LOGW(TAG, "Found null component in manager, skipping start");
-            continue;
-        }
-        
-        // Skip any null component Name to prevent crashes
-        if (!component->GetName()) {
-            ESP_LOGW(TAG, "Component has null name, skipping start");
-            continue;
-        }
-        
-        // 跳过已经启动的IOT组件
-        if (component->GetType() == COMPONENT_TYPE_IOT && component->IsRunning()) {
-            continue;
-        }
-        
-        // Schedule component start to avoid blocking
-        Schedule([this, component]() {
-            if (!component || !component->GetName()) {
-                ESP_LOGW(TAG, "Component became invalid, skipping start");
-                return;
-            }
-            
-            if (!component->IsRunning()) {
-                try {
-                    ESP_LOGI(TAG, "Starting component: %s", component->GetName());
-                    bool started = component->Start();
-                    if (!started) {
-                        ESP_LOGE(TAG, "Failed to start component: %s", component->GetName());
-                    } else {
-                        ESP_LOGI(TAG, "Component %s started successfully", component->GetName());
-                    }
-                } catch (const std::exception& e) {
-                    ESP_LOGE(TAG, "Exception while starting component: %s", e.what());
-                } catch (...) {
-                    ESP_LOGE(TAG, "Unknown exception while starting component");
-                }
-            }
-        });
-    }
-    
-    // Special handling for vision components to ensure proper startup sequence
-#ifdef CONFIG_ENABLE_VISION_CONTROLLER
-    try {
-        ESP_LOGI(TAG, "Starting vision components with proper dependencies");
-        
-        // 启动VisionController (现已包含相机功能)
-        Component* vision = GetComponent("VisionController");
-        if (vision) {
-            if (!vision->IsRunning()) {
-                // 添加静态标志避免重复启动
-                static bool vision_start_in_progress = false;
-                if (vision_start_in_progress) {
-                    ESP_LOGI(TAG, "Vision controller startup already in progress, skipping");
-                } else {
-                
-                ESP_LOGI(TAG, "Starting vision controller component (with integrated camera)");
-                vision_start_in_progress = true;
-                
-                Schedule([this, vision]() {
-                    try {
-                        if (!vision->Start()) {
-                            ESP_LOGE(TAG, "Failed to start VisionController from sequence");
-                        } else {
-                            ESP_LOGI(TAG, "VisionController (with camera) started successfully");
-                            
-#if defined(CONFIG_ENABLE_VISION_CONTENT)
-                            // Start VisionContent only after VisionController is running
-                            Component* vision_content = GetComponent("VisionContent");
-                            if (vision_content && !vision_content->IsRunning()) {
-                                try {
-                                    if (!vision_content->Start()) {
-                                        ESP_LOGE(TAG, "Failed to start VisionContent");
-                                    } else {
-                                        ESP_LOGI(TAG, "VisionContent started successfully");
-                                    }
-                                } catch (const std::exception& e) {
-                                    ESP_LOGE(TAG, "Exception starting VisionContent: %s", e.what());
-                                }
-                            }
-#endif // CONFIG_ENABLE_VISION_CONTENT
-                        }
-                        
-                        // 完成启动过程后重置标志
-                        vision_start_in_progress = false;
-                    } catch (const std::exception& e) {
-                        // 异常处理中也要重置标志
-                        vision_start_in_progress = false;
-                        ESP_LOGE(TAG, "Exception starting vision sequence: %s", e.what());
-                    }
-                });
-                } // end of else block for vision_start_in_progress check
-            } else {
-                ESP_LOGW(TAG, "Vision controller already running");
-            }
-        }
-    } catch (const std::exception& e) {
-        ESP_LOGE(TAG, "Exception in vision component startup: %s", e.what());
-    } catch (...) {
-        ESP_LOGE(TAG, "Unknown exception in vision component startup");
-    }
-#endif // CONFIG_ENABLE_VISION_CONTROLLER
-    
-    ESP_LOGI(TAG, "All components processing scheduled");
-
-#ifdef CONFIG_ENABLE_LOCATION_CONTROLLER
-    // 初始化并启动位置控制器
-    InitLocationController();
-#endif
 }
 
 void Application::StopComponents() {
@@ -1519,24 +1520,6 @@ bool Application::InitComponents() {
     return true;
 }
 
-#ifdef CONFIG_ENABLE_LOCATION_CONTROLLER
-// 初始化位置控制器
-void Application::InitLocationController() {
-    ESP_LOGI(TAG, "初始化位置控制器...");
-    try {
-        auto* location = (Location*)ComponentManager::GetInstance().GetComponent("Location");
-        if (location && !location->IsRunning()) {
-            location->Start();
-        }
-
-        ESP_LOGI(TAG, "位置控制器初始化成功");
-    } catch (const std::exception& e) {
-        ESP_LOGE(TAG, "位置控制器初始化异常: %s", e.what());
-    } catch (...) {
-        ESP_LOGE(TAG, "位置控制器初始化发生未知错误");
-    }
-}
-#endif // CONFIG_ENABLE_LOCATION_CONTROLLER
 void Application::SetAecMode(AecMode mode) {
     aec_mode_ = mode;
     Schedule([this]() {
@@ -1575,6 +1558,7 @@ void Application::ResetProtocol() {
             protocol_->CloseAudioChannel();
         }
         // Reset protocol
+        std::lock_guard<std::mutex> lock(protocol_mutex_);
         protocol_.reset();
-    });
+    }, kSchedulePriorityCritical);
 }
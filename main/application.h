@@ -36,6 +36,7 @@
 #define CHECK_NEW_VERSION_DONE_EVENT (1 << 2)
 #include "audio_service.h"
 #include "device_state_machine.h"
+#include "main_task_queue.h"
 #include "hardware/hardware_manager.h"
 
 // Main event bits
@@ -95,8 +96,9 @@ public:
 
     /**
      * Schedule a callback to be executed in the main task
+     * Critical callbacks (audio / protocol state) run before any pending normal (UI) callback
      */
-    void Schedule(std::function<void()>&& callback);
+    void Schedule(MainTask&& callback, SchedulePriority priority = kSchedulePriorityNormal);
 
     /**
      * Alert with status, message, emotion and optional sound
@@ -135,6 +137,11 @@ public:
     void StopComponents();
     Component* GetComponent(const char* name);
     void SendMcpMessage(const std::string& payload);
+    // Streams a large payload (image results) without building it in memory, never on the main task
+    void SendMcpMessageStream(std::function<bool(const Protocol::MessageWriter& write)> payload);
+    // RTT, throughput and send queue statistics of the active protocol, "null" before activation
+    std::string GetProtocolMetricsJson();
+    std::string GetSchedulerMetricsJson() const { return main_tasks_.GetMetricsJson(); }
     bool InitComponents();
     void SetAecMode(AecMode mode);
     AecMode GetAecMode() const { return aec_mode_; }
@@ -154,8 +161,9 @@ private:
     Application();
     ~Application();
 
-    std::mutex mutex_;
-    std::deque<std::function<void()>> main_tasks_;
+    MainTaskQueue main_tasks_;
+    // Created and reset by the main task, protocol_mutex_ guards those writes and reads from other tasks
+    std::mutex protocol_mutex_;
     std::unique_ptr<Protocol> protocol_;
     EventGroupHandle_t event_group_ = nullptr;
     esp_timer_handle_t clock_timer_handle_ = nullptr;
@@ -172,6 +180,7 @@ private:
     bool play_popup_on_listening_ = false;  // Flag to play popup sound after state changes to listening
     int clock_ticks_ = 0;
     TaskHandle_t activation_task_handle_ = nullptr;
+    TaskHandle_t main_task_handle_ = nullptr;
     
     HardwareManager* hardware_manager_ = nullptr;
 
@@ -180,6 +189,8 @@ private:
     void HandleToggleChatEvent();
     void HandleStartListeningEvent();
     void HandleStopListeningEvent();
+    void HandleSendAudioEvent();
+    void StreamMcpMessage(const std::function<bool(const Protocol::MessageWriter& write)>& payload);
     void HandleNetworkConnectedEvent();
     void HandleNetworkDisconnectedEvent();
     void HandleActivationDoneEvent();
@@ -191,13 +202,11 @@ private:
     void CheckAssetsVersion();
     void CheckNewVersion();
     void InitializeProtocol();
+    void HandleServerMessage(const ServerMessage& message);
     void ShowActivationCode(const std::string& code, const std::string& message);
     void SetListeningMode(ListeningMode mode);
     // State change handler called by state machine
     void OnStateChanged(DeviceState old_state, DeviceState new_state);
-#ifdef CONFIG_ENABLE_LOCATION_CONTROLLER
-    void InitLocationController();
-#endif
 };
 
 
@@ -415,6 +415,20 @@ function initWebSocketModules() {
     sendWebSocketMessage({
         type: 'get_config'
     });
+    
+    // Sensor data is only pushed to subscribers, the vehicle page needs fast IMU and distance updates
+    if (currentPage === 'vehicle') {
+        sendWebSocketMessage({
+            type: 'subscribe',
+            sensors: ['imu', 'orientation', 'distance', 'light'],
+            rate: 20
+        });
+    } else {
+        sendWebSocketMessage({
+            type: 'subscribe',
+            rate: 1
+        });
+    }
 }
 
 /**
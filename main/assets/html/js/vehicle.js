@@ -116,8 +116,8 @@ $(document).ready(function () {
         $('#joystick-direction').text(direction);
         $('#joystick-force').text(Math.round(force * 100) + '%');
 
-        // Send control command to vehicle
-        sendControlCommand(direction, force);
+        // Send control command to vehicle, repeated while the stick is held
+        holdControl(force, data.angle.radian);
     });
 
     joystickManager.on('end', function () {
@@ -125,7 +125,7 @@ $(document).ready(function () {
         $('#joystick-force').text('0%');
 
         // Send stop command
-        sendControlCommand('stop', 0);
+        releaseControl();
     });
 
     function getDirection(angle) {
@@ -140,33 +140,25 @@ $(document).ready(function () {
         return 'Center';
     }
 
-    // Button controls
-    $('#btn-forward').on('mousedown touchstart', function () {
-        sendControlCommand('forward', 1);
-    }).on('mouseup touchend', function () {
-        sendControlCommand('stop', 0);
-    });
-
-    $('#btn-backward').on('mousedown touchstart', function () {
-        sendControlCommand('backward', 1);
-    }).on('mouseup touchend', function () {
-        sendControlCommand('stop', 0);
-    });
-
-    $('#btn-left').on('mousedown touchstart', function () {
-        sendControlCommand('left', 1);
-    }).on('mouseup touchend', function () {
-        sendControlCommand('stop', 0);
-    });
-
-    $('#btn-right').on('mousedown touchstart', function () {
-        sendControlCommand('right', 1);
-    }).on('mouseup touchend', function () {
-        sendControlCommand('stop', 0);
+    // Button controls, the command is repeated while the button is held
+    const buttonDirections = {
+        '#btn-forward': Math.PI / 2,
+        '#btn-backward': -Math.PI / 2,
+        '#btn-left': Math.PI,
+        '#btn-right': 0
+    };
+    $.each(buttonDirections, function (selector, radian) {
+        $(selector).on('mousedown touchstart', function () {
+            holdControl(1, radian);
+        }).on('mouseup mouseleave touchend touchcancel', function () {
+            if (heldControl) {
+                releaseControl();
+            }
+        });
     });
 
     $('#btn-stop').click(function () {
-        sendControlCommand('stop', 0);
+        releaseControl();
     });
 
     // Pan-Tilt controls
@@ -261,26 +253,65 @@ $(document).ready(function () {
         }
     };
 
-    // Send control command to vehicle
-    function sendControlCommand(direction, force) {
-        const dir = String(direction || '').toLowerCase();
-        const f = Math.max(0, Math.min(1, force || 0));
-        let left = 0, right = 0, base = Math.round(255 * f);
-        if (dir.includes('forward') && dir.includes('left')) { left = base * 0.6; right = base; }
-        else if (dir.includes('forward') && dir.includes('right')) { left = base; right = base * 0.6; }
-        else if (dir.includes('backward') && dir.includes('left')) { left = -base * 0.6; right = -base; }
-        else if (dir.includes('backward') && dir.includes('right')) { left = -base; right = -base * 0.6; }
-        else if (dir === 'forward') { left = base; right = base; }
-        else if (dir === 'backward') { left = -base; right = -base; }
-        else if (dir === 'left') { left = -base; right = base; }
-        else if (dir === 'right') { left = base; right = -base; }
-        else { left = 0; right = 0; }
-        if (window.HardwareManager) {
-            window.HardwareManager.controlMotor(0, Math.round(left)).catch(() => { });
-            window.HardwareManager.controlMotor(1, Math.round(right)).catch(() => { });
+    // Negotiate the control transport. Browsers cannot send UDP, so the page stays on the
+    // WebSocket and shows the UDP endpoint for native controllers when the vehicle offers one
+    function negotiateTeleop() {
+        $.get('/api/vehicle/teleop', function (info) {
+            const badge = $('#teleop-badge');
+            if (info.enabled && info.transport === 'udp') {
+                let title = `Session ${info.session}, protocol v${info.version}, telemetry ${info.telemetry_ms} ms`;
+                if (info.client) {
+                    title += `, client ${info.client}`;
+                }
+                badge.text(`UDP :${info.port}`).attr('title', title);
+            } else {
+                badge.text('WebSocket').attr('title', 'UDP teleop disabled');
+            }
+            badge.removeClass('d-none');
+        });
+    }
+    negotiateTeleop();
+
+    // The vehicle stops by itself when no move command arrived for 500 ms (deadman), nipplejs only
+    // fires 'move' while the finger moves, so the held command is resent on an interval
+    const CONTROL_REPEAT_MS = 150;
+    let heldControl = null;
+    let controlRepeatTimer = null;
+
+    // Joystick position for the vehicle: unit direction scaled by the force, forward is negative y
+    function sendMoveCommand(force, radian) {
+        if (socket && socket.readyState === WebSocket.OPEN) {
+            socket.send(JSON.stringify({
+                command: 'move',
+                distance: force,
+                dirX: Math.round(Math.cos(radian) * 100),
+                dirY: Math.round(-Math.sin(radian) * 100)
+            }));
+        }
+    }
+
+    // Only the WebSocket move path drives, it is covered by the deadman. Motor commands over HTTP
+    // would keep running after the page or Wi-Fi drops, so the joystick does not send any
+    function holdControl(force, radian) {
+        heldControl = { force: force, radian: radian };
+        sendMoveCommand(force, radian);
+        if (!controlRepeatTimer) {
+            controlRepeatTimer = setInterval(function () {
+                if (heldControl) {
+                    sendMoveCommand(heldControl.force, heldControl.radian);
+                }
+            }, CONTROL_REPEAT_MS);
+        }
+    }
+
+    function releaseControl() {
+        if (controlRepeatTimer) {
+            clearInterval(controlRepeatTimer);
+            controlRepeatTimer = null;
         }
+        heldControl = null;
         if (socket && socket.readyState === WebSocket.OPEN) {
-            socket.send(JSON.stringify({ type: 'control', direction: direction, force: force }));
+            socket.send(JSON.stringify({ command: 'stop' }));
         }
     }
 
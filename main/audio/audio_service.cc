@@ -1,4 +1,5 @@
 #include "audio_service.h"
+#include "trace.h"
 #include <esp_log.h>
 #include <cstring>
 
@@ -274,6 +275,7 @@ void AudioService::AudioInputTask() {
             int samples = wake_word_->GetFeedSize();
             if (samples > 0) {
                 if (ReadAudioData(data, 16000, samples)) {
+                    TRACE_SCOPE("audio:wake_word_feed");
                     wake_word_->Feed(data);
                     continue;
                 }
@@ -286,6 +288,7 @@ void AudioService::AudioInputTask() {
             int samples = audio_processor_->GetFeedSize();
             if (samples > 0) {
                 if (ReadAudioData(data, 16000, samples)) {
+                    TRACE_SCOPE("audio:processor_feed");
                     audio_processor_->Feed(std::move(data));
                     continue;
                 }
@@ -317,7 +320,10 @@ void AudioService::AudioOutputTask() {
             esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
             codec_->EnableOutput(true);
         }
-        codec_->OutputData(task->pcm);
+        {
+            TRACE_SCOPE("audio:output");
+            codec_->OutputData(task->pcm);
+        }
 
         /* Update the last output time */
         last_output_time_ = std::chrono::steady_clock::now();
@@ -340,7 +346,7 @@ void AudioService::OpusCodecTask() {
         std::unique_lock<std::mutex> lock(audio_queue_mutex_);
         audio_queue_cv_.wait(lock, [this]() {
             return service_stopped_ ||
-                (!audio_encode_queue_.empty() && audio_send_queue_.size() < MAX_SEND_PACKETS_IN_QUEUE) ||
+                !audio_encode_queue_.empty() ||
                 (!audio_decode_queue_.empty() && audio_playback_queue_.size() < MAX_PLAYBACK_TASKS_IN_QUEUE);
         });
         if (service_stopped_) {
@@ -354,6 +360,7 @@ void AudioService::OpusCodecTask() {
             audio_queue_cv_.notify_all();
             lock.unlock();
 
+            TRACE_SCOPE("audio:decode");
             auto task = std::make_unique<AudioTask>();
             task->type = kAudioTaskTypeDecodeToPlaybackQueue;
             task->timestamp = packet->timestamp;
@@ -402,13 +409,14 @@ void AudioService::OpusCodecTask() {
             }
             debug_statistics_.decode_count++;
         }
-        /* Encode the audio to send queue */
-        if (!audio_encode_queue_.empty() && audio_send_queue_.size() < MAX_SEND_PACKETS_IN_QUEUE) {
+        /* Encode the audio to send queue, never wait for the network so the microphone keeps running */
+        if (!audio_encode_queue_.empty()) {
             auto task = std::move(audio_encode_queue_.front());
             audio_encode_queue_.pop_front();
             audio_queue_cv_.notify_all();
             lock.unlock();
 
+            TRACE_SCOPE("audio:encode");
             auto packet = std::make_unique<AudioStreamPacket>();
             packet->frame_duration = OPUS_FRAME_DURATION_MS;
             packet->sample_rate = 16000;
@@ -432,6 +440,11 @@ void AudioService::OpusCodecTask() {
                     if (task->type == kAudioTaskTypeEncodeToSendQueue) {
                         {
                             std::lock_guard<std::mutex> lock2(audio_queue_mutex_);
+                            if (audio_send_queue_.size() >= MAX_SEND_PACKETS_IN_QUEUE) {
+                                audio_send_queue_.pop_front();
+                                send_queue_statistics_.overflow_dropped++;
+                            }
+                            packet->enqueue_time_us = esp_timer_get_time();
                             audio_send_queue_.push_back(std::move(packet));
                         }
                         if (callbacks_.on_send_queue_available) {
@@ -528,15 +541,39 @@ bool AudioService::PushPacketToDecodeQueue(std::unique_ptr<AudioStreamPacket> pa
     return true;
 }
 
-std::unique_ptr<AudioStreamPacket> AudioService::PopPacketFromSendQueue() {
+size_t AudioService::PopPacketsFromSendQueue(std::vector<std::unique_ptr<AudioStreamPacket>>& packets, size_t max_packets) {
     std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    if (audio_send_queue_.empty()) {
-        return nullptr;
+    int64_t deadline = esp_timer_get_time() - MAX_SEND_PACKET_AGE_MS * 1000LL;
+    while (!audio_send_queue_.empty() && audio_send_queue_.front()->enqueue_time_us < deadline) {
+        audio_send_queue_.pop_front();
+        send_queue_statistics_.stale_dropped++;
     }
-    auto packet = std::move(audio_send_queue_.front());
-    audio_send_queue_.pop_front();
-    audio_queue_cv_.notify_all();
-    return packet;
+    while (!audio_send_queue_.empty() && packets.size() < max_packets) {
+        packets.push_back(std::move(audio_send_queue_.front()));
+        audio_send_queue_.pop_front();
+        send_queue_statistics_.popped++;
+    }
+    return audio_send_queue_.size();
+}
+
+void AudioService::RequeueSendPackets(std::vector<std::unique_ptr<AudioStreamPacket>>& packets, size_t first) {
+    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
+    // Older than anything queued meanwhile, so they go in front. A full queue evicts the oldest as usual
+    for (size_t i = packets.size(); i > first; i--) {
+        if (audio_send_queue_.size() >= MAX_SEND_PACKETS_IN_QUEUE) {
+            send_queue_statistics_.overflow_dropped += i - first;
+            break;
+        }
+        audio_send_queue_.push_front(std::move(packets[i - 1]));
+        send_queue_statistics_.requeued++;
+    }
+}
+
+SendQueueStatistics AudioService::GetSendQueueStatistics() {
+    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
+    auto statistics = send_queue_statistics_;
+    statistics.depth = audio_send_queue_.size();
+    return statistics;
 }
 
 void AudioService::EncodeWakeWord() {
@@ -41,6 +41,7 @@
 #define MAX_PLAYBACK_TASKS_IN_QUEUE 2
 #define MAX_DECODE_PACKETS_IN_QUEUE (2400 / OPUS_FRAME_DURATION_MS)
 #define MAX_SEND_PACKETS_IN_QUEUE (2400 / OPUS_FRAME_DURATION_MS)
+#define MAX_SEND_PACKET_AGE_MS 1000
 #define AUDIO_TESTING_MAX_DURATION_MS 10000
 #define MAX_TIMESTAMPS_IN_QUEUE 3
 
@@ -95,6 +96,15 @@ struct AudioTask {
     uint32_t timestamp;
 };
 
+// Uplink counters, when the network stalls old speech is dropped instead of played catch-up
+struct SendQueueStatistics {
+    uint32_t depth = 0;
+    uint32_t popped = 0;
+    uint32_t stale_dropped = 0;     // Older than MAX_SEND_PACKET_AGE_MS when the main loop got to it
+    uint32_t overflow_dropped = 0;  // Evicted by a newer packet while the queue was full
+    uint32_t requeued = 0;          // Put back after a failed send, popped again later
+};
+
 struct DebugStatistics {
     uint32_t input_count = 0;
     uint32_t decode_count = 0;
@@ -127,7 +137,11 @@ public:
     void SetCallbacks(AudioServiceCallbacks& callbacks);
 
     bool PushPacketToDecodeQueue(std::unique_ptr<AudioStreamPacket> packet, bool wait = false);
-    std::unique_ptr<AudioStreamPacket> PopPacketFromSendQueue();
+    // Pops up to max_packets fresh packets, discarding stale ones. Returns the number still queued.
+    size_t PopPacketsFromSendQueue(std::vector<std::unique_ptr<AudioStreamPacket>>& packets, size_t max_packets);
+    // Puts packets[first..] back at the front of the send queue, in order, after a failed send
+    void RequeueSendPackets(std::vector<std::unique_ptr<AudioStreamPacket>>& packets, size_t first);
+    SendQueueStatistics GetSendQueueStatistics();
     void PlaySound(const std::string_view& sound);
     bool ReadAudioData(std::vector<int16_t>& data, int sample_rate, int samples);
     void ResetDecoder();
@@ -154,6 +168,7 @@ private:
     int decoder_duration_ms_ = OPUS_FRAME_DURATION_MS;
     int decoder_frame_size_ = 0;
     DebugStatistics debug_statistics_;
+    SendQueueStatistics send_queue_statistics_;
     srmodel_list_t* models_list_ = nullptr;
 
     EventGroupHandle_t event_group_;
@@ -216,10 +216,11 @@ private:
             return;
         }
         
-        // 设置所有通道为中位 (90度)
+        // 设置所有通道为中位 (90度)，一次I2C事务写完
         for (int i = 0; i < 16; i++) {
-            lu9685_set_channel_angle(lu9685_handle_, i, 90);
+            lu9685_stage_channel_angle(lu9685_handle_, i, 90);
         }
+        lu9685_flush(lu9685_handle_);
         
         lu9685_initialized_ = true;
         ESP_LOGI(TAG, "LU9685 servo controller initialized successfully at address 0x%02X (via PCA9548A channel %d)", 
@@ -667,13 +668,10 @@ public:
             return false;
         }
         
-        bool success = true;
         for (int i = 0; i < 16; i++) {
-            if (lu9685_set_channel_angle(lu9685_handle_, i, angle) != ESP_OK) {
-                success = false;
-            }
+            lu9685_stage_channel_angle(lu9685_handle_, i, angle);
         }
-        return success;
+        return lu9685_flush(lu9685_handle_) == ESP_OK;
     }
     
     bool SetServoFrequency(uint16_t freq_hz) {
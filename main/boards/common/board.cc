@@ -4,6 +4,7 @@
 #include "display/display.h"
 #include "display/oled_display.h"
 #include "assets/lang_config.h"
+#include "application.h"
 
 #include <esp_log.h>
 #include <esp_ota_ops.h>
@@ -637,6 +638,18 @@ std::string Board::GetSystemInfoJson() {
             "ota": {
                 "label": "ota_0"
             },
+            "network_metrics": {
+                "rtt_ms": 42,
+                ...
+            },
+            "scheduler": {
+                "critical_depth": 0,
+                ...
+            },
+            "boot_timeline": {
+                "total_us": 412000,
+                "components": [{"name": "Web", "state": "started", "start_us": 30, "duration_us": 41000}, ...]
+            },
             "board": {
                 ...
             }
@@ -705,6 +718,10 @@ std::string Board::GetSystemInfoJson() {
     }
     json += R"(},)";
 
+    json += R"("network_metrics":)" + Application::GetInstance().GetProtocolMetricsJson() + R"(,)";
+    json += R"("scheduler":)" + Application::GetInstance().GetSchedulerMetricsJson() + R"(,)";
+    json += R"("boot_timeline":)" + ComponentManager::GetInstance().GetBootTimelineJson() + R"(,)";
+
     json += R"("board":)" + GetBoardJson();
 
     // Close the JSON object
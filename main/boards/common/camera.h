@@ -2,6 +2,7 @@
 #define CAMERA_H
 
 #include <string>
+#include <functional>
 
 class Camera {
 public:
@@ -13,6 +14,8 @@ public:
     virtual bool GetHMirror() = 0;
     virtual bool GetVFlip() = 0;
     virtual std::string Explain(const std::string& question) = 0;
+    // 将最近一次 Capture 的画面编码为 JPEG，分块交给 write，返回 false 表示不支持或编码失败
+    virtual bool EncodeJpeg(int quality, const std::function<bool(const void* data, size_t len)>& write) { return false; }
 
     virtual bool Initialize() = 0;
     virtual void Deinitialize() = 0;
@@ -875,6 +875,34 @@ bool Esp32Camera::SetVFlip(bool enabled) {
     return true;
 }
 
+bool Esp32Camera::EncodeJpeg(int quality, const std::function<bool(const void* data, size_t len)>& write) {
+    if (frame_.data == nullptr) {
+        ESP_LOGE(TAG, "No captured frame to encode");
+        return false;
+    }
+
+    struct EncodeContext {
+        const std::function<bool(const void* data, size_t len)>& write;
+        bool ok;
+    } context = {write, true};
+    uint16_t w = frame_.width ? frame_.width : 320;
+    uint16_t h = frame_.height ? frame_.height : 240;
+    bool encoded = image_to_jpeg_cb(
+        frame_.data, frame_.len, w, h, frame_.format, quality,
+        [](void* arg, size_t index, const void* data, size_t len) -> size_t {
+            auto context = static_cast<EncodeContext*>(arg);
+            if (index != 0 || data == nullptr || len == 0) {
+                return len;  // Sentinel
+            }
+            if (context->ok) {
+                context->ok = context->write(data, len);
+            }
+            return context->ok ? len : 0;
+        },
+        &context);
+    return encoded && context.ok;
+}
+
 /**
  * @brief 将摄像头捕获的图像发送到远程服务器进行AI分析和解释
  *
@@ -60,6 +60,7 @@ public:
     virtual bool GetHMirror() override;
     virtual bool GetVFlip() override;
     virtual std::string Explain(const std::string& question) override;
+    virtual bool EncodeJpeg(int quality, const std::function<bool(const void* data, size_t len)>& write) override;
 
     // 额外的控制方法
     virtual bool HasFlash() override;
@@ -146,7 +146,9 @@ bool McpCameraTools::RegisterPhotoTool() {
     mcp_server_->AddTool("self.camera.take_photo",
         "Take a photo and explain it. Use this tool after the user asks you to see something. Args: question (string): Optional question about what to look for in the photo. Returns: Description of what was captured in the photo",
         PropertyList(photo_properties),
-        TakePhotoTool);
+        TakePhotoTool,
+        // Capture and the explain upload take seconds, keep them off the main task
+        McpToolOptions{.execution = kToolExecutionWorker, .timeout_ms = 30000});
     
     ESP_LOGI(TAG, "Photo tool registered");
     return true;
@@ -1,5 +1,9 @@
 #include "components.h"
+#include "trace.h"
 #include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 #include <algorithm>
 #include <cstring>
 
@@ -25,6 +29,194 @@ void ComponentManager::StartAll() {
     }
 }
 
+bool ComponentManager::StartAllAsync(int workers) {
+    std::unique_lock<std::mutex> lock(boot_mutex_);
+    if (boot_workers_ > 0) {
+        ESP_LOGW(TAG, "Component startup already in progress");
+        return false;
+    }
+
+    boot_records_.clear();
+    boot_ready_.clear();
+    boot_in_flight_ = 0;
+    boot_total_us_ = 0;
+    boot_begin_us_ = esp_timer_get_time();
+
+    for (auto component : components_) {
+        if (component && !component->IsRunning()) {
+            ComponentBootRecord record;
+            record.component = component;
+            boot_records_.push_back(record);
+        }
+    }
+
+    // 构建依赖图，已运行或未注册的依赖视为已满足
+    for (size_t i = 0; i < boot_records_.size(); i++) {
+        for (const char* dependency : boot_records_[i].component->GetDependencies()) {
+            auto it = std::find_if(boot_records_.begin(), boot_records_.end(),
+                [dependency](const ComponentBootRecord& r) {
+                    return strcmp(r.component->GetName(), dependency) == 0;
+                });
+            if (it == boot_records_.end()) {
+                if (GetComponent(dependency) == nullptr) {
+                    ESP_LOGI(TAG, "%s: dependency %s not registered, ignored",
+                             boot_records_[i].component->GetName(), dependency);
+                }
+                continue;
+            }
+            it->dependents.push_back(i);
+            boot_records_[i].pending_dependencies++;
+        }
+    }
+
+    for (size_t i = 0; i < boot_records_.size(); i++) {
+        if (boot_records_[i].pending_dependencies == 0) {
+            boot_ready_.push_back(i);
+        }
+    }
+
+    if (boot_records_.empty()) {
+        ESP_LOGI(TAG, "No components to start");
+        return true;
+    }
+
+    int count = std::min<int>(std::max(workers, 1), boot_records_.size());
+    ESP_LOGI(TAG, "Starting %zu components on %d workers", boot_records_.size(), count);
+    for (int i = 0; i < count; i++) {
+        boot_workers_++;
+        BaseType_t ret = xTaskCreate([](void* arg) {
+            static_cast<ComponentManager*>(arg)->BootWorker();
+            vTaskDelete(NULL);
+        }, "comp_start", 4096 * 2, this, 2, nullptr);
+        if (ret != pdPASS) {
+            boot_workers_--;
+            ESP_LOGE(TAG, "Failed to create component start worker %d", i);
+        }
+    }
+
+    if (boot_workers_ == 0) {
+        // 无法创建任务时退回到当前任务上按顺序启动
+        boot_workers_ = 1;
+        lock.unlock();
+        BootWorker();
+    }
+    return true;
+}
+
+void ComponentManager::BootWorker() {
+    std::unique_lock<std::mutex> lock(boot_mutex_);
+    while (true) {
+        if (!boot_ready_.empty()) {
+            size_t index = boot_ready_.front();
+            boot_ready_.pop_front();
+            auto& record = boot_records_[index];
+            Component* component = record.component;
+            record.state = COMPONENT_BOOT_STARTING;
+            record.start_us = esp_timer_get_time() - boot_begin_us_;
+            boot_in_flight_++;
+            lock.unlock();
+
+            bool success = false;
+            {
+                TRACE_SCOPE_ARG("component:start", component);
+                ESP_LOGI(TAG, "Starting component: %s", component->GetName());
+                try {
+                    success = component->Start();
+                } catch (const std::exception& e) {
+                    ESP_LOGE(TAG, "Exception while starting component %s: %s", component->GetName(), e.what());
+                } catch (...) {
+                    ESP_LOGE(TAG, "Unknown exception while starting component %s", component->GetName());
+                }
+            }
+
+            lock.lock();
+            boot_in_flight_--;
+            CompleteBootRecord(index, success);
+            boot_cv_.notify_all();
+            continue;
+        }
+        // 没有就绪的组件，也没有正在启动的组件，剩下的只能是循环依赖
+        if (boot_in_flight_ == 0) {
+            break;
+        }
+        boot_cv_.wait(lock);
+    }
+
+    if (--boot_workers_ == 0) {
+        FinishBoot();
+    }
+}
+
+void ComponentManager::CompleteBootRecord(size_t index, bool success) {
+    auto& record = boot_records_[index];
+    record.end_us = esp_timer_get_time() - boot_begin_us_;
+    if (success) {
+        record.state = COMPONENT_BOOT_STARTED;
+        ESP_LOGI(TAG, "Component %s started in %lld ms", record.component->GetName(),
+                 (record.end_us - record.start_us) / 1000);
+    } else if (record.state == COMPONENT_BOOT_STARTING) {
+        record.state = COMPONENT_BOOT_FAILED;
+        ESP_LOGE(TAG, "Failed to start component: %s", record.component->GetName());
+    } else {
+        record.start_us = record.end_us;
+    }
+
+    for (size_t dependent : record.dependents) {
+        auto& next = boot_records_[dependent];
+        if (next.state != COMPONENT_BOOT_PENDING) {
+            continue;
+        }
+        if (success) {
+            if (--next.pending_dependencies == 0) {
+                boot_ready_.push_back(dependent);
+            }
+        } else {
+            ESP_LOGW(TAG, "Skipping %s, dependency %s did not start",
+                     next.component->GetName(), record.component->GetName());
+            next.state = COMPONENT_BOOT_SKIPPED;
+            CompleteBootRecord(dependent, false);
+        }
+    }
+}
+
+void ComponentManager::FinishBoot() {
+    for (auto& record : boot_records_) {
+        if (record.state == COMPONENT_BOOT_PENDING) {
+            ESP_LOGE(TAG, "Component %s not started, circular dependency", record.component->GetName());
+            record.state = COMPONENT_BOOT_SKIPPED;
+        }
+    }
+    boot_total_us_ = esp_timer_get_time() - boot_begin_us_;
+
+    int64_t serial_us = 0;
+    for (const auto& record : boot_records_) {
+        serial_us += record.end_us - record.start_us;
+    }
+    ESP_LOGI(TAG, "Components ready in %lld ms (%lld ms if started one by one)",
+             boot_total_us_ / 1000, serial_us / 1000);
+}
+
+std::string ComponentManager::GetBootTimelineJson() const {
+    static const char* const kStateNames[] = { "pending", "starting", "started", "failed", "skipped" };
+
+    std::lock_guard<std::mutex> lock(boot_mutex_);
+    std::string json = "{";
+    json += "\"in_progress\":" + std::string(boot_workers_ > 0 ? "true" : "false") + ",";
+    json += "\"total_us\":" + std::to_string(boot_total_us_) + ",";
+    json += "\"components\":[";
+    for (const auto& record : boot_records_) {
+        json += "{\"name\":\"" + std::string(record.component->GetName()) + "\",";
+        json += "\"state\":\"" + std::string(kStateNames[record.state]) + "\",";
+        json += "\"start_us\":" + std::to_string(record.start_us) + ",";
+        json += "\"duration_us\":" + std::to_string(record.end_us - record.start_us) + "},";
+    }
+    if (json.back() == ',') {
+        json.pop_back();
+    }
+    json += "]}";
+    return json;
+}
+
 // 新增：按类型启动组件
 void ComponentManager::StartComponentsByType(ComponentType type) {
     // 先检查该类型是否已被配置启用
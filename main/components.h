@@ -3,6 +3,10 @@
 #include <string>
 #include <functional>
 #include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
 #include "sdkconfig.h"
 
 // 组件类型枚举，用于更好地组织和控制组件
@@ -50,6 +54,13 @@ public:
     // 新增：获取组件类型
     virtual ComponentType GetType() const { return COMPONENT_TYPE_GENERIC; }
     
+    /**
+     * Names of the components that must have started before Start() is called.
+     * Dependencies that are not registered (disabled in Kconfig) are ignored.
+     * Start() runs on a startup worker task, in parallel with independent components.
+     */
+    virtual std::vector<const char*> GetDependencies() const { return {}; }
+    
     // 新增：组件是否已初始化
     bool IsInitialized() const { return is_initialized_; }
     void SetInitialized(bool initialized) { is_initialized_ = initialized; }
@@ -59,6 +70,24 @@ protected:
     bool is_initialized_ = false;
 };
 
+// 启动时间线中单个组件的记录
+enum ComponentBootState {
+    COMPONENT_BOOT_PENDING = 0,    // 等待依赖
+    COMPONENT_BOOT_STARTING,       // 正在启动
+    COMPONENT_BOOT_STARTED,        // 启动成功
+    COMPONENT_BOOT_FAILED,         // Start()返回false或抛出异常
+    COMPONENT_BOOT_SKIPPED         // 依赖启动失败或存在循环依赖
+};
+
+struct ComponentBootRecord {
+    Component* component = nullptr;
+    ComponentBootState state = COMPONENT_BOOT_PENDING;
+    int64_t start_us = 0;          // 相对于StartAllAsync调用的时间
+    int64_t end_us = 0;
+    int pending_dependencies = 0;
+    std::vector<size_t> dependents;
+};
+
 /**
  * Component Manager singleton to manage system components
  */
@@ -94,6 +123,18 @@ public:
     // 启动所有组件
     void StartAll();
     
+    /**
+     * Start all components that are not running yet, ordered by GetDependencies().
+     * Components whose dependencies are satisfied start in parallel on up to
+     * `workers` tasks; the call returns immediately. Each start is recorded in the
+     * boot timeline, see GetBootTimelineJson().
+     * @return false if a previous startup is still in progress
+     */
+    bool StartAllAsync(int workers = kDefaultStartWorkers);
+    
+    // 启动时间线: 总耗时及每个组件的开始时间、耗时和结果
+    std::string GetBootTimelineJson() const;
+    
     // 启动指定类型的组件
     void StartComponentsByType(ComponentType type);
     
@@ -166,6 +207,22 @@ private:
     ComponentManager(const ComponentManager&) = delete;
     ComponentManager& operator=(const ComponentManager&) = delete;
 
+    static constexpr int kDefaultStartWorkers = 3;
+
     // 保存所有注册的组件
     std::vector<Component*> components_;
+    
+    // 并行启动状态，由boot_mutex_保护
+    mutable std::mutex boot_mutex_;
+    std::condition_variable boot_cv_;
+    std::vector<ComponentBootRecord> boot_records_;
+    std::deque<size_t> boot_ready_;
+    int boot_workers_ = 0;          // 仍在运行的启动任务数
+    int boot_in_flight_ = 0;        // 正在执行Start()的组件数
+    int64_t boot_begin_us_ = 0;
+    int64_t boot_total_us_ = 0;     // 从StartAllAsync到最后一个组件完成
+    
+    void BootWorker();
+    void CompleteBootRecord(size_t index, bool success);
+    void FinishBoot();
 };
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define DISPLAY_H
 
 #include "emoji_collection.h"
+#include "trace.h"
 
 #ifndef CONFIG_USE_EMOTE_MESSAGE_STYLE
 #define HAVE_LVGL 1
@@ -58,12 +59,16 @@ protected:
 class DisplayLockGuard {
 public:
     DisplayLockGuard(Display *display) : display_(display) {
+        TRACE_BEGIN("display:lock_wait");
         if (!display_->Lock(30000)) {
             ESP_LOGE("Display", "Failed to lock display");
         }
+        TRACE_END("display:lock_wait");
+        TRACE_BEGIN("display:locked");
     }
     ~DisplayLockGuard() {
         display_->Unlock();
+        TRACE_END("display:locked");
     }
 
 private:
@@ -9,10 +9,13 @@
 
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include "esp_err.h"
 #include "driver/i2c_master.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "i2c_utils.h"  // 添加I2C工具头文件
 
 #ifdef __cplusplus
@@ -50,6 +53,9 @@ extern "C" {
 // 重置指令
 #define LU9685_RESET         0x06
 
+#define LU9685_CHANNEL_COUNT   16
+#define LU9685_I2C_TIMEOUT_MS  50    // 单次I2C事务超时，一次完整突发写入在400kHz下约1.5ms
+
 /**
  * @brief LU9685设备结构体
  */
@@ -59,6 +65,11 @@ typedef struct {
     uint16_t pwm_freq;          // PWM频率(Hz)
     bool use_pca9548a;          // 是否使用PCA9548A
     uint8_t pca9548a_channel;   // PCA9548A通道
+    i2c_master_dev_handle_t dev_handle;     // 初始化时创建，释放时删除的持久设备句柄
+    SemaphoreHandle_t lock;                 // 保护影子寄存器，并让一次刷新成为一个完整事务
+    uint16_t shadow_on[LU9685_CHANNEL_COUNT];   // 各通道ON/OFF寄存器的期望值
+    uint16_t shadow_off[LU9685_CHANNEL_COUNT];
+    uint16_t dirty_mask;        // 影子值尚未写入芯片的通道
 } lu9685_dev_t;
 
 /**
@@ -121,6 +132,40 @@ esp_err_t lu9685_set_frequency(lu9685_handle_t handle, uint16_t freq_hz);
  */
 esp_err_t lu9685_set_pwm_channel(lu9685_handle_t handle, uint8_t channel, uint16_t on_value, uint16_t off_value);
 
+/**
+ * @brief 暂存单个PWM通道的值，只更新影子寄存器，不访问I2C
+ *
+ * 与影子值相同的设置被忽略。暂存的通道由 lu9685_flush() 一次写入。
+ *
+ * @param handle 设备句柄
+ * @param channel 通道号（0-15）
+ * @param on_value 开始时间（0-4095）
+ * @param off_value 结束时间（0-4095）
+ * @return esp_err_t 操作结果
+ */
+esp_err_t lu9685_stage_pwm_channel(lu9685_handle_t handle, uint8_t channel, uint16_t on_value, uint16_t off_value);
+
+/**
+ * @brief 暂存舵机通道的角度，只更新影子寄存器，不访问I2C
+ *
+ * @param handle 设备句柄
+ * @param channel 通道号（0-15）
+ * @param angle 角度（0-180）
+ * @return esp_err_t 操作结果
+ */
+esp_err_t lu9685_stage_channel_angle(lu9685_handle_t handle, uint8_t channel, uint8_t angle);
+
+/**
+ * @brief 把所有待写通道在一次自动递增的I2C事务中写入芯片
+ *
+ * 写入范围是最低到最高的待写通道，中间未变化的通道按影子值重写。没有待写通道时不访问总线。
+ * 写入失败时通道保持待写状态，下次刷新重试。
+ *
+ * @param handle 设备句柄
+ * @return esp_err_t 操作结果
+ */
+esp_err_t lu9685_flush(lu9685_handle_t handle);
+
 /**
  * @brief 设置单个通道的PWM占空比（百分比）
  * 
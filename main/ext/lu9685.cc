@@ -52,6 +52,54 @@ static esp_err_t select_pca9548a_channel(lu9685_dev_t *dev)
     return ESP_OK;
 }
 
+/**
+ * @brief 在持久设备句柄上发送一次I2C写事务
+ * 
+ * @param dev LU9685设备结构体指针
+ * @param data 寄存器地址加数据
+ * @param length 字节数
+ * @return esp_err_t 操作结果
+ */
+static esp_err_t lu9685_transmit(lu9685_dev_t *dev, const uint8_t *data, size_t length)
+{
+    esp_err_t ret = select_pca9548a_channel(dev);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    return i2c_master_transmit(dev->dev_handle, data, length, LU9685_I2C_TIMEOUT_MS);
+}
+
+/**
+ * @brief 释放设备句柄、锁和内存，初始化失败时也用它清理
+ * 
+ * @param dev LU9685设备结构体指针
+ */
+static void lu9685_free(lu9685_dev_t *dev)
+{
+    if (dev->dev_handle != NULL) {
+        i2c_master_bus_rm_device(dev->dev_handle);
+    }
+    if (dev->lock != NULL) {
+        vSemaphoreDelete(dev->lock);
+    }
+    free(dev);
+}
+
+/**
+ * @brief 舵机角度转换为OFF寄存器值
+ * 
+ * 舵机通常使用1ms-2ms的脉冲宽度对应0-180度
+ * 在50Hz下，一个周期是20ms，所以1ms对应4096的204.8
+ * 因此脉冲宽度范围约为204-410
+ */
+static uint16_t angle_to_pulse(uint8_t angle)
+{
+    if (angle > 180) {
+        angle = 180;
+    }
+    return 204 + (angle * 206) / 180;
+}
+
 /**
  * @brief 初始化LU9685设备
  * 
@@ -65,8 +113,8 @@ lu9685_handle_t lu9685_init(const lu9685_config_t *config)
         return NULL;
     }
 
-    // 分配内存
-    lu9685_dev_t *dev = (lu9685_dev_t *)malloc(sizeof(lu9685_dev_t));
+    // 分配内存，句柄、锁和影子寄存器从零开始
+    lu9685_dev_t *dev = (lu9685_dev_t *)calloc(1, sizeof(lu9685_dev_t));
     if (dev == NULL) {
         ESP_LOGE(TAG, "内存分配失败");
         return NULL;
@@ -105,42 +153,75 @@ lu9685_handle_t lu9685_init(const lu9685_config_t *config)
     }
     
     // 尝试探测设备是否存在
-    esp_err_t ret = i2c_master_probe(bus_handle, dev->i2c_addr, 1000);
+    esp_err_t ret = i2c_master_probe(bus_handle, dev->i2c_addr, LU9685_I2C_TIMEOUT_MS);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "LU9685设备探测失败(0x%02X), %s", dev->i2c_addr, esp_err_to_name(ret));
         free(dev);
-            return NULL;
-        }
+        return NULL;
+    }
+
+    // 设备句柄在整个生命周期内保留，不再每次读写都创建和删除
+    i2c_device_config_t dev_cfg = {
+        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+        .device_address = dev->i2c_addr,
+        .scl_speed_hz = 400000, // 400kHz
+    };
+    ret = i2c_master_bus_add_device(bus_handle, &dev_cfg, &dev->dev_handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "无法创建I2C设备: %s", esp_err_to_name(ret));
+        dev->dev_handle = NULL;
+        lu9685_free(dev);
+        return NULL;
+    }
+
+    dev->lock = xSemaphoreCreateMutex();
+    if (dev->lock == NULL) {
+        ESP_LOGE(TAG, "创建互斥锁失败");
+        lu9685_free(dev);
+        return NULL;
+    }
         
     // 复位LU9685
     ret = lu9685_reset(dev);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "LU9685重置失败: %s", esp_err_to_name(ret));
-        free(dev);
-            return NULL;
-        }
+        lu9685_free(dev);
+        return NULL;
+    }
     
     // 唤醒LU9685
     ret = lu9685_set_sleep_mode(dev, false);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "LU9685唤醒失败: %s", esp_err_to_name(ret));
-        free(dev);
-            return NULL;
-        }
+        lu9685_free(dev);
+        return NULL;
+    }
+
+    // 打开寄存器地址自动递增，批量刷新依赖它连续写多个通道
+    uint8_t mode1;
+    ret = lu9685_read_register(dev, LU9685_MODE1, &mode1);
+    if (ret == ESP_OK) {
+        ret = lu9685_write_register(dev, LU9685_MODE1, (mode1 & ~LU9685_RESTART) | LU9685_AI);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "打开自动递增失败: %s", esp_err_to_name(ret));
+        lu9685_free(dev);
+        return NULL;
+    }
     
     // 设置PWM频率
     ret = lu9685_set_frequency(dev, dev->pwm_freq);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "设置PWM频率失败: %s", esp_err_to_name(ret));
-        free(dev);
+        lu9685_free(dev);
         return NULL;
     }
     
-    // 将所有通道设置为0
+    // 将所有通道设置为0，同时确定影子寄存器的初值
     ret = lu9685_set_all_pwm(dev, 0, 0);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "清除所有通道失败: %s", esp_err_to_name(ret));
-        free(dev);
+        lu9685_free(dev);
         return NULL;
     }
     
@@ -170,7 +251,7 @@ esp_err_t lu9685_deinit(lu9685_handle_t *handle)
         lu9685_global_handle = NULL;
     }
     
-    free(dev);
+    lu9685_free(dev);
     *handle = NULL;
     
     return ESP_OK;
@@ -190,41 +271,9 @@ esp_err_t lu9685_reset(lu9685_handle_t handle)
 
     lu9685_dev_t *dev = static_cast<lu9685_dev_t*>(handle);
     
-    // 如果启用了多路复用器，先选择正确的通道
-    if (dev->use_pca9548a) {
-        esp_err_t ret = select_pca9548a_channel(dev);
-        if (ret != ESP_OK) {
-            return ret;
-        }
-    }
-
-    // 使用新版I2C API
-    i2c_master_bus_handle_t bus_handle = (i2c_master_bus_handle_t)dev->i2c_port;
-    i2c_master_dev_handle_t dev_handle;
-    
-    // 配置I2C设备
-    i2c_device_config_t dev_cfg = {
-        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
-        .device_address = dev->i2c_addr,
-        .scl_speed_hz = 400000, // 400kHz
-    };
-    
-    // 创建临时设备句柄
-    esp_err_t ret = i2c_master_bus_add_device(bus_handle, &dev_cfg, &dev_handle);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "无法创建I2C设备: %s", esp_err_to_name(ret));
-        return ret;
-    }
-    
-    // 准备发送数据
-    uint8_t tx_data[2] = {LU9685_MODE1, LU9685_RESET};
-    
     // 发送复位命令
-    ret = i2c_master_transmit(dev_handle, tx_data, sizeof(tx_data), 1000);
-    
-    // 删除临时设备
-    i2c_master_bus_rm_device(dev_handle);
-    
+    uint8_t tx_data[2] = {LU9685_MODE1, LU9685_RESET};
+    esp_err_t ret = lu9685_transmit(dev, tx_data, sizeof(tx_data));
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "重置LU9685设备失败：%s", esp_err_to_name(ret));
     }
@@ -252,46 +301,15 @@ esp_err_t lu9685_read_register(lu9685_handle_t handle, uint8_t reg_addr, uint8_t
 
     lu9685_dev_t *dev = static_cast<lu9685_dev_t*>(handle);
     
-    // 如果启用了多路复用器，先选择正确的通道
-    if (dev->use_pca9548a) {
-        esp_err_t ret = select_pca9548a_channel(dev);
-        if (ret != ESP_OK) {
-            return ret;
-        }
-    }
-    
-    // 使用新版I2C API
-    i2c_master_bus_handle_t bus_handle = (i2c_master_bus_handle_t)dev->i2c_port;
-    i2c_master_dev_handle_t dev_handle;
-    
-    // 配置I2C设备
-    i2c_device_config_t dev_cfg = {
-        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
-        .device_address = dev->i2c_addr,
-        .scl_speed_hz = 400000, // 400kHz
-    };
-    
-    // 创建临时设备句柄
-    esp_err_t ret = i2c_master_bus_add_device(bus_handle, &dev_cfg, &dev_handle);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "无法创建I2C设备: %s", esp_err_to_name(ret));
-        return ret;
-    }
-    
     // 先发送寄存器地址
-    ret = i2c_master_transmit(dev_handle, &reg_addr, 1, 1000);
+    esp_err_t ret = lu9685_transmit(dev, &reg_addr, 1);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to write register address: %s", esp_err_to_name(ret));
-        i2c_master_bus_rm_device(dev_handle);
         return ret;
     }
     
     // 然后读取数据
-    ret = i2c_master_receive(dev_handle, value, 1, 1000);
-    
-    // 删除临时设备
-    i2c_master_bus_rm_device(dev_handle);
-    
+    ret = i2c_master_receive(dev->dev_handle, value, 1, LU9685_I2C_TIMEOUT_MS);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to read register 0x%02x: %s", reg_addr, esp_err_to_name(ret));
     }
@@ -316,41 +334,8 @@ esp_err_t lu9685_write_register(lu9685_handle_t handle, uint8_t reg_addr, uint8_
 
     lu9685_dev_t *dev = static_cast<lu9685_dev_t*>(handle);
     
-    // 如果启用了多路复用器，先选择正确的通道
-    if (dev->use_pca9548a) {
-        esp_err_t ret = select_pca9548a_channel(dev);
-        if (ret != ESP_OK) {
-            return ret;
-        }
-    }
-    
-    // 使用新版I2C API
-    i2c_master_bus_handle_t bus_handle = (i2c_master_bus_handle_t)dev->i2c_port;
-    i2c_master_dev_handle_t dev_handle;
-    
-    // 配置I2C设备
-    i2c_device_config_t dev_cfg = {
-        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
-        .device_address = dev->i2c_addr,
-        .scl_speed_hz = 400000, // 400kHz
-    };
-    
-    // 创建临时设备句柄
-    esp_err_t ret = i2c_master_bus_add_device(bus_handle, &dev_cfg, &dev_handle);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "无法创建I2C设备: %s", esp_err_to_name(ret));
-        return ret;
-    }
-    
-    // 准备发送数据
     uint8_t tx_data[2] = {reg_addr, value};
-    
-    // 发送数据
-    ret = i2c_master_transmit(dev_handle, tx_data, sizeof(tx_data), 1000);
-    
-    // 删除临时设备
-    i2c_master_bus_rm_device(dev_handle);
-    
+    esp_err_t ret = lu9685_transmit(dev, tx_data, sizeof(tx_data));
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to write register 0x%02x: %s", reg_addr, esp_err_to_name(ret));
     }
@@ -430,7 +415,7 @@ esp_err_t lu9685_set_frequency(lu9685_handle_t handle, uint16_t freq_hz)
 }
 
 /**
- * @brief 设置单个PWM通道的占空比
+ * @brief 暂存单个PWM通道的值
  * 
  * @param handle 设备句柄
  * @param channel 通道号（0-15）
@@ -438,70 +423,108 @@ esp_err_t lu9685_set_frequency(lu9685_handle_t handle, uint16_t freq_hz)
  * @param off_value 结束时间（0-4095）
  * @return esp_err_t 操作结果
  */
-esp_err_t lu9685_set_pwm_channel(lu9685_handle_t handle, uint8_t channel, uint16_t on_value, uint16_t off_value)
+esp_err_t lu9685_stage_pwm_channel(lu9685_handle_t handle, uint8_t channel, uint16_t on_value, uint16_t off_value)
 {
     if (handle == NULL) {
         return ESP_ERR_INVALID_ARG;
     }
 
-    if (channel > 15) {
+    if (channel >= LU9685_CHANNEL_COUNT) {
         ESP_LOGE(TAG, "通道编号错误：%d", channel);
         return ESP_ERR_INVALID_ARG;
     }
 
     lu9685_dev_t *dev = static_cast<lu9685_dev_t*>(handle);
-    
-    // 如果启用了多路复用器，先选择正确的通道
-    if (dev->use_pca9548a) {
-        esp_err_t ret = select_pca9548a_channel(dev);
-        if (ret != ESP_OK) {
-            return ret;
-        }
-    }
+    on_value &= 0x0FFF;
+    off_value &= 0x0FFF;
 
-    // 准备寄存器地址
-    uint8_t reg_addr = LU9685_LED0_ON_L + 4 * channel;
-    
-    // 使用新版I2C API
-    i2c_master_bus_handle_t bus_handle = (i2c_master_bus_handle_t)dev->i2c_port;
-    i2c_master_dev_handle_t dev_handle;
-    
-    // 配置I2C设备
-    i2c_device_config_t dev_cfg = {
-        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
-        .device_address = dev->i2c_addr,
-        .scl_speed_hz = 400000, // 400kHz
-    };
-    
-    // 创建临时设备句柄
-    esp_err_t ret = i2c_master_bus_add_device(bus_handle, &dev_cfg, &dev_handle);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "无法创建I2C设备: %s", esp_err_to_name(ret));
-        return ret;
+    xSemaphoreTake(dev->lock, portMAX_DELAY);
+    // 值没变就不标记，刷新时也不会为它访问总线
+    if (dev->shadow_on[channel] != on_value || dev->shadow_off[channel] != off_value) {
+        dev->shadow_on[channel] = on_value;
+        dev->shadow_off[channel] = off_value;
+        dev->dirty_mask |= (1u << channel);
     }
-    
-    // 准备发送数据
-    uint8_t tx_data[5] = {
-        reg_addr,
-        static_cast<uint8_t>(on_value & 0xFF),
-        static_cast<uint8_t>((on_value >> 8) & 0x0F),
-        static_cast<uint8_t>(off_value & 0xFF),
-        static_cast<uint8_t>((off_value >> 8) & 0x0F)
-    };
-    
-    // 发送数据
-    ret = i2c_master_transmit(dev_handle, tx_data, sizeof(tx_data), 1000);
-    
-    // 删除临时设备
-    i2c_master_bus_rm_device(dev_handle);
+    xSemaphoreGive(dev->lock);
+    return ESP_OK;
+}
 
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "设置PWM通道 %d 失败：%s", channel, esp_err_to_name(ret));
+/**
+ * @brief 暂存舵机通道的角度
+ * 
+ * @param handle 设备句柄
+ * @param channel 通道号（0-15）
+ * @param angle 角度（0-180）
+ * @return esp_err_t 操作结果
+ */
+esp_err_t lu9685_stage_channel_angle(lu9685_handle_t handle, uint8_t channel, uint8_t angle)
+{
+    return lu9685_stage_pwm_channel(handle, channel, 0, angle_to_pulse(angle));
+}
+
+/**
+ * @brief 把所有待写通道在一次I2C事务中写入芯片
+ * 
+ * @param handle 设备句柄
+ * @return esp_err_t 操作结果
+ */
+esp_err_t lu9685_flush(lu9685_handle_t handle)
+{
+    if (handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
     }
 
+    lu9685_dev_t *dev = static_cast<lu9685_dev_t*>(handle);
+
+    xSemaphoreTake(dev->lock, portMAX_DELAY);
+    unsigned int dirty = dev->dirty_mask;
+    if (dirty == 0) {
+        xSemaphoreGive(dev->lock);
+        return ESP_OK;
+    }
+
+    // 从最低到最高的待写通道连续写入，芯片按自动递增依次落到后面的寄存器
+    int first = __builtin_ctz(dirty);
+    int last = 31 - __builtin_clz(dirty);
+    uint8_t tx_data[1 + LU9685_CHANNEL_COUNT * 4];
+    size_t length = 0;
+    tx_data[length++] = LU9685_LED0_ON_L + 4 * first;
+    for (int channel = first; channel <= last; channel++) {
+        tx_data[length++] = dev->shadow_on[channel] & 0xFF;
+        tx_data[length++] = (dev->shadow_on[channel] >> 8) & 0x0F;
+        tx_data[length++] = dev->shadow_off[channel] & 0xFF;
+        tx_data[length++] = (dev->shadow_off[channel] >> 8) & 0x0F;
+    }
+
+    esp_err_t ret = lu9685_transmit(dev, tx_data, length);
+    if (ret == ESP_OK) {
+        dev->dirty_mask = 0;
+    } else {
+        // 保留待写标记，下次刷新重试
+        ESP_LOGE(TAG, "写入PWM通道 %d-%d 失败：%s", first, last, esp_err_to_name(ret));
+    }
+    xSemaphoreGive(dev->lock);
     return ret;
 }
 
+/**
+ * @brief 设置单个PWM通道的占空比
+ * 
+ * @param handle 设备句柄
+ * @param channel 通道号（0-15）
+ * @param on_value 开始时间（0-4095）
+ * @param off_value 结束时间（0-4095）
+ * @return esp_err_t 操作结果
+ */
+esp_err_t lu9685_set_pwm_channel(lu9685_handle_t handle, uint8_t channel, uint16_t on_value, uint16_t off_value)
+{
+    esp_err_t ret = lu9685_stage_pwm_channel(handle, channel, on_value, off_value);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    return lu9685_flush(handle);
+}
+
 /**
  * @brief 设置单个通道的PWM占空比（百分比）
  * 
@@ -515,27 +538,12 @@ esp_err_t lu9685_set_duty_percent(lu9685_handle_t handle, uint8_t channel, float
     if (handle == NULL) {
         return ESP_ERR_INVALID_ARG;
     }
-
-    if (channel > 15) {
-        ESP_LOGE(TAG, "通道编号错误：%d", channel);
-        return ESP_ERR_INVALID_ARG;
-    }
     
     if (duty_percent < 0.0f) duty_percent = 0.0f;
     if (duty_percent > 100.0f) duty_percent = 100.0f;
 
     uint16_t off_value = (uint16_t)(duty_percent * 40.96f); // 4096 * (duty_percent / 100.0)
     
-    lu9685_dev_t *dev = static_cast<lu9685_dev_t*>(handle);
-    
-    // 如果启用了多路复用器，先选择正确的通道
-    if (dev->use_pca9548a) {
-        esp_err_t ret = select_pca9548a_channel(dev);
-        if (ret != ESP_OK) {
-            return ret;
-        }
-    }
-    
     return lu9685_set_pwm_channel(handle, channel, 0, off_value);
 }
 
@@ -554,34 +562,9 @@ esp_err_t lu9685_set_all_pwm(lu9685_handle_t handle, uint16_t on_value, uint16_t
     }
 
     lu9685_dev_t *dev = static_cast<lu9685_dev_t*>(handle);
+    on_value &= 0x0FFF;
+    off_value &= 0x0FFF;
 
-    // 如果启用了多路复用器，先选择正确的通道
-    if (dev->use_pca9548a) {
-        esp_err_t ret = select_pca9548a_channel(dev);
-        if (ret != ESP_OK) {
-            return ret;
-        }
-    }
-
-    // 使用新版I2C API
-    i2c_master_bus_handle_t bus_handle = (i2c_master_bus_handle_t)dev->i2c_port;
-    i2c_master_dev_handle_t dev_handle;
-    
-    // 配置I2C设备
-    i2c_device_config_t dev_cfg = {
-        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
-        .device_address = dev->i2c_addr,
-        .scl_speed_hz = 400000, // 400kHz
-    };
-    
-    // 创建临时设备句柄
-    esp_err_t ret = i2c_master_bus_add_device(bus_handle, &dev_cfg, &dev_handle);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "无法创建I2C设备: %s", esp_err_to_name(ret));
-        return ret;
-    }
-    
-    // 准备发送数据
     uint8_t tx_data[5] = {
         LU9685_ALL_LED_ON_L,
         static_cast<uint8_t>(on_value & 0xFF),
@@ -589,12 +572,16 @@ esp_err_t lu9685_set_all_pwm(lu9685_handle_t handle, uint16_t on_value, uint16_t
         static_cast<uint8_t>(off_value & 0xFF),
         static_cast<uint8_t>((off_value >> 8) & 0x0F)
     };
-    
-    // 发送数据
-    ret = i2c_master_transmit(dev_handle, tx_data, sizeof(tx_data), 1000);
-    
-    // 删除临时设备
-    i2c_master_bus_rm_device(dev_handle);
+
+    xSemaphoreTake(dev->lock, portMAX_DELAY);
+    esp_err_t ret = lu9685_transmit(dev, tx_data, sizeof(tx_data));
+    for (int channel = 0; channel < LU9685_CHANNEL_COUNT; channel++) {
+        dev->shadow_on[channel] = on_value;
+        dev->shadow_off[channel] = off_value;
+    }
+    // 失败时芯片状态未知，全部标记为待写，下次刷新补上
+    dev->dirty_mask = (ret == ESP_OK) ? 0 : 0xFFFF;
+    xSemaphoreGive(dev->lock);
     
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "设置所有PWM通道失败：%s", esp_err_to_name(ret));
@@ -621,16 +608,6 @@ esp_err_t lu9685_set_all_duty_percent(lu9685_handle_t handle, float duty_percent
 
     uint16_t off_value = (uint16_t)(duty_percent * 40.96f); // 4096 * (duty_percent / 100.0)
     
-    lu9685_dev_t *dev = static_cast<lu9685_dev_t*>(handle);
-    
-    // 如果启用了多路复用器，先选择正确的通道
-    if (dev->use_pca9548a) {
-        esp_err_t ret = select_pca9548a_channel(dev);
-        if (ret != ESP_OK) {
-            return ret;
-        }
-    }
-    
     return lu9685_set_all_pwm(handle, 0, off_value);
 }
 
@@ -647,16 +624,6 @@ esp_err_t lu9685_set_sleep_mode(lu9685_handle_t handle, bool sleep)
         return ESP_ERR_INVALID_ARG;
     }
 
-    lu9685_dev_t *dev = static_cast<lu9685_dev_t*>(handle);
-
-    // 如果启用了多路复用器，先选择正确的通道
-    if (dev->use_pca9548a) {
-        esp_err_t ret = select_pca9548a_channel(dev);
-        if (ret != ESP_OK) {
-            return ret;
-        }
-    }
-
     // 获取当前模式
     uint8_t mode1;
     esp_err_t ret = lu9685_read_register(handle, LU9685_MODE1, &mode1);
@@ -697,33 +664,7 @@ esp_err_t lu9685_set_sleep_mode(lu9685_handle_t handle, bool sleep)
  */
 esp_err_t lu9685_set_channel_angle(lu9685_handle_t handle, uint8_t channel, uint8_t angle)
 {
-    if (handle == NULL) {
-        return ESP_ERR_INVALID_ARG;
-    }
-    
-    if (channel > 15) {
-        ESP_LOGE(TAG, "无效的通道编号: %d", channel);
-        return ESP_ERR_INVALID_ARG;
-    }
-    
-    if (angle > 180) {
-        angle = 180;
-    }
-    
-    // 角度转换为脉冲宽度
-    // 舵机通常使用1ms-2ms的脉冲宽度对应0-180度
-    // 在50Hz下，一个周期是20ms，所以1ms对应4096的204.8
-    // 因此脉冲宽度范围约为204-410
-    uint16_t pulse_width = 204 + (angle * 206) / 180;
-    
-    // 如果启用了多路复用器，先选择正确的通道
-    lu9685_dev_t *dev = static_cast<lu9685_dev_t*>(handle);
-    if (dev->use_pca9548a) {
-        select_pca9548a_channel(dev);
-    }
-    
-    // 设置PWM
-    return lu9685_set_pwm_channel(handle, channel, 0, pulse_width);
+    return lu9685_set_pwm_channel(handle, channel, 0, angle_to_pulse(angle));
 }
 
 /**
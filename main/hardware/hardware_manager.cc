@@ -1,9 +1,12 @@
 #include "hardware_manager.h"
 #include "simple_error_handler.h"
+#include "sensor_history.h"
+#include "obstacle_supervisor.h"
 #include "esp_log.h"
 #include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "multiplexer.h"
 #include <fstream>
 #include <sstream>
@@ -20,6 +23,7 @@ HardwareManager::HardwareManager()
 }
 
 HardwareManager::~HardwareManager() {
+    StopHistorySampling();
     if (pcf8575_handle_) {
         pcf8575_delete(&pcf8575_handle_);
     }
@@ -29,6 +33,9 @@ HardwareManager::~HardwareManager() {
     if (hw178_handle_) {
         hw178_delete(hw178_handle_);
     }
+    if (history_done_) {
+        vSemaphoreDelete(history_done_);
+    }
 }
 
 esp_err_t HardwareManager::Initialize() {
@@ -41,6 +48,11 @@ esp_err_t HardwareManager::Initialize() {
         return ret;
     }
     
+    // Motors that keep running are re-limited or stopped when an obstacle comes closer
+    ObstacleSupervisor::GetInstance().AddListener([this](float, float) {
+        ReapplyMotorRequests();
+    });
+    
     initialized_ = true;
     ESP_LOGI(TAG, "Hardware Manager initialized successfully");
     return ESP_OK;
@@ -432,14 +444,55 @@ sensor_reading_t HardwareManager::ReadSensor(const std::string& sensor_id) {
     reading.unit = config.unit;
     
     if (config.multiplexer == "hw178") {
+        // The HW178 channel select and the ADC read must not interleave with another reader
+        std::lock_guard<std::mutex> lock(sensor_mutex_);
         reading = ReadHW178Sensor(config);
     } else {
         ESP_LOGE(TAG, "Unsupported multiplexer type: %s", config.multiplexer.c_str());
     }
     
+    if (reading.valid) {
+        SensorHistory::GetInstance().Record(reading.sensor_id, reading.value, reading.unit.c_str());
+    }
     return reading;
 }
 
+void HardwareManager::StartHistorySampling(uint32_t interval_ms) {
+    if (!initialized_ || sensor_configs_.empty() || history_task_ != nullptr) {
+        return;
+    }
+    if (history_done_ == nullptr) {
+        history_done_ = xSemaphoreCreateBinary();
+    }
+    history_interval_ms_ = interval_ms;
+    history_running_ = true;
+    xTaskCreate([](void* arg) {
+        auto* manager = static_cast<HardwareManager*>(arg);
+        while (manager->history_running_) {
+            // ReadSensor() records every valid reading
+            manager->ReadAllSensors();
+            // Woken early by StopHistorySampling()
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(manager->history_interval_ms_));
+        }
+        // Given only after the last read, so sensor_mutex_ is no longer held
+        xSemaphoreGive(manager->history_done_);
+        vTaskDelete(NULL);
+    }, "hw_history", 4096, this, 2, &history_task_);
+    ESP_LOGI(TAG, "Sampling %u sensors every %lu ms for history",
+        (unsigned)sensor_configs_.size(), (unsigned long)interval_ms);
+}
+
+void HardwareManager::StopHistorySampling() {
+    if (history_task_ == nullptr) {
+        return;
+    }
+    history_running_ = false;
+    xTaskNotifyGive(history_task_);
+    // The task may be in the middle of a read, wait for it to leave the loop
+    xSemaphoreTake(history_done_, portMAX_DELAY);
+    history_task_ = nullptr;
+}
+
 sensor_reading_t HardwareManager::ReadHW178Sensor(const sensor_config_t& config) {
     sensor_reading_t reading;
     reading.sensor_id = config.id;
@@ -543,6 +596,17 @@ esp_err_t HardwareManager::SetMotorSpeed(int motor_id, int speed) {
         ESP_LOGW(TAG, "Motor speed clamped to %d for motor %d", speed, motor_id);
     }
     
+    // Positive speeds drive forward. A stop by the obstacle supervisor drops the request, a
+    // limited request is kept so the full speed returns once the obstacle is gone. The request
+    // and the output are updated under one lock, so ReapplyMotorRequests() never writes an
+    // older request over a stop that arrived in between
+    std::lock_guard<std::mutex> lock(motor_mutex_);
+    int limited = ObstacleSupervisor::GetInstance().LimitDuty(speed, config.name.c_str());
+    motor_requests_[motor_id] = limited != 0 ? speed : 0;
+    return WriteMotor(config, limited);
+}
+
+esp_err_t HardwareManager::WriteMotor(const motor_config_t& config, int speed) {
     esp_err_t ret = ESP_ERR_NOT_SUPPORTED;
     
     if (config.connection_type == "pcf8575") {
@@ -557,15 +621,34 @@ esp_err_t HardwareManager::SetMotorSpeed(int motor_id, int speed) {
     
     if (ret == ESP_OK) {
         ESP_LOGI(TAG, "Motor %d (%s) speed set to %d", 
-                 motor_id, config.name.c_str(), speed);
+                 config.id, config.name.c_str(), speed);
     } else {
         ESP_LOGE(TAG, "Failed to set motor %d speed: %s", 
-                 motor_id, esp_err_to_name(ret));
+                 config.id, esp_err_to_name(ret));
     }
     
     return ret;
 }
 
+void HardwareManager::ReapplyMotorRequests() {
+    // Each request is read and written under motor_mutex_, a stop that got in first leaves 0 here
+    std::lock_guard<std::mutex> lock(motor_mutex_);
+    for (auto& [motor_id, speed] : motor_requests_) {
+        if (speed == 0) {
+            continue;
+        }
+        auto it = motor_configs_.find(motor_id);
+        if (it == motor_configs_.end()) {
+            continue;
+        }
+        int limited = ObstacleSupervisor::GetInstance().LimitDuty(speed, it->second.name.c_str());
+        if (limited == 0) {
+            speed = 0;
+        }
+        WriteMotor(it->second, limited);
+    }
+}
+
 esp_err_t HardwareManager::SetPCF8575Motor(const motor_config_t& config, int speed) {
     // Initialize PCF8575 if not already done
     esp_err_t ret = InitializePCF8575();
@@ -698,6 +781,23 @@ esp_err_t HardwareManager::SetServoAngle(int servo_id, int angle) {
 }
 
 esp_err_t HardwareManager::SetLU9685Servo(const servo_config_t& config, int angle) {
+    esp_err_t ret = StageLU9685Servo(config, angle);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    
+    ret = lu9685_flush(lu9685_handle_);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to set LU9685 servo %d angle: %s", 
+                 config.id, esp_err_to_name(ret));
+        return ret;
+    }
+    
+    ESP_LOGD(TAG, "Successfully set LU9685 servo %d angle to %d degrees", config.id, angle);
+    return ESP_OK;
+}
+
+esp_err_t HardwareManager::StageLU9685Servo(const servo_config_t& config, int angle) {
     // Initialize LU9685 if not already done
     esp_err_t ret = InitializeLU9685();
     if (ret != ESP_OK) {
@@ -718,15 +818,7 @@ esp_err_t HardwareManager::SetLU9685Servo(const servo_config_t& config, int angl
     ESP_LOGD(TAG, "Setting LU9685 servo %d (channel %d) angle to %d degrees", 
              config.id, config.channel, angle);
     
-    ret = lu9685_set_channel_angle(lu9685_handle_, config.channel, angle);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to set LU9685 servo %d angle: %s", 
-                 config.id, esp_err_to_name(ret));
-        return ret;
-    }
-    
-    ESP_LOGD(TAG, "Successfully set LU9685 servo %d angle to %d degrees", config.id, angle);
-    return ESP_OK;
+    return lu9685_stage_channel_angle(lu9685_handle_, config.channel, angle);
 }
 
 std::vector<actuator_status_t> HardwareManager::GetActuatorStatus() {
@@ -4,8 +4,13 @@
 #include <vector>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <atomic>
 #include "esp_err.h"
 #include "cJSON.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
 
 // Forward declarations for multiplexer drivers
 #include "../ext/include/multiplexer.h"
@@ -149,6 +154,17 @@ public:
      */
     sensor_reading_t ReadSensor(const std::string& sensor_id);
 
+    /**
+     * @brief Read all sensors periodically in a background task so they show up in SensorHistory
+     * @param interval_ms Sampling interval in milliseconds
+     */
+    void StartHistorySampling(uint32_t interval_ms);
+
+    /**
+     * @brief Stop the history task and wait until it has finished its current read
+     */
+    void StopHistorySampling();
+
     /**
      * @brief Get sensor configuration
      * @param sensor_id Sensor identifier
@@ -246,6 +262,17 @@ private:
     lu9685_handle_t lu9685_handle_ = nullptr;
     hw178_handle_t hw178_handle_ = nullptr;
 
+    // Serializes sensor reads from the web API, MCP and the history task
+    std::mutex sensor_mutex_;
+    TaskHandle_t history_task_ = nullptr;
+    SemaphoreHandle_t history_done_ = nullptr;   // Given by the history task as it exits
+    std::atomic<bool> history_running_{false};
+    uint32_t history_interval_ms_ = 1000;
+
+    // Last requested speed of each motor before the obstacle limit, re-applied when the limit changes
+    std::map<int, int> motor_requests_;
+    std::mutex motor_mutex_;    // Also held while a motor output is written
+
     // Initialization helpers
     esp_err_t InitializeMultiplexers();
     esp_err_t ParseSensorConfig(cJSON* sensors_json);
@@ -253,10 +280,13 @@ private:
     esp_err_t ParseServoConfig(cJSON* servos_json);
     
     sensor_reading_t ReadHW178Sensor(const sensor_config_t& config);
+    esp_err_t WriteMotor(const motor_config_t& config, int speed);    // With motor_mutex_ held
     esp_err_t SetPCF8575Motor(const motor_config_t& config, int speed);
     esp_err_t SetLU9685Servo(const servo_config_t& config, int angle);
+    esp_err_t StageLU9685Servo(const servo_config_t& config, int angle);
     esp_err_t SetDirectMotor(const motor_config_t& config, int speed);
     esp_err_t SetDirectServo(const servo_config_t& config, int angle);
+    void ReapplyMotorRequests();
     
     // Actuator helper methods
     bool ValidateMotorSpeed(int speed, const motor_config_t& config);
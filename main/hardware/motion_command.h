@@ -0,0 +1,128 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+
+/**
+ * @brief One joystick style motion command
+ *
+ * x / y is a velocity vector in the frame of the sender, each axis -1..1. Its length is the
+ * speed, (0, 0) stops. What the axes mean is up to the output the command is fed to.
+ */
+struct MotionCommand {
+    float x = 0.0f;
+    float y = 0.0f;
+    int64_t time_us = 0;        ///< When the command was received, for the latency
+    uint32_t sequence = 0;      ///< Assigned by MotionMailbox::Post()
+};
+
+/**
+ * @brief Single slot mailbox that only keeps the latest command
+ *
+ * The sender never blocks on the consumer: a command that has not been taken yet is replaced
+ * by the next one, which is what a joystick stream wants - only the newest position matters.
+ */
+class MotionMailbox {
+public:
+    /**
+     * @brief Store a command, replacing an unread one
+     * @return true when an unread command was replaced
+     */
+    bool Post(MotionCommand command) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        command.sequence = ++sequence_;
+        bool replaced = full_;
+        command_ = command;
+        full_ = true;
+        return replaced;
+    }
+
+    /**
+     * @brief Take the latest command
+     * @return false when nothing was posted since the last call
+     */
+    bool Take(MotionCommand& command) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!full_) {
+            return false;
+        }
+        command = command_;
+        full_ = false;
+        return true;
+    }
+
+    void Clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        full_ = false;
+    }
+
+private:
+    std::mutex mutex_;
+    MotionCommand command_;
+    uint32_t sequence_ = 0;
+    bool full_ = false;
+};
+
+/**
+ * @brief Acceleration limit of a motion vector
+ *
+ * The output moves toward the target by at most accel * dt while speeding up and decel * dt
+ * while slowing down or reversing, both axes by the same factor so the direction of the change
+ * is kept. A reversal therefore always passes through zero at the deceleration rate.
+ */
+class MotionRamp {
+public:
+    /**
+     * @param accel Speed-up rate, full scale (1.0) per second, 0 for no limit
+     * @param decel Slow-down rate, full scale per second, 0 for no limit
+     */
+    MotionRamp(float accel = 0.0f, float decel = 0.0f) : accel_(accel), decel_(decel) {}
+
+    void SetRates(float accel, float decel) {
+        accel_ = accel;
+        decel_ = decel;
+    }
+
+    void Reset() {
+        x_ = 0.0f;
+        y_ = 0.0f;
+    }
+
+    /**
+     * @brief Move the output toward a target, called once per control step
+     */
+    void Update(float target_x, float target_y, float dt) {
+        float dx = target_x - x_;
+        float dy = target_y - y_;
+        float change = std::hypot(dx, dy);
+        if (change == 0.0f) {
+            return;
+        }
+        bool slowing = std::hypot(target_x, target_y) < std::hypot(x_, y_) || target_x * x_ + target_y * y_ < 0.0f;
+        float rate = slowing ? decel_ : accel_;
+        float step = rate * dt;
+        if (rate > 0.0f && change > step) {
+            dx *= step / change;
+            dy *= step / change;
+        }
+        x_ += dx;
+        y_ += dy;
+        // Snap the last fraction of a step so the output reaches zero exactly
+        if (std::fabs(x_ - target_x) < 1e-4f && std::fabs(y_ - target_y) < 1e-4f) {
+            x_ = target_x;
+            y_ = target_y;
+        }
+    }
+
+    float x() const { return x_; }
+    float y() const { return y_; }
+    bool stopped() const { return x_ == 0.0f && y_ == 0.0f; }
+
+private:
+    float accel_;
+    float decel_;
+    float x_ = 0.0f;
+    float y_ = 0.0f;
+};
@@ -0,0 +1,252 @@
+#include "motion_controller.h"
+
+#include <sdkconfig.h>
+#include <cmath>
+#include "esp_log.h"
+#include "../iot/json_writer.h"
+
+#define TAG "MotionController"
+
+#ifndef CONFIG_MOTION_CONTROL_RATE_HZ
+#define CONFIG_MOTION_CONTROL_RATE_HZ 50
+#endif
+#ifndef CONFIG_MOTION_DEADMAN_MS
+#define CONFIG_MOTION_DEADMAN_MS 500
+#endif
+#ifndef CONFIG_MOTION_RAMP_UP_MS
+#define CONFIG_MOTION_RAMP_UP_MS 300
+#endif
+#ifndef CONFIG_MOTION_RAMP_DOWN_MS
+#define CONFIG_MOTION_RAMP_DOWN_MS 150
+#endif
+
+// Weight of a new sample in the average latency
+static constexpr int kLatencyAverageWindow = 16;
+
+static float RampRate(int full_scale_ms) {
+    return full_scale_ms > 0 ? 1000.0f / full_scale_ms : 0.0f;
+}
+
+MotionController::MotionController(const char* name, Output output)
+    : name_(name), output_(std::move(output)), deadman_us_(CONFIG_MOTION_DEADMAN_MS * 1000LL),
+      ramp_(RampRate(CONFIG_MOTION_RAMP_UP_MS), RampRate(CONFIG_MOTION_RAMP_DOWN_MS)) {
+}
+
+MotionController::~MotionController() {
+    if (timer_) {
+        esp_timer_stop(timer_);
+        esp_timer_delete(timer_);
+    }
+    if (task_) {
+        vTaskDelete(task_);
+    }
+}
+
+bool MotionController::Start() {
+    if (task_ != nullptr) {
+        return true;
+    }
+    TaskHandle_t task = nullptr;
+    xTaskCreate([](void* arg) {
+        static_cast<MotionController*>(arg)->Run();
+    }, name_.c_str(), 3072, this, 5, &task);
+    if (task == nullptr) {
+        ESP_LOGE(TAG, "%s: failed to create the motion task, commands are applied directly", name_.c_str());
+        return false;
+    }
+
+    esp_timer_create_args_t timer_args = {
+        .callback = [](void* arg) {
+            xTaskNotifyGive(static_cast<TaskHandle_t>(arg));
+        },
+        .arg = task,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "motion_timer",
+        .skip_unhandled_events = true,
+    };
+    if (esp_timer_create(&timer_args, &timer_) != ESP_OK ||
+        esp_timer_start_periodic(timer_, 1000000 / CONFIG_MOTION_CONTROL_RATE_HZ) != ESP_OK) {
+        ESP_LOGE(TAG, "%s: failed to start the motion timer, commands are applied directly", name_.c_str());
+        if (timer_) {
+            esp_timer_delete(timer_);
+            timer_ = nullptr;
+        }
+        vTaskDelete(task);
+        return false;
+    }
+    task_ = task;
+    ESP_LOGI(TAG, "%s: motion loop at %d Hz, deadman %d ms, ramp up %d ms, ramp down %d ms", name_.c_str(),
+        CONFIG_MOTION_CONTROL_RATE_HZ, CONFIG_MOTION_DEADMAN_MS, CONFIG_MOTION_RAMP_UP_MS, CONFIG_MOTION_RAMP_DOWN_MS);
+    return true;
+}
+
+void MotionController::Post(float x, float y) {
+    MotionCommand command;
+    float length = std::hypot(x, y);
+    if (!std::isfinite(length)) {
+        x = 0.0f;
+        y = 0.0f;
+    } else if (length > 1.0f) {
+        x /= length;
+        y /= length;
+    }
+    command.x = x;
+    command.y = y;
+    command.time_us = esp_timer_get_time();
+    received_++;
+
+    if (task_ == nullptr) {
+        std::lock_guard<std::mutex> lock(step_mutex_);
+        output_(x, y);
+        return;
+    }
+    if (mailbox_.Post(command)) {
+        superseded_++;
+    }
+    // An idle loop starts right away, a running one picks the command up on its next period
+    if (!active_) {
+        xTaskNotifyGive(task_);
+    }
+}
+
+void MotionController::Cancel() {
+    std::lock_guard<std::mutex> lock(step_mutex_);
+    mailbox_.Clear();
+    ramp_.Reset();
+    target_x_ = target_y_ = 0.0f;
+    output_x_ = output_y_ = 0.0f;
+    unapplied_command_us_ = 0;
+    if (active_) {
+        active_ = false;
+        LogSession();
+    }
+}
+
+void MotionController::Run() {
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        Step();
+    }
+}
+
+void MotionController::Step() {
+    std::lock_guard<std::mutex> lock(step_mutex_);
+    int64_t now = esp_timer_get_time();
+    float dt = last_step_us_ > 0 ? (now - last_step_us_) / 1000000.0f : 0.0f;
+    last_step_us_ = now;
+
+    MotionCommand command;
+    if (mailbox_.Take(command)) {
+        target_x_ = command.x;
+        target_y_ = command.y;
+        last_command_us_ = command.time_us;
+        unapplied_command_us_ = command.time_us;
+        active_ = true;
+    }
+    if (!active_) {
+        return;
+    }
+
+    bool moving_target = target_x_ != 0.0f || target_y_ != 0.0f;
+    if (moving_target && now - last_command_us_ > deadman_us_) {
+        ramp_.Reset();
+        target_x_ = target_y_ = 0.0f;
+        Write(0.0f, 0.0f);
+        deadman_stops_++;
+        active_ = false;
+        ESP_LOGW(TAG, "%s: no motion command for %lld ms, stopping", name_.c_str(),
+            (long long)((now - last_command_us_) / 1000));
+        LogSession();
+        return;
+    }
+
+    ramp_.Update(target_x_, target_y_, dt);
+    if (ramp_.x() != output_x_ || ramp_.y() != output_y_) {
+        Write(ramp_.x(), ramp_.y());
+    } else {
+        // The command matched what is already applied, nothing to actuate
+        unapplied_command_us_ = 0;
+    }
+
+    if (!moving_target && ramp_.stopped()) {
+        active_ = false;
+        LogSession();
+    }
+}
+
+void MotionController::Write(float x, float y) {
+    output_(x, y);
+    output_x_ = x;
+    output_y_ = y;
+    if (unapplied_command_us_ == 0) {
+        return;
+    }
+
+    int64_t latency = esp_timer_get_time() - unapplied_command_us_;
+    unapplied_command_us_ = 0;
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats_.last_latency_us = latency;
+    if (stats_.latency_samples == 0) {
+        stats_.avg_latency_us = latency;
+    } else {
+        stats_.avg_latency_us += (latency - stats_.avg_latency_us) / kLatencyAverageWindow;
+    }
+    stats_.max_latency_us = std::max(stats_.max_latency_us, latency);
+    stats_.latency_samples++;
+}
+
+void MotionController::LogSession() {
+    MotionStats stats = GetStats();
+    ESP_LOGI(TAG, "%s: motion ended, %lu commands (%lu superseded), latency last %.1f ms, avg %.1f ms, max %.1f ms",
+        name_.c_str(), (unsigned long)(stats.received - logged_received_),
+        (unsigned long)(stats.superseded - logged_superseded_), stats.last_latency_us / 1000.0f,
+        stats.avg_latency_us / 1000.0f, stats.max_latency_us / 1000.0f);
+    logged_received_ = stats.received;
+    logged_superseded_ = stats.superseded;
+}
+
+MotionStats MotionController::GetStats() const {
+    MotionStats stats;
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats = stats_;
+    }
+    stats.received = received_;
+    stats.superseded = superseded_;
+    stats.deadman_stops = deadman_stops_;
+    return stats;
+}
+
+std::string MotionController::GetStatusJson() const {
+    MotionStats stats = GetStats();
+    std::string json;
+    iot::JsonWriter writer(json);
+    writer.BeginObject();
+    writer.Key("running");
+    writer.Bool(task_ != nullptr);
+    writer.Key("active");
+    writer.Bool(active_);
+    writer.Key("rate_hz");
+    writer.Number(CONFIG_MOTION_CONTROL_RATE_HZ);
+    writer.Key("deadman_ms");
+    writer.Number((int)(deadman_us_ / 1000));
+    writer.Key("received");
+    writer.Number((int)stats.received);
+    writer.Key("superseded");
+    writer.Number((int)stats.superseded);
+    writer.Key("deadman_stops");
+    writer.Number((int)stats.deadman_stops);
+    writer.Key("latency_ms");
+    writer.BeginObject();
+    writer.Key("last");
+    writer.Number(stats.last_latency_us / 1000.0);
+    writer.Key("avg");
+    writer.Number(stats.avg_latency_us / 1000.0);
+    writer.Key("max");
+    writer.Number(stats.max_latency_us / 1000.0);
+    writer.Key("samples");
+    writer.Number((int)stats.latency_samples);
+    writer.EndObject();
+    writer.EndObject();
+    return json;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "esp_timer.h"
+
+#include "motion_command.h"
+
+/**
+ * @brief Counters and command-to-actuation latency of a MotionController
+ */
+struct MotionStats {
+    uint32_t received = 0;          ///< Commands posted
+    uint32_t superseded = 0;        ///< Replaced by a newer command before the loop took them
+    uint32_t deadman_stops = 0;     ///< Stops because the command stream went silent
+    uint32_t latency_samples = 0;
+    int64_t last_latency_us = 0;    ///< From Post() to the output write it caused
+    int64_t avg_latency_us = 0;     ///< Moving average over about 16 commands
+    int64_t max_latency_us = 0;
+};
+
+/**
+ * @brief Fixed-rate motion loop between a joystick command stream and a motor output
+ *
+ * Senders call Post() and return at once, the command lands in a latest-wins MotionMailbox.
+ * The loop task takes the newest command every period, ramps toward it with MotionRamp and
+ * calls the output only when the ramped value changed, so a flood of joystick messages costs
+ * one output write per period at most instead of one per message. A moving output that gets no
+ * new command for the deadman time is stopped at once, a dropped connection cannot leave the
+ * motors running; senders have to repeat their command while the joystick is held.
+ *
+ * The loop starts immediately when the first command arrives while idle, later commands wait
+ * for the next period. Commands that bypass the pipeline (buttons, voice, stop) call Cancel()
+ * first so the loop does not overwrite them.
+ */
+class MotionController {
+public:
+    // Called from the loop task with the ramped vector, (0, 0) means stop
+    using Output = std::function<void(float x, float y)>;
+
+    /**
+     * @param name Task name and log prefix
+     * @param output Writes the vector to the motors, must not call back into the controller
+     */
+    MotionController(const char* name, Output output);
+    ~MotionController();
+
+    MotionController(const MotionController&) = delete;
+    MotionController& operator=(const MotionController&) = delete;
+
+    /**
+     * @brief Create the loop task and timer, Post() applies directly until this succeeded
+     */
+    bool Start();
+
+    /**
+     * @brief Queue a command, called from any task
+     */
+    void Post(float x, float y);
+
+    /**
+     * @brief Drop the queued command and the ramp without writing the output
+     *
+     * Returns after a running loop step finished, the caller owns the motors afterwards.
+     */
+    void Cancel();
+
+    // A command is being ramped to or held, the deadman is armed
+    bool IsActive() const { return active_; }
+    MotionStats GetStats() const;
+    std::string GetStatusJson() const;
+
+private:
+    std::string name_;
+    Output output_;
+    int64_t deadman_us_;
+
+    MotionMailbox mailbox_;
+    MotionRamp ramp_;
+    std::mutex step_mutex_;             // Held by a loop step and by Cancel()
+    std::atomic<bool> active_{false};
+    float target_x_ = 0.0f;
+    float target_y_ = 0.0f;
+    float output_x_ = 0.0f;
+    float output_y_ = 0.0f;
+    int64_t last_command_us_ = 0;
+    int64_t unapplied_command_us_ = 0;  // Receive time of the newest command not written yet
+    int64_t last_step_us_ = 0;
+
+    std::atomic<uint32_t> received_{0};
+    std::atomic<uint32_t> superseded_{0};
+    std::atomic<uint32_t> deadman_stops_{0};
+    mutable std::mutex stats_mutex_;
+    MotionStats stats_;
+    uint32_t logged_received_ = 0;      // Counters at the last summary log
+    uint32_t logged_superseded_ = 0;
+
+    TaskHandle_t task_ = nullptr;
+    esp_timer_handle_t timer_ = nullptr;
+
+    void Run();
+    void Step();
+    void Write(float x, float y);
+    void LogSession();
+};
@@ -0,0 +1,216 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+/**
+ * @brief Thresholds of one direction of travel, distances in cm
+ */
+struct ObstacleThresholds {
+    float stop_distance_cm = 10.0f;         ///< Motors stop at or below this distance
+    float slow_distance_cm = 40.0f;         ///< Duty ramps down from here to min_scale at the stop distance
+    float min_time_to_collision_s = 0.5f;   ///< Stop when the stop distance would be reached sooner, includes the filter delay
+    float min_scale = 0.3f;                 ///< Duty scale just above the stop distance and while the sensor is stale
+    float release_margin_cm = 10.0f;        ///< A stop is only released this far beyond the stop distance
+    int64_t sample_timeout_us = 300000;     ///< A sensor without a ping for this long counts as failed
+};
+
+/**
+ * @brief Why a direction is limited, ordered by severity
+ */
+enum class ObstacleState {
+    kClear,     ///< Nothing within the slow distance
+    kSlow,      ///< Within the slow distance, duty is ramped down
+    kStale,     ///< Sensor stopped reporting, duty is held at min_scale
+    kClosing,   ///< Approaching too fast for the remaining distance
+    kStop       ///< Within the stop distance
+};
+
+inline const char* ObstacleStateName(ObstacleState state) {
+    switch (state) {
+        case ObstacleState::kClear: return "clear";
+        case ObstacleState::kSlow: return "slow";
+        case ObstacleState::kStale: return "stale";
+        case ObstacleState::kClosing: return "closing";
+        case ObstacleState::kStop: return "stop";
+    }
+    return "unknown";
+}
+
+/**
+ * @brief Filtered distance and duty limit of one direction of travel
+ *
+ * Add() takes every ping. The distance is the median of the last kWindow pings, so single
+ * spurious echoes are ignored; missing echoes are skipped and only kMissingEchoes of them in a
+ * row count as nothing in range. The closing speed is the slope of the filtered distance across
+ * the last kRateWindow pings. Update() turns both into a duty scale between 0 (stop) and 1
+ * (unlimited), using the distance predicted for the moment the decision takes effect. The short
+ * median keeps that prediction small, host_test/test_obstacle_guard replays noisy approaches.
+ *
+ * Plain logic without ESP-IDF dependencies and with caller supplied timestamps, so recorded or
+ * simulated distance traces can be replayed on the host.
+ */
+class ObstacleGuard {
+public:
+    static constexpr int kWindow = 3;
+    static constexpr int kRateWindow = 4;
+    static constexpr int kMissingEchoes = 3;                // Missing echoes in a row before nothing is in range
+    static constexpr float kDelayPings = (kWindow - 1) / 2 + 1;
+
+    explicit ObstacleGuard(const ObstacleThresholds& thresholds = ObstacleThresholds())
+        : thresholds_(thresholds) {}
+
+    void SetThresholds(const ObstacleThresholds& thresholds) { thresholds_ = thresholds; }
+    const ObstacleThresholds& thresholds() const { return thresholds_; }
+
+    void Reset() {
+        *this = ObstacleGuard(thresholds_);
+    }
+
+    /**
+     * @brief Add one ping
+     * @param distance_cm Measured distance, zero, negative or NAN for a ping without an echo
+     * @param time_us Time of the ping, monotonic
+     */
+    void Add(float distance_cm, int64_t time_us) {
+        last_time_us_ = time_us;
+        has_sample_ = true;
+        // Single missing echoes are far more often lost pings than an empty path, skip them
+        if (!(distance_cm > 0.0f) && ++missing_in_row_ < kMissingEchoes) {
+            return;
+        }
+        if (distance_cm > 0.0f) {
+            missing_in_row_ = 0;
+        }
+        raw_[raw_next_] = distance_cm > 0.0f ? distance_cm : INFINITY;
+        raw_next_ = (raw_next_ + 1) % kWindow;
+        if (raw_count_ < kWindow) {
+            raw_count_++;
+        }
+
+        // Lower median while the window fills up, the closer value is the safer one
+        float sorted[kWindow];
+        std::copy(raw_, raw_ + raw_count_, sorted);
+        std::nth_element(sorted, sorted + (raw_count_ - 1) / 2, sorted + raw_count_);
+        distance_ = sorted[(raw_count_ - 1) / 2];
+
+        filtered_[rate_next_] = distance_;
+        filtered_time_us_[rate_next_] = time_us;
+        int newest = rate_next_;
+        rate_next_ = (rate_next_ + 1) % kRateWindow;
+        if (rate_count_ < kRateWindow) {
+            rate_count_++;
+        }
+        int oldest = rate_count_ < kRateWindow ? 0 : rate_next_;
+        int64_t dt_us = filtered_time_us_[newest] - filtered_time_us_[oldest];
+        if (dt_us > 0 && std::isfinite(filtered_[newest]) && std::isfinite(filtered_[oldest])) {
+            closing_speed_ = (filtered_[oldest] - filtered_[newest]) * 1e6f / dt_us;
+        } else {
+            closing_speed_ = 0.0f;
+        }
+        ping_interval_s_ = rate_count_ > 1 && dt_us > 0 ? dt_us / 1e6f / (rate_count_ - 1) : 0.0f;
+    }
+
+    /**
+     * @brief Evaluate the thresholds at now_us
+     *
+     * Without any ping yet the direction is clear, a sensor that never ran does not limit the
+     * motors. A stop is held until the distance exceeds the stop distance plus the release margin,
+     * then the direction creeps at min_scale until the obstacle is out of the slow zone again.
+     */
+    ObstacleState Update(int64_t now_us) {
+        const ObstacleThresholds& t = thresholds_;
+        if (!has_sample_) {
+            state_ = ObstacleState::kClear;
+            scale_ = 1.0f;
+            return state_;
+        }
+        if (now_us - last_time_us_ > t.sample_timeout_us) {
+            state_ = ObstacleState::kStale;
+            scale_ = t.min_scale;
+            return state_;
+        }
+
+        float distance = predicted_distance();
+        float time_to_collision = time_to_collision_s();
+        // After any stop the direction only creeps at min_scale until the obstacle moved away: beyond
+        // the slow distance and farther than at the stop. Speeding up again right next to it would
+        // outrun the filtered distance, the closing speed lags behind an accelerating vehicle.
+        if (creep_ && distance_ >= t.slow_distance_cm + t.release_margin_cm &&
+            distance_ >= creep_distance_ + t.release_margin_cm) {
+            creep_ = false;
+        }
+        bool stopped = state_ == ObstacleState::kStop || state_ == ObstacleState::kClosing;
+        float stop_distance = stopped ? t.stop_distance_cm + t.release_margin_cm : t.stop_distance_cm;
+        if (distance <= stop_distance || time_to_collision < t.min_time_to_collision_s) {
+            state_ = distance <= stop_distance ? ObstacleState::kStop : ObstacleState::kClosing;
+            scale_ = 0.0f;
+            if (!creep_ || distance_ < creep_distance_) {
+                creep_distance_ = distance_;
+            }
+            creep_ = true;
+        } else if (creep_) {
+            state_ = ObstacleState::kSlow;
+            scale_ = t.min_scale;
+        } else if (distance < t.slow_distance_cm) {
+            float ratio = (distance - t.stop_distance_cm) / (t.slow_distance_cm - t.stop_distance_cm);
+            state_ = ObstacleState::kSlow;
+            scale_ = t.min_scale + (1.0f - t.min_scale) * std::min(std::max(ratio, 0.0f), 1.0f);
+        } else {
+            state_ = ObstacleState::kClear;
+            scale_ = 1.0f;
+        }
+        return state_;
+    }
+
+    ObstacleState state() const { return state_; }
+    // Duty scale from the last Update(), 0 stops the motors
+    float scale() const { return scale_; }
+    // Median distance in cm, INFINITY when nothing is in range
+    float distance() const { return distance_; }
+    // Positive when the obstacle comes closer, cm/s
+    float closing_speed() const { return closing_speed_; }
+    /**
+     * Distance expected when the next decision takes effect: the median lags the newest ping by
+     * half the window and the motors only react at the next ping, both at the closing speed
+     */
+    float predicted_distance() const {
+        if (closing_speed_ <= 0.0f || !std::isfinite(distance_)) {
+            return distance_;
+        }
+        return distance_ - closing_speed_ * ping_interval_s_ * (kDelayPings + missing_in_row_);
+    }
+    // Seconds until the stop distance is reached at the current closing speed, INFINITY if not closing
+    float time_to_collision_s() const {
+        if (closing_speed_ <= 0.0f || !std::isfinite(distance_)) {
+            return INFINITY;
+        }
+        return std::max(predicted_distance() - thresholds_.stop_distance_cm, 0.0f) / closing_speed_;
+    }
+    int64_t last_time_us() const { return last_time_us_; }
+
+private:
+    ObstacleThresholds thresholds_;
+
+    float raw_[kWindow] = {};
+    int raw_next_ = 0;
+    int raw_count_ = 0;
+
+    float filtered_[kRateWindow] = {};
+    int64_t filtered_time_us_[kRateWindow] = {};
+    int rate_next_ = 0;
+    int rate_count_ = 0;
+
+    float distance_ = INFINITY;
+    float closing_speed_ = 0.0f;
+    float ping_interval_s_ = 0.0f;
+    int missing_in_row_ = 0;
+    int64_t last_time_us_ = 0;
+    bool has_sample_ = false;
+
+    ObstacleState state_ = ObstacleState::kClear;
+    float scale_ = 1.0f;
+    bool creep_ = false;
+    float creep_distance_ = 0.0f;   // Closest filtered distance of the stops since creeping
+};
@@ -0,0 +1,281 @@
+#include "obstacle_supervisor.h"
+
+#include <sdkconfig.h>
+#include <cmath>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "settings.h"
+#include "../iot/json_writer.h"
+
+#define TAG "ObstacleSupervisor"
+
+#ifndef CONFIG_US_SAFE_DISTANCE
+#define CONFIG_US_SAFE_DISTANCE 10
+#endif
+#ifndef CONFIG_OBSTACLE_SLOW_DISTANCE
+#define CONFIG_OBSTACLE_SLOW_DISTANCE 40
+#endif
+#ifndef CONFIG_OBSTACLE_MIN_TTC_MS
+#define CONFIG_OBSTACLE_MIN_TTC_MS 500
+#endif
+#ifndef CONFIG_OBSTACLE_MIN_DUTY_PERCENT
+#define CONFIG_OBSTACLE_MIN_DUTY_PERCENT 30
+#endif
+
+// Smaller scale changes are not passed to the listeners, a stop always is
+static constexpr float kScaleStep = 0.05f;
+// Commands limited by LimitDuty() are logged at most this often per direction
+static constexpr int64_t kLimitLogIntervalUs = 1000000;
+
+static bool ScaleChanged(float scale, float notified) {
+    return (scale == 0.0f) != (notified == 0.0f) || std::fabs(scale - notified) >= kScaleStep ||
+        (scale == 1.0f && notified != 1.0f);
+}
+
+static const char* DirectionName(MotionDirection direction) {
+    return direction == MotionDirection::kForward ? "forward" : "backward";
+}
+
+static const char* SensorName(MotionDirection direction) {
+    return direction == MotionDirection::kForward ? "Front" : "Rear";
+}
+
+void ObstacleSupervisor::Start() {
+    if (task_ != nullptr) {
+        return;
+    }
+    LoadThresholds();
+    xTaskCreate([](void* arg) {
+        static_cast<ObstacleSupervisor*>(arg)->Run();
+    }, "obstacle_guard", 3072, this, configMAX_PRIORITIES - 3, &task_);
+
+    ObstacleThresholds t = GetThresholds();
+    ESP_LOGI(TAG, "Started: stop %.0f cm, slow %.0f cm, time to collision %.2f s, min duty %.0f%%",
+        t.stop_distance_cm, t.slow_distance_cm, t.min_time_to_collision_s, t.min_scale * 100.0f);
+}
+
+void ObstacleSupervisor::LoadThresholds() {
+    Settings settings("obstacle", false);
+    ObstacleThresholds t;
+    t.stop_distance_cm = settings.GetInt("stop_cm", CONFIG_US_SAFE_DISTANCE);
+    t.slow_distance_cm = settings.GetInt("slow_cm", CONFIG_OBSTACLE_SLOW_DISTANCE);
+    t.min_time_to_collision_s = settings.GetInt("ttc_ms", CONFIG_OBSTACLE_MIN_TTC_MS) / 1000.0f;
+    t.min_scale = settings.GetInt("min_duty", CONFIG_OBSTACLE_MIN_DUTY_PERCENT) / 100.0f;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& guard : guards_) {
+        guard.SetThresholds(t);
+    }
+}
+
+ObstacleThresholds ObstacleSupervisor::GetThresholds() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return guards_[0].thresholds();
+}
+
+bool ObstacleSupervisor::SetThresholds(const ObstacleThresholds& thresholds, std::string& error) {
+    if (thresholds.stop_distance_cm < 2.0f) {
+        error = "Stop distance must be at least 2 cm";
+        return false;
+    }
+    if (thresholds.slow_distance_cm <= thresholds.stop_distance_cm) {
+        error = "Slow distance must be larger than the stop distance";
+        return false;
+    }
+    if (thresholds.min_time_to_collision_s < 0.0f || thresholds.min_time_to_collision_s > 5.0f) {
+        error = "Time to collision must be between 0 and 5 s";
+        return false;
+    }
+    if (thresholds.min_scale < 0.0f || thresholds.min_scale > 1.0f) {
+        error = "Minimum duty must be between 0 and 100%";
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& guard : guards_) {
+            guard.SetThresholds(thresholds);
+        }
+    }
+    Settings settings("obstacle", true);
+    settings.SetInt("stop_cm", std::lround(thresholds.stop_distance_cm));
+    settings.SetInt("slow_cm", std::lround(thresholds.slow_distance_cm));
+    settings.SetInt("ttc_ms", std::lround(thresholds.min_time_to_collision_s * 1000.0f));
+    settings.SetInt("min_duty", std::lround(thresholds.min_scale * 100.0f));
+    ESP_LOGI(TAG, "Thresholds changed: stop %.0f cm, slow %.0f cm, time to collision %.2f s, min duty %.0f%%",
+        thresholds.stop_distance_cm, thresholds.slow_distance_cm, thresholds.min_time_to_collision_s,
+        thresholds.min_scale * 100.0f);
+    if (task_ != nullptr) {
+        xTaskNotifyGive(task_);
+    }
+    return true;
+}
+
+void ObstacleSupervisor::OnDistance(MotionDirection direction, float distance_cm) {
+    if (task_ == nullptr) {
+        return;
+    }
+    int i = static_cast<int>(direction);
+    int64_t now = esp_timer_get_time();
+    bool notify;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ObstacleGuard& guard = guards_[i];
+        guard.Add(distance_cm, now);
+        ObstacleState state = guard.Update(now);
+        float scale = guard.scale();
+        scale_[i].store(scale, std::memory_order_release);
+        notify = state != logged_state_[i] || ScaleChanged(scale, notified_scale_[i]);
+    }
+    // Outputs read the new scale from now on, the task only has to stop what is already running
+    if (notify) {
+        xTaskNotifyGive(task_);
+    }
+}
+
+float ObstacleSupervisor::GetDistance(MotionDirection direction) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return guards_[static_cast<int>(direction)].distance();
+}
+
+int ObstacleSupervisor::LimitDuty(int duty, const char* source) {
+    if (duty == 0) {
+        return 0;
+    }
+    MotionDirection direction = duty > 0 ? MotionDirection::kForward : MotionDirection::kBackward;
+    float scale = GetScale(direction);
+    if (scale >= 1.0f) {
+        return duty;
+    }
+    int limited = static_cast<int>(duty * scale);
+
+    int i = static_cast<int>(direction);
+    int64_t now = esp_timer_get_time();
+    int64_t last = last_limit_log_us_[i].load();
+    if (now - last >= kLimitLogIntervalUs && last_limit_log_us_[i].compare_exchange_strong(last, now)) {
+        ObstacleState state;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            state = guards_[i].state();
+        }
+        ESP_LOGW(TAG, "%s: %s duty %d limited to %d (%s)", source, DirectionName(direction), duty, limited,
+            ObstacleStateName(state));
+    }
+    return limited;
+}
+
+void ObstacleSupervisor::AddListener(LimitListener listener) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    listeners_.push_back(std::move(listener));
+}
+
+void ObstacleSupervisor::LogStateChange(MotionDirection direction, ObstacleState state, const ObstacleGuard& guard) {
+    const char* sensor = SensorName(direction);
+    const char* motion = DirectionName(direction);
+    const ObstacleThresholds& t = guard.thresholds();
+    switch (state) {
+        case ObstacleState::kStop:
+            ESP_LOGW(TAG, "%s obstacle at %.0f cm, stopping %s motion", sensor, guard.distance(), motion);
+            break;
+        case ObstacleState::kClosing:
+            ESP_LOGW(TAG, "%s obstacle at %.0f cm closing at %.0f cm/s (%.2f s to the stop distance), stopping %s motion",
+                sensor, guard.distance(), guard.closing_speed(), guard.time_to_collision_s(), motion);
+            break;
+        case ObstacleState::kSlow:
+            ESP_LOGW(TAG, "%s obstacle at %.0f cm, limiting %s duty to %.0f%%", sensor, guard.distance(), motion,
+                guard.scale() * 100.0f);
+            break;
+        case ObstacleState::kStale:
+            ESP_LOGW(TAG, "%s ultrasonic sensor silent for %lld ms, limiting %s duty to %.0f%%", sensor,
+                (long long)((esp_timer_get_time() - guard.last_time_us()) / 1000), motion, t.min_scale * 100.0f);
+            break;
+        case ObstacleState::kClear:
+            ESP_LOGI(TAG, "%s clear, %s duty no longer limited", sensor, motion);
+            break;
+    }
+}
+
+void ObstacleSupervisor::Run() {
+    std::vector<LimitListener> listeners;
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(kWatchdogMs));
+
+        int64_t now = esp_timer_get_time();
+        bool changed = false;
+        bool state_changed[2] = {false, false};
+        ObstacleGuard guards[2];
+        float scales[2];
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (int i = 0; i < 2; i++) {
+                // Re-evaluating also catches a sensor that stopped reporting
+                ObstacleState state = guards_[i].Update(now);
+                float scale = guards_[i].scale();
+                scale_[i].store(scale, std::memory_order_release);
+                if (state != logged_state_[i]) {
+                    logged_state_[i] = state;
+                    state_changed[i] = true;
+                    guards[i] = guards_[i];
+                }
+                if (ScaleChanged(scale, notified_scale_[i])) {
+                    notified_scale_[i] = scale;
+                    changed = true;
+                }
+                scales[i] = scale;
+            }
+            if (changed) {
+                listeners = listeners_;
+            }
+        }
+
+        if (changed) {
+            for (auto& listener : listeners) {
+                listener(scales[0], scales[1]);
+            }
+        }
+        for (int i = 0; i < 2; i++) {
+            if (state_changed[i]) {
+                LogStateChange(static_cast<MotionDirection>(i), guards[i].state(), guards[i]);
+            }
+        }
+    }
+}
+
+std::string ObstacleSupervisor::GetStatusJson() {
+    std::string json;
+    iot::JsonWriter writer(json);
+    std::lock_guard<std::mutex> lock(mutex_);
+    const ObstacleThresholds& t = guards_[0].thresholds();
+    writer.BeginObject();
+    writer.Key("running");
+    writer.Bool(task_ != nullptr);
+    writer.Key("thresholds");
+    writer.BeginObject();
+    writer.Key("stop_distance");
+    writer.Number((double)t.stop_distance_cm);
+    writer.Key("slow_distance");
+    writer.Number((double)t.slow_distance_cm);
+    writer.Key("min_time_to_collision");
+    writer.Number((double)t.min_time_to_collision_s);
+    writer.Key("min_duty");
+    writer.Number((double)t.min_scale);
+    writer.EndObject();
+    for (int i = 0; i < 2; i++) {
+        const ObstacleGuard& guard = guards_[i];
+        writer.Key(DirectionName(static_cast<MotionDirection>(i)));
+        writer.BeginObject();
+        writer.Key("state");
+        writer.String(ObstacleStateName(guard.state()));
+        writer.Key("scale");
+        writer.Number((double)guard.scale());
+        writer.Key("distance");
+        writer.Number((double)guard.distance());
+        writer.Key("closing_speed");
+        writer.Number((double)guard.closing_speed());
+        writer.Key("time_to_collision");
+        writer.Number((double)guard.time_to_collision_s());
+        writer.EndObject();
+    }
+    writer.EndObject();
+    return json;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "obstacle_guard.h"
+
+/**
+ * @brief Direction of travel watched by the supervisor
+ */
+enum class MotionDirection {
+    kForward = 0,   ///< Watched by the front ultrasonic sensor
+    kBackward = 1   ///< Watched by the rear ultrasonic sensor
+};
+
+/**
+ * @brief Safety layer between the ultrasonic sensors and every motor output
+ *
+ * The ultrasonic measure task hands over each ping through OnDistance(), which runs the
+ * ObstacleGuard of that direction inline and publishes the new duty scale atomically. Motor
+ * outputs read the scale with GetScale() / LimitDuty() right before they write a duty, so a
+ * new command never exceeds the limit. Commands that are already running are handled by the
+ * supervisor task: it is woken as soon as a limit tightens and calls the registered listeners,
+ * which re-apply or stop their current motion. The latency from the ping to the motor output
+ * is therefore one task switch, a watchdog tick every kWatchdogMs catches a sensor that stops
+ * reporting.
+ */
+class ObstacleSupervisor {
+public:
+    // Called from the supervisor task whenever a scale changes, 0 means stop
+    using LimitListener = std::function<void(float forward_scale, float backward_scale)>;
+
+    static constexpr int kWatchdogMs = 100;
+
+    static ObstacleSupervisor& GetInstance() {
+        static ObstacleSupervisor instance;
+        return instance;
+    }
+
+    ObstacleSupervisor(const ObstacleSupervisor&) = delete;
+    ObstacleSupervisor& operator=(const ObstacleSupervisor&) = delete;
+
+    /**
+     * @brief Load the thresholds and start the supervisor task, called once the sensors measure
+     */
+    void Start();
+    bool IsRunning() const { return task_ != nullptr; }
+
+    /**
+     * @brief Feed one ping, called from the ultrasonic measure task
+     * @param distance_cm Measured distance, zero, negative or NAN without an echo
+     */
+    void OnDistance(MotionDirection direction, float distance_cm);
+
+    /**
+     * @brief Duty scale of a direction, 1 while the supervisor is not running
+     */
+    float GetScale(MotionDirection direction) const {
+        return scale_[static_cast<int>(direction)].load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Median filtered distance of a direction in cm, INFINITY without an obstacle in range or any ping
+     */
+    float GetDistance(MotionDirection direction) const;
+
+    /**
+     * @brief Limit a signed duty, positive is forward
+     * @param source Shown in the intervention log
+     * @return The duty to apply, 0 when the direction is blocked
+     */
+    int LimitDuty(int duty, const char* source);
+
+    /**
+     * @brief Register a motor output that keeps moving on its own, listeners are never removed
+     */
+    void AddListener(LimitListener listener);
+
+    ObstacleThresholds GetThresholds() const;
+
+    /**
+     * @brief Change the thresholds of both directions and store them in Settings
+     * @param error Reason when the thresholds are inconsistent
+     */
+    bool SetThresholds(const ObstacleThresholds& thresholds, std::string& error);
+
+    /**
+     * @brief Thresholds, state, filtered distance and closing speed of both directions as JSON
+     */
+    std::string GetStatusJson();
+
+private:
+    ObstacleSupervisor() = default;
+
+    mutable std::mutex mutex_;
+    ObstacleGuard guards_[2];
+    std::atomic<float> scale_[2] = {1.0f, 1.0f};
+    ObstacleState logged_state_[2] = {ObstacleState::kClear, ObstacleState::kClear};
+    float notified_scale_[2] = {1.0f, 1.0f};
+    std::atomic<int64_t> last_limit_log_us_[2] = {0, 0};
+
+    std::vector<LimitListener> listeners_;
+    TaskHandle_t task_ = nullptr;
+
+    void LoadThresholds();
+    void Run();
+    void LogStateChange(MotionDirection direction, ObstacleState state, const ObstacleGuard& guard);
+};
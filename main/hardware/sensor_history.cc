@@ -0,0 +1,292 @@
+#include "sensor_history.h"
+
+#include <sdkconfig.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "../iot/json_writer.h"
+
+#define TAG "SensorHistory"
+
+#ifndef CONFIG_SENSOR_HISTORY_MEMORY_KB
+#define CONFIG_SENSOR_HISTORY_MEMORY_KB 0
+#endif
+
+SensorHistory::~SensorHistory() {
+    for (auto& pair : series_) {
+        heap_caps_free(pair.second.memory);
+    }
+}
+
+void SensorHistory::Accumulator::Add(float value_min, float value_max, double value_sum, uint32_t value_count) {
+    if (count == 0) {
+        min = value_min;
+        max = value_max;
+    } else {
+        min = std::min(min, value_min);
+        max = std::max(max, value_max);
+    }
+    sum += value_sum;
+    count += value_count;
+}
+
+SensorHistory::Bucket SensorHistory::Accumulator::ToBucket() const {
+    return Bucket{time_s, min, max, (float)(sum / count)};
+}
+
+SensorHistory::Series* SensorHistory::CreateSeries(std::string_view id, const char* unit) {
+    if (memory_used_ + kSeriesBytes > (size_t)CONFIG_SENSOR_HISTORY_MEMORY_KB * 1024) {
+        if (!budget_warned_) {
+            budget_warned_ = true;
+            ESP_LOGW(TAG, "Memory budget of %d KB used up, not recording %.*s and later new series",
+                CONFIG_SENSOR_HISTORY_MEMORY_KB, (int)id.size(), id.data());
+        }
+        return nullptr;
+    }
+
+    // The rings are only read by queries, so PSRAM is preferred
+    void* memory = heap_caps_malloc(kSeriesBytes, MALLOC_CAP_SPIRAM);
+    if (memory == nullptr) {
+        memory = heap_caps_malloc(kSeriesBytes, MALLOC_CAP_8BIT);
+    }
+    if (memory == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate %u bytes for %.*s", (unsigned)kSeriesBytes, (int)id.size(), id.data());
+        return nullptr;
+    }
+    memory_used_ += kSeriesBytes;
+
+    Series& series = series_.emplace(std::string(id), Series()).first->second;
+    series.unit = unit != nullptr ? unit : "";
+    series.memory = memory;
+    series.raw.data = static_cast<RawSample*>(memory);
+    series.raw.capacity = kRawCapacity;
+    series.seconds.data = reinterpret_cast<Bucket*>(series.raw.data + kRawCapacity);
+    series.seconds.capacity = kSecondCapacity;
+    series.minutes.data = series.seconds.data + kSecondCapacity;
+    series.minutes.capacity = kMinuteCapacity;
+    ESP_LOGI(TAG, "Recording %.*s (%u / %d KB used)", (int)id.size(), id.data(),
+        (unsigned)(memory_used_ / 1024), CONFIG_SENSOR_HISTORY_MEMORY_KB);
+    return &series;
+}
+
+void SensorHistory::CloseSecond(Series& series) {
+    Accumulator& second = series.second;
+    Accumulator& minute = series.minute;
+    series.seconds.Push(second.ToBucket());
+
+    uint32_t minute_start = second.time_s / 60 * 60;
+    if (minute.count > 0 && minute.time_s != minute_start) {
+        series.minutes.Push(minute.ToBucket());
+        minute = Accumulator();
+    }
+    if (minute.count == 0) {
+        minute.time_s = minute_start;
+    }
+    minute.Add(second.min, second.max, second.sum, second.count);
+    second = Accumulator();
+}
+
+void SensorHistory::Record(std::string_view id, float value, const char* unit) {
+    if (CONFIG_SENSOR_HISTORY_MEMORY_KB == 0 || !std::isfinite(value)) {
+        return;
+    }
+    int64_t now_ms = esp_timer_get_time() / 1000;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    Series* series;
+    auto it = series_.find(id);
+    if (it != series_.end()) {
+        series = &it->second;
+    } else {
+        series = CreateSeries(id, unit);
+        if (series == nullptr) {
+            return;
+        }
+    }
+
+    series->raw.Push(RawSample{now_ms, value});
+
+    uint32_t now_s = (uint32_t)(now_ms / 1000);
+    if (series->second.count > 0 && series->second.time_s != now_s) {
+        CloseSecond(*series);
+    }
+    if (series->second.count == 0) {
+        series->second.time_s = now_s;
+    }
+    series->second.Add(value, value, value, 1);
+}
+
+bool SensorHistory::Query(std::string_view id, SensorResolution resolution, int64_t from_ms, size_t max_points,
+                          std::vector<SensorHistoryPoint>& points) {
+    points.clear();
+    if (from_ms < 0) {
+        from_ms = std::max<int64_t>(0, esp_timer_get_time() / 1000 + from_ms);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = series_.find(id);
+    if (it == series_.end()) {
+        return false;
+    }
+    const Series& series = it->second;
+
+    auto add_bucket = [&](const Bucket& bucket, int64_t length_ms) {
+        int64_t time_ms = (int64_t)bucket.time_s * 1000;
+        if (time_ms + length_ms > from_ms) {
+            points.push_back(SensorHistoryPoint{time_ms, bucket.min, bucket.max, bucket.avg});
+        }
+    };
+
+    switch (resolution) {
+    case SensorResolution::kRaw:
+        points.reserve(series.raw.size);
+        for (size_t i = 0; i < series.raw.size; i++) {
+            const RawSample& sample = series.raw.At(i);
+            if (sample.time_ms >= from_ms) {
+                points.push_back(SensorHistoryPoint{sample.time_ms, sample.value, sample.value, sample.value});
+            }
+        }
+        break;
+    case SensorResolution::kSecond:
+        points.reserve(series.seconds.size + 1);
+        for (size_t i = 0; i < series.seconds.size; i++) {
+            add_bucket(series.seconds.At(i), 1000);
+        }
+        // The open bucket is included so the newest point is never more than a second behind
+        if (series.second.count > 0) {
+            add_bucket(series.second.ToBucket(), 1000);
+        }
+        break;
+    case SensorResolution::kMinute: {
+        points.reserve(series.minutes.size + 2);
+        for (size_t i = 0; i < series.minutes.size; i++) {
+            add_bucket(series.minutes.At(i), 60000);
+        }
+        // The open second has not been folded into the open minute yet
+        Accumulator minute = series.minute;
+        const Accumulator& second = series.second;
+        uint32_t second_minute = second.time_s / 60 * 60;
+        if (second.count > 0 && minute.count > 0 && minute.time_s != second_minute) {
+            add_bucket(minute.ToBucket(), 60000);
+            minute = Accumulator();
+        }
+        if (second.count > 0) {
+            if (minute.count == 0) {
+                minute.time_s = second_minute;
+            }
+            minute.Add(second.min, second.max, second.sum, second.count);
+        }
+        if (minute.count > 0) {
+            add_bucket(minute.ToBucket(), 60000);
+        }
+        break;
+    }
+    }
+
+    if (points.size() > max_points) {
+        points.erase(points.begin(), points.end() - max_points);
+    }
+    return true;
+}
+
+std::string SensorHistory::GetHistoryJson(std::string_view id, SensorResolution resolution, int64_t from_ms,
+                                          size_t max_points) {
+    std::vector<SensorHistoryPoint> points;
+    if (!Query(id, resolution, from_ms, std::min(max_points, kMaxQueryPoints), points)) {
+        return "";
+    }
+    std::string unit;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = series_.find(id);
+        if (it != series_.end()) {
+            unit = it->second.unit;
+        }
+    }
+
+    std::string json;
+    json.reserve(96 + points.size() * (resolution == SensorResolution::kRaw ? 24 : 48));
+    iot::JsonWriter writer(json);
+    writer.BeginObject();
+    writer.Key("id");
+    writer.String(id);
+    writer.Key("unit");
+    writer.String(unit);
+    writer.Key("resolution");
+    writer.String(ResolutionName(resolution));
+    writer.Key("points");
+    writer.BeginArray();
+    char buffer[64];
+    for (const auto& point : points) {
+        int length;
+        if (resolution == SensorResolution::kRaw) {
+            length = snprintf(buffer, sizeof(buffer), "[%lld,%g]", (long long)point.time_ms, point.avg);
+        } else {
+            length = snprintf(buffer, sizeof(buffer), "[%lld,%g,%g,%g]", (long long)point.time_ms,
+                point.avg, point.min, point.max);
+        }
+        writer.Raw(std::string_view(buffer, length));
+    }
+    writer.EndArray();
+    writer.EndObject();
+    return json;
+}
+
+std::string SensorHistory::GetSeriesJson() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string json;
+    iot::JsonWriter writer(json);
+    writer.BeginObject();
+    writer.Key("memory_used");
+    writer.Number((int)memory_used_);
+    writer.Key("memory_budget");
+    writer.Number(CONFIG_SENSOR_HISTORY_MEMORY_KB * 1024);
+    writer.Key("series");
+    writer.BeginArray();
+    for (const auto& pair : series_) {
+        const Series& series = pair.second;
+        writer.BeginObject();
+        writer.Key("id");
+        writer.String(pair.first);
+        writer.Key("unit");
+        writer.String(series.unit);
+        writer.Key("raw");
+        writer.Number((int)series.raw.size);
+        writer.Key("seconds");
+        writer.Number((int)series.seconds.size);
+        writer.Key("minutes");
+        writer.Number((int)series.minutes.size);
+        writer.EndObject();
+    }
+    writer.EndArray();
+    writer.EndObject();
+    return json;
+}
+
+bool SensorHistory::ParseResolution(std::string_view name, SensorResolution& resolution) {
+    if (name == "raw") {
+        resolution = SensorResolution::kRaw;
+    } else if (name == "1s") {
+        resolution = SensorResolution::kSecond;
+    } else if (name == "1m") {
+        resolution = SensorResolution::kMinute;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* SensorHistory::ResolutionName(SensorResolution resolution) {
+    switch (resolution) {
+    case SensorResolution::kRaw:
+        return "raw";
+    case SensorResolution::kSecond:
+        return "1s";
+    case SensorResolution::kMinute:
+        return "1m";
+    }
+    return "";
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Resolution of a history query
+ */
+enum class SensorResolution {
+    kRaw,       ///< Every recorded sample
+    kSecond,    ///< 1 s min / max / avg rollups
+    kMinute     ///< 1 min min / max / avg rollups
+};
+
+/**
+ * @brief One point of a history query, for raw samples min == max == avg
+ */
+struct SensorHistoryPoint {
+    int64_t time_ms;    ///< Milliseconds since boot, start of the bucket for rollups
+    float min;
+    float max;
+    float avg;
+};
+
+/**
+ * @brief Per sensor time series kept in fixed rings, preferably in PSRAM
+ *
+ * Every series holds the last kRawCapacity raw samples plus 1 s and 1 min
+ * rollups, so a few seconds of full rate data and hours of trend data are
+ * available without touching flash. Series are created on the first Record()
+ * of an id until CONFIG_SENSOR_HISTORY_MEMORY_KB is used up, recording into
+ * an existing series never allocates.
+ */
+class SensorHistory {
+public:
+    static constexpr size_t kRawCapacity = 256;
+    static constexpr size_t kSecondCapacity = 300;     ///< 5 minutes
+    static constexpr size_t kMinuteCapacity = 360;     ///< 6 hours
+    static constexpr size_t kMaxQueryPoints = 1000;
+
+    static SensorHistory& GetInstance() {
+        static SensorHistory instance;
+        return instance;
+    }
+
+    SensorHistory(const SensorHistory&) = delete;
+    SensorHistory& operator=(const SensorHistory&) = delete;
+
+    /**
+     * @brief Record a sample, safe to call from any task
+     * @param id Series id, e.g. "imu.accel_x"
+     * @param value Sample value
+     * @param unit Unit shown by queries, only used when the series is created
+     */
+    void Record(std::string_view id, float value, const char* unit = "");
+
+    /**
+     * @brief Points of a series not older than from_ms
+     * @param from_ms Milliseconds since boot, negative values are relative to now
+     * @param max_points The newest points are kept when more are available
+     * @return false if the series does not exist
+     */
+    bool Query(std::string_view id, SensorResolution resolution, int64_t from_ms, size_t max_points,
+               std::vector<SensorHistoryPoint>& points);
+
+    /**
+     * @brief Query() as {"id","unit","resolution","points":[[time_ms,avg,min,max],...]}
+     * @return Empty string if the series does not exist
+     */
+    std::string GetHistoryJson(std::string_view id, SensorResolution resolution, int64_t from_ms,
+                               size_t max_points = kMaxQueryPoints);
+
+    /**
+     * @brief Known series and memory usage
+     */
+    std::string GetSeriesJson();
+
+    static bool ParseResolution(std::string_view name, SensorResolution& resolution);
+    static const char* ResolutionName(SensorResolution resolution);
+
+private:
+    SensorHistory() = default;
+    ~SensorHistory();
+
+    struct RawSample {
+        int64_t time_ms;    ///< 64 bits, 32 bit milliseconds wrap after 49.7 days of uptime
+        float value;
+    };
+
+    struct Bucket {
+        uint32_t time_s;    ///< Start of the bucket in seconds since boot, 32 bits last 136 years
+        float min;
+        float max;
+        float avg;
+    };
+
+    template <typename T>
+    struct Ring {
+        T* data = nullptr;
+        size_t capacity = 0;
+        size_t head = 0;    ///< Next slot to write
+        size_t size = 0;
+
+        void Push(const T& item) {
+            data[head] = item;
+            head = (head + 1) % capacity;
+            if (size < capacity) {
+                size++;
+            }
+        }
+
+        /// i-th oldest entry
+        const T& At(size_t i) const { return data[(head + capacity - size + i) % capacity]; }
+    };
+
+    /// Open bucket that is still collecting samples
+    struct Accumulator {
+        uint32_t time_s = 0;
+        uint32_t count = 0;
+        float min = 0;
+        float max = 0;
+        double sum = 0;
+
+        void Add(float value_min, float value_max, double value_sum, uint32_t value_count);
+        Bucket ToBucket() const;
+    };
+
+    struct Series {
+        std::string unit;
+        void* memory = nullptr;     ///< One allocation holding all three rings
+        Ring<RawSample> raw;
+        Ring<Bucket> seconds;
+        Ring<Bucket> minutes;
+        Accumulator second;
+        Accumulator minute;
+    };
+
+    static constexpr size_t kSeriesBytes = kRawCapacity * sizeof(RawSample) +
+        (kSecondCapacity + kMinuteCapacity) * sizeof(Bucket);
+
+    std::mutex mutex_;
+    std::map<std::string, Series, std::less<>> series_;
+    size_t memory_used_ = 0;
+    bool budget_warned_ = false;
+
+    Series* CreateSeries(std::string_view id, const char* unit);
+    void CloseSecond(Series& series);
+};
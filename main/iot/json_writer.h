@@ -0,0 +1,91 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <string>
+#include <string_view>
+#include <cstdio>
+#include <cmath>
+
+namespace iot {
+
+/**
+ * Appends JSON to a caller owned std::string. Callers keep the string between calls, so once it has
+ * grown to the largest document no further allocation happens. Commas are inserted automatically
+ * and strings are escaped.
+ */
+class JsonWriter {
+public:
+    explicit JsonWriter(std::string& out) : out_(out) {}
+
+    void BeginObject() { Separator(); out_ += '{'; first_ = true; }
+    void EndObject() { out_ += '}'; first_ = false; }
+    void BeginArray() { Separator(); out_ += '['; first_ = true; }
+    void EndArray() { out_ += ']'; first_ = false; }
+
+    void Key(std::string_view key) {
+        Separator();
+        AppendString(key);
+        out_ += ':';
+        first_ = true;
+    }
+
+    void String(std::string_view value) { Separator(); AppendString(value); }
+    void Bool(bool value) { Separator(); out_ += value ? "true" : "false"; }
+    void Null() { Separator(); out_ += "null"; }
+
+    void Number(int value) {
+        Separator();
+        char number[12];
+        int length = snprintf(number, sizeof(number), "%d", value);
+        out_.append(number, length);
+    }
+
+    // NaN and infinity have no JSON representation and are written as null
+    void Number(double value) {
+        if (!std::isfinite(value)) {
+            Null();
+            return;
+        }
+        Separator();
+        char number[24];
+        int length = snprintf(number, sizeof(number), "%.7g", value);
+        out_.append(number, length);
+    }
+
+    // An already serialized value
+    void Raw(std::string_view json) { Separator(); out_ += json; }
+
+private:
+    std::string& out_;
+    bool first_ = true;
+
+    void Separator() {
+        if (!first_) {
+            out_ += ',';
+        }
+        first_ = false;
+    }
+
+    void AppendString(std::string_view value) {
+        out_ += '"';
+        for (char c : value) {
+            if (c == '"' || c == '\\') {
+                out_ += '\\';
+                out_ += c;
+            } else if (c == '\n') {
+                out_ += "\\n";
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                char escaped[7];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                out_ += escaped;
+            } else {
+                out_ += c;
+            }
+        }
+        out_ += '"';
+    }
+};
+
+} // namespace iot
+
+#endif // JSON_WRITER_H
@@ -2,6 +2,7 @@
 #include "application.h"
 
 #include <esp_log.h>
+#include <cmath>
 
 #define TAG "Thing"
 
@@ -67,21 +68,51 @@ const char* Thing::GetName() const {
 }
 
 std::string Thing::GetDescriptorJson() {
-    std::string json_str = "{";
-    json_str += "\"name\":\"" + name_ + "\",";
-    json_str += "\"description\":\"" + description_ + "\",";
-    json_str += "\"properties\":" + properties_.GetDescriptorJson() + ",";
-    json_str += "\"methods\":" + methods_.GetDescriptorJson();
-    json_str += "}";
-    return json_str;
+    if (descriptor_json_.empty()) {
+        JsonWriter writer(descriptor_json_);
+        writer.BeginObject();
+        writer.Key("name");
+        writer.String(name_);
+        writer.Key("description");
+        writer.String(description_);
+        writer.Key("properties");
+        properties_.WriteDescriptor(writer);
+        writer.Key("methods");
+        methods_.WriteDescriptor(writer);
+        writer.EndObject();
+    }
+    return descriptor_json_;
 }
 
 std::string Thing::GetStateJson() {
-    std::string json_str = "{";
-    json_str += "\"name\":\"" + name_ + "\",";
-    json_str += "\"state\":" + properties_.GetStateJson();
-    json_str += "}";
-    return json_str;
+    std::string json;
+    JsonWriter writer(json);
+    writer.BeginObject();
+    writer.Key("name");
+    writer.String(name_);
+    writer.Key("state");
+    properties_.WriteState(writer);
+    writer.EndObject();
+    return json;
+}
+
+bool Thing::WriteStateJson(JsonWriter& writer, bool full) {
+    auto begin = [this, &writer]() {
+        writer.BeginObject();
+        writer.Key("name");
+        writer.String(name_);
+        writer.Key("state");
+        writer.BeginObject();
+    };
+    if (!properties_.WriteChangedState(writer, full, begin)) {
+        if (!full) {
+            return false;
+        }
+        begin();
+    }
+    writer.EndObject();
+    writer.EndObject();
+    return true;
 }
 
 void Thing::Invoke(const cJSON* command) {
@@ -122,28 +153,40 @@ void Thing::Invoke(const cJSON* command) {
 
 // Get a value by property name
 float Thing::GetValue(const std::string& property_name) const {
-    auto it = property_values_.find(property_name);
-    if (it != property_values_.end()) {
-        return it->second;
+    float value;
+    if (FindValue(property_name, value)) {
+        return value;
     }
     
     // If not found in values map, try to get from properties
-    try {
-        return properties_[property_name].value();
-    } catch (const std::runtime_error& e) {
+    auto property = properties_.Find(property_name);
+    if (property == nullptr) {
         ESP_LOGW(TAG, "Property not found: %s", property_name.c_str());
         return 0.0f;
     }
+    return property->value();
 }
 
-// Get all values as a map
-std::map<std::string, float> Thing::GetValues() const {
-    return property_values_;
+bool Thing::FindValue(const std::string& property_name, float& value) const {
+    auto it = property_values_.find(property_name);
+    if (it == property_values_.end()) {
+        return false;
+    }
+    value = it->second;
+    return true;
 }
 
 // Set value implementations
 bool Thing::SetValue(const std::string& property_name, float value) {
-    property_values_[property_name] = value;
+    auto it = property_values_.find(property_name);
+    if (it == property_values_.end()) {
+        property_values_.emplace(property_name, value);
+    } else if (it->second == value || (std::isnan(it->second) && std::isnan(value))) {
+        return true;
+    } else {
+        it->second = value;
+    }
+    values_version_.Increment();
     return true;
 }
 
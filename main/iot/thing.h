@@ -6,8 +6,12 @@
 #include <functional>
 #include <vector>
 #include <stdexcept>
+#include <atomic>
+#include <cstdint>
+#include <unordered_map>
 #include <cJSON.h>
 #include "../components.h"
+#include "json_writer.h"
 
 namespace iot {
 
@@ -17,6 +21,32 @@ enum ValueType {
     kValueTypeString
 };
 
+inline const char* ValueTypeName(ValueType type) {
+    switch (type) {
+        case kValueTypeBoolean: return "boolean";
+        case kValueTypeNumber: return "number";
+        case kValueTypeString: return "string";
+    }
+    return "null";
+}
+
+// Copyable atomic counter so Property can stay in a std::vector, bumped from any task
+class ChangeCounter {
+public:
+    ChangeCounter() = default;
+    ChangeCounter(const ChangeCounter& other) : value_(other.value_.load(std::memory_order_relaxed)) {}
+    ChangeCounter& operator=(const ChangeCounter& other) {
+        value_.store(other.value_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        return *this;
+    }
+
+    void Increment() { value_.fetch_add(1, std::memory_order_release); }
+    uint32_t Load() const { return value_.load(std::memory_order_acquire); }
+
+private:
+    std::atomic<uint32_t> value_{0};
+};
+
 class Property {
 private:
     std::string name_;
@@ -26,6 +56,16 @@ private:
     std::function<int()> number_getter_;
     std::function<std::string()> string_getter_;
 
+    // Change tracking for delta state reports. By default the getter is polled and the typed value
+    // compared with the last reported one. Tracked properties are only read again after MarkChanged()
+    bool change_tracked_ = false;
+    ChangeCounter version_;
+    uint32_t reported_version_ = 0;
+    bool reported_ = false;
+    bool reported_boolean_ = false;
+    int reported_number_ = 0;
+    std::string reported_string_;
+
 public:
     Property(const std::string& name, const std::string& description, std::function<bool()> getter) :
         name_(name), description_(description), type_(kValueTypeBoolean), boolean_getter_(getter) {}
@@ -49,83 +89,179 @@ public:
         return 0.0f;
     }
 
-    std::string GetDescriptorJson() {
-        std::string json_str = "{";
-        json_str += "\"description\":\"" + description_ + "\",";
+    void WriteDescriptor(JsonWriter& writer) const {
+        writer.BeginObject();
+        writer.Key("description");
+        writer.String(description_);
+        writer.Key("type");
+        writer.String(ValueTypeName(type_));
+        writer.EndObject();
+    }
+
+    // Current value from the getter
+    void WriteValue(JsonWriter& writer) const {
+        if (type_ == kValueTypeBoolean) {
+            writer.Bool(boolean_getter_());
+        } else if (type_ == kValueTypeNumber) {
+            writer.Number(number_getter_());
+        } else if (type_ == kValueTypeString) {
+            writer.String(string_getter_());
+        } else {
+            writer.Null();
+        }
+    }
+
+    // For getters that are expensive, the Thing then has to call MarkChanged() on every change
+    void set_change_tracked(bool tracked) { change_tracked_ = tracked; }
+    void MarkChanged() { version_.Increment(); }
+
+    // Reads the value and keeps it as the reported one. Returns true if it differs from the previous
+    // report (always if `force`). Boolean and number properties allocate nothing
+    bool UpdateReported(bool force) {
+        uint32_t version = version_.Load();
+        if (change_tracked_ && reported_ && !force && version == reported_version_) {
+            return false;
+        }
+        bool changed = force || !reported_;
+        reported_version_ = version;
+        reported_ = true;
         if (type_ == kValueTypeBoolean) {
-            json_str += "\"type\":\"boolean\"";
+            bool value = boolean_getter_();
+            changed = changed || value != reported_boolean_;
+            reported_boolean_ = value;
         } else if (type_ == kValueTypeNumber) {
-            json_str += "\"type\":\"number\"";
+            int value = number_getter_();
+            changed = changed || value != reported_number_;
+            reported_number_ = value;
         } else if (type_ == kValueTypeString) {
-            json_str += "\"type\":\"string\"";
+            std::string value = string_getter_();
+            changed = changed || value != reported_string_;
+            reported_string_ = std::move(value);
         }
-        json_str += "}";
-        return json_str;
+        return changed;
     }
 
-    std::string GetStateJson() {
+    // "name":value of the last UpdateReported()
+    void WriteReported(JsonWriter& writer) const {
+        writer.Key(name_);
         if (type_ == kValueTypeBoolean) {
-            return boolean_getter_() ? "true" : "false";
+            writer.Bool(reported_boolean_);
         } else if (type_ == kValueTypeNumber) {
-            return std::to_string(number_getter_());
+            writer.Number(reported_number_);
         } else if (type_ == kValueTypeString) {
-            return "\"" + string_getter_() + "\"";
+            writer.String(reported_string_);
+        } else {
+            writer.Null();
         }
-        return "null";
     }
 };
 
+// Index of a property in its PropertyList, stays valid because properties are never removed
+using PropertyHandle = size_t;
+
 class PropertyList {
 private:
     std::vector<Property> properties_;
+    std::unordered_map<std::string, PropertyHandle> index_;
+
+    PropertyHandle Add(Property&& property) {
+        PropertyHandle handle = properties_.size();
+        index_.emplace(property.name(), handle);
+        properties_.push_back(std::move(property));
+        return handle;
+    }
 
 public:
     PropertyList() = default;
-    PropertyList(const std::vector<Property>& properties) : properties_(properties) {}
+    PropertyList(const std::vector<Property>& properties) {
+        for (auto& property : properties) {
+            Add(Property(property));
+        }
+    }
 
-    void AddBooleanProperty(const std::string& name, const std::string& description, std::function<bool()> getter) {
-        properties_.push_back(Property(name, description, getter));
+    PropertyHandle AddBooleanProperty(const std::string& name, const std::string& description, std::function<bool()> getter) {
+        return Add(Property(name, description, getter));
     }
-    void AddNumberProperty(const std::string& name, const std::string& description, std::function<int()> getter) {
-        properties_.push_back(Property(name, description, getter));
+    PropertyHandle AddNumberProperty(const std::string& name, const std::string& description, std::function<int()> getter) {
+        return Add(Property(name, description, getter));
     }
-    void AddStringProperty(const std::string& name, const std::string& description, std::function<std::string()> getter) {
-        properties_.push_back(Property(name, description, getter));
+    PropertyHandle AddStringProperty(const std::string& name, const std::string& description, std::function<std::string()> getter) {
+        return Add(Property(name, description, getter));
+    }
+
+    // nullptr if there is no such property
+    const Property* Find(const std::string& name) const {
+        auto it = index_.find(name);
+        return it != index_.end() ? &properties_[it->second] : nullptr;
+    }
+    Property* Find(const std::string& name) {
+        auto it = index_.find(name);
+        return it != index_.end() ? &properties_[it->second] : nullptr;
     }
 
     const Property& operator[](const std::string& name) const {
-        for (auto& property : properties_) {
-            if (property.name() == name) {
-                return property;
-            }
+        auto property = Find(name);
+        if (property == nullptr) {
+            throw std::runtime_error("Property not found: " + name);
         }
-        throw std::runtime_error("Property not found: " + name);
+        return *property;
     }
+    Property& operator[](const std::string& name) {
+        auto property = Find(name);
+        if (property == nullptr) {
+            throw std::runtime_error("Property not found: " + name);
+        }
+        return *property;
+    }
+
+    // Handle of a property added earlier, false if there is none
+    bool FindHandle(const std::string& name, PropertyHandle& handle) const {
+        auto it = index_.find(name);
+        if (it == index_.end()) {
+            return false;
+        }
+        handle = it->second;
+        return true;
+    }
+
+    const Property& operator[](PropertyHandle handle) const { return properties_[handle]; }
+    Property& operator[](PropertyHandle handle) { return properties_[handle]; }
 
     const std::vector<Property>& properties() const { return properties_; }
 
-    std::string GetDescriptorJson() {
-        std::string json_str = "{";
+    // Writes "name":value for every property that changed since the last report, all of them if `full`.
+    // `begin` runs before the first one, so nothing is written at all when nothing changed
+    template <typename Begin>
+    bool WriteChangedState(JsonWriter& writer, bool full, Begin&& begin) {
+        bool written = false;
         for (auto& property : properties_) {
-            json_str += "\"" + property.name() + "\":" + property.GetDescriptorJson() + ",";
-        }
-        if (json_str.back() == ',') {
-            json_str.pop_back();
+            if (property.UpdateReported(full)) {
+                if (!written) {
+                    begin();
+                    written = true;
+                }
+                property.WriteReported(writer);
+            }
         }
-        json_str += "}";
-        return json_str;
+        return written;
     }
 
-    std::string GetStateJson() {
-        std::string json_str = "{";
+    void WriteDescriptor(JsonWriter& writer) const {
+        writer.BeginObject();
         for (auto& property : properties_) {
-            json_str += "\"" + property.name() + "\":" + property.GetStateJson() + ",";
+            writer.Key(property.name());
+            property.WriteDescriptor(writer);
         }
-        if (json_str.back() == ',') {
-            json_str.pop_back();
+        writer.EndObject();
+    }
+
+    void WriteState(JsonWriter& writer) const {
+        writer.BeginObject();
+        for (auto& property : properties_) {
+            writer.Key(property.name());
+            property.WriteValue(writer);
         }
-        json_str += "}";
-        return json_str;
+        writer.EndObject();
     }
 };
 
@@ -156,18 +292,13 @@ public:
     void set_number(int value) { number_ = value; }
     void set_string(const std::string& value) { string_ = value; }
 
-    std::string GetDescriptorJson() {
-        std::string json_str = "{";
-        json_str += "\"description\":\"" + description_ + "\",";
-        if (type_ == kValueTypeBoolean) {
-            json_str += "\"type\":\"boolean\"";
-        } else if (type_ == kValueTypeNumber) {
-            json_str += "\"type\":\"number\"";
-        } else if (type_ == kValueTypeString) {
-            json_str += "\"type\":\"string\"";
-        }
-        json_str += "}";
-        return json_str;
+    void WriteDescriptor(JsonWriter& writer) const {
+        writer.BeginObject();
+        writer.Key("description");
+        writer.String(description_);
+        writer.Key("type");
+        writer.String(ValueTypeName(type_));
+        writer.EndObject();
     }
 };
 
@@ -182,29 +313,35 @@ public:
         parameters_.push_back(parameter);
     }
 
-    const Parameter& operator[](const std::string& name) const {
+    // Methods have a handful of parameters, a scan beats hashing here. nullptr if not found
+    const Parameter* Find(const std::string& name) const {
         for (auto& parameter : parameters_) {
             if (parameter.name() == name) {
-                return parameter;
+                return &parameter;
             }
         }
-        throw std::runtime_error("Parameter not found: " + name);
+        return nullptr;
+    }
+
+    const Parameter& operator[](const std::string& name) const {
+        auto parameter = Find(name);
+        if (parameter == nullptr) {
+            throw std::runtime_error("Parameter not found: " + name);
+        }
+        return *parameter;
     }
 
     // iterator
     auto begin() { return parameters_.begin(); }
     auto end() { return parameters_.end(); }
 
-    std::string GetDescriptorJson() {
-        std::string json_str = "{";
+    void WriteDescriptor(JsonWriter& writer) const {
+        writer.BeginObject();
         for (auto& parameter : parameters_) {
-            json_str += "\"" + parameter.name() + "\":" + parameter.GetDescriptorJson() + ",";
-        }
-        if (json_str.back() == ',') {
-            json_str.pop_back();
+            writer.Key(parameter.name());
+            parameter.WriteDescriptor(writer);
         }
-        json_str += "}";
-        return json_str;
+        writer.EndObject();
     }
 };
 
@@ -223,12 +360,13 @@ public:
     const std::string& description() const { return description_; }
     ParameterList& parameters() { return parameters_; }
 
-    std::string GetDescriptorJson() {
-        std::string json_str = "{";
-        json_str += "\"description\":\"" + description_ + "\",";
-        json_str += "\"parameters\":" + parameters_.GetDescriptorJson();
-        json_str += "}";
-        return json_str;
+    void WriteDescriptor(JsonWriter& writer) const {
+        writer.BeginObject();
+        writer.Key("description");
+        writer.String(description_);
+        writer.Key("parameters");
+        parameters_.WriteDescriptor(writer);
+        writer.EndObject();
     }
 
     void Invoke() {
@@ -239,34 +377,43 @@ public:
 class MethodList {
 private:
     std::vector<Method> methods_;
+    std::unordered_map<std::string, size_t> index_;
 
 public:
     MethodList() = default;
-    MethodList(const std::vector<Method>& methods) : methods_(methods) {}
+    MethodList(const std::vector<Method>& methods) {
+        for (auto& method : methods) {
+            index_.emplace(method.name(), methods_.size());
+            methods_.push_back(method);
+        }
+    }
 
     void AddMethod(const std::string& name, const std::string& description, const ParameterList& parameters, std::function<void(const ParameterList&)> callback) {
+        index_.emplace(name, methods_.size());
         methods_.push_back(Method(name, description, parameters, callback));
     }
 
+    // nullptr if there is no such method
+    Method* Find(const std::string& name) {
+        auto it = index_.find(name);
+        return it != index_.end() ? &methods_[it->second] : nullptr;
+    }
+
     Method& operator[](const std::string& name) {
-        for (auto& method : methods_) {
-            if (method.name() == name) {
-                return method;
-            }
+        auto method = Find(name);
+        if (method == nullptr) {
+            throw std::runtime_error("Method not found: " + name);
         }
-        throw std::runtime_error("Method not found: " + name);
+        return *method;
     }
 
-    std::string GetDescriptorJson() {
-        std::string json_str = "{";
+    void WriteDescriptor(JsonWriter& writer) const {
+        writer.BeginObject();
         for (auto& method : methods_) {
-            json_str += "\"" + method.name() + "\":" + method.GetDescriptorJson() + ",";
+            writer.Key(method.name());
+            method.WriteDescriptor(writer);
         }
-        if (json_str.back() == ',') {
-            json_str.pop_back();
-        }
-        json_str += "}";
-        return json_str;
+        writer.EndObject();
     }
 };
 
@@ -283,15 +430,23 @@ public:
     virtual const char* GetName() const override;
     ComponentType GetType() const override { return COMPONENT_TYPE_IOT; }
 
+    // Built on the first call and cached, properties and methods are all added in the constructor
     virtual std::string GetDescriptorJson();
     virtual std::string GetStateJson();
+    // Writes {"name":..,"state":{..}} holding the properties changed since the last call, all of them
+    // if `full`. Writes nothing and returns false if nothing changed
+    virtual bool WriteStateJson(JsonWriter& writer, bool full);
     virtual void Invoke(const cJSON* command);
 
     // Get a value by property name
     float GetValue(const std::string& property_name) const;
+    // Value stored with SetValue(), false if there is none. Does not log
+    bool FindValue(const std::string& property_name, float& value) const;
     
     // Get all values as a map
-    std::map<std::string, float> GetValues() const;
+    const std::map<std::string, float>& GetValues() const { return property_values_; }
+    // Bumped whenever SetValue() changes a value, readers skip the Thing while it stays the same
+    uint32_t values_version() const { return values_version_.Load(); }
     
     // Set a value by property name
     virtual bool SetValue(const std::string& property_name, float value);
@@ -311,6 +466,10 @@ protected:
     
     // Property values storage
     std::map<std::string, float> property_values_;
+    ChangeCounter values_version_;
+
+private:
+    std::string descriptor_json_;
 };
 
 void RegisterThing(const std::string& type, std::function<Thing*()> creator);
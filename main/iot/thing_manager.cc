@@ -8,55 +8,39 @@ namespace iot {
 
 void ThingManager::AddThing(Thing* thing) {
     things_.push_back(thing);
+    thing_index_.emplace(thing->name(), thing);
+    descriptors_json_.clear();
 }
 
-// 添加FindThingByName实现
 Thing* ThingManager::FindThingByName(const std::string& name) {
-    for (auto& thing : things_) {
-        if (thing->name() == name) {
-            return thing;
-        }
-    }
-    return nullptr;
+    auto it = thing_index_.find(name);
+    return it != thing_index_.end() ? it->second : nullptr;
 }
 
 std::string ThingManager::GetDescriptorsJson() {
-    std::string json_str = "[";
-    for (auto& thing : things_) {
-        json_str += thing->GetDescriptorJson() + ",";
-    }
-    if (json_str.back() == ',') {
-        json_str.pop_back();
+    if (descriptors_json_.empty()) {
+        JsonWriter writer(descriptors_json_);
+        writer.BeginArray();
+        for (auto& thing : things_) {
+            writer.Raw(thing->GetDescriptorJson());
+        }
+        writer.EndArray();
     }
-    json_str += "]";
-    return json_str;
+    return descriptors_json_;
 }
 
 bool ThingManager::GetStatesJson(std::string& json, bool delta) {
-    if (!delta) {
-        last_states_.clear();
-    }
     bool changed = false;
-    json = "[";
-    // 枚举thing，获取每个thing的state，如果发生变化，则更新，保存到last_states_
-    // 如果delta为true，则只返回变化的部分
+    json.clear();
+    JsonWriter writer(json);
+    writer.BeginArray();
+    // 每个属性记录上次上报的值，delta为true时只返回变化的属性，没有变化时不会构造JSON也不分配内存
     for (auto& thing : things_) {
-        std::string state = thing->GetStateJson();
-        if (delta) {
-            // 如果delta为true，则只返回变化的部分
-            auto it = last_states_.find(thing->name());
-            if (it != last_states_.end() && it->second == state) {
-                continue;
-            }
-            changed = true;
-            last_states_[thing->name()] = state;
+        if (thing->WriteStateJson(writer, !delta)) {
+            changed = changed || delta;
         }
-        json += state + ",";
     }
-    if (json.back() == ',') {
-        json.pop_back();
-    }
-    json += "]";
+    writer.EndArray();
     return changed;
 }
 
@@ -91,19 +75,17 @@ void ThingManager::Invoke(const cJSON* command) {
     }
     
     // 正常通过 name 查找 thing
-    for (auto& thing : things_) {
-        if (thing->name() == name->valuestring) {
-            try {
-                thing->Invoke(command);
-            } catch (const std::exception& e) {
-                ESP_LOGE(TAG, "Error invoking command on thing %s: %s", 
-                         thing->name().c_str(), e.what());
-            }
-            return;
-        }
+    auto thing = FindThingByName(name->valuestring);
+    if (thing == nullptr) {
+        ESP_LOGW(TAG, "Thing with name '%s' not found", name->valuestring);
+        return;
+    }
+    try {
+        thing->Invoke(command);
+    } catch (const std::exception& e) {
+        ESP_LOGE(TAG, "Error invoking command on thing %s: %s",
+                 thing->name().c_str(), e.what());
     }
-    
-    ESP_LOGW(TAG, "Thing with name '%s' not found", name->valuestring);
 }
 
 } // namespace iot
@@ -10,6 +10,7 @@
 #include <memory>
 #include <functional>
 #include <map>
+#include <unordered_map>
 
 namespace iot {
 
@@ -24,7 +25,7 @@ public:
 
     void AddThing(Thing* thing);
 
-    // 根据名称查找Thing
+    // 根据名称查找Thing，不存在时返回nullptr
     Thing* FindThingByName(const std::string& name);
 
     // 获取所有注册的Things
@@ -44,7 +45,8 @@ private:
     ~ThingManager() = default;
 
     std::vector<Thing*> things_;
-    std::map<std::string, std::string> last_states_;
+    std::unordered_map<std::string, Thing*> thing_index_;   // First Thing registered under each name
+    std::string descriptors_json_;                          // Cleared when a Thing is added
 };
 
 
@@ -1,8 +1,13 @@
 #include <memory>
 #include <cstring>
 #include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
 
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "driver/i2c_master.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -11,6 +16,12 @@
 #include "../boards/common/board.h"
 #include "../thing.h"
 #include "../thing_manager.h"
+#include "../json_writer.h"
+#include "imu.h"
+#include "imu_fusion.h"
+#include "imu_calibration.h"
+#include "hardware/sensor_history.h"
+#include "settings.h"
 
 static constexpr char TAG[] = "IMU";
 
@@ -24,11 +35,31 @@ static constexpr char TAG[] = "IMU";
 #define MPU6050_CONFIG 0x1A
 #define MPU6050_GYRO_CONFIG 0x1B
 #define MPU6050_ACCEL_CONFIG 0x1C
+#define MPU6050_SMPLRT_DIV 0x19
+#define MPU6050_FIFO_EN 0x23
 #define MPU6050_INT_ENABLE 0x38
 #define MPU6050_ACCEL_XOUT_H 0x3B
 #define MPU6050_GYRO_XOUT_H 0x43
+#define MPU6050_USER_CTRL 0x6A
+#define MPU6050_FIFO_COUNT_H 0x72
+#define MPU6050_FIFO_R_W 0x74
 #define MPU6050_WHO_AM_I 0x75
 
+// MPU6050 FIFO: accelerometer and gyroscope, 12 bytes per sample
+#define MPU6050_FIFO_EN_ACCEL_GYRO 0x78
+#define MPU6050_USER_CTRL_FIFO_EN 0x40
+#define MPU6050_USER_CTRL_FIFO_RESET 0x04
+#define MPU6050_FIFO_SAMPLE_SIZE 12
+#define MPU6050_FIFO_SIZE 1024
+#define MPU6050_SAMPLE_RATE_HZ 200    // 1 kHz gyro output rate with the DLPF on, divided by 1 + SMPLRT_DIV
+
+// Samples per fusion step, more than one on targets without an FPU
+#ifdef CONFIG_IMU_FUSION_DECIMATION
+#define IMU_FUSION_DECIMATION CONFIG_IMU_FUSION_DECIMATION
+#else
+#define IMU_FUSION_DECIMATION 1
+#endif
+
 // QMC5883L register addresses
 #define QMC5883L_REG_CONFIG_1 0x09
 #define QMC5883L_REG_CONFIG_2 0x0A
@@ -52,14 +83,23 @@ static constexpr char TAG[] = "IMU";
 #define QMC5883L_OSR_64 0xC0    // Oversampling ratio 64
 
 // I2C configuration
-#define I2C_MASTER_FREQ_HZ 100000     // 100KHz
+#define I2C_MASTER_FREQ_HZ 400000     // 400KHz fast mode, supported by all three GY-87 sensors
 #define I2C_TIMEOUT_MS 1000           // 1 second
 
 // Data update intervals
-#define IMU_UPDATE_INTERVAL_MS 100    // Update IMU data every 100ms
+#define IMU_UPDATE_INTERVAL_MS 20     // Drain the MPU6050 FIFO every 20ms (4 samples at 200Hz)
+#define IMU_POLL_INTERVAL_MS 10       // Poll the data registers every 10ms without the FIFO (every other sample)
+#define IMU_STATS_INTERVAL_MS 10000   // Log sample rate and I2C time every 10s
 #define MAG_UPDATE_INTERVAL_MS 500    // Update magnetometer data every 500ms
 #define BARO_UPDATE_INTERVAL_MS 1000  // Update barometer data every 1000ms
 
+// Calibration
+#define CALIBRATION_GYRO_DEFAULT_S 3          // Held still
+#define CALIBRATION_ELLIPSOID_DEFAULT_S 30    // Rotated through all orientations
+#define CALIBRATION_MAX_S 120
+#define CALIBRATION_GYRO_MAX_STDDEV 1.0f      // deg/s, more means the device moved
+#define CALIBRATION_ACCEL_MAX_RATE 10.0f      // deg/s, faster samples are not static enough for the accelerometer fit
+
 // Define I2C configuration pins if not present in board config
 #ifndef CONFIG_I2C_PORT
 #define CONFIG_I2C_PORT ((i2c_port_t)0)
@@ -100,6 +140,20 @@ struct SensorData {
     
     // Altitude in meters (derived from pressure)
     float altitude;
+    
+    // Orientation from ImuFusion: body to earth quaternion and Euler angles in degrees
+    float quat_w;
+    float quat_x;
+    float quat_y;
+    float quat_z;
+    float roll;
+    float pitch;
+    float yaw;
+    
+    // Acceleration without gravity in g, body frame
+    float linear_accel_x;
+    float linear_accel_y;
+    float linear_accel_z;
 };
 
 class IMU : public Thing {
@@ -133,6 +187,46 @@ public:
             [this]() { return static_cast<int>(sensor_data_.pressure * 10); });
         properties_.AddNumberProperty("altitude", "Altitude (m)", 
             [this]() { return static_cast<int>(sensor_data_.altitude * 10); });
+        
+        properties_.AddNumberProperty("roll", "Roll angle (0.1°)", 
+            [this]() { return static_cast<int>(sensor_data_.roll * 10); });
+        properties_.AddNumberProperty("pitch", "Pitch angle (0.1°)", 
+            [this]() { return static_cast<int>(sensor_data_.pitch * 10); });
+        properties_.AddNumberProperty("yaw", "Yaw angle (0.1°), relative to the start unless the magnetometer is fused", 
+            [this]() { return static_cast<int>(sensor_data_.yaw * 10); });
+        properties_.AddNumberProperty("quat_w", "Orientation quaternion W (x10000)", 
+            [this]() { return static_cast<int>(sensor_data_.quat_w * 10000); });
+        properties_.AddNumberProperty("quat_x", "Orientation quaternion X (x10000)", 
+            [this]() { return static_cast<int>(sensor_data_.quat_x * 10000); });
+        properties_.AddNumberProperty("quat_y", "Orientation quaternion Y (x10000)", 
+            [this]() { return static_cast<int>(sensor_data_.quat_y * 10000); });
+        properties_.AddNumberProperty("quat_z", "Orientation quaternion Z (x10000)", 
+            [this]() { return static_cast<int>(sensor_data_.quat_z * 10000); });
+        properties_.AddNumberProperty("linear_accel_x", "Acceleration without gravity X-axis (mg)", 
+            [this]() { return static_cast<int>(sensor_data_.linear_accel_x * 1000); });
+        properties_.AddNumberProperty("linear_accel_y", "Acceleration without gravity Y-axis (mg)", 
+            [this]() { return static_cast<int>(sensor_data_.linear_accel_y * 1000); });
+        properties_.AddNumberProperty("linear_accel_z", "Acceleration without gravity Z-axis (mg)", 
+            [this]() { return static_cast<int>(sensor_data_.linear_accel_z * 1000); });
+        
+        stats_properties_[0] = properties_.AddNumberProperty("sample_rate", "Accelerometer / gyroscope samples per second", 
+            [this]() { return sample_rate_hz_; });
+        stats_properties_[1] = properties_.AddNumberProperty("i2c_us_per_sample", "I2C bus time per sample (us)", 
+            [this]() { return i2c_us_per_sample_; });
+        calibration_property_ = properties_.AddStringProperty("calibration", "Calibration state: idle, collecting, done or failed", 
+            [this]() {
+                std::lock_guard<std::mutex> lock(calibration_mutex_);
+                return std::string(calibration_state_);
+            });
+        
+        // Every property is marked where the update task (or a calibration call) writes it, so a state
+        // report skips the getters, the string copy under calibration_mutex_ included, until then
+        for (size_t i = 0; i < std::size(kPublishedValues); i++) {
+            properties_.FindHandle(kPublishedValues[i], published_properties_[i]);
+        }
+        for (PropertyHandle handle = 0; handle < properties_.properties().size(); handle++) {
+            properties_[handle].set_change_tracked(true);
+        }
             
         // Add a configuration method
         ParameterList configParams;
@@ -167,6 +261,42 @@ public:
                     ESP_LOGE(TAG, "Error in configure method: %s", e.what());
                 }
             });
+        
+        ParameterList fusionParams;
+        fusionParams.AddParameter(Parameter("use_magnetometer",
+            "Correct the yaw with the magnetometer, needs its axes aligned with the MPU6050", kValueTypeBoolean));
+        methods_.AddMethod("configure_fusion", "Configure the orientation fusion", fusionParams,
+            [this](const ParameterList& params) {
+                // The filter belongs to the update task, it restarts there on the next pass
+                fusion_use_magnetometer_ = params["use_magnetometer"].boolean();
+                fusion_reset_pending_ = true;
+            });
+        
+        ParameterList calibrateParams;
+        calibrateParams.AddParameter(Parameter("sensor",
+            "gyro (keep the device still), accel or mag (rotate it slowly through all orientations)", kValueTypeString));
+        calibrateParams.AddParameter(Parameter("duration", "Seconds to collect samples, 0 for the default", kValueTypeNumber, false));
+        methods_.AddMethod("calibrate", "Calibrate a sensor of the IMU and store the result", calibrateParams,
+            [this](const ParameterList& params) {
+                int duration_s = params["duration"].type() == kValueTypeNumber ? params["duration"].number() : 0;
+                std::string error;
+                if (!StartCalibration(params["sensor"].string(), duration_s, error)) {
+                    ESP_LOGE(TAG, "Calibration not started: %s", error.c_str());
+                }
+            });
+        
+        ParameterList resetParams;
+        resetParams.AddParameter(Parameter("sensor", "gyro, accel, mag or all", kValueTypeString));
+        methods_.AddMethod("reset_calibration", "Drop the stored calibration of a sensor", resetParams,
+            [this](const ParameterList& params) {
+                ResetCalibration(params["sensor"].string());
+            });
+        
+        // Float copies of the readings for clients that read GetValues(), such as the web sensor stream.
+        // All keys exist from the start so later updates never modify the map structure
+        for (const char* key : kPublishedValues) {
+            SetValue(key, 0.0f);
+        }
     }
 
     ~IMU() {
@@ -210,39 +340,35 @@ public:
             return;
         }
         
-        // 新I2C驱动：配置设备（默认用MPU6050地址，后续可动态切换）
-        i2c_device_config_t dev_cfg = {
-            .dev_addr_length = I2C_ADDR_BIT_LEN_7,
-            .device_address = MPU6050_ADDR,
-            .scl_speed_hz = I2C_MASTER_FREQ_HZ,
-        };
-        ret = i2c_master_bus_add_device(bus_handle_, &dev_cfg, &dev_handle_);
-        if (ret != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to add I2C device: %s", esp_err_to_name(ret));
-            i2c_del_master_bus(bus_handle_);
-            bus_handle_ = NULL;
-            return;
+        // 新I2C驱动：每个传感器一个常驻设备句柄，读写时不再反复增删设备
+        const uint8_t addresses[] = {MPU6050_ADDR, QMC5883L_ADDR, BMP180_ADDR};
+        i2c_master_dev_handle_t* handles[] = {&mpu6050_dev_, &qmc5883l_dev_, &bmp180_dev_};
+        for (int i = 0; i < 3; i++) {
+            i2c_device_config_t dev_cfg = {
+                .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+                .device_address = addresses[i],
+                .scl_speed_hz = I2C_MASTER_FREQ_HZ,
+            };
+            ret = i2c_master_bus_add_device(bus_handle_, &dev_cfg, handles[i]);
+            if (ret != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to add I2C device 0x%02x: %s", addresses[i], esp_err_to_name(ret));
+                RemoveDevices();
+                i2c_del_master_bus(bus_handle_);
+                bus_handle_ = NULL;
+                return;
+            }
         }
         
+        LoadCalibration();
+        
         // Initialize sensors
         mpu6050_initialized_ = InitMPU6050();
         if (mpu6050_initialized_) {
             // Enable access to the QMC5883L through the MPU6050 bypass
             EnableHMC5883LAccess();
-            // 切换设备地址为QMC5883L
-            i2c_master_bus_rm_device(dev_handle_);
-            dev_cfg.device_address = QMC5883L_ADDR;
-            i2c_master_bus_add_device(bus_handle_, &dev_cfg, &dev_handle_);
+            mpu6050_fifo_ = StartMPU6050Fifo();
             qmc5883l_initialized_ = InitQMC5883L();
-            // 切换设备地址为BMP180
-            i2c_master_bus_rm_device(dev_handle_);
-            dev_cfg.device_address = BMP180_ADDR;
-            i2c_master_bus_add_device(bus_handle_, &dev_cfg, &dev_handle_);
             bmp180_initialized_ = InitBMP180();
-            // 恢复为MPU6050
-            i2c_master_bus_rm_device(dev_handle_);
-            dev_cfg.device_address = MPU6050_ADDR;
-            i2c_master_bus_add_device(bus_handle_, &dev_cfg, &dev_handle_);
         }
         memset(&sensor_data_, 0, sizeof(sensor_data_));
         if (mpu6050_initialized_ || qmc5883l_initialized_ || bmp180_initialized_) {
@@ -261,27 +387,121 @@ public:
             vTaskDelete(update_task_);
             update_task_ = nullptr;
         }
-        if (dev_handle_) {
-            i2c_master_bus_rm_device(dev_handle_);
-            dev_handle_ = NULL;
-        }
+        RemoveDevices();
         if (bus_handle_) {
             i2c_del_master_bus(bus_handle_);
             bus_handle_ = NULL;
         }
         initialized_ = false;
     }
+    
+    // Samples are collected by the update task, which also fits and stores the result when the time is up
+    bool StartCalibration(const std::string& sensor, int duration_s, std::string& error) {
+        CalibrationSensor target;
+        if (!ParseCalibrationSensor(sensor, target) || target == CalibrationSensor::kAll) {
+            error = "Unknown sensor, expected gyro, accel or mag";
+            return false;
+        }
+        if (!initialized_ || !mpu6050_initialized_) {
+            error = "IMU is not running";
+            return false;
+        }
+        if (target == CalibrationSensor::kMag && !qmc5883l_initialized_) {
+            error = "Magnetometer is not available";
+            return false;
+        }
+        if (duration_s <= 0) {
+            duration_s = target == CalibrationSensor::kGyro ? CALIBRATION_GYRO_DEFAULT_S : CALIBRATION_ELLIPSOID_DEFAULT_S;
+        }
+        duration_s = std::min(duration_s, CALIBRATION_MAX_S);
+        
+        std::lock_guard<std::mutex> lock(calibration_mutex_);
+        if (calibrating_ != CalibrationSensor::kNone) {
+            error = std::string("Calibration of ") + CalibrationSensorName(calibrating_) + " in progress";
+            return false;
+        }
+        bias_estimator_.Reset();
+        ellipsoid_fit_.Reset();
+        calibration_end_us_ = esp_timer_get_time() + duration_s * 1000000LL;
+        calibration_sensor_ = target;
+        calibration_state_ = "collecting";
+        calibration_message_.clear();
+        calibrating_ = target;
+        properties_[calibration_property_].MarkChanged();
+        ESP_LOGI(TAG, "Calibrating %s for %d s", sensor.c_str(), duration_s);
+        return true;
+    }
+    
+    bool ResetCalibration(const std::string& sensor) {
+        CalibrationSensor target;
+        if (!ParseCalibrationSensor(sensor, target)) {
+            return false;
+        }
+        // Applied by the update task, the only writer of the corrections
+        uint32_t mask = target == CalibrationSensor::kAll ? 0x0E : 1u << static_cast<int>(target);
+        pending_reset_.fetch_or(mask);
+        if (!initialized_) {
+            ApplyPendingReset();
+        }
+        return true;
+    }
+    
+    std::string GetCalibrationJson() {
+        std::lock_guard<std::mutex> lock(calibration_mutex_);
+        std::string json;
+        JsonWriter writer(json);
+        writer.BeginObject();
+        writer.Key("state");
+        writer.String(calibration_state_);
+        writer.Key("sensor");
+        writer.String(CalibrationSensorName(calibration_sensor_));
+        if (calibrating_ != CalibrationSensor::kNone) {
+            writer.Key("remaining_ms");
+            writer.Number((int)std::max<int64_t>(0, (calibration_end_us_ - esp_timer_get_time()) / 1000));
+            writer.Key("samples");
+            writer.Number((int)(calibrating_ == CalibrationSensor::kGyro ? bias_estimator_.count() : ellipsoid_fit_.count()));
+        }
+        writer.Key("message");
+        writer.String(calibration_message_);
+        const std::pair<const char*, const ImuAxisCorrection*> corrections[] = {
+            {"gyro", &published_corrections_[0]}, {"accel", &published_corrections_[1]}, {"mag", &published_corrections_[2]},
+        };
+        for (const auto& correction : corrections) {
+            writer.Key(correction.first);
+            writer.BeginObject();
+            writer.Key("offset");
+            writer.BeginArray();
+            for (float value : correction.second->offset) {
+                writer.Number((double)value);
+            }
+            writer.EndArray();
+            writer.Key("matrix");
+            writer.BeginArray();
+            for (float value : correction.second->matrix) {
+                writer.Number((double)value);
+            }
+            writer.EndArray();
+            writer.EndObject();
+        }
+        writer.EndObject();
+        return json;
+    }
 
 private:
+    enum class CalibrationSensor { kNone, kGyro, kAccel, kMag, kAll };
+
     i2c_port_t i2c_port_ = I2C_NUM_0;
     gpio_num_t sda_pin_ = GPIO_NUM_NC;
     gpio_num_t scl_pin_ = GPIO_NUM_NC;
     TaskHandle_t update_task_ = nullptr;
     bool initialized_ = false;
     i2c_master_bus_handle_t bus_handle_ = NULL;
-    i2c_master_dev_handle_t dev_handle_ = NULL;
+    i2c_master_dev_handle_t mpu6050_dev_ = NULL;
+    i2c_master_dev_handle_t qmc5883l_dev_ = NULL;
+    i2c_master_dev_handle_t bmp180_dev_ = NULL;
     
     bool mpu6050_initialized_ = false;
+    bool mpu6050_fifo_ = false;       // Samples are read from the FIFO, otherwise the data registers are polled
     bool qmc5883l_initialized_ = false;
     bool bmp180_initialized_ = false;
     
@@ -294,6 +514,196 @@ private:
     
     SensorData sensor_data_ = {};
     
+    ImuFusion fusion_;
+    std::atomic<bool> fusion_use_magnetometer_{false};
+    std::atomic<bool> fusion_reset_pending_{false};   // Set by configure_fusion, applied by the update task
+    float fusion_gyro_sum_[3] = {};                   // Gyroscope integrated over the samples of one fusion step
+    float fusion_dt_sum_ = 0.0f;
+    int fusion_samples_ = 0;
+    int64_t last_sample_us_ = 0;      // Only used to get the time step when polling without the FIFO
+    int64_t fusion_time_us_ = 0;
+    
+    static constexpr const char* kPublishedValues[] = {
+        "accel_x", "accel_y", "accel_z", "gyro_x", "gyro_y", "gyro_z",
+        "mag_x", "mag_y", "mag_z", "temperature", "pressure", "altitude",
+        "roll", "pitch", "yaw", "quat_w", "quat_x", "quat_y", "quat_z",
+        "linear_accel_x", "linear_accel_y", "linear_accel_z",
+    };
+    // Index ranges of kPublishedValues by the code that writes them
+    static constexpr size_t kPublishedMotion[] = {0, 6};        // accel, gyro
+    static constexpr size_t kPublishedMag[] = {6, 9};
+    static constexpr size_t kPublishedBaro[] = {9, 12};         // temperature, pressure, altitude
+    static constexpr size_t kPublishedOrientation[] = {12, std::size(kPublishedValues)};
+    PropertyHandle published_properties_[std::size(kPublishedValues)] = {};
+    PropertyHandle stats_properties_[2] = {};
+    PropertyHandle calibration_property_ = 0;
+    
+    void MarkPublishedChanged(const size_t (&range)[2]) {
+        for (size_t i = range[0]; i < range[1]; i++) {
+            properties_[published_properties_[i]].MarkChanged();
+        }
+    }
+    
+    // Applied to every sample, only written by the update task (or before it runs)
+    ImuAxisCorrection gyro_correction_;
+    ImuAxisCorrection accel_correction_;
+    ImuAxisCorrection mag_correction_;
+    
+    // Calibration. The estimators are only touched by the update task while calibrating_ is set,
+    // everything else is guarded by calibration_mutex_
+    std::mutex calibration_mutex_;
+    std::atomic<CalibrationSensor> calibrating_{CalibrationSensor::kNone};
+    std::atomic<uint32_t> pending_reset_{0};        // 1 << CalibrationSensor
+    CalibrationSensor calibration_sensor_ = CalibrationSensor::kNone;
+    int64_t calibration_end_us_ = 0;
+    const char* calibration_state_ = "idle";
+    std::string calibration_message_;
+    ImuAxisCorrection published_corrections_[3];    // gyro, accel, mag for GetCalibrationJson()
+    ImuBiasEstimator bias_estimator_;
+    ImuEllipsoidFit ellipsoid_fit_;
+    
+    // Sample rate and bus time over the last stats interval
+    uint32_t samples_ = 0;
+    int64_t i2c_time_us_ = 0;
+    int sample_rate_hz_ = 0;
+    int i2c_us_per_sample_ = 0;
+    
+    void RemoveDevices() {
+        for (auto* handle : {&mpu6050_dev_, &qmc5883l_dev_, &bmp180_dev_}) {
+            if (*handle) {
+                i2c_master_bus_rm_device(*handle);
+                *handle = NULL;
+            }
+        }
+    }
+    
+    static bool ParseCalibrationSensor(const std::string& name, CalibrationSensor& sensor) {
+        if (name == "gyro") {
+            sensor = CalibrationSensor::kGyro;
+        } else if (name == "accel") {
+            sensor = CalibrationSensor::kAccel;
+        } else if (name == "mag") {
+            sensor = CalibrationSensor::kMag;
+        } else if (name == "all") {
+            sensor = CalibrationSensor::kAll;
+        } else {
+            return false;
+        }
+        return true;
+    }
+    
+    static const char* CalibrationSensorName(CalibrationSensor sensor) {
+        switch (sensor) {
+            case CalibrationSensor::kGyro: return "gyro";
+            case CalibrationSensor::kAccel: return "accel";
+            case CalibrationSensor::kMag: return "mag";
+            case CalibrationSensor::kAll: return "all";
+            default: return "";
+        }
+    }
+    
+    ImuAxisCorrection& Correction(CalibrationSensor sensor) {
+        switch (sensor) {
+            case CalibrationSensor::kGyro: return gyro_correction_;
+            case CalibrationSensor::kAccel: return accel_correction_;
+            default: return mag_correction_;
+        }
+    }
+    
+    void PublishCorrections() {
+        std::lock_guard<std::mutex> lock(calibration_mutex_);
+        published_corrections_[0] = gyro_correction_;
+        published_corrections_[1] = accel_correction_;
+        published_corrections_[2] = mag_correction_;
+    }
+    
+    void LoadCalibration() {
+        Settings settings("imu_cal", false);
+        for (auto sensor : {CalibrationSensor::kGyro, CalibrationSensor::kAccel, CalibrationSensor::kMag}) {
+            std::string text = settings.GetString(CalibrationSensorName(sensor));
+            ImuAxisCorrection correction;
+            if (!text.empty()) {
+                if (correction.Deserialize(text)) {
+                    ESP_LOGI(TAG, "Loaded %s calibration", CalibrationSensorName(sensor));
+                } else {
+                    ESP_LOGW(TAG, "Ignoring invalid %s calibration: %s", CalibrationSensorName(sensor), text.c_str());
+                }
+            }
+            Correction(sensor) = correction;
+        }
+        PublishCorrections();
+    }
+    
+    void ApplyPendingReset() {
+        if (fusion_reset_pending_.exchange(false)) {
+            fusion_.Reset();
+            fusion_samples_ = 0;
+        }
+        uint32_t mask = pending_reset_.exchange(0);
+        if (mask == 0) {
+            return;
+        }
+        Settings settings("imu_cal", true);
+        for (auto sensor : {CalibrationSensor::kGyro, CalibrationSensor::kAccel, CalibrationSensor::kMag}) {
+            if (mask & (1u << static_cast<int>(sensor))) {
+                Correction(sensor) = ImuAxisCorrection();
+                settings.EraseKey(CalibrationSensorName(sensor));
+                ESP_LOGI(TAG, "Reset %s calibration", CalibrationSensorName(sensor));
+            }
+        }
+        PublishCorrections();
+        fusion_.Reset();
+    }
+    
+    // Called by the update task once the collection time is up
+    void FinishCalibration() {
+        CalibrationSensor sensor = calibrating_;
+        ImuAxisCorrection correction;
+        std::string error;
+        char message[96];
+        bool ok = false;
+        
+        if (sensor == CalibrationSensor::kGyro) {
+            float stddev = bias_estimator_.MaxStdDev();
+            if (bias_estimator_.count() < 100) {
+                error = "Too few samples";
+            } else if (stddev > CALIBRATION_GYRO_MAX_STDDEV) {
+                snprintf(message, sizeof(message), "The device moved (%.2f deg/s noise), keep it still", stddev);
+                error = message;
+            } else {
+                bias_estimator_.Mean(correction.offset);
+                snprintf(message, sizeof(message), "Bias %.2f, %.2f, %.2f deg/s",
+                    correction.offset[0], correction.offset[1], correction.offset[2]);
+                ok = true;
+            }
+        } else {
+            // The accelerometer is scaled to 1 g, the magnetometer keeps the local field strength
+            float fit_error = 0.0f;
+            ok = ellipsoid_fit_.Solve(sensor == CalibrationSensor::kAccel ? 1.0f : 0.0f, correction, fit_error, error);
+            if (ok) {
+                snprintf(message, sizeof(message), "%u samples, fit error %.1f%%",
+                    (unsigned)ellipsoid_fit_.count(), fit_error * 100.0f);
+            }
+        }
+        
+        if (ok) {
+            Correction(sensor) = correction;
+            Settings settings("imu_cal", true);
+            settings.SetString(CalibrationSensorName(sensor), correction.Serialize());
+            fusion_.Reset();
+            ESP_LOGI(TAG, "%s calibration done: %s", CalibrationSensorName(sensor), message);
+        } else {
+            ESP_LOGW(TAG, "%s calibration failed: %s", CalibrationSensorName(sensor), error.c_str());
+        }
+        
+        PublishCorrections();
+        std::lock_guard<std::mutex> lock(calibration_mutex_);
+        calibration_state_ = ok ? "done" : "failed";
+        calibration_message_ = ok ? message : error;
+        calibrating_ = CalibrationSensor::kNone;
+        properties_[calibration_property_].MarkChanged();
+    }
+    
     // MPU6050 initialization
     bool InitMPU6050() {
         uint8_t who_am_i = 0;
@@ -344,7 +754,7 @@ private:
         }
         
         // Set sample rate
-        ret = I2CWrite(MPU6050_ADDR, 0x19, 0x07);  // 1000/(1+7) = 125Hz
+        ret = I2CWrite(MPU6050_ADDR, MPU6050_SMPLRT_DIV, 1000 / MPU6050_SAMPLE_RATE_HZ - 1);
         if (ret != ESP_OK) {
             ESP_LOGE(TAG, "Failed to set sample rate: %s", esp_err_to_name(ret));
             return false;
@@ -354,6 +764,29 @@ private:
         return true;
     }
     
+    // Let the MPU6050 buffer accelerometer and gyroscope samples so they can be read in bursts
+    bool StartMPU6050Fifo() {
+        esp_err_t ret = I2CWrite(MPU6050_ADDR, MPU6050_FIFO_EN, MPU6050_FIFO_EN_ACCEL_GYRO);
+        if (ret == ESP_OK) {
+            ret = ResetMPU6050Fifo();
+        }
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "MPU6050 FIFO not available, polling the data registers: %s", esp_err_to_name(ret));
+            return false;
+        }
+        ESP_LOGI(TAG, "MPU6050 FIFO enabled at %d Hz", MPU6050_SAMPLE_RATE_HZ);
+        return true;
+    }
+    
+    // USER_CTRL also holds the I2C master enable, which stays off for the bypass
+    esp_err_t ResetMPU6050Fifo() {
+        esp_err_t ret = I2CWrite(MPU6050_ADDR, MPU6050_USER_CTRL, MPU6050_USER_CTRL_FIFO_RESET);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        return I2CWrite(MPU6050_ADDR, MPU6050_USER_CTRL, MPU6050_USER_CTRL_FIFO_EN);
+    }
+    
     // Enable HMC5883L bypass
     void EnableHMC5883LAccess() {
         // Disable I2C master mode
@@ -466,32 +899,112 @@ private:
     }
 
     // I2C utility functions
+    i2c_master_dev_handle_t Device(uint8_t dev_addr) const {
+        switch (dev_addr) {
+            case MPU6050_ADDR: return mpu6050_dev_;
+            case QMC5883L_ADDR: return qmc5883l_dev_;
+            case BMP180_ADDR: return bmp180_dev_;
+            default: return NULL;
+        }
+    }
+    
     esp_err_t I2CWrite(uint8_t dev_addr, uint8_t reg_addr, uint8_t data) {
-        // 切换设备地址
-        i2c_device_config_t dev_cfg = {
-            .dev_addr_length = I2C_ADDR_BIT_LEN_7,
-            .device_address = dev_addr,
-            .scl_speed_hz = I2C_MASTER_FREQ_HZ,
-        };
-        i2c_master_bus_rm_device(dev_handle_);
-        i2c_master_bus_add_device(bus_handle_, &dev_cfg, &dev_handle_);
+        int64_t start = esp_timer_get_time();
         uint8_t buf[2] = {reg_addr, data};
-        return i2c_master_transmit(dev_handle_, buf, 2, I2C_TIMEOUT_MS / portTICK_PERIOD_MS);
+        esp_err_t ret = i2c_master_transmit(Device(dev_addr), buf, 2, I2C_TIMEOUT_MS / portTICK_PERIOD_MS);
+        i2c_time_us_ += esp_timer_get_time() - start;
+        return ret;
     }
     
+    // Register address write and the burst read in one transaction with a repeated start
     esp_err_t I2CRead(uint8_t dev_addr, uint8_t reg_addr, uint8_t* data, size_t len) {
-        // 切换设备地址
-        i2c_device_config_t dev_cfg = {
-            .dev_addr_length = I2C_ADDR_BIT_LEN_7,
-            .device_address = dev_addr,
-            .scl_speed_hz = I2C_MASTER_FREQ_HZ,
+        int64_t start = esp_timer_get_time();
+        esp_err_t ret = i2c_master_transmit_receive(Device(dev_addr), &reg_addr, 1, data, len,
+            I2C_TIMEOUT_MS / portTICK_PERIOD_MS);
+        i2c_time_us_ += esp_timer_get_time() - start;
+        return ret;
+    }
+    
+    // Accelerometer and gyroscope registers are big endian, ±2g and ±250°/s full scale.
+    // Every sample goes through the fusion, dt is fixed by the MPU6050 sample rate in FIFO mode
+    void ApplyMPU6050Sample(const uint8_t* accel, const uint8_t* gyro, float dt) {
+        float ax = (int16_t)((accel[0] << 8) | accel[1]) / 16384.0f;
+        float ay = (int16_t)((accel[2] << 8) | accel[3]) / 16384.0f;
+        float az = (int16_t)((accel[4] << 8) | accel[5]) / 16384.0f;
+        float gx = (int16_t)((gyro[0] << 8) | gyro[1]) / 131.0f;
+        float gy = (int16_t)((gyro[2] << 8) | gyro[3]) / 131.0f;
+        float gz = (int16_t)((gyro[4] << 8) | gyro[5]) / 131.0f;
+        samples_++;
+        
+        // Calibration works on the raw readings, the accelerometer only while the device is almost still
+        CalibrationSensor calibrating = calibrating_;
+        if (calibrating == CalibrationSensor::kGyro) {
+            bias_estimator_.Add(gx, gy, gz);
+        }
+        gyro_correction_.Apply(gx, gy, gz);
+        if (calibrating == CalibrationSensor::kAccel &&
+            gx * gx + gy * gy + gz * gz < CALIBRATION_ACCEL_MAX_RATE * CALIBRATION_ACCEL_MAX_RATE) {
+            ellipsoid_fit_.Add(ax, ay, az);
+        }
+        accel_correction_.Apply(ax, ay, az);
+        sensor_data_.accel_x = ax;
+        sensor_data_.accel_y = ay;
+        sensor_data_.accel_z = az;
+        sensor_data_.gyro_x = gx;
+        sensor_data_.gyro_y = gy;
+        sensor_data_.gyro_z = gz;
+        
+        // With decimation the step uses the mean rate, so the integrated angle is unchanged
+        fusion_gyro_sum_[0] += gx * dt;
+        fusion_gyro_sum_[1] += gy * dt;
+        fusion_gyro_sum_[2] += gz * dt;
+        fusion_dt_sum_ += dt;
+        if (++fusion_samples_ < IMU_FUSION_DECIMATION) {
+            return;
+        }
+        float step_dt = fusion_dt_sum_;
+        float rate_scale = step_dt > 0.0f ? ImuFusion::kDegToRad / step_dt : 0.0f;
+        fusion_samples_ = 0;
+        fusion_dt_sum_ = 0.0f;
+        
+        int64_t start = esp_timer_get_time();
+        bool use_magnetometer = fusion_use_magnetometer_ && qmc5883l_initialized_;
+        fusion_.Update(ax, ay, az,
+            fusion_gyro_sum_[0] * rate_scale, fusion_gyro_sum_[1] * rate_scale, fusion_gyro_sum_[2] * rate_scale,
+            use_magnetometer ? sensor_data_.mag_x : 0.0f, use_magnetometer ? sensor_data_.mag_y : 0.0f,
+            use_magnetometer ? sensor_data_.mag_z : 0.0f, step_dt);
+        fusion_time_us_ += esp_timer_get_time() - start;
+        fusion_gyro_sum_[0] = fusion_gyro_sum_[1] = fusion_gyro_sum_[2] = 0.0f;
+    }
+    
+    // Derived outputs only need the newest sample of a FIFO batch
+    void UpdateOrientation() {
+        const auto& q = fusion_.quaternion();
+        sensor_data_.quat_w = q.w;
+        sensor_data_.quat_x = q.x;
+        sensor_data_.quat_y = q.y;
+        sensor_data_.quat_z = q.z;
+        sensor_data_.roll = fusion_.roll();
+        sensor_data_.pitch = fusion_.pitch();
+        sensor_data_.yaw = fusion_.yaw();
+        fusion_.LinearAcceleration(sensor_data_.accel_x, sensor_data_.accel_y, sensor_data_.accel_z,
+            sensor_data_.linear_accel_x, sensor_data_.linear_accel_y, sensor_data_.linear_accel_z);
+        
+        const float values[] = {
+            sensor_data_.accel_x, sensor_data_.accel_y, sensor_data_.accel_z,
+            sensor_data_.gyro_x, sensor_data_.gyro_y, sensor_data_.gyro_z,
+            sensor_data_.mag_x, sensor_data_.mag_y, sensor_data_.mag_z,
+            sensor_data_.temperature, sensor_data_.pressure, sensor_data_.altitude,
+            sensor_data_.roll, sensor_data_.pitch, sensor_data_.yaw,
+            sensor_data_.quat_w, sensor_data_.quat_x, sensor_data_.quat_y, sensor_data_.quat_z,
+            sensor_data_.linear_accel_x, sensor_data_.linear_accel_y, sensor_data_.linear_accel_z,
         };
-        i2c_master_bus_rm_device(dev_handle_);
-        i2c_master_bus_add_device(bus_handle_, &dev_cfg, &dev_handle_);
-        // 先写寄存器地址，再读数据
-        esp_err_t ret = i2c_master_transmit(dev_handle_, &reg_addr, 1, I2C_TIMEOUT_MS / portTICK_PERIOD_MS);
-        if (ret != ESP_OK) return ret;
-        return i2c_master_receive(dev_handle_, data, len, I2C_TIMEOUT_MS / portTICK_PERIOD_MS);
+        static_assert(sizeof(values) / sizeof(values[0]) == sizeof(kPublishedValues) / sizeof(kPublishedValues[0]));
+        for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+            SetValue(kPublishedValues[i], values[i]);
+        }
+        MarkPublishedChanged(kPublishedMotion);
+        MarkPublishedChanged(kPublishedOrientation);
     }
     
     // Read sensor data
@@ -500,21 +1013,62 @@ private:
             return;
         }
         
-        uint8_t data[6];
-        esp_err_t ret = I2CRead(MPU6050_ADDR, MPU6050_ACCEL_XOUT_H, data, 6);
+        if (mpu6050_fifo_) {
+            ReadMPU6050Fifo();
+        } else {
+            // Accelerometer, temperature and gyroscope are contiguous, one 14 byte burst
+            uint8_t data[14];
+            esp_err_t ret = I2CRead(MPU6050_ADDR, MPU6050_ACCEL_XOUT_H, data, sizeof(data));
+            if (ret != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to read accelerometer data: %s", esp_err_to_name(ret));
+                return;
+            }
+            int64_t now = esp_timer_get_time();
+            float dt = last_sample_us_ > 0 ? (now - last_sample_us_) / 1000000.0f : 1.0f / MPU6050_SAMPLE_RATE_HZ;
+            last_sample_us_ = now;
+            ApplyMPU6050Sample(data, data + 8, dt);
+        }
+        UpdateOrientation();
+        
+        auto& history = SensorHistory::GetInstance();
+        history.Record("imu.accel_x", sensor_data_.accel_x, "g");
+        history.Record("imu.accel_y", sensor_data_.accel_y, "g");
+        history.Record("imu.accel_z", sensor_data_.accel_z, "g");
+        history.Record("imu.roll", sensor_data_.roll, "°");
+        history.Record("imu.pitch", sensor_data_.pitch, "°");
+    }
+    
+    // Drains the FIFO with one count read and one burst read of all complete samples
+    void ReadMPU6050Fifo() {
+        uint8_t count_data[2];
+        esp_err_t ret = I2CRead(MPU6050_ADDR, MPU6050_FIFO_COUNT_H, count_data, 2);
         if (ret != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to read accelerometer data: %s", esp_err_to_name(ret));
+            ESP_LOGE(TAG, "Failed to read FIFO count: %s", esp_err_to_name(ret));
             return;
         }
         
-        int16_t accelX = (data[0] << 8) | data[1];
-        int16_t accelY = (data[2] << 8) | data[3];
-        int16_t accelZ = (data[4] << 8) | data[5];
+        size_t count = (count_data[0] << 8) | count_data[1];
+        if (count >= MPU6050_FIFO_SIZE) {
+            // Overflowed, the oldest bytes were overwritten and the sample alignment is lost
+            ESP_LOGW(TAG, "MPU6050 FIFO overflow, resetting");
+            ResetMPU6050Fifo();
+            return;
+        }
         
-        // Convert raw values to g (±2g range)
-        sensor_data_.accel_x = accelX / 16384.0f;
-        sensor_data_.accel_y = accelY / 16384.0f;
-        sensor_data_.accel_z = accelZ / 16384.0f;
+        uint8_t data[16 * MPU6050_FIFO_SAMPLE_SIZE];
+        size_t samples = std::min(count / MPU6050_FIFO_SAMPLE_SIZE, sizeof(data) / MPU6050_FIFO_SAMPLE_SIZE);
+        if (samples == 0) {
+            return;
+        }
+        ret = I2CRead(MPU6050_ADDR, MPU6050_FIFO_R_W, data, samples * MPU6050_FIFO_SAMPLE_SIZE);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to read FIFO: %s", esp_err_to_name(ret));
+            return;
+        }
+        for (size_t i = 0; i < samples; i++) {
+            const uint8_t* sample = data + i * MPU6050_FIFO_SAMPLE_SIZE;
+            ApplyMPU6050Sample(sample, sample + 6, 1.0f / MPU6050_SAMPLE_RATE_HZ);
+        }
     }
     
     void ReadQMC5883LData() {
@@ -535,9 +1089,17 @@ private:
         int16_t magZ = (data[5] << 8) | data[4];
         
         // Convert raw values to microtesla
-        sensor_data_.mag_x = magX * 0.002f;
-        sensor_data_.mag_y = magY * 0.002f;
-        sensor_data_.mag_z = magZ * 0.002f;
+        float mx = magX * 0.002f;
+        float my = magY * 0.002f;
+        float mz = magZ * 0.002f;
+        if (calibrating_ == CalibrationSensor::kMag) {
+            ellipsoid_fit_.Add(mx, my, mz);
+        }
+        mag_correction_.Apply(mx, my, mz);
+        sensor_data_.mag_x = mx;
+        sensor_data_.mag_y = my;
+        sensor_data_.mag_z = mz;
+        MarkPublishedChanged(kPublishedMag);
     }
     
     void ReadBMP180Data() {
@@ -611,26 +1173,52 @@ private:
         sensor_data_.temperature = T;
         sensor_data_.pressure = pressure;
         sensor_data_.altitude = altitude;
+        MarkPublishedChanged(kPublishedBaro);
+
+        auto& history = SensorHistory::GetInstance();
+        history.Record("imu.temperature", T, "°C");
+        history.Record("imu.pressure", pressure, "hPa");
+        history.Record("imu.altitude", altitude, "m");
+    }
+    
+    void UpdateStats(uint32_t elapsed_ms) {
+        sample_rate_hz_ = samples_ * 1000 / elapsed_ms;
+        i2c_us_per_sample_ = samples_ > 0 ? (int)(i2c_time_us_ / samples_) : 0;
+        properties_[stats_properties_[0]].MarkChanged();
+        properties_[stats_properties_[1]].MarkChanged();
+        ESP_LOGI(TAG, "%d Hz, I2C %d us per sample, bus busy %.1f%%, fusion %.1f us per sample",
+            sample_rate_hz_, i2c_us_per_sample_, i2c_time_us_ / (elapsed_ms * 10.0f),
+            samples_ > 0 ? (float)fusion_time_us_ / samples_ : 0.0f);
+        samples_ = 0;
+        i2c_time_us_ = 0;
+        fusion_time_us_ = 0;
+    }
+    
+    // At least one tick, a shorter interval would make the task spin without blocking
+    static TickType_t IntervalTicks(uint32_t interval_ms) {
+        TickType_t ticks = pdMS_TO_TICKS(interval_ms);
+        return ticks > 0 ? ticks : 1;
     }
     
     // Periodic update task
     static void IMUUpdateTask(void* arg) {
         IMU* imu = static_cast<IMU*>(arg);
-        TickType_t last_imu_update = xTaskGetTickCount();
+        TickType_t last_wake = xTaskGetTickCount();
         TickType_t last_mag_update = xTaskGetTickCount();
         TickType_t last_baro_update = xTaskGetTickCount();
+        TickType_t last_stats = xTaskGetTickCount();
         
         while (true) {
             // Update MPU6050 data (accelerometer and gyroscope)
-            if ((xTaskGetTickCount() - last_imu_update) * portTICK_PERIOD_MS >= IMU_UPDATE_INTERVAL_MS) {
-                if (imu->mpu6050_initialized_) {
-                    imu->ReadMPU6050Data();
-                }
-                last_imu_update = xTaskGetTickCount();
+            // The loop runs once per IMU interval, so this is due on every pass
+            if (imu->mpu6050_initialized_) {
+                imu->ReadMPU6050Data();
             }
             
             // Update QMC5883L data (magnetometer)
-            if ((xTaskGetTickCount() - last_mag_update) * portTICK_PERIOD_MS >= MAG_UPDATE_INTERVAL_MS) {
+            // The fusion and the calibration want the magnetometer at its 50Hz output rate, once per pass
+            bool mag_full_rate = imu->fusion_use_magnetometer_ || imu->calibrating_ == CalibrationSensor::kMag;
+            if (mag_full_rate || (xTaskGetTickCount() - last_mag_update) * portTICK_PERIOD_MS >= MAG_UPDATE_INTERVAL_MS) {
                 if (imu->qmc5883l_initialized_) {
                     imu->ReadQMC5883LData();
                 }
@@ -645,8 +1233,19 @@ private:
                 last_baro_update = xTaskGetTickCount();
             }
             
-            // Short delay to prevent hogging CPU
-            vTaskDelay(10 / portTICK_PERIOD_MS);
+            if (imu->calibrating_ != CalibrationSensor::kNone && esp_timer_get_time() >= imu->calibration_end_us_) {
+                imu->FinishCalibration();
+            }
+            imu->ApplyPendingReset();
+            
+            if ((xTaskGetTickCount() - last_stats) * portTICK_PERIOD_MS >= IMU_STATS_INTERVAL_MS) {
+                imu->UpdateStats((xTaskGetTickCount() - last_stats) * portTICK_PERIOD_MS);
+                last_stats = xTaskGetTickCount();
+            }
+            
+            // Sleep until the FIFO has collected the next batch (or the next sample is due when polling),
+            // the magnetometer and barometer intervals are multiples of it
+            vTaskDelayUntil(&last_wake, IntervalTicks(imu->mpu6050_fifo_ ? IMU_UPDATE_INTERVAL_MS : IMU_POLL_INTERVAL_MS));
         }
     }
 };
@@ -654,14 +1253,31 @@ private:
 // Register the IMU thing
 DECLARE_THING(IMU)
 
+static IMU* g_imu = nullptr;
+
 // 添加 RegisterIMU 函数的实现
 void RegisterIMU() {
-    static IMU* instance = nullptr;
-    if (instance == nullptr) {
-        instance = new IMU();
-        ThingManager::GetInstance().AddThing(instance);
+    if (g_imu == nullptr) {
+        g_imu = new IMU();
+        ThingManager::GetInstance().AddThing(g_imu);
         ESP_LOGI(TAG, "IMU Thing registered to ThingManager");
     }
 }
 
+bool StartIMUCalibration(const std::string& sensor, int duration_s, std::string& error) {
+    if (g_imu == nullptr) {
+        error = "IMU is not registered";
+        return false;
+    }
+    return g_imu->StartCalibration(sensor, duration_s, error);
+}
+
+bool ResetIMUCalibration(const std::string& sensor) {
+    return g_imu != nullptr && g_imu->ResetCalibration(sensor);
+}
+
+std::string GetIMUCalibrationJson() {
+    return g_imu != nullptr ? g_imu->GetCalibrationJson() : std::string();
+}
+
 }  // namespace iot 
\ No newline at end of file
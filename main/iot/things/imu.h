@@ -1,12 +1,32 @@
 #pragma once
 
+#include <string>
+
 namespace iot {
 
 /**
  * @brief Register the IMU (Inertial Measurement Unit) Thing
- * 
+ *
  * This function creates and registers an instance of the IMU Thing.
  */
 void RegisterIMU();
 
-} // namespace iot 
\ No newline at end of file
+/**
+ * @brief Start a calibration, the result is fitted and stored in Settings when the time is up
+ * @param sensor "gyro" (keep the device still), "accel" or "mag" (rotate it slowly through all orientations)
+ * @param duration_s Seconds to collect samples, 0 for the default of the sensor
+ * @param error Reason when the calibration could not be started
+ */
+bool StartIMUCalibration(const std::string& sensor, int duration_s, std::string& error);
+
+/**
+ * @brief Drop the stored calibration of "gyro", "accel", "mag" or "all"
+ */
+bool ResetIMUCalibration(const std::string& sensor);
+
+/**
+ * @brief Calibration state and the coefficients in use as JSON, empty if the IMU is not registered
+ */
+std::string GetIMUCalibrationJson();
+
+} // namespace iot
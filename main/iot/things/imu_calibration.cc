@@ -0,0 +1,286 @@
+#include "imu_calibration.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+namespace iot {
+
+// A real sensor is never off by more than this between its longest and shortest axis,
+// a larger ratio means the samples did not cover enough orientations
+static constexpr double kMaxAxisRatio = 1.5;
+// Every axis has to be swept over at least this part of the diameter
+static constexpr double kMinAxisCoverage = 1.0;
+
+std::string ImuAxisCorrection::Serialize() const {
+    std::string text;
+    char buffer[24];
+    for (int i = 0; i < 12; i++) {
+        snprintf(buffer, sizeof(buffer), i == 0 ? "%.7g" : " %.7g", i < 3 ? offset[i] : matrix[i - 3]);
+        text += buffer;
+    }
+    return text;
+}
+
+bool ImuAxisCorrection::Deserialize(const std::string& text) {
+    float values[12];
+    const char* p = text.c_str();
+    for (int i = 0; i < 12; i++) {
+        char* end;
+        values[i] = strtof(p, &end);
+        if (end == p || !std::isfinite(values[i])) {
+            return false;
+        }
+        p = end;
+    }
+    std::copy(values, values + 3, offset);
+    std::copy(values + 3, values + 12, matrix);
+    return true;
+}
+
+void ImuBiasEstimator::Reset() {
+    *this = ImuBiasEstimator();
+}
+
+void ImuBiasEstimator::Add(float x, float y, float z) {
+    const float v[3] = {x, y, z};
+    for (int i = 0; i < 3; i++) {
+        sum_[i] += v[i];
+        sum_sq_[i] += (double)v[i] * v[i];
+    }
+    count_++;
+}
+
+void ImuBiasEstimator::Mean(float mean[3]) const {
+    for (int i = 0; i < 3; i++) {
+        mean[i] = count_ > 0 ? (float)(sum_[i] / count_) : 0.0f;
+    }
+}
+
+float ImuBiasEstimator::MaxStdDev() const {
+    if (count_ < 2) {
+        return 0.0f;
+    }
+    double max_variance = 0.0;
+    for (int i = 0; i < 3; i++) {
+        double mean = sum_[i] / count_;
+        max_variance = std::max(max_variance, sum_sq_[i] / count_ - mean * mean);
+    }
+    return (float)std::sqrt(max_variance);
+}
+
+void ImuEllipsoidFit::Reset() {
+    *this = ImuEllipsoidFit();
+}
+
+void ImuEllipsoidFit::Add(float x, float y, float z) {
+    // A x² + B y² + C z² + 2D xy + 2E xz + 2F yz + 2G x + 2H y + 2I z = 1
+    const double d[kTerms] = {
+        (double)x * x, (double)y * y, (double)z * z,
+        2.0 * x * y, 2.0 * x * z, 2.0 * y * z,
+        2.0 * x, 2.0 * y, 2.0 * z,
+    };
+    for (int i = 0; i < kTerms; i++) {
+        for (int j = i; j < kTerms; j++) {
+            normal_[i][j] += d[i] * d[j];
+        }
+        rhs_[i] += d[i];
+    }
+
+    const float v[3] = {x, y, z};
+    for (int i = 0; i < 3; i++) {
+        if (count_ == 0 || v[i] < min_[i]) {
+            min_[i] = v[i];
+        }
+        if (count_ == 0 || v[i] > max_[i]) {
+            max_[i] = v[i];
+        }
+    }
+    count_++;
+}
+
+// Gaussian elimination with partial pivoting, a and b are destroyed
+template <int N>
+static bool SolveLinear(double (&a)[N][N], double (&b)[N], double (&x)[N]) {
+    constexpr int n = N;
+    for (int col = 0; col < n; col++) {
+        int pivot = col;
+        for (int row = col + 1; row < n; row++) {
+            if (std::fabs(a[row][col]) > std::fabs(a[pivot][col])) {
+                pivot = row;
+            }
+        }
+        if (std::fabs(a[pivot][col]) < 1e-12) {
+            return false;
+        }
+        if (pivot != col) {
+            std::swap_ranges(a[col], a[col] + n, a[pivot]);
+            std::swap(b[col], b[pivot]);
+        }
+        for (int row = col + 1; row < n; row++) {
+            double factor = a[row][col] / a[col][col];
+            for (int k = col; k < n; k++) {
+                a[row][k] -= factor * a[col][k];
+            }
+            b[row] -= factor * b[col];
+        }
+    }
+    for (int row = n - 1; row >= 0; row--) {
+        double sum = b[row];
+        for (int k = row + 1; k < n; k++) {
+            sum -= a[row][k] * x[k];
+        }
+        x[row] = sum / a[row][row];
+    }
+    return true;
+}
+
+// Jacobi rotations, eigenvectors end up in the columns of v
+static void SymmetricEigen3(double a[3][3], double values[3], double v[3][3]) {
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            v[i][j] = i == j ? 1.0 : 0.0;
+        }
+    }
+    for (int sweep = 0; sweep < 50; sweep++) {
+        double off = a[0][1] * a[0][1] + a[0][2] * a[0][2] + a[1][2] * a[1][2];
+        if (off < 1e-24) {
+            break;
+        }
+        for (int p = 0; p < 2; p++) {
+            for (int q = p + 1; q < 3; q++) {
+                if (std::fabs(a[p][q]) < 1e-30) {
+                    continue;
+                }
+                double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+                double t = (theta >= 0 ? 1.0 : -1.0) / (std::fabs(theta) + std::sqrt(theta * theta + 1.0));
+                double c = 1.0 / std::sqrt(t * t + 1.0);
+                double s = t * c;
+                for (int k = 0; k < 3; k++) {
+                    double akp = a[k][p], akq = a[k][q];
+                    a[k][p] = c * akp - s * akq;
+                    a[k][q] = s * akp + c * akq;
+                }
+                for (int k = 0; k < 3; k++) {
+                    double apk = a[p][k], aqk = a[q][k];
+                    a[p][k] = c * apk - s * aqk;
+                    a[q][k] = s * apk + c * aqk;
+                }
+                for (int k = 0; k < 3; k++) {
+                    double vkp = v[k][p], vkq = v[k][q];
+                    v[k][p] = c * vkp - s * vkq;
+                    v[k][q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+    for (int i = 0; i < 3; i++) {
+        values[i] = a[i][i];
+    }
+}
+
+bool ImuEllipsoidFit::Solve(float radius, ImuAxisCorrection& correction, float& fit_error, std::string& error) const {
+    if (count_ < 50) {
+        error = "Too few samples";
+        return false;
+    }
+
+    double a[kTerms][kTerms];
+    double b[kTerms];
+    for (int i = 0; i < kTerms; i++) {
+        for (int j = 0; j < kTerms; j++) {
+            a[i][j] = i <= j ? normal_[i][j] : normal_[j][i];
+        }
+        b[i] = rhs_[i];
+    }
+    double p[kTerms];
+    if (!SolveLinear(a, b, p)) {
+        error = "Samples do not span all three axes, rotate the device through more orientations";
+        return false;
+    }
+
+    // (x - c)^T Q (x - c) = k with Q from the quadratic terms and c = -Q^-1 * (G, H, I)
+    double q[3][3] = {
+        {p[0], p[3], p[4]},
+        {p[3], p[1], p[5]},
+        {p[4], p[5], p[2]},
+    };
+    double qa[3][3];
+    std::copy(&q[0][0], &q[0][0] + 9, &qa[0][0]);
+    double linear[3] = {-p[6], -p[7], -p[8]};
+    double center[3];
+    if (!SolveLinear(qa, linear, center)) {
+        error = "Degenerate fit, rotate the device through more orientations";
+        return false;
+    }
+    double k = 1.0;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            k += center[i] * q[i][j] * center[j];
+        }
+    }
+
+    // The quadric comes out with both sides negated when the origin lies outside the ellipsoid
+    if (k < 0.0) {
+        k = -k;
+        for (auto& row : q) {
+            for (double& value : row) {
+                value = -value;
+            }
+        }
+    }
+    double values[3];
+    double v[3][3];
+    SymmetricEigen3(q, values, v);
+    if (k == 0.0 || values[0] <= 0.0 || values[1] <= 0.0 || values[2] <= 0.0) {
+        error = "Samples do not form an ellipsoid, rotate the device through more orientations";
+        return false;
+    }
+
+    // Semi-axis i is sqrt(k / value_i)
+    double axes[3];
+    for (int i = 0; i < 3; i++) {
+        axes[i] = std::sqrt(k / values[i]);
+    }
+    double shortest = std::min({axes[0], axes[1], axes[2]});
+    double longest = std::max({axes[0], axes[1], axes[2]});
+    if (longest / shortest > kMaxAxisRatio) {
+        error = "Fitted axes differ too much, rotate the device through more orientations";
+        return false;
+    }
+    double mean_radius = std::cbrt(axes[0] * axes[1] * axes[2]);
+    for (int i = 0; i < 3; i++) {
+        if (max_[i] - min_[i] < kMinAxisCoverage * mean_radius) {
+            error = "Axis " + std::string(1, "xyz"[i]) + " was not rotated through enough of its range";
+            return false;
+        }
+    }
+    double target = radius > 0.0f ? radius : mean_radius;
+
+    // W = target * V * diag(1 / axis) * V^T maps the ellipsoid onto the sphere without rotating it
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            double sum = 0.0;
+            for (int n = 0; n < 3; n++) {
+                sum += v[i][n] * v[j][n] / axes[n];
+            }
+            correction.matrix[i * 3 + j] = (float)(target * sum);
+        }
+        correction.offset[i] = (float)center[i];
+    }
+
+    // Algebraic residual sum((d^T p - 1)^2) = p^T N p - 2 p^T r + n, about twice the relative radius error
+    double residual = (double)count_;
+    for (int i = 0; i < kTerms; i++) {
+        double row = 0.0;
+        for (int j = 0; j < kTerms; j++) {
+            row += (i <= j ? normal_[i][j] : normal_[j][i]) * p[j];
+        }
+        residual += p[i] * row - 2.0 * p[i] * rhs_[i];
+    }
+    fit_error = (float)(std::sqrt(std::max(0.0, residual) / count_) / (2.0 * k));
+    return true;
+}
+
+} // namespace iot
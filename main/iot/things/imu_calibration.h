@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace iot {
+
+/**
+ * @brief Correction of one 3-axis sensor, corrected = matrix * (raw - offset)
+ *
+ * The gyroscope only uses the offset (bias), the accelerometer and the magnetometer use
+ * the matrix for scale, cross-axis and soft-iron errors and the offset for the zero
+ * offset / hard-iron field. Apply() is the only part on the sample hot path.
+ */
+struct ImuAxisCorrection {
+    float offset[3] = {0.0f, 0.0f, 0.0f};
+    float matrix[9] = {1.0f, 0.0f, 0.0f,
+                       0.0f, 1.0f, 0.0f,
+                       0.0f, 0.0f, 1.0f};
+
+    void Apply(float& x, float& y, float& z) const {
+        float dx = x - offset[0];
+        float dy = y - offset[1];
+        float dz = z - offset[2];
+        x = matrix[0] * dx + matrix[1] * dy + matrix[2] * dz;
+        y = matrix[3] * dx + matrix[4] * dy + matrix[5] * dz;
+        z = matrix[6] * dx + matrix[7] * dy + matrix[8] * dz;
+    }
+
+    // "ox oy oz m00 m01 ... m22", the format stored in Settings
+    std::string Serialize() const;
+    bool Deserialize(const std::string& text);
+};
+
+/**
+ * @brief Mean and standard deviation of a sensor held still, used for the gyroscope bias
+ */
+class ImuBiasEstimator {
+public:
+    void Reset();
+    void Add(float x, float y, float z);
+    size_t count() const { return count_; }
+    void Mean(float mean[3]) const;
+    // Largest standard deviation of the three axes
+    float MaxStdDev() const;
+
+private:
+    size_t count_ = 0;
+    double sum_[3] = {};
+    double sum_sq_[3] = {};
+};
+
+/**
+ * @brief Least squares ellipsoid fit for the accelerometer and the magnetometer
+ *
+ * Samples taken in many orientations lie on an ellipsoid instead of a sphere because of
+ * offsets, per-axis gains and soft-iron distortion. Add() only accumulates the normal
+ * equations of the general quadric, so there is no sample buffer and every Add() costs
+ * the same. Solve() turns the quadric into the correction that maps it onto a sphere.
+ */
+class ImuEllipsoidFit {
+public:
+    void Reset();
+    void Add(float x, float y, float z);
+    size_t count() const { return count_; }
+
+    /**
+     * @brief Fit the collected samples
+     * @param radius Radius of the corrected sphere, 0 keeps the mean radius of the ellipsoid
+     * @param correction Result, only written on success
+     * @param fit_error Relative RMS distance of the samples from the fitted surface
+     * @param error Reason when the fit fails, mostly too few orientations
+     */
+    bool Solve(float radius, ImuAxisCorrection& correction, float& fit_error, std::string& error) const;
+
+private:
+    static constexpr int kTerms = 9;
+
+    size_t count_ = 0;
+    double normal_[kTerms][kTerms] = {};    // Upper triangle of sum(d * d^T)
+    double rhs_[kTerms] = {};               // sum(d)
+    float min_[3] = {};
+    float max_[3] = {};
+};
+
+} // namespace iot
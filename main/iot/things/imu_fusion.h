@@ -0,0 +1,167 @@
+#pragma once
+
+#include <cmath>
+
+namespace iot {
+
+/**
+ * @brief Mahony complementary filter for accelerometer, gyroscope and optional magnetometer
+ *
+ * The gyroscope is integrated into a body to earth quaternion, the accelerometer (and the
+ * magnetometer when given) pull the estimate back with a PI correction on the angle error.
+ * Earth frame is x north / y west / z up once the magnetometer is used, without it the yaw
+ * starts at zero and drifts with the gyroscope bias. One Update() is about 60 float
+ * multiplications and one or two square roots.
+ */
+class ImuFusion {
+public:
+    struct Quaternion {
+        float w = 1.0f;
+        float x = 0.0f;
+        float y = 0.0f;
+        float z = 0.0f;
+    };
+
+    /**
+     * @param kp Proportional gain, how fast the accelerometer / magnetometer correct the attitude
+     * @param ki Integral gain, how fast the gyroscope bias is learned
+     */
+    explicit ImuFusion(float kp = 1.0f, float ki = 0.02f) : kp_(kp), ki_(ki) {}
+
+    void Reset() {
+        q_ = Quaternion();
+        bias_x_ = bias_y_ = bias_z_ = 0.0f;
+        initialized_ = false;
+    }
+
+    /**
+     * @brief One filter step
+     * @param ax, ay, az Acceleration in any unit, only the direction is used
+     * @param gx, gy, gz Angular rate in rad/s
+     * @param mx, my, mz Magnetic field in any unit, all zero to skip the magnetometer
+     * @param dt Time since the previous step in seconds
+     */
+    void Update(float ax, float ay, float az, float gx, float gy, float gz,
+                float mx, float my, float mz, float dt) {
+        float a_norm = std::sqrt(ax * ax + ay * ay + az * az);
+        if (!initialized_ && a_norm > 0.0f) {
+            // Start level with the measured gravity instead of converging from identity
+            InitFromAccel(ax / a_norm, ay / a_norm, az / a_norm);
+        }
+
+        float w = q_.w, x = q_.x, y = q_.y, z = q_.z;
+        float ex = 0.0f, ey = 0.0f, ez = 0.0f;
+
+        // Free fall or a crash gives no usable gravity direction, only integrate the gyroscope then
+        if (a_norm > 0.0f) {
+            ax /= a_norm;
+            ay /= a_norm;
+            az /= a_norm;
+
+            // Earth z axis seen from the body
+            float vx = 2.0f * (x * z - w * y);
+            float vy = 2.0f * (y * z + w * x);
+            float vz = w * w - x * x - y * y + z * z;
+            ex = ay * vz - az * vy;
+            ey = az * vx - ax * vz;
+            ez = ax * vy - ay * vx;
+
+            float m_norm = std::sqrt(mx * mx + my * my + mz * mz);
+            if (m_norm > 0.0f) {
+                mx /= m_norm;
+                my /= m_norm;
+                mz /= m_norm;
+
+                // Field in the earth frame, only its horizontal magnitude and vertical part are kept
+                float hx = 2.0f * (mx * (0.5f - y * y - z * z) + my * (x * y - w * z) + mz * (x * z + w * y));
+                float hy = 2.0f * (mx * (x * y + w * z) + my * (0.5f - x * x - z * z) + mz * (y * z - w * x));
+                float hz = 2.0f * (mx * (x * z - w * y) + my * (y * z + w * x) + mz * (0.5f - x * x - y * y));
+                float bx = std::sqrt(hx * hx + hy * hy);
+                float bz = hz;
+
+                // That reference field seen from the body
+                float wx = 2.0f * (bx * (0.5f - y * y - z * z) + bz * (x * z - w * y));
+                float wy = 2.0f * (bx * (x * y - w * z) + bz * (w * x + y * z));
+                float wz = 2.0f * (bx * (w * y + x * z) + bz * (0.5f - x * x - y * y));
+                ex += my * wz - mz * wy;
+                ey += mz * wx - mx * wz;
+                ez += mx * wy - my * wx;
+            }
+
+            if (ki_ > 0.0f) {
+                bias_x_ += ki_ * ex * dt;
+                bias_y_ += ki_ * ey * dt;
+                bias_z_ += ki_ * ez * dt;
+            }
+            gx += kp_ * ex + bias_x_;
+            gy += kp_ * ey + bias_y_;
+            gz += kp_ * ez + bias_z_;
+        }
+
+        // q' = 0.5 * q * (0, g)
+        float half_dt = 0.5f * dt;
+        q_.w = w + (-x * gx - y * gy - z * gz) * half_dt;
+        q_.x = x + (w * gx + y * gz - z * gy) * half_dt;
+        q_.y = y + (w * gy - x * gz + z * gx) * half_dt;
+        q_.z = z + (w * gz + x * gy - y * gx) * half_dt;
+        Normalize();
+    }
+
+    const Quaternion& quaternion() const { return q_; }
+
+    // Euler angles in degrees, aerospace sequence (yaw, then pitch, then roll)
+    float roll() const {
+        return std::atan2(2.0f * (q_.w * q_.x + q_.y * q_.z), 1.0f - 2.0f * (q_.x * q_.x + q_.y * q_.y)) * kRadToDeg;
+    }
+    float pitch() const {
+        float s = 2.0f * (q_.w * q_.y - q_.z * q_.x);
+        return std::asin(s > 1.0f ? 1.0f : (s < -1.0f ? -1.0f : s)) * kRadToDeg;
+    }
+    float yaw() const {
+        return std::atan2(2.0f * (q_.w * q_.z + q_.x * q_.y), 1.0f - 2.0f * (q_.y * q_.y + q_.z * q_.z)) * kRadToDeg;
+    }
+
+    // Subtracts the estimated gravity from a body frame acceleration in g
+    void LinearAcceleration(float ax, float ay, float az, float& lx, float& ly, float& lz) const {
+        lx = ax - 2.0f * (q_.x * q_.z - q_.w * q_.y);
+        ly = ay - 2.0f * (q_.y * q_.z + q_.w * q_.x);
+        lz = az - (q_.w * q_.w - q_.x * q_.x - q_.y * q_.y + q_.z * q_.z);
+    }
+
+    static constexpr float kDegToRad = 0.017453292f;
+    static constexpr float kRadToDeg = 57.29578f;
+
+private:
+    float kp_;
+    float ki_;
+    Quaternion q_;
+    float bias_x_ = 0.0f;
+    float bias_y_ = 0.0f;
+    float bias_z_ = 0.0f;
+    bool initialized_ = false;
+
+    void InitFromAccel(float ax, float ay, float az) {
+        float roll = std::atan2(ay, az);
+        float pitch = std::atan2(-ax, std::sqrt(ay * ay + az * az));
+        float cr = std::cos(roll * 0.5f), sr = std::sin(roll * 0.5f);
+        float cp = std::cos(pitch * 0.5f), sp = std::sin(pitch * 0.5f);
+        q_.w = cr * cp;
+        q_.x = sr * cp;
+        q_.y = cr * sp;
+        q_.z = -sr * sp;
+        initialized_ = true;
+    }
+
+    void Normalize() {
+        float norm = std::sqrt(q_.w * q_.w + q_.x * q_.x + q_.y * q_.y + q_.z * q_.z);
+        if (norm > 0.0f) {
+            float inv = 1.0f / norm;
+            q_.w *= inv;
+            q_.x *= inv;
+            q_.y *= inv;
+            q_.z *= inv;
+        }
+    }
+};
+
+} // namespace iot
@@ -26,12 +26,21 @@ extern "C" {
 #include "driver/i2c_master.h"
 #include "esp_log.h"
 #include "esp_err.h"
+#include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <mutex>
 #include <freertos/timers.h>
 
 #include "ext/include/pcf8575.h"
 #include "ext/include/pca9548a.h"
 #include "ext/include/multiplexer.h"
+#include "hardware/obstacle_supervisor.h"
+#include "hardware/motion_controller.h"
+#include "wheel_control.h"
+#ifdef CONFIG_MOTOR_ENCODER_ENABLE
+#include "wheel_encoder.h"
+#endif
 
 #define TAG "MotorThing"
 
@@ -91,6 +100,25 @@ extern "C" {
 #define MOTOR_LEDC_DUTY_RES  LEDC_TIMER_8_BIT   // 8位分辨率，0-255
 #define MOTOR_LEDC_FREQ      5000               // PWM频率5kHz
 
+// 闭环速度控制参数，只有启用编码器时才使用
+#ifndef CONFIG_MOTOR_ENCODER_COUNTS_PER_REV
+#define CONFIG_MOTOR_ENCODER_COUNTS_PER_REV 1320
+#endif
+#ifndef CONFIG_MOTOR_WHEEL_DIAMETER_MM
+#define CONFIG_MOTOR_WHEEL_DIAMETER_MM 65
+#endif
+#ifndef CONFIG_MOTOR_WHEEL_TRACK_MM
+#define CONFIG_MOTOR_WHEEL_TRACK_MM 130
+#endif
+#ifndef CONFIG_MOTOR_MAX_WHEEL_SPEED
+#define CONFIG_MOTOR_MAX_WHEEL_SPEED 600
+#endif
+#ifndef CONFIG_MOTOR_CONTROL_RATE_HZ
+#define CONFIG_MOTOR_CONTROL_RATE_HZ 100
+#endif
+#define WHEEL_MAX_ACCEL_MM_S2    1500               // 轮速设定值的最大变化率
+#define WHEEL_SPEED_FILTER_HZ    20                 // 编码器测速低通截止频率
+
 namespace iot {
 
 class Motor : public Thing {
@@ -113,12 +141,44 @@ private:
     // 状态标志
     bool running_;
     bool use_pcf8575_;      // 是否使用PCF8575
+    std::atomic<int> motion_{0};  // 1前进，-1后退，0停止或转向，供避障监控重新输出
     
     // 缓存值
     int last_dir_x_;  // 缓存上一次的X方向
     int last_dir_y_;  // 缓存上一次的Y方向
     float cached_angle_degrees_; // 缓存计算的角度
 
+    // 速度、方向和轮速属性只在写入处标记变化，状态上报不必每次读取
+    PropertyHandle speed_property_ = 0;
+    PropertyHandle direction_x_property_ = 0;
+    PropertyHandle direction_y_property_ = 0;
+    PropertyHandle wheel_speed_properties_[2] = {0, 0};
+    
+    // 闭环速度控制，下标0为左轮(电机A)，1为右轮(电机B)
+    bool closed_loop_ = false;              // 编码器和控制任务是否可用
+    std::atomic<bool> velocity_mode_{false}; // Drive指令生效中，其他指令会退出该模式
+    // 串行化所有电机输出（方向引脚、LEDC、PCF8575）以及motion_和velocity_mode_的切换
+    std::mutex output_mutex_;
+    std::atomic<float> target_linear_{0.0f};  // mm/s
+    std::atomic<float> target_angular_{0.0f}; // rad/s，向左为正
+    DifferentialDrive drive_{CONFIG_MOTOR_WHEEL_TRACK_MM, CONFIG_MOTOR_MAX_WHEEL_SPEED, WHEEL_MAX_ACCEL_MM_S2};
+    WheelSpeedPid wheel_pids_[2];
+    WheelSpeedEstimator speed_estimators_[2];
+    float wheel_speeds_[2] = {0.0f, 0.0f};  // 测得的轮速 mm/s
+    std::atomic<int> wheel_duty_[2] = {0, 0};   // 实际输出的带方向占空比，开环和闭环都会更新
+    int encoder_sign_[2] = {1, 1};          // 单路编码器的计数方向，输出为0(滑行)时保持上一次的方向
+    int64_t last_control_us_ = 0;
+    TaskHandle_t control_task_ = nullptr;
+    esp_timer_handle_t control_timer_ = nullptr;
+#ifdef CONFIG_MOTOR_ENCODER_ENABLE
+    WheelEncoder encoders_[2];
+#endif
+    
+    // 摇杆指令只保留最新一条，由固定频率的运动循环加减速后输出；最后声明，最先析构
+    MotionController motion_controller_{"motor_motion", [this](float x, float y) {
+        ApplyMove(x, y);
+    }};
+
     // 初始化GPIO
     void InitGPIO() {
         // 从board配置中获取电机引脚
@@ -363,8 +423,174 @@ private:
         ESP_LOGI(TAG, "Motor GPIO pins and LEDC initialized successfully");
     }
     
+    // 启动编码器和固定频率的速度控制任务
+    void InitClosedLoop() {
+#ifdef CONFIG_MOTOR_ENCODER_ENABLE
+        if (use_pcf8575_ || !ledc_initialized_) {
+            ESP_LOGW(TAG, "Closed-loop speed control needs direct GPIO direction pins and LEDC, encoders unused");
+            return;
+        }
+        if (!encoders_[0].Init(CONFIG_MOTOR_ENCODER_LEFT_A_PIN, CONFIG_MOTOR_ENCODER_LEFT_B_PIN) ||
+            !encoders_[1].Init(CONFIG_MOTOR_ENCODER_RIGHT_A_PIN, CONFIG_MOTOR_ENCODER_RIGHT_B_PIN)) {
+            ESP_LOGE(TAG, "Failed to initialize wheel encoders, closed-loop speed control disabled");
+            encoders_[0].Deinit();
+            encoders_[1].Deinit();
+            return;
+        }
+        
+        float mm_per_count = M_PI * CONFIG_MOTOR_WHEEL_DIAMETER_MM / CONFIG_MOTOR_ENCODER_COUNTS_PER_REV;
+        for (auto& estimator : speed_estimators_) {
+            estimator = WheelSpeedEstimator(mm_per_count, WHEEL_SPEED_FILTER_HZ);
+        }
+        
+        xTaskCreate([](void* arg) {
+            auto* motor = static_cast<Motor*>(arg);
+            while (true) {
+                ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+                motor->ControlStep();
+            }
+        }, "wheel_control", 4096, this, 6, &control_task_);
+        
+        // 定时器只负责唤醒任务，FreeRTOS节拍太粗无法提供精确的控制周期
+        esp_timer_create_args_t timer_args = {
+            .callback = [](void* arg) {
+                auto* motor = static_cast<Motor*>(arg);
+                xTaskNotifyGive(motor->control_task_);
+            },
+            .arg = this,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "wheel_timer",
+            .skip_unhandled_events = true,
+        };
+        if (control_task_ == nullptr || esp_timer_create(&timer_args, &control_timer_) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to start the wheel control loop");
+            return;
+        }
+        esp_timer_start_periodic(control_timer_, 1000000 / CONFIG_MOTOR_CONTROL_RATE_HZ);
+        closed_loop_ = true;
+        ESP_LOGI(TAG, "Closed-loop speed control at %d Hz, %.3f mm per count", CONFIG_MOTOR_CONTROL_RATE_HZ, mm_per_count);
+#endif
+    }
+    
+    // 一个控制周期：测速，然后在Drive模式下运行运动学和两个轮子的PID
+    void ControlStep() {
+        int64_t now = esp_timer_get_time();
+        float dt = last_control_us_ > 0 ? (now - last_control_us_) / 1000000.0f : 0.0f;
+        last_control_us_ = now;
+        
+#ifdef CONFIG_MOTOR_ENCODER_ENABLE
+        for (int i = 0; i < 2; i++) {
+            int32_t delta = encoders_[i].TakeDelta();
+            // 单路霍尔传感器不带方向，按实际输出的驱动方向取符号
+            int duty = wheel_duty_[i];
+            if (duty != 0) {
+                encoder_sign_[i] = duty > 0 ? 1 : -1;
+            }
+            if (!encoders_[i].has_direction()) {
+                delta *= encoder_sign_[i];
+            }
+            wheel_speeds_[i] = speed_estimators_[i].Update(delta, dt);
+            properties_[wheel_speed_properties_[i]].MarkChanged();
+        }
+#endif
+        
+        if (!velocity_mode_) {
+            drive_.Reset();
+            wheel_pids_[0].Reset();
+            wheel_pids_[1].Reset();
+            return;
+        }
+        
+        // 前进/后退速度受避障监控限制，被阻止的方向放弃当前指令
+        float linear = target_linear_;
+        float angular = target_angular_;
+        if (linear != 0.0f) {
+            auto& supervisor = ObstacleSupervisor::GetInstance();
+            float scale = supervisor.GetScale(linear > 0.0f ? MotionDirection::kForward : MotionDirection::kBackward);
+            if (scale < 1.0f) {
+                // 只用于限速日志，按浮点缩放速度，小于1mm/s的指令也不会被当成停车
+                int logged = static_cast<int>(std::lround(linear));
+                supervisor.LimitDuty(logged != 0 ? logged : (linear > 0.0f ? 1 : -1), "Motor");
+            }
+            if (scale <= 0.0f) {
+                // 避障停车不走加速度限制，立即清零设定值和积分并停转
+                target_linear_ = 0.0f;
+                drive_.Reset();
+                wheel_pids_[0].Reset();
+                wheel_pids_[1].Reset();
+                std::lock_guard<std::mutex> lock(output_mutex_);
+                if (velocity_mode_) {
+                    SetWheelDuty(0, 0);
+                    if (angular == 0.0f) {
+                        velocity_mode_ = false;
+                    }
+                }
+                return;
+            }
+            linear *= scale;
+        }
+        
+        const WheelSpeeds& setpoint = drive_.Update(linear, angular, dt);
+        float left = wheel_pids_[0].Update(setpoint.left, wheel_speeds_[0], dt);
+        float right = wheel_pids_[1].Update(setpoint.right, wheel_speeds_[1], dt);
+        
+        // 其他指令可能在计算期间接管了电机，检查和输出在同一把锁内
+        std::lock_guard<std::mutex> lock(output_mutex_);
+        if (!velocity_mode_) {
+            return;
+        }
+        SetWheelDuty(static_cast<int>(std::lround(left)), static_cast<int>(std::lround(right)));
+        if (linear == 0.0f && angular == 0.0f && setpoint.left == 0.0f && setpoint.right == 0.0f) {
+            velocity_mode_ = false;
+        }
+    }
+    
+    // 按符号设置每个轮子的方向引脚和占空比，0为滑行；调用者持有output_mutex_
+    void SetWheelDuty(int left, int right) {
+        wheel_duty_[0] = left;
+        wheel_duty_[1] = right;
+        gpio_set_level((gpio_num_t)in1_pin_, left > 0);
+        gpio_set_level((gpio_num_t)in2_pin_, left < 0);
+        gpio_set_level((gpio_num_t)in3_pin_, right > 0);
+        gpio_set_level((gpio_num_t)in4_pin_, right < 0);
+        ledc_set_duty(MOTOR_LEDC_MODE, MOTOR_LEDC_CHANNEL_A, std::min(std::abs(left), MAX_SPEED));
+        ledc_set_duty(MOTOR_LEDC_MODE, MOTOR_LEDC_CHANNEL_B, std::min(std::abs(right), MAX_SPEED));
+        ledc_update_duty(MOTOR_LEDC_MODE, MOTOR_LEDC_CHANNEL_A);
+        ledc_update_duty(MOTOR_LEDC_MODE, MOTOR_LEDC_CHANNEL_B);
+    }
+    
     // 控制电机函数
     void ControlMotor(int in1, int in2, int in3, int in4) {
+        std::lock_guard<std::mutex> lock(output_mutex_);
+        WriteMotorOutput(in1, in2, in3, in4);
+    }
+    
+    // 调用者持有output_mutex_
+    void WriteMotorOutput(int in1, int in2, int in3, int in4) {
+        // 开环指令接管电机，退出闭环速度模式
+        velocity_mode_ = false;
+        
+        // 前进和后退受避障监控限制，原地转向不会缩短前后距离
+        int motion = 0;
+        if (in1 == HIGH && in2 == LOW && in3 == HIGH && in4 == LOW) {
+            motion = 1;
+        } else if (in1 == LOW && in2 == HIGH && in3 == LOW && in4 == HIGH) {
+            motion = -1;
+        }
+        float obstacle_scale = 1.0f;
+        if (motion != 0) {
+            int duty = motion * motor_speed_;
+            int limited = ObstacleSupervisor::GetInstance().LimitDuty(duty, "Motor");
+            if (limited == 0) {
+                // 方向被阻止，按停车输出
+                in1 = in2 = in3 = in4 = LOW;
+                motion = 0;
+            } else {
+                obstacle_scale = static_cast<float>(limited) / duty;
+            }
+        }
+        motion_ = motion;
+        
         if (use_pcf8575_) {
             pcf8575_handle_t pcf_handle = pcf8575_get_handle();
             if (pcf_handle) {
@@ -447,6 +673,8 @@ private:
         
         // 如果是停止状态，两个电机都停止
         if (in1 == LOW && in2 == LOW && in3 == LOW && in4 == LOW) {
+            wheel_duty_[0] = 0;
+            wheel_duty_[1] = 0;
             // 2a. 对于停止状态，同时关闭两个电机使能
             err = ledc_set_duty(MOTOR_LEDC_MODE, MOTOR_LEDC_CHANNEL_A, 0);
             err |= ledc_set_duty(MOTOR_LEDC_MODE, MOTOR_LEDC_CHANNEL_B, 0);
@@ -524,6 +752,14 @@ private:
         leftSpeed = leftSpeed < MIN_SPEED ? MIN_SPEED : (leftSpeed > MAX_SPEED ? MAX_SPEED : leftSpeed);
         rightSpeed = rightSpeed < MIN_SPEED ? MIN_SPEED : (rightSpeed > MAX_SPEED ? MAX_SPEED : rightSpeed);
         
+        // 避障限速在最低速度之后生效，靠近障碍物时允许低于起转速度
+        leftSpeed = static_cast<int>(leftSpeed * obstacle_scale);
+        rightSpeed = static_cast<int>(rightSpeed * obstacle_scale);
+        
+        // 记下实际输出的方向，单路编码器据此确定转向
+        wheel_duty_[0] = (in1 == HIGH && in2 == LOW) ? leftSpeed : (in1 == LOW && in2 == HIGH) ? -leftSpeed : 0;
+        wheel_duty_[1] = (in3 == HIGH && in4 == LOW) ? rightSpeed : (in3 == LOW && in4 == HIGH) ? -rightSpeed : 0;
+        
         // 2b. 对于运动状态，同时设置好两个电机的占空比
         err = ledc_set_duty(MOTOR_LEDC_MODE, MOTOR_LEDC_CHANNEL_A, leftSpeed);
         err |= ledc_set_duty(MOTOR_LEDC_MODE, MOTOR_LEDC_CHANNEL_B, rightSpeed);
@@ -541,6 +777,52 @@ private:
         }
     }
 
+    // 限制在 MIN_SPEED 到 MAX_SPEED 之间
+    void SetMotorSpeed(int speed) {
+        motor_speed_ = speed < MIN_SPEED ? MIN_SPEED : (speed > MAX_SPEED ? MAX_SPEED : speed);
+        properties_[speed_property_].MarkChanged();
+    }
+
+    // 运动循环的输出：x/y为摇杆方向乘以拖动距离(-1到1)，(0,0)停车
+    void ApplyMove(float x, float y) {
+        direction_x_ = x * 100.0f;
+        direction_y_ = y * 100.0f;
+        properties_[direction_x_property_].MarkChanged();
+        properties_[direction_y_property_].MarkChanged();
+        distance_percent_ = std::min(std::hypot(x, y), 1.0f);
+        
+        if (distance_percent_ == 0.0f) {
+            // 停止
+            ControlMotor(LOW, LOW, LOW, LOW);
+            return;
+        }
+        
+        // 根据摇杆拖动距离计算速度
+        float speedFactor = pow(distance_percent_, 2.0);
+        SetMotorSpeed(MIN_SPEED + (int)((MAX_SPEED - MIN_SPEED) * speedFactor));
+        
+        // 计算角度，确定前进、后退、左转、右转
+        float angle = atan2(direction_y_, direction_x_);
+        float angleDegrees = angle * 180.0 / M_PI;
+        
+        // 前进区域（大致在-135度到-45度之间）
+        if (angleDegrees < -45 && angleDegrees > -135) {
+            ControlMotor(HIGH, LOW, HIGH, LOW); // 前进
+        }
+        // 后退区域（大致在45度到135度之间）
+        else if (angleDegrees > 45 && angleDegrees < 135) {
+            ControlMotor(LOW, HIGH, LOW, HIGH); // 后退
+        }
+        // 右转区域（大致在-45度到45度之间）
+        else if (angleDegrees >= -45 && angleDegrees <= 45) {
+            ControlMotor(LOW, HIGH, HIGH, LOW); // 右转
+        }
+        // 左转区域（135度到180度或-180度到-135度之间）
+        else {
+            ControlMotor(HIGH, LOW, LOW, HIGH); // 左转
+        }
+    }
+
 public:
     Motor() : Thing("Motor", "小车电机控制"),
               ena_pin_(DEFAULT_ENA_PIN), 
@@ -568,16 +850,38 @@ public:
         ControlMotor(LOW, LOW, LOW, LOW);
         running_ = true;
         
+        InitClosedLoop();
+        motion_controller_.Start();
+        
+        // 避障限制变化时按新限制重新输出当前的前进/后退，限制为0时ControlMotor停车；
+        // Drive模式下立即唤醒控制任务，不等下一个控制周期
+        ObstacleSupervisor::GetInstance().AddListener([this](float, float) {
+            // 在输出锁内读取当前运动：期间到达的停车已经把motion_清零，不会被这里重新启动
+            std::lock_guard<std::mutex> lock(output_mutex_);
+            if (velocity_mode_) {
+                if (control_task_) {
+                    xTaskNotifyGive(control_task_);
+                }
+                return;
+            }
+            int motion = motion_;
+            if (motion == 1) {
+                WriteMotorOutput(HIGH, LOW, HIGH, LOW);
+            } else if (motion == -1) {
+                WriteMotorOutput(LOW, HIGH, LOW, HIGH);
+            }
+        });
+        
         // 定义设备的属性
-        properties_.AddNumberProperty("speed", "电机速度 (100-255)", [this]() -> int {
+        speed_property_ = properties_.AddNumberProperty("speed", "电机速度 (100-255)", [this]() -> int {
             return motor_speed_;
         });
         
-        properties_.AddNumberProperty("directionX", "X轴方向 (-100 to 100)", [this]() -> int {
+        direction_x_property_ = properties_.AddNumberProperty("directionX", "X轴方向 (-100 to 100)", [this]() -> int {
             return direction_x_;
         });
         
-        properties_.AddNumberProperty("directionY", "Y轴方向 (-100 to 100)", [this]() -> int {
+        direction_y_property_ = properties_.AddNumberProperty("directionY", "Y轴方向 (-100 to 100)", [this]() -> int {
             return direction_y_;
         });
         
@@ -585,6 +889,23 @@ public:
             return running_;
         });
         
+        wheel_speed_properties_[0] = properties_.AddNumberProperty("left_speed", "左轮实测速度 (mm/s)，没有编码器时为0", [this]() -> int {
+            return static_cast<int>(wheel_speeds_[0]);
+        });
+        
+        wheel_speed_properties_[1] = properties_.AddNumberProperty("right_speed", "右轮实测速度 (mm/s)，没有编码器时为0", [this]() -> int {
+            return static_cast<int>(wheel_speeds_[1]);
+        });
+        
+        for (PropertyHandle handle : {speed_property_, direction_x_property_, direction_y_property_,
+                                      wheel_speed_properties_[0], wheel_speed_properties_[1]}) {
+            properties_[handle].set_change_tracked(true);
+        }
+        
+        properties_.AddNumberProperty("command_latency", "摇杆指令到电机输出的平均延迟 (us)", [this]() -> int {
+            return static_cast<int>(motion_controller_.GetStats().avg_latency_us);
+        });
+        
         // 定义设备可以被远程执行的指令
         ParameterList moveParams;
         moveParams.AddParameter(Parameter("dirX", "X轴方向 (-100 to 100)", kValueTypeNumber));
@@ -604,49 +925,42 @@ public:
             if (distance < 0.0f) distance = 0.0f;
             if (distance > 1.0f) distance = 1.0f;
             
-            // 设置控制参数
-            distance_percent_ = distance;
-            direction_x_ = dirX;
-            direction_y_ = dirY;
-            
-            // 根据摇杆拖动距离计算速度
-            float speedFactor = pow(distance_percent_, 2.0);
-            motor_speed_ = MIN_SPEED + (int)((MAX_SPEED - MIN_SPEED) * speedFactor);
-            
-            // 根据方向值确定电机控制方式
-            if (direction_x_ == 0 && direction_y_ == 0) {
-                // 停止
-                ControlMotor(LOW, LOW, LOW, LOW);
+            // 方向单位向量乘以拖动距离，交给运动循环输出
+            float length = std::hypot((float)dirX, (float)dirY);
+            if (length == 0.0f) {
+                motion_controller_.Post(0.0f, 0.0f);
             } else {
-                // 计算角度，确定前进、后退、左转、右转
-                float angle = atan2(direction_y_, direction_x_);
-                float angleDegrees = angle * 180.0 / M_PI;
-                
-                // 前进区域（大致在-135度到-45度之间）
-                if (angleDegrees < -45 && angleDegrees > -135) {
-                    ControlMotor(HIGH, LOW, HIGH, LOW); // 前进
-                }
-                // 后退区域（大致在45度到135度之间）
-                else if (angleDegrees > 45 && angleDegrees < 135) {
-                    ControlMotor(LOW, HIGH, LOW, HIGH); // 后退
-                }
-                // 右转区域（大致在-45度到45度之间）
-                else if (angleDegrees >= -45 && angleDegrees <= 45) {
-                    ControlMotor(LOW, HIGH, HIGH, LOW); // 右转
-                }
-                // 左转区域（135度到180度或-180度到-135度之间）
-                else {
-                    ControlMotor(HIGH, LOW, LOW, HIGH); // 左转
-                }
+                motion_controller_.Post(dirX / length * distance, dirY / length * distance);
             }
         });
         
+        ParameterList driveParams;
+        driveParams.AddParameter(Parameter("linear", "前进速度 (mm/s)，负数为后退", kValueTypeNumber));
+        driveParams.AddParameter(Parameter("angular", "转向角速度 (度/秒)，正数向左", kValueTypeNumber));
+        
+        methods_.AddMethod("Drive", "按线速度和角速度闭环行驶（需要编码器）", driveParams, [this](const ParameterList& parameters) {
+            if (!closed_loop_) {
+                ESP_LOGW(TAG, "Drive needs wheel encoders, use Move or Forward instead");
+                return;
+            }
+            float linear = parameters["linear"].number();
+            float angular = parameters["angular"].number() * static_cast<float>(M_PI) / 180.0f;
+            linear = std::clamp(linear, -(float)CONFIG_MOTOR_MAX_WHEEL_SPEED, (float)CONFIG_MOTOR_MAX_WHEEL_SPEED);
+            
+            motion_controller_.Cancel();
+            std::lock_guard<std::mutex> lock(output_mutex_);
+            target_linear_ = linear;
+            target_angular_ = angular;
+            motion_ = 0;
+            velocity_mode_ = true;
+        });
+        
         ParameterList speedParams;
         speedParams.AddParameter(Parameter("speed", "速度 (100-255)", kValueTypeNumber));
         
         methods_.AddMethod("SetSpeed", "设置电机速度", speedParams, [this](const ParameterList& parameters) {
             int speed = parameters["speed"].number();
-            motor_speed_ = speed < MIN_SPEED ? MIN_SPEED : (speed > MAX_SPEED ? MAX_SPEED : speed);
+            SetMotorSpeed(speed);
         });
         
         methods_.AddMethod("Forward", "向前移动", speedParams, [this](const ParameterList& parameters) {
@@ -662,7 +976,8 @@ public:
                 // 使用默认速度
             }
             
-            motor_speed_ = speed < MIN_SPEED ? MIN_SPEED : (speed > MAX_SPEED ? MAX_SPEED : speed);
+            motion_controller_.Cancel();
+            SetMotorSpeed(speed);
             ControlMotor(HIGH, LOW, HIGH, LOW);
         });
         
@@ -679,7 +994,8 @@ public:
                 // 使用默认速度
             }
             
-            motor_speed_ = speed < MIN_SPEED ? MIN_SPEED : (speed > MAX_SPEED ? MAX_SPEED : speed);
+            motion_controller_.Cancel();
+            SetMotorSpeed(speed);
             ControlMotor(LOW, HIGH, LOW, HIGH);
         });
         
@@ -696,7 +1012,8 @@ public:
                 // 使用默认速度
             }
             
-            motor_speed_ = speed < MIN_SPEED ? MIN_SPEED : (speed > MAX_SPEED ? MAX_SPEED : speed);
+            motion_controller_.Cancel();
+            SetMotorSpeed(speed);
             ControlMotor(HIGH, LOW, LOW, HIGH);
         });
         
@@ -713,7 +1030,8 @@ public:
                 // 使用默认速度
             }
             
-            motor_speed_ = speed < MIN_SPEED ? MIN_SPEED : (speed > MAX_SPEED ? MAX_SPEED : speed);
+            motion_controller_.Cancel();
+            SetMotorSpeed(speed);
             ControlMotor(LOW, HIGH, HIGH, LOW);
         });
         
@@ -726,6 +1044,9 @@ public:
                 return;
             }
             
+            // 停止指令立即生效，丢弃运动循环中尚未输出的摇杆指令
+            motion_controller_.Cancel();
+            
             bool brake = false;
             try {
                 brake = parameters["brake"].boolean();
@@ -746,6 +1067,14 @@ public:
     }
     
     ~Motor() {
+        motion_controller_.Cancel();
+        if (control_timer_) {
+            esp_timer_stop(control_timer_);
+            esp_timer_delete(control_timer_);
+        }
+        if (control_task_) {
+            vTaskDelete(control_task_);
+        }
         // 确保电机停止
         ControlMotor(LOW, LOW, LOW, LOW);
     }
@@ -386,8 +386,9 @@ static esp_err_t init_lu9685_servo(servo_controller_t *controller) {
     
     // 重置所有舵机到中间位置
     for (int i = 0; i < 16; i++) {
-        lu9685_set_channel_angle(controller->lu9685.handle, i, 90);
+        lu9685_stage_channel_angle(controller->lu9685.handle, i, 90);
     }
+    lu9685_flush(controller->lu9685.handle);
     
     ESP_LOGI(TAG_CTRL, "LU9685 servo controller initialized successfully");
     return ESP_OK;
@@ -18,6 +18,8 @@
 #include "../boards/common/board.h"
 #include "../thing.h"
 #include "../thing_manager.h"
+#include "hardware/sensor_history.h"
+#include "hardware/obstacle_supervisor.h"
 #include "ext/include/multiplexer.h"
 #include "ext/include/pcf8575.h"
 
@@ -28,16 +30,25 @@ static constexpr char TAG[] = "Ultrasonic";
 
 // Default configurations
 #define DEFAULT_SAFE_DISTANCE_CM         15                  // Default safe distance in cm for obstacle detection
+#ifdef CONFIG_US_MAX_DISTANCE
+#define DEFAULT_MAX_DISTANCE_CM          CONFIG_US_MAX_DISTANCE
+#else
 #define DEFAULT_MAX_DISTANCE_CM          400                 // Maximum measurable distance in cm
+#endif
 #define DEFAULT_MIN_DISTANCE_CM          2                   // Minimum reliable distance in cm
-#define DEFAULT_ECHO_TIMEOUT_US          25000               // Echo timeout in microseconds (for 400cm max distance)
-#define DEFAULT_MEASURE_INTERVAL_MS      100                 // Measurement interval in ms
+#define DEFAULT_ECHO_TIMEOUT_US          (DEFAULT_MAX_DISTANCE_CM * 2 * 10000 / 343)  // Round trip at the max distance (23.3ms for 400cm)
+#define DEFAULT_MEASURE_INTERVAL_MS      50                  // Measurement interval of each sensor in ms (20Hz)
+#define PCF8575_MIN_MEASURE_INTERVAL_MS  50                  // PCF8575 sensors poll the echo over I2C, at most 20Hz each to bound the bus load
+#define PCF8575_ECHO_FIRST_POLL_US       400                 // The echo cannot rise before the 40kHz burst has been sent
+#define PCF8575_ECHO_POLL_US             250                 // Echo level read cadence, the task blocks in between (~2cm per edge)
+#define STATS_INTERVAL_US                10000000            // Log the measured rates every 10s
 
 // Sensor constants
 #define SC_SOUND_SPEED_M_S               343                 // Sound speed in m/s at 20°C
 #define SC_MIN_DISTANCE_CM               DEFAULT_MIN_DISTANCE_CM
 #define SC_MAX_DISTANCE_CM               DEFAULT_MAX_DISTANCE_CM
 #define SC_ONE_ECHO_TIMEOUT_US           DEFAULT_ECHO_TIMEOUT_US
+#define SC_ECHO_START_DELAY_US           1000                // Trigger to echo rising edge, the 40kHz burst takes ~500us
 #define SC_IO_MODE_OUTPUT                1
 #define SC_IO_MODE_INPUT                 0
 #define SC_IO_LEVEL_HIGH                 1
@@ -76,6 +87,17 @@ struct ultrasonic_sensor_config_t {
     float min_distance_cm;
     uint32_t echo_timeout_us;
     bool is_initialized;
+
+    // 调度状态，每个传感器独立的测量周期
+    uint32_t interval_us;
+    int64_t next_due_us;
+    uint32_t pings;                     // 统计周期内的测量次数
+
+    // 回波边沿时间戳，由GPIO中断写入 (仅DIRECT_GPIO)
+    TaskHandle_t notify_task;
+    volatile int64_t echo_rise_us;
+    volatile int64_t echo_fall_us;
+    volatile bool echo_done;
 };
 
 // 直接使用pcf8575.h中已经定义的函数来设置和读取引脚电平
@@ -95,6 +117,35 @@ static esp_err_t pcf8575_get_echo(ultrasonic_sensor_config_t* sensor, uint32_t*
     return pcf8575_get_level(sensor->pcf8575.handle, sensor->pcf8575.echo_pin, level);
 }
 
+static const char* position_name(ultrasonic_position_t position) {
+    switch (position) {
+        case USP_FRONT: return "front";
+        case USP_REAR:  return "rear";
+        case USP_LEFT:  return "left";
+        case USP_RIGHT: return "right";
+        default: return "unknown";
+    }
+}
+
+// 回波引脚的边沿中断：上升沿记录起点，下降沿记录终点并唤醒测量任务
+static void echo_isr_handler(void* arg) {
+    ultrasonic_sensor_config_t* sensor = static_cast<ultrasonic_sensor_config_t*>(arg);
+    int64_t now = esp_timer_get_time();
+    if (gpio_get_level(sensor->gpio.echo_pin)) {
+        sensor->echo_rise_us = now;
+    } else if (sensor->echo_rise_us != 0 && !sensor->echo_done) {
+        sensor->echo_fall_us = now;
+        sensor->echo_done = true;
+        BaseType_t woken = pdFALSE;
+        if (sensor->notify_task) {
+            vTaskNotifyGiveFromISR(sensor->notify_task, &woken);
+        }
+        if (woken) {
+            portYIELD_FROM_ISR();
+        }
+    }
+}
+
 class UltrasonicSensor : public Thing {
 private:
     std::unique_ptr<ultrasonic_sensor_config_t[]> sensors_;
@@ -102,21 +153,36 @@ private:
     float safe_distance_cm_ = DEFAULT_SAFE_DISTANCE_CM;
     bool front_obstacle_ = false;
     bool rear_obstacle_ = false;
+    float front_distance_cm_ = -1;
+    float rear_distance_cm_ = -1;
+    PropertyHandle front_property_ = 0;
+    PropertyHandle rear_property_ = 0;
     
     TaskHandle_t measure_task_handle_ = nullptr;
     esp_timer_handle_t measure_timer_handle_ = nullptr;
-    SemaphoreHandle_t measure_mutex_ = nullptr;
+    std::atomic<bool> running_{false};
+    bool isr_installed_ = false;
     
     uint32_t measure_interval_ms_ = DEFAULT_MEASURE_INTERVAL_MS;
     
+    // 测量任务占用CPU的时间，用于统计
+    int64_t busy_us_ = 0;
+    int64_t stats_start_us_ = 0;
+    
     static void measure_task(void* arg) {
         UltrasonicSensor* us = static_cast<UltrasonicSensor*>(arg);
-        while (true) {
-            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
-            us->measure_all();
+        // 第一次测距之前登记，定时器和回波中断从此可以唤醒本任务；
+        // 任务可能在 xTaskCreate 返回并写入句柄之前就开始运行
+        us->measure_task_handle_ = xTaskGetCurrentTaskHandle();
+        for (size_t i = 0; i < us->sensor_count_; i++) {
+            us->sensors_[i].notify_task = xTaskGetCurrentTaskHandle();
         }
+        us->measure_loop();
+        us->measure_task_handle_ = nullptr;
+        vTaskDelete(NULL);
     }
     
+    // 一次性定时器只负责在指定时间唤醒测量任务
     static void measure_timer_callback(void* arg) {
         UltrasonicSensor* us = static_cast<UltrasonicSensor*>(arg);
         if (us->measure_task_handle_) {
@@ -124,6 +190,19 @@ private:
         }
     }
     
+    // 阻塞到指定时间，或者 done 变为 true (回波中断) 为止
+    void wait_until(int64_t time_us, volatile bool* done = nullptr) {
+        while (running_ && !(done && *done)) {
+            int64_t remaining = time_us - esp_timer_get_time();
+            if (remaining <= 0) {
+                return;
+            }
+            esp_timer_stop(measure_timer_handle_);
+            esp_timer_start_once(measure_timer_handle_, remaining);
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+    }
+    
     bool init_gpio_sensor(ultrasonic_sensor_config_t* sensor) {
         if (!sensor || sensor->connection_type != DIRECT_GPIO) {
             return false;
@@ -140,16 +219,30 @@ private:
             return false;
         }
         
-        // Configure echo pin as input
+        // Configure echo pin as input, both edges are timestamped in the ISR
         io_conf.mode = GPIO_MODE_INPUT;
         io_conf.pin_bit_mask = (1ULL << sensor->gpio.echo_pin);
-        io_conf.intr_type = GPIO_INTR_DISABLE;
+        io_conf.intr_type = GPIO_INTR_ANYEDGE;
         io_conf.pull_down_en = GPIO_PULLDOWN_DISABLE;
         io_conf.pull_up_en = GPIO_PULLUP_ENABLE;
         if (gpio_config(&io_conf) != ESP_OK) {
             return false;
         }
         
+        // The ISR service may already be installed by the board
+        if (!isr_installed_) {
+            esp_err_t err = gpio_install_isr_service(0);
+            if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+                ESP_LOGE(TAG, "Failed to install GPIO ISR service: %s", esp_err_to_name(err));
+                return false;
+            }
+            isr_installed_ = true;
+        }
+        if (gpio_isr_handler_add(sensor->gpio.echo_pin, echo_isr_handler, sensor) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to add echo ISR on GPIO %d", sensor->gpio.echo_pin);
+            return false;
+        }
+        
         // Set initial level of trigger pin to LOW
         gpio_set_level(sensor->gpio.trigger_pin, 0);
         
@@ -173,89 +266,98 @@ private:
         return true;
     }
     
-    float measure_distance_cm(ultrasonic_sensor_config_t* sensor) {
-        if (!sensor || !sensor->is_initialized) {
-            return -1;
-        }
-        
-        esp_err_t err;
-        uint32_t echo_level = 0;
-        
-        // 触发超声波测距过程
+    // 发出10us的触发脉冲
+    bool trigger(ultrasonic_sensor_config_t* sensor) {
         if (sensor->connection_type == DIRECT_GPIO) {
-            // 设置触发引脚为高电平
             gpio_set_level(sensor->gpio.trigger_pin, 1);
-            // 保持高电平至少10us
             esp_rom_delay_us(10);
-            // 设置触发引脚为低电平
             gpio_set_level(sensor->gpio.trigger_pin, 0);
-        } else {
-            // 使用PCF8575设置触发引脚
-            err = pcf8575_set_trigger(sensor, 1);
-            if (err != ESP_OK) {
+            return true;
+        }
+        if (pcf8575_set_trigger(sensor, 1) != ESP_OK) {
+            return false;
+        }
+        esp_rom_delay_us(10);
+        return pcf8575_set_trigger(sensor, 0) == ESP_OK;
+    }
+    
+    // 直接GPIO：回波边沿由中断记录，等待期间任务阻塞，不占用CPU
+    int64_t wait_echo_gpio(ultrasonic_sensor_config_t* sensor, int64_t trigger_us) {
+        wait_until(trigger_us + SC_ECHO_START_DELAY_US + sensor->echo_timeout_us, &sensor->echo_done);
+        if (!sensor->echo_done) {
+            return -1;
+        }
+        return sensor->echo_fall_us - sensor->echo_rise_us;
+    }
+    
+    // PCF8575：回波电平只能通过I2C读取，按固定节拍轮询；两次读取之间任务阻塞在定时器上，
+    // 低优先级任务照常运行。边沿时间取前后两次读取的中点，误差不超过半个轮询周期
+    int64_t wait_echo_pcf8575(ultrasonic_sensor_config_t* sensor, int64_t trigger_us) {
+        uint32_t echo_level = 0;
+        int64_t echo_start = 0;
+        int64_t next_poll_us = trigger_us + PCF8575_ECHO_FIRST_POLL_US;
+        int64_t last_sample_us = next_poll_us;  // 回波不会在第一次读取之前上升
+        while (true) {
+            wait_until(next_poll_us);
+            if (!running_) {
                 return -1;
             }
-            // 保持高电平至少10us
-            esp_rom_delay_us(10);
-            // 设置触发引脚为低电平
-            err = pcf8575_set_trigger(sensor, 0);
+            int64_t read_start = esp_timer_get_time();
+            esp_err_t err = pcf8575_get_echo(sensor, &echo_level);
+            int64_t now = esp_timer_get_time();
+            busy_us_ += now - read_start;
             if (err != ESP_OK) {
                 return -1;
             }
-        }
-        
-        // 等待回波引脚变为高电平
-        int64_t start_time = esp_timer_get_time();
-        while (true) {
-            if (sensor->connection_type == DIRECT_GPIO) {
-                echo_level = gpio_get_level(sensor->gpio.echo_pin);
-            } else {
-                err = pcf8575_get_echo(sensor, &echo_level);
-                if (err != ESP_OK) {
+            // 电平在I2C读取的中途被采样，变化发生在上次采样和这次采样之间
+            int64_t sample_us = (read_start + now) / 2;
+            int64_t edge_us = (last_sample_us + sample_us) / 2;
+            last_sample_us = sample_us;
+            if (echo_start == 0) {
+                if (echo_level == 1) {
+                    echo_start = edge_us;
+                } else if (now - trigger_us > SC_ECHO_START_DELAY_US + sensor->echo_timeout_us) {
                     return -1;
                 }
-            }
-            
-            if (echo_level == 1) break;
-            
-            // 检查是否超时（没有回波）
-            if (esp_timer_get_time() - start_time > sensor->echo_timeout_us) {
+            } else if (echo_level == 0) {
+                return edge_us - echo_start;
+            } else if (now - echo_start > sensor->echo_timeout_us) {
                 return -1;
             }
-            
-            esp_rom_delay_us(1);  // 小延迟防止占用过多CPU
+            next_poll_us = std::max(next_poll_us + PCF8575_ECHO_POLL_US, now);
+        }
+    }
+    
+    // 单次测距，无有效回波时返回-1
+    float ping(ultrasonic_sensor_config_t* sensor) {
+        if (!sensor || !sensor->is_initialized) {
+            return -1;
         }
         
-        // 记录回波开始时间
-        int64_t echo_start = esp_timer_get_time();
+        sensor->echo_rise_us = 0;
+        sensor->echo_fall_us = 0;
+        sensor->echo_done = false;
+        ulTaskNotifyTake(pdTRUE, 0);    // 丢弃上次遗留的通知
         
-        // 等待回波引脚变为低电平
-        while (true) {
-            if (sensor->connection_type == DIRECT_GPIO) {
-                echo_level = gpio_get_level(sensor->gpio.echo_pin);
-            } else {
-                err = pcf8575_get_echo(sensor, &echo_level);
-                if (err != ESP_OK) {
-                    return -1;
-                }
-            }
-            
-            if (echo_level == 0) break;
-            
-            // 检查是否超时（回波时间过长）
-            if (esp_timer_get_time() - echo_start > sensor->echo_timeout_us) {
-                return -1;
-            }
-            
-            esp_rom_delay_us(1);  // 小延迟防止占用过多CPU
+        int64_t trigger_us = esp_timer_get_time();
+        if (!trigger(sensor)) {
+            return -1;
+        }
+        int64_t triggered_us = esp_timer_get_time();
+        busy_us_ += triggered_us - trigger_us;
+        int64_t echo_duration;
+        if (sensor->connection_type == DIRECT_GPIO) {
+            echo_duration = wait_echo_gpio(sensor, trigger_us);
+        } else {
+            echo_duration = wait_echo_pcf8575(sensor, trigger_us);
+        }
+        if (echo_duration <= 0) {
+            return -1;
         }
-        
-        // 计算回波持续时间（微秒）
-        int64_t echo_duration = esp_timer_get_time() - echo_start;
         
         // 计算距离：距离 = (声速 × 时间) ÷ 2
         // 声速约为343米/秒，转换为厘米/微秒为0.0343厘米/微秒
-        float distance_cm = static_cast<float>(echo_duration) * 0.0343 / 2.0;
+        float distance_cm = static_cast<float>(echo_duration) * 0.0343f / 2.0f;
         
         // 距离范围检查
         if (distance_cm < sensor->min_distance_cm || distance_cm > sensor->max_distance_cm) {
@@ -265,67 +367,127 @@ private:
         return distance_cm;
     }
     
-    void measure_all() {
-        if (!measure_mutex_) return;
-        
-        // 获取互斥锁
-        if (xSemaphoreTake(measure_mutex_, pdMS_TO_TICKS(10)) == pdFALSE) {
-            return;
+    void update_reading(ultrasonic_sensor_config_t* sensor, float distance) {
+        bool obstacle = distance > 0 && distance < safe_distance_cm_;
+        const char* pos_str = position_name(sensor->position);
+        switch (sensor->position) {
+            case USP_FRONT:
+                // 先交给安全监控，电机限速不等属性更新和日志
+                ObstacleSupervisor::GetInstance().OnDistance(MotionDirection::kForward, distance);
+                front_obstacle_ = obstacle;
+                front_distance_cm_ = distance;
+                properties_[front_property_].MarkChanged();
+                SetValue("front_distance", distance > 0 ? distance : NAN);
+                break;
+            case USP_REAR:
+                ObstacleSupervisor::GetInstance().OnDistance(MotionDirection::kBackward, distance);
+                rear_obstacle_ = obstacle;
+                rear_distance_cm_ = distance;
+                properties_[rear_property_].MarkChanged();
+                SetValue("rear_distance", distance > 0 ? distance : NAN);
+                break;
+            default:
+                break;
         }
         
-        bool new_front_obstacle = false;
-        bool new_rear_obstacle = false;
-        
-        // 测量每个传感器的距离
+        if (distance > 0) {
+            ESP_LOGD(TAG, "%s distance: %.1f cm", pos_str, distance);
+            char history_id[16];
+            snprintf(history_id, sizeof(history_id), "us.%s", pos_str);
+            SensorHistory::GetInstance().Record(history_id, distance, "cm");
+        }
+    }
+    
+    void log_stats(int64_t now) {
+        int64_t elapsed_us = now - stats_start_us_;
         for (size_t i = 0; i < sensor_count_; i++) {
-            float distance = measure_distance_cm(&sensors_[i]);
+            ESP_LOGI(TAG, "%s: %.1f Hz", position_name(sensors_[i].position),
+                sensors_[i].pings * 1000000.0f / elapsed_us);
+            sensors_[i].pings = 0;
+        }
+        ESP_LOGI(TAG, "Measure task CPU %.2f%%", busy_us_ * 100.0f / elapsed_us);
+        busy_us_ = 0;
+        stats_start_us_ = now;
+    }
+    
+    // PCF8575传感器测一次要在整个回波时间内读I2C，周期不短于PCF8575_MIN_MEASURE_INTERVAL_MS
+    static uint32_t interval_us_for(const ultrasonic_sensor_config_t* sensor, uint32_t interval_ms) {
+        if (sensor->connection_type == PCF8575_GPIO) {
+            interval_ms = std::max<uint32_t>(interval_ms, PCF8575_MIN_MEASURE_INTERVAL_MS);
+        }
+        return interval_ms * 1000;
+    }
+    
+    // 调度器：同一时间只有一个传感器在测距，避免相互串扰；每个传感器按自己的周期轮流触发，
+    // 两次触发之间至少间隔一个最大量程的往返时间，让上一次的声波衰减
+    void measure_loop() {
+        size_t next = 0;
+        stats_start_us_ = esp_timer_get_time();
+        
+        while (running_) {
+            int64_t now = esp_timer_get_time();
+            if (now - stats_start_us_ >= STATS_INTERVAL_US) {
+                log_stats(now);
+            }
             
-            // 记录障碍物状态
-            if (distance > 0 && distance < safe_distance_cm_) {
-                switch (sensors_[i].position) {
-                    case USP_FRONT:
-                        new_front_obstacle = true;
-                        break;
-                    case USP_REAR:
-                        new_rear_obstacle = true;
-                        break;
-                    default:
-                        break;
+            // 从上次之后的传感器开始找第一个到期的
+            ultrasonic_sensor_config_t* sensor = nullptr;
+            int64_t earliest_due = INT64_MAX;
+            for (size_t n = 0; n < sensor_count_; n++) {
+                size_t i = (next + n) % sensor_count_;
+                if (sensors_[i].next_due_us <= now) {
+                    sensor = &sensors_[i];
+                    next = i + 1;
+                    break;
                 }
+                earliest_due = std::min(earliest_due, sensors_[i].next_due_us);
+            }
+            if (sensor == nullptr) {
+                wait_until(earliest_due);
+                continue;
             }
             
-            // 记录日志（仅在值有效或状态改变时）
-            if (distance > 0 || 
-                (sensors_[i].position == USP_FRONT && front_obstacle_ != new_front_obstacle) || 
-                (sensors_[i].position == USP_REAR && rear_obstacle_ != new_rear_obstacle)) {
-                
-                const char* pos_str = "unknown";
-                switch (sensors_[i].position) {
-                    case USP_FRONT: pos_str = "front"; break;
-                    case USP_REAR:  pos_str = "rear";  break;
-                    case USP_LEFT:  pos_str = "left";  break;
-                    case USP_RIGHT: pos_str = "right"; break;
-                    default: break;
-                }
-                
-                if (distance > 0) {
-                    ESP_LOGD(TAG, "%s distance: %.1f cm", pos_str, distance);
-                } else {
-                    ESP_LOGD(TAG, "%s sensor: no valid reading", pos_str);
-                }
+            int64_t trigger_us = esp_timer_get_time();
+            float distance = ping(sensor);
+            int64_t done_us = esp_timer_get_time();
+            update_reading(sensor, distance);
+            sensor->pings++;
+            busy_us_ += esp_timer_get_time() - done_us;
+            
+            // 落后超过一个周期时不补测
+            sensor->next_due_us += sensor->interval_us;
+            if (sensor->next_due_us < trigger_us) {
+                sensor->next_due_us = trigger_us + sensor->interval_us;
             }
+            
+            wait_until(trigger_us + SC_ECHO_START_DELAY_US + sensor->echo_timeout_us);
         }
-        
-        // 更新障碍物状态
-        front_obstacle_ = new_front_obstacle;
-        rear_obstacle_ = new_rear_obstacle;
-        
-        // 释放互斥锁
-        xSemaphoreGive(measure_mutex_);
     }
     
 public:
-    UltrasonicSensor() : Thing("UltrasonicSensor", "Ultrasonic distance sensor") {}
+    UltrasonicSensor() : Thing("UltrasonicSensor", "Ultrasonic distance sensor") {
+        // 距离只在 update_reading() 中写入并标记变化，状态上报不必每次读取
+        front_property_ = properties_.AddNumberProperty("front_distance", "Front distance (cm), -1 without an echo",
+            [this]() { return static_cast<int>(front_distance_cm_); });
+        rear_property_ = properties_.AddNumberProperty("rear_distance", "Rear distance (cm), -1 without an echo",
+            [this]() { return static_cast<int>(rear_distance_cm_); });
+        properties_[front_property_].set_change_tracked(true);
+        properties_[rear_property_].set_change_tracked(true);
+        
+        ParameterList rateParams;
+        rateParams.AddParameter(Parameter("rate", "Measurements per second of each sensor (1-50)", kValueTypeNumber));
+        methods_.AddMethod("set_rate", "Set the measurement rate of the ultrasonic sensors", rateParams,
+            [this](const ParameterList& params) {
+                int rate = params["rate"].number();
+                if (rate > 0) {
+                    set_measure_interval(1000 / rate);
+                }
+            });
+        
+        // 浮点距离供 GetValues() 的使用者 (如网页传感器推送) 读取，NAN表示没有回波
+        SetValue("front_distance", NAN);
+        SetValue("rear_distance", NAN);
+    }
     
     bool init() {
         ESP_LOGI(TAG, "Initializing UltrasonicSensor");
@@ -451,14 +613,7 @@ public:
             return false;
         }
         
-        // 创建测量任务
-        xTaskCreate(measure_task, "us_measure", 4096, this, 5, &measure_task_handle_);
-        if (!measure_task_handle_) {
-            ESP_LOGE(TAG, "Failed to create measure task");
-            return false;
-        }
-        
-        // 创建定时器
+        // 创建定时器，测量任务用它在下一个时隙或回波超时时醒来
         esp_timer_create_args_t timer_args = {
             .callback = measure_timer_callback,
             .arg = this,
@@ -472,17 +627,38 @@ public:
             return false;
         }
         
-        // 启动定时器
-        if (esp_timer_start_periodic(measure_timer_handle_, measure_interval_ms_ * 1000) != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to start measure timer");
-            return false;
+        // 初始相位错开，每个传感器按自己的周期测量
+        int64_t now = esp_timer_get_time();
+        for (size_t i = 0; i < sensor_count_; i++) {
+            sensors_[i].interval_us = interval_us_for(&sensors_[i], measure_interval_ms_);
+            sensors_[i].next_due_us = now + i * sensors_[i].interval_us / sensor_count_;
         }
         
-        ESP_LOGI(TAG, "Initialized %d ultrasonic sensors", sensor_count_);
+        // 创建测量任务
+        running_ = true;
+        xTaskCreate(measure_task, "us_measure", 4096, this, 5, &measure_task_handle_);
+        if (!measure_task_handle_) {
+            ESP_LOGE(TAG, "Failed to create measure task");
+            running_ = false;
+            return false;
+        }
+        for (size_t i = 0; i < sensor_count_; i++) {
+            ESP_LOGI(TAG, "%s sensor at %lu Hz", position_name(sensors_[i].position),
+                (unsigned long)(1000000 / sensors_[i].interval_us));
+        }
         return true;
     }
     
     void deinit() {
+        // 通知测量任务退出，最多等待一个测量时隙
+        if (measure_task_handle_) {
+            running_ = false;
+            xTaskNotifyGive(measure_task_handle_);
+            for (int i = 0; i < 10 && measure_task_handle_ != nullptr; i++) {
+                vTaskDelay(pdMS_TO_TICKS(10));
+            }
+        }
+        
         // 停止定时器
         if (measure_timer_handle_) {
             esp_timer_stop(measure_timer_handle_);
@@ -490,16 +666,11 @@ public:
             measure_timer_handle_ = nullptr;
         }
         
-        // 删除任务
-        if (measure_task_handle_) {
-            vTaskDelete(measure_task_handle_);
-            measure_task_handle_ = nullptr;
-        }
-        
-        // 释放互斥锁
-        if (measure_mutex_) {
-            vSemaphoreDelete(measure_mutex_);
-            measure_mutex_ = nullptr;
+        // 移除回波中断
+        for (size_t i = 0; i < sensor_count_; i++) {
+            if (sensors_[i].connection_type == DIRECT_GPIO && sensors_[i].is_initialized) {
+                gpio_isr_handler_remove(sensors_[i].gpio.echo_pin);
+            }
         }
         
         // 清除传感器配置
@@ -525,14 +696,12 @@ public:
         return safe_distance_cm_;
     }
     
+    // 每个传感器的测量周期；传感器数量 × 最大量程往返时间 决定了能达到的最高频率
     void set_measure_interval(uint32_t ms) {
-        if (ms >= 10 && ms <= 1000) {
+        if (ms >= 20 && ms <= 1000) {
             measure_interval_ms_ = ms;
-            
-            // 更新定时器间隔
-            if (measure_timer_handle_) {
-                esp_timer_stop(measure_timer_handle_);
-                esp_timer_start_periodic(measure_timer_handle_, measure_interval_ms_ * 1000);
+            for (size_t i = 0; i < sensor_count_; i++) {
+                sensors_[i].interval_us = interval_us_for(&sensors_[i], ms);
             }
         }
     }
@@ -554,6 +723,12 @@ void RegisterUS() {
         instance = new UltrasonicSensor();
         ThingManager::GetInstance().AddThing(instance);
         ESP_LOGI(TAG, "Ultrasonic Sensor Thing registered to ThingManager");
+        // 避障安全监控依赖持续的测量，只有传感器启动成功才启用
+        if (instance->init()) {
+#ifdef CONFIG_ENABLE_OBSTACLE_SUPERVISOR
+            ObstacleSupervisor::GetInstance().Start();
+#endif
+        }
     }
 }
 } // namespace iot
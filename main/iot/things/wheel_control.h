@@ -0,0 +1,213 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace iot {
+
+/**
+ * @brief Gains of one wheel, speeds in mm/s and duty in LEDC counts (-255..255)
+ */
+struct WheelPidConfig {
+    float kp = 0.25f;               // Duty per mm/s of speed error
+    float ki = 2.0f;                // Duty per mm of accumulated speed error
+    float kd = 0.0f;                // Duty per mm/s² of measured acceleration
+    float kf = 0.35f;               // Feed-forward duty per mm/s of setpoint
+    float static_duty = 40.0f;      // Feed-forward duty that overcomes static friction
+    float max_duty = 255.0f;
+    float d_filter_hz = 10.0f;      // Low-pass on the derivative term
+};
+
+/**
+ * @brief Velocity PID of one wheel with feed-forward and anti-windup
+ *
+ * The feed-forward term carries most of the duty so the PID only corrects for battery voltage,
+ * friction and load. The integrator is frozen while the output is saturated in the direction
+ * of the error (conditional integration) and never exceeds the output range. The derivative
+ * acts on the filtered measurement, so a setpoint step does not kick the output. A zero
+ * setpoint returns zero duty and clears the state, the wheel then stops on its own instead of
+ * being held against the load.
+ */
+class WheelSpeedPid {
+public:
+    explicit WheelSpeedPid(const WheelPidConfig& config = WheelPidConfig()) : config_(config) {}
+
+    void SetConfig(const WheelPidConfig& config) { config_ = config; }
+    const WheelPidConfig& config() const { return config_; }
+
+    void Reset() {
+        integral_ = 0.0f;
+        derivative_ = 0.0f;
+        output_ = 0.0f;
+        has_last_ = false;
+    }
+
+    /**
+     * @brief One control step
+     * @param setpoint Wanted wheel speed, mm/s
+     * @param measured Measured wheel speed, mm/s
+     * @param dt Seconds since the previous step
+     * @return Signed duty
+     */
+    float Update(float setpoint, float measured, float dt) {
+        if (dt <= 0.0f) {
+            return output_;
+        }
+        if (setpoint == 0.0f) {
+            Reset();
+            return 0.0f;
+        }
+
+        const WheelPidConfig& c = config_;
+        float error = setpoint - measured;
+        float feed_forward = c.kf * setpoint + std::copysign(c.static_duty, setpoint);
+
+        if (has_last_ && c.kd != 0.0f) {
+            float raw = -(measured - last_measured_) / dt;
+            float alpha = dt / (dt + 1.0f / (2.0f * kPi * c.d_filter_hz));
+            derivative_ += alpha * (raw - derivative_);
+        }
+        last_measured_ = measured;
+        has_last_ = true;
+
+        float unsaturated = feed_forward + c.kp * error + integral_ + c.kd * derivative_;
+        float output = std::clamp(unsaturated, -c.max_duty, c.max_duty);
+        bool winding_up = (unsaturated > c.max_duty && error > 0.0f) || (unsaturated < -c.max_duty && error < 0.0f);
+        if (!winding_up) {
+            integral_ = std::clamp(integral_ + c.ki * error * dt, -c.max_duty, c.max_duty);
+        }
+        output_ = output;
+        return output;
+    }
+
+    float integral() const { return integral_; }
+    float output() const { return output_; }
+
+private:
+    static constexpr float kPi = 3.14159265f;
+
+    WheelPidConfig config_;
+    float integral_ = 0.0f;
+    float derivative_ = 0.0f;
+    float output_ = 0.0f;
+    float last_measured_ = 0.0f;
+    bool has_last_ = false;
+};
+
+/**
+ * @brief Wheel speed from encoder counts, low-pass filtered against the count quantization
+ */
+class WheelSpeedEstimator {
+public:
+    /**
+     * @param mm_per_count Travel of the wheel per encoder count
+     * @param filter_hz Cut-off of the low-pass, 0 disables it
+     */
+    explicit WheelSpeedEstimator(float mm_per_count = 1.0f, float filter_hz = 20.0f)
+        : mm_per_count_(mm_per_count), filter_hz_(filter_hz) {}
+
+    void Reset() { speed_ = 0.0f; }
+
+    // Counts since the previous call, signed; returns mm/s
+    float Update(int32_t count_delta, float dt) {
+        if (dt <= 0.0f) {
+            return speed_;
+        }
+        float raw = count_delta * mm_per_count_ / dt;
+        if (filter_hz_ <= 0.0f) {
+            speed_ = raw;
+        } else {
+            float alpha = dt / (dt + 1.0f / (2.0f * 3.14159265f * filter_hz_));
+            speed_ += alpha * (raw - speed_);
+        }
+        return speed_;
+    }
+
+    float speed() const { return speed_; }
+
+private:
+    float mm_per_count_;
+    float filter_hz_;
+    float speed_ = 0.0f;
+};
+
+/**
+ * @brief Left / right wheel speeds in mm/s
+ */
+struct WheelSpeeds {
+    float left = 0.0f;
+    float right = 0.0f;
+};
+
+/**
+ * @brief Differential drive kinematics from body velocity to wheel speed setpoints
+ *
+ * Wheel speeds above max_wheel_speed scale both wheels down together, so the driven curve keeps
+ * its radius and only becomes slower. Setpoint changes are limited to max_accel, again by the
+ * same factor for both wheels.
+ */
+class DifferentialDrive {
+public:
+    /**
+     * @param track_mm Distance between the wheel contact points
+     * @param max_wheel_speed Fastest wheel speed the motors reach under load, mm/s
+     * @param max_accel Largest wheel speed change per second, mm/s², 0 for no limit
+     */
+    DifferentialDrive(float track_mm, float max_wheel_speed, float max_accel)
+        : track_mm_(track_mm), max_wheel_speed_(max_wheel_speed), max_accel_(max_accel) {}
+
+    /**
+     * @brief Wheel speeds for a body velocity without the acceleration limit
+     * @param linear Forward speed, mm/s
+     * @param angular Turn rate, rad/s, counter-clockwise (left) positive
+     */
+    WheelSpeeds Compute(float linear, float angular) const {
+        WheelSpeeds speeds;
+        speeds.left = linear - angular * track_mm_ * 0.5f;
+        speeds.right = linear + angular * track_mm_ * 0.5f;
+        float peak = std::max(std::fabs(speeds.left), std::fabs(speeds.right));
+        if (peak > max_wheel_speed_) {
+            float scale = max_wheel_speed_ / peak;
+            speeds.left *= scale;
+            speeds.right *= scale;
+        }
+        return speeds;
+    }
+
+    /**
+     * @brief Move the setpoints toward a body velocity, called once per control step
+     */
+    const WheelSpeeds& Update(float linear, float angular, float dt) {
+        WheelSpeeds target = Compute(linear, angular);
+        float delta_left = target.left - setpoint_.left;
+        float delta_right = target.right - setpoint_.right;
+        float largest = std::max(std::fabs(delta_left), std::fabs(delta_right));
+        float step = max_accel_ * dt;
+        if (max_accel_ > 0.0f && largest > step) {
+            float scale = step / largest;
+            delta_left *= scale;
+            delta_right *= scale;
+        }
+        setpoint_.left += delta_left;
+        setpoint_.right += delta_right;
+        return setpoint_;
+    }
+
+    void Reset() { setpoint_ = WheelSpeeds(); }
+    const WheelSpeeds& setpoint() const { return setpoint_; }
+
+    // Body velocity of measured wheel speeds, the inverse of Compute()
+    void BodyVelocity(const WheelSpeeds& wheels, float& linear, float& angular) const {
+        linear = (wheels.left + wheels.right) * 0.5f;
+        angular = (wheels.right - wheels.left) / track_mm_;
+    }
+
+private:
+    float track_mm_;
+    float max_wheel_speed_;
+    float max_accel_;
+    WheelSpeeds setpoint_;
+};
+
+} // namespace iot
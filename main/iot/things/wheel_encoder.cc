@@ -0,0 +1,104 @@
+#include "wheel_encoder.h"
+
+#include <esp_log.h>
+
+#define TAG "WheelEncoder"
+
+namespace iot {
+
+// The hardware counter wraps at these limits, the driver accumulates the overflows
+static constexpr int kCountLimit = 30000;
+// Shorter pulses are treated as noise from the motor brushes
+static constexpr int kGlitchFilterNs = 1000;
+
+bool WheelEncoder::Init(int pin_a, int pin_b) {
+    if (unit_ != nullptr) {
+        return true;
+    }
+    if (pin_a < 0) {
+        return false;
+    }
+
+    pcnt_unit_config_t unit_config = {};
+    unit_config.low_limit = -kCountLimit;
+    unit_config.high_limit = kCountLimit;
+    unit_config.flags.accum_count = 1;
+    esp_err_t err = pcnt_new_unit(&unit_config, &unit_);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create PCNT unit: %s", esp_err_to_name(err));
+        unit_ = nullptr;
+        return false;
+    }
+
+    pcnt_glitch_filter_config_t filter_config = {};
+    filter_config.max_glitch_ns = kGlitchFilterNs;
+    pcnt_unit_set_glitch_filter(unit_, &filter_config);
+
+    has_direction_ = pin_b >= 0;
+    pcnt_chan_config_t channel_a = {};
+    channel_a.edge_gpio_num = pin_a;
+    channel_a.level_gpio_num = has_direction_ ? pin_b : -1;
+    err = pcnt_new_channel(unit_, &channel_a, &channels_[0]);
+    if (err == ESP_OK && has_direction_) {
+        pcnt_chan_config_t channel_b = {};
+        channel_b.edge_gpio_num = pin_b;
+        channel_b.level_gpio_num = pin_a;
+        err = pcnt_new_channel(unit_, &channel_b, &channels_[1]);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create PCNT channel on GPIO %d/%d: %s", pin_a, pin_b, esp_err_to_name(err));
+        Deinit();
+        return false;
+    }
+
+    if (has_direction_) {
+        // 4x quadrature decoding, A leading B counts up
+        pcnt_channel_set_edge_action(channels_[0], PCNT_CHANNEL_EDGE_ACTION_DECREASE, PCNT_CHANNEL_EDGE_ACTION_INCREASE);
+        pcnt_channel_set_level_action(channels_[0], PCNT_CHANNEL_LEVEL_ACTION_KEEP, PCNT_CHANNEL_LEVEL_ACTION_INVERSE);
+        pcnt_channel_set_edge_action(channels_[1], PCNT_CHANNEL_EDGE_ACTION_INCREASE, PCNT_CHANNEL_EDGE_ACTION_DECREASE);
+        pcnt_channel_set_level_action(channels_[1], PCNT_CHANNEL_LEVEL_ACTION_KEEP, PCNT_CHANNEL_LEVEL_ACTION_INVERSE);
+    } else {
+        pcnt_channel_set_edge_action(channels_[0], PCNT_CHANNEL_EDGE_ACTION_INCREASE, PCNT_CHANNEL_EDGE_ACTION_HOLD);
+        pcnt_channel_set_level_action(channels_[0], PCNT_CHANNEL_LEVEL_ACTION_KEEP, PCNT_CHANNEL_LEVEL_ACTION_KEEP);
+    }
+
+    // Reaching a limit resets the hardware counter, the watch points let the driver add the overflow
+    pcnt_unit_add_watch_point(unit_, -kCountLimit);
+    pcnt_unit_add_watch_point(unit_, kCountLimit);
+
+    pcnt_unit_enable(unit_);
+    pcnt_unit_clear_count(unit_);
+    pcnt_unit_start(unit_);
+    last_count_ = 0;
+    ESP_LOGI(TAG, "Encoder on GPIO %d/%d (%s)", pin_a, pin_b, has_direction_ ? "quadrature" : "single channel");
+    return true;
+}
+
+void WheelEncoder::Deinit() {
+    if (unit_ == nullptr) {
+        return;
+    }
+    pcnt_unit_stop(unit_);
+    pcnt_unit_disable(unit_);
+    for (auto& channel : channels_) {
+        if (channel != nullptr) {
+            pcnt_del_channel(channel);
+            channel = nullptr;
+        }
+    }
+    pcnt_del_unit(unit_);
+    unit_ = nullptr;
+}
+
+int32_t WheelEncoder::TakeDelta() {
+    if (unit_ == nullptr) {
+        return 0;
+    }
+    int count = 0;
+    pcnt_unit_get_count(unit_, &count);
+    int32_t delta = count - last_count_;
+    last_count_ = count;
+    return delta;
+}
+
+} // namespace iot
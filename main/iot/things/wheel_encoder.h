@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <driver/pulse_cnt.h>
+
+namespace iot {
+
+/**
+ * @brief Wheel encoder counted in hardware by one PCNT unit
+ *
+ * With both channels a quadrature encoder is decoded in 4x mode and the count carries the
+ * direction. With only channel A (a single hall sensor) rising edges are counted and the
+ * count is always positive, the caller has to apply the sign of the driven direction.
+ * Counts are accumulated beyond the 16 bit hardware counter, so TakeDelta() never wraps.
+ */
+class WheelEncoder {
+public:
+    WheelEncoder() = default;
+    ~WheelEncoder() { Deinit(); }
+
+    WheelEncoder(const WheelEncoder&) = delete;
+    WheelEncoder& operator=(const WheelEncoder&) = delete;
+
+    /**
+     * @param pin_a Channel A GPIO
+     * @param pin_b Channel B GPIO, -1 for a single channel sensor
+     */
+    bool Init(int pin_a, int pin_b);
+    void Deinit();
+
+    bool initialized() const { return unit_ != nullptr; }
+    bool has_direction() const { return has_direction_; }
+
+    // Counts since the previous call
+    int32_t TakeDelta();
+
+private:
+    pcnt_unit_handle_t unit_ = nullptr;
+    pcnt_channel_handle_t channels_[2] = {nullptr, nullptr};
+    bool has_direction_ = false;
+    int last_count_ = 0;
+};
+
+} // namespace iot
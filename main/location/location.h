@@ -44,6 +44,7 @@ public:
     virtual void Stop() override;
     virtual bool IsRunning() const override;
     virtual const char* GetName() const override;
+    virtual std::vector<const char*> GetDependencies() const override { return {"Web"}; }
     
     // GPS和定位功能
     bool StartGPS();
@@ -0,0 +1,115 @@
+#include "main_task_queue.h"
+#include "trace.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#define TAG "MainTaskQueue"
+
+void MainTaskQueue::Push(MainTask&& task, SchedulePriority priority) {
+    Lane& lane = priority == kSchedulePriorityCritical ? critical_ : normal_;
+    if (task.boxed()) {
+        boxed_++;
+    }
+
+    if (lane.overflow_size.load(std::memory_order_acquire) > 0 || !lane.ring.TryPush(std::move(task))) {
+        std::lock_guard<std::mutex> lock(lane.overflow_mutex);
+        lane.overflow.push_back(std::move(task));
+        lane.overflow_size++;
+        overflowed_++;
+    }
+
+    uint32_t depth = lane.Size();
+    if (depth > lane.max_depth.load(std::memory_order_relaxed)) {
+        lane.max_depth = depth;
+    }
+}
+
+bool MainTaskQueue::Pop(Lane& lane, MainTask& task) {
+    if (lane.ring.TryPop(task)) {
+        return true;
+    }
+    if (lane.overflow_size.load(std::memory_order_acquire) == 0) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(lane.overflow_mutex);
+    if (lane.overflow.empty()) {
+        return false;
+    }
+    // Entries pushed to the ring before the overflow started have been consumed above
+    task = std::move(lane.overflow.front());
+    lane.overflow.pop_front();
+    lane.overflow_size--;
+    return true;
+}
+
+void MainTaskQueue::Execute(MainTask& task) {
+    int64_t start = esp_timer_get_time();
+    {
+        TRACE_SCOPE_ARG("scheduled_task", task.target());
+        task();
+        task.Reset();
+    }
+    uint32_t elapsed = (uint32_t)(esp_timer_get_time() - start);
+
+    executed_++;
+    uint32_t avg = callback_avg_us_.load(std::memory_order_relaxed);
+    callback_avg_us_ = avg == 0 ? elapsed : avg - avg / 8 + elapsed / 8;
+    if (elapsed > callback_max_us_.load(std::memory_order_relaxed)) {
+        callback_max_us_ = elapsed;
+    }
+    if (elapsed > kSlowCallbackUs) {
+        slow_callbacks_++;
+        ESP_LOGW(TAG, "Scheduled callback took %lu ms", (unsigned long)(elapsed / 1000));
+    }
+}
+
+bool MainTaskQueue::RunPending(size_t max_normal_tasks) {
+    MainTask task;
+    size_t normal_executed = 0;
+    while (true) {
+        while (Pop(critical_, task)) {
+            Execute(task);
+        }
+        if (normal_executed >= max_normal_tasks) {
+            return normal_.Size() > 0;
+        }
+        if (!Pop(normal_, task)) {
+            return false;
+        }
+        Execute(task);
+        normal_executed++;
+    }
+}
+
+MainTaskQueueMetrics MainTaskQueue::GetMetrics() const {
+    MainTaskQueueMetrics metrics;
+    metrics.critical_depth = critical_.Size();
+    metrics.normal_depth = normal_.Size();
+    metrics.critical_max_depth = critical_.max_depth.load();
+    metrics.normal_max_depth = normal_.max_depth.load();
+    metrics.executed = executed_.load();
+    metrics.overflowed = overflowed_.load();
+    metrics.boxed = boxed_.load();
+    metrics.slow_callbacks = slow_callbacks_.load();
+    metrics.callback_avg_us = callback_avg_us_.load();
+    metrics.callback_max_us = callback_max_us_.load();
+    return metrics;
+}
+
+std::string MainTaskQueue::GetMetricsJson() const {
+    auto metrics = GetMetrics();
+    std::string json = "{";
+    json += "\"critical_depth\":" + std::to_string(metrics.critical_depth) + ",";
+    json += "\"normal_depth\":" + std::to_string(metrics.normal_depth) + ",";
+    json += "\"critical_max_depth\":" + std::to_string(metrics.critical_max_depth) + ",";
+    json += "\"normal_max_depth\":" + std::to_string(metrics.normal_max_depth) + ",";
+    json += "\"executed\":" + std::to_string(metrics.executed) + ",";
+    json += "\"overflowed\":" + std::to_string(metrics.overflowed) + ",";
+    json += "\"boxed\":" + std::to_string(metrics.boxed) + ",";
+    json += "\"slow_callbacks\":" + std::to_string(metrics.slow_callbacks) + ",";
+    json += "\"callback_avg_us\":" + std::to_string(metrics.callback_avg_us) + ",";
+    json += "\"callback_max_us\":" + std::to_string(metrics.callback_max_us);
+    json += "}";
+    return json;
+}
@@ -0,0 +1,249 @@
+#ifndef MAIN_TASK_QUEUE_H
+#define MAIN_TASK_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+enum SchedulePriority {
+    kSchedulePriorityNormal,    // UI updates, component start, anything that may take a while
+    kSchedulePriorityCritical,  // Audio / protocol state: abort, listen and tts state, MCP replies
+};
+
+/**
+ * Move-only callable with inline storage, the replacement for std::function in Application::Schedule.
+ * Captures up to kInlineSize bytes (this + a pointer + a std::string on ESP32) live inside the object,
+ * larger ones are boxed on the heap and counted by MainTaskQueue so they can be spotted and trimmed.
+ */
+class MainTask {
+public:
+    static constexpr size_t kInlineSize = 40;
+
+    MainTask() = default;
+
+    template <typename F, typename Fn = std::decay_t<F>,
+              typename = std::enable_if_t<!std::is_same_v<Fn, MainTask>>>
+    MainTask(F&& f) {
+        if constexpr (sizeof(Fn) <= kInlineSize && alignof(Fn) <= alignof(std::max_align_t) &&
+                      std::is_nothrow_move_constructible_v<Fn>) {
+            new (storage_) Fn(std::forward<F>(f));
+            ops_ = &kInlineOps<Fn>;
+        } else {
+            *reinterpret_cast<Fn**>(storage_) = new Fn(std::forward<F>(f));
+            ops_ = &kHeapOps<Fn>;
+        }
+    }
+
+    MainTask(MainTask&& other) noexcept {
+        MoveFrom(other);
+    }
+
+    MainTask& operator=(MainTask&& other) noexcept {
+        if (this != &other) {
+            Reset();
+            MoveFrom(other);
+        }
+        return *this;
+    }
+
+    MainTask(const MainTask&) = delete;
+    MainTask& operator=(const MainTask&) = delete;
+
+    ~MainTask() {
+        Reset();
+    }
+
+    void operator()() {
+        ops_->invoke(storage_);
+    }
+
+    explicit operator bool() const {
+        return ops_ != nullptr;
+    }
+
+    bool boxed() const {
+        return ops_ != nullptr && ops_->boxed;
+    }
+
+    // Address of the type-specific invoker, resolves to the lambda's enclosing function with addr2line
+    uintptr_t target() const {
+        return ops_ != nullptr ? reinterpret_cast<uintptr_t>(ops_->invoke) : 0;
+    }
+
+    void Reset() {
+        if (ops_ != nullptr) {
+            ops_->destroy(storage_);
+            ops_ = nullptr;
+        }
+    }
+
+private:
+    struct Ops {
+        void (*invoke)(void* storage);
+        void (*move)(void* dst, void* src);     // Move construct into dst and destroy src
+        void (*destroy)(void* storage);
+        bool boxed;
+    };
+
+    template <typename Fn>
+    static void InlineInvoke(void* storage) { (*static_cast<Fn*>(storage))(); }
+    template <typename Fn>
+    static void InlineMove(void* dst, void* src) {
+        new (dst) Fn(std::move(*static_cast<Fn*>(src)));
+        static_cast<Fn*>(src)->~Fn();
+    }
+    template <typename Fn>
+    static void InlineDestroy(void* storage) { static_cast<Fn*>(storage)->~Fn(); }
+
+    template <typename Fn>
+    static void HeapInvoke(void* storage) { (**static_cast<Fn**>(storage))(); }
+    template <typename Fn>
+    static void HeapMove(void* dst, void* src) { *static_cast<Fn**>(dst) = *static_cast<Fn**>(src); }
+    template <typename Fn>
+    static void HeapDestroy(void* storage) { delete *static_cast<Fn**>(storage); }
+
+    template <typename Fn>
+    static constexpr Ops kInlineOps = { &InlineInvoke<Fn>, &InlineMove<Fn>, &InlineDestroy<Fn>, false };
+    template <typename Fn>
+    static constexpr Ops kHeapOps = { &HeapInvoke<Fn>, &HeapMove<Fn>, &HeapDestroy<Fn>, true };
+
+    void MoveFrom(MainTask& other) {
+        ops_ = other.ops_;
+        if (ops_ != nullptr) {
+            ops_->move(storage_, other.storage_);
+            other.ops_ = nullptr;
+        }
+    }
+
+    alignas(std::max_align_t) unsigned char storage_[kInlineSize];
+    const Ops* ops_ = nullptr;
+};
+
+/**
+ * Bounded multi-producer / single-consumer ring (Vyukov style sequence numbers).
+ * Producers from any task claim a slot with one CAS, the main task is the only consumer.
+ */
+template <size_t kCapacity>
+class MainTaskRing {
+    static_assert((kCapacity & (kCapacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    MainTaskRing() {
+        for (size_t i = 0; i < kCapacity; i++) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool TryPush(MainTask&& task) {
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells_[pos & (kCapacity - 1)];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.task = std::move(task);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Consumer only
+    bool TryPop(MainTask& task) {
+        size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        Cell& cell = cells_[pos & (kCapacity - 1)];
+        size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        if ((intptr_t)sequence - (intptr_t)(pos + 1) < 0) {
+            return false;
+        }
+        task = std::move(cell.task);
+        cell.sequence.store(pos + kCapacity, std::memory_order_release);
+        dequeue_pos_.store(pos + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    size_t Size() const {
+        return enqueue_pos_.load(std::memory_order_relaxed) - dequeue_pos_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        MainTask task;
+    };
+
+    Cell cells_[kCapacity];
+    std::atomic<size_t> enqueue_pos_{0};
+    std::atomic<size_t> dequeue_pos_{0};
+};
+
+struct MainTaskQueueMetrics {
+    uint32_t critical_depth = 0;
+    uint32_t normal_depth = 0;
+    uint32_t critical_max_depth = 0;
+    uint32_t normal_max_depth = 0;
+    uint32_t executed = 0;
+    uint32_t overflowed = 0;        // Pushed while the ring was full, went to the fallback deque
+    uint32_t boxed = 0;             // Captures too large for MainTask inline storage
+    uint32_t slow_callbacks = 0;    // Callbacks that held the main task longer than kSlowCallbackUs
+    uint32_t callback_avg_us = 0;
+    uint32_t callback_max_us = 0;
+};
+
+class MainTaskQueue {
+public:
+    static constexpr size_t kLaneCapacity = 32;
+    static constexpr int64_t kSlowCallbackUs = 50 * 1000;
+
+    // Any task
+    void Push(MainTask&& task, SchedulePriority priority);
+
+    /**
+     * Main task only. Critical tasks run first and are checked again before every normal task,
+     * so a slow display update can only delay an abort by the length of that one update.
+     * Returns true if normal tasks are left over for the next wakeup.
+     */
+    bool RunPending(size_t max_normal_tasks);
+
+    MainTaskQueueMetrics GetMetrics() const;
+    std::string GetMetricsJson() const;
+
+private:
+    struct Lane {
+        MainTaskRing<kLaneCapacity> ring;
+        // Keeps Schedule() infallible when a burst exceeds the ring, FIFO order is preserved
+        // by sending new tasks to the deque until it has been drained
+        std::mutex overflow_mutex;
+        std::deque<MainTask> overflow;
+        std::atomic<uint32_t> overflow_size{0};
+        std::atomic<uint32_t> max_depth{0};
+
+        size_t Size() const { return ring.Size() + overflow_size.load(std::memory_order_relaxed); }
+    };
+
+    Lane critical_;
+    Lane normal_;
+    std::atomic<uint32_t> executed_{0};
+    std::atomic<uint32_t> overflowed_{0};
+    std::atomic<uint32_t> boxed_{0};
+    std::atomic<uint32_t> slow_callbacks_{0};
+    std::atomic<uint32_t> callback_avg_us_{0};
+    std::atomic<uint32_t> callback_max_us_{0};
+
+    bool Pop(Lane& lane, MainTask& task);
+    void Execute(MainTask& task);
+};
+
+#endif // MAIN_TASK_QUEUE_H
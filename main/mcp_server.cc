@@ -17,17 +17,19 @@
 #include "settings.h"
 #include "lvgl_theme.h"
 #include "lvgl_display.h"
+#include "trace.h"
+#include "hardware/sensor_history.h"
+#include "iot/things/imu.h"
 
 #define TAG "MCP"
 
+// Set while a tool callback runs so it can poll McpServer::IsToolCallCancelled()
+static thread_local const std::atomic<bool>* current_call_finished = nullptr;
+
 McpServer::McpServer() {
 }
 
 McpServer::~McpServer() {
-    for (auto tool : tools_) {
-        delete tool;
-    }
-    tools_.clear();
 }
 
 void McpServer::AddCommonTools() {
@@ -36,7 +38,7 @@ void McpServer::AddCommonTools() {
     // **重要** 为了提升响应速度，我们把常用的工具放在前面，利用 prompt cache 的特性。
 
     // Backup the original tools list and restore it after adding the common tools.
-    auto original_tools = std::move(tools_);
+    auto original_tools = tools_.TakeAll();
     auto& board = Board::GetInstance();
 
     // Do not add custom tools here.
@@ -117,12 +119,89 @@ void McpServer::AddCommonTools() {
                 }
                 auto question = properties["question"].value<std::string>();
                 return camera->Explain(question);
-            });
+            },
+            // Capture and the explain upload take seconds, keep them off the main task
+            McpToolOptions{.execution = kToolExecutionWorker, .timeout_ms = 30000});
     }
 #endif
 
+#if CONFIG_SENSOR_HISTORY_MEMORY_KB > 0
+    AddTool("self.sensors.get_history",
+        "Get the recent history of a sensor, e.g. to answer how the temperature or a distance changed.\n"
+        "Args:\n"
+        "  `id`: The sensor series id, e.g. `imu.temperature` or `us.front`. Leave empty to list the series.\n"
+        "  `from`: Start time in milliseconds since boot, negative values are relative to now (-60000 is the last minute).\n"
+        "  `resolution`: `raw` for every sample, `1s` or `1m` for min / max / avg rollups.\n"
+        "Return:\n"
+        "  `points` as [time_ms, value] for raw and [time_ms, avg, min, max] for rollups.",
+        PropertyList({
+            Property("id", kPropertyTypeString, std::string()),
+            Property("from", kPropertyTypeInteger, -60000, -86400000, 86400000),
+            Property("resolution", kPropertyTypeString, std::string("1s"))
+        }),
+        [](const PropertyList& properties) -> ReturnValue {
+            auto& history = SensorHistory::GetInstance();
+            auto id = properties["id"].value<std::string>();
+            if (id.empty()) {
+                return cJSON_Parse(history.GetSeriesJson().c_str());
+            }
+            SensorResolution resolution;
+            if (!SensorHistory::ParseResolution(properties["resolution"].value<std::string>(), resolution)) {
+                throw std::runtime_error("Invalid resolution, expected raw, 1s or 1m");
+            }
+            // Fewer points than the web API, the reply ends up in the model context
+            auto json = history.GetHistoryJson(id, resolution, properties["from"].value<int>(), 120);
+            if (json.empty()) {
+                throw std::runtime_error("No history for sensor: " + id);
+            }
+            return cJSON_Parse(json.c_str());
+        });
+#endif
+
+#ifdef CONFIG_ENABLE_IMU
+    AddTool("self.imu.calibrate",
+        "Calibrate the motion sensors when the tilt or the heading drifts. Tell the user what to do first:\n"
+        "  `gyro`: keep the device completely still for a few seconds.\n"
+        "  `accel`: hold the device still in as many orientations as possible (each side facing down), turning it slowly in between.\n"
+        "  `mag`: rotate the device slowly through all orientations, away from metal and magnets.\n"
+        "The result is stored and used from then on. Use `self.imu.get_calibration` to check the outcome after `duration` seconds.\n"
+        "Args:\n"
+        "  `sensor`: `gyro`, `accel` or `mag`, or `reset` to drop all stored calibrations.\n"
+        "  `duration`: Seconds to collect samples, 0 for the default (3 for gyro, 30 otherwise).",
+        PropertyList({
+            Property("sensor", kPropertyTypeString),
+            Property("duration", kPropertyTypeInteger, 0, 0, 120)
+        }),
+        [](const PropertyList& properties) -> ReturnValue {
+            auto sensor = properties["sensor"].value<std::string>();
+            if (sensor == "reset") {
+                if (!iot::ResetIMUCalibration("all")) {
+                    throw std::runtime_error("IMU not available");
+                }
+            } else {
+                std::string error;
+                if (!iot::StartIMUCalibration(sensor, properties["duration"].value<int>(), error)) {
+                    throw std::runtime_error(error);
+                }
+            }
+            return cJSON_Parse(iot::GetIMUCalibrationJson().c_str());
+        });
+
+    AddTool("self.imu.get_calibration",
+        "Get the state of the motion sensor calibration (idle, collecting, done or failed with a reason) "
+        "and the coefficients in use.",
+        PropertyList(),
+        [](const PropertyList& properties) -> ReturnValue {
+            auto json = iot::GetIMUCalibrationJson();
+            if (json.empty()) {
+                throw std::runtime_error("IMU not available");
+            }
+            return cJSON_Parse(json.c_str());
+        });
+#endif
+
     // Restore the original tools list to the end of the tools list
-    tools_.insert(tools_.end(), original_tools.begin(), original_tools.end());
+    tools_.Append(original_tools);
 }
 
 void McpServer::AddUserOnlyTools() {
@@ -135,6 +214,15 @@ void McpServer::AddUserOnlyTools() {
             return board.GetSystemInfoJson();
         });
 
+    AddUserOnlyTool("self.network.get_metrics",
+        "Get the health metrics of the server connection: round trip time, uplink / downlink bitrate, "
+        "dropped audio packets and the delay of the audio send queue",
+        PropertyList(),
+        [](const PropertyList& properties) -> ReturnValue {
+            auto json = Application::GetInstance().GetProtocolMetricsJson();
+            return cJSON_Parse(json.c_str());
+        });
+
     AddUserOnlyTool("self.reboot", "Reboot the system",
         PropertyList(),
         [this](const PropertyList& properties) -> ReturnValue {
@@ -239,7 +327,8 @@ void McpServer::AddUserOnlyTools() {
                 http->Close();
                 ESP_LOGI(TAG, "Snapshot screen result: %s", result.c_str());
                 return true;
-            });
+            },
+            McpToolOptions{.execution = kToolExecutionWorker, .timeout_ms = 30000});
         
         AddUserOnlyTool("self.screen.preview_image", "Preview an image on the screen",
             PropertyList({
@@ -279,9 +368,35 @@ void McpServer::AddUserOnlyTools() {
                 auto image = std::make_unique<LvglAllocatedImage>(data, content_length);
                 display->SetPreviewImage(std::move(image));
                 return true;
-            });
+            },
+            McpToolOptions{.execution = kToolExecutionWorker, .timeout_ms = 30000});
 #endif // CONFIG_LV_USE_SNAPSHOT
     }
+
+    auto camera = board.GetCamera();
+    if (camera) {
+        AddUserOnlyTool("self.camera.get_photo",
+            "Take a photo and return it as a JPEG image",
+            PropertyList({
+                Property("quality", kPropertyTypeInteger, 80, 10, 100)
+            }),
+            [camera](const PropertyList& properties) -> ReturnValue {
+                TaskPriorityReset priority_reset(1);
+
+                if (!camera->Capture()) {
+                    throw std::runtime_error("Failed to capture photo");
+                }
+                // The JPEG encoder feeds the base64 stream while the reply is sent from this worker,
+                // the captured frame stays in the camera until then
+                int quality = properties["quality"].value<int>();
+                return new ImageContent("image/jpeg", [camera, quality](const ImageContent::Writer& write) {
+                    return camera->EncodeJpeg(quality, [&write](const void* data, size_t len) {
+                        return write(static_cast<const char*>(data), len);
+                    });
+                });
+            },
+            McpToolOptions{.execution = kToolExecutionWorker, .timeout_ms = 30000});
+    }
 #endif // HAVE_LVGL
 
     // Assets download url
@@ -302,22 +417,23 @@ void McpServer::AddUserOnlyTools() {
 
 void McpServer::AddTool(McpTool* tool) {
     // Prevent adding duplicate tools
-    if (std::find_if(tools_.begin(), tools_.end(), [tool](const McpTool* t) { return t->name() == tool->name(); }) != tools_.end()) {
+    if (!tools_.Add(tool)) {
         ESP_LOGW(TAG, "Tool %s already added", tool->name().c_str());
         return;
     }
-
     ESP_LOGI(TAG, "Add tool: %s%s", tool->name().c_str(), tool->user_only() ? " [user]" : "");
-    tools_.push_back(tool);
 }
 
-void McpServer::AddTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback) {
-    AddTool(new McpTool(name, description, properties, callback));
+void McpServer::AddTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback, const McpToolOptions& options) {
+    auto tool = new McpTool(name, description, properties, callback);
+    tool->set_options(options);
+    AddTool(tool);
 }
 
-void McpServer::AddUserOnlyTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback) {
+void McpServer::AddUserOnlyTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback, const McpToolOptions& options) {
     auto tool = new McpTool(name, description, properties, callback);
     tool->set_user_only(true);
+    tool->set_options(options);
     AddTool(tool);
 }
 
@@ -348,9 +464,91 @@ void McpServer::ParseCapabilities(const cJSON* capabilities) {
             }
         }
     }
+
+    auto pipeline = cJSON_GetObjectItem(capabilities, "pipelineBatchReplies");
+    pipeline_batch_replies_ = cJSON_IsTrue(pipeline);
 }
 
 void McpServer::ParseMessage(const cJSON* json) {
+    if (cJSON_IsArray(json)) {
+        ParseBatch(json);
+    } else {
+        ParseRequest(json);
+    }
+}
+
+bool McpServer::GetReplyId(const cJSON* json, int& id) {
+    // Same checks as ParseRequest, true for the requests that are going to reply
+    auto version = cJSON_GetObjectItem(json, "jsonrpc");
+    auto method = cJSON_GetObjectItem(json, "method");
+    auto params = cJSON_GetObjectItem(json, "params");
+    auto id_item = cJSON_GetObjectItem(json, "id");
+    if (!cJSON_IsString(version) || strcmp(version->valuestring, "2.0") != 0 || !cJSON_IsString(method) ||
+        strncmp(method->valuestring, "notifications", 13) == 0 || (params != nullptr && !cJSON_IsObject(params)) ||
+        !cJSON_IsNumber(id_item)) {
+        return false;
+    }
+    id = id_item->valueint;
+    return true;
+}
+
+void McpServer::ParseBatch(const cJSON* json) {
+    int size = cJSON_GetArraySize(json);
+    if (size == 0) {
+        ESP_LOGE(TAG, "Empty batch");
+        return;
+    }
+    TRACE_SCOPE_ARG("mcp:batch", size);
+
+    // Items whose id is already waiting for a reply, they are answered with an error and not run
+    std::vector<bool> rejected(size, false);
+    std::vector<int> rejected_ids;
+    if (!pipeline_batch_replies_) {
+        // Register every request first, so replies sent while the batch is still being parsed are collected
+        auto batch = std::make_shared<Batch>();
+        {
+            // A call in flight or an earlier batch owns its id, registering it again would take its reply
+            std::scoped_lock lock(calls_mutex_, batches_mutex_);
+            int index = 0;
+            cJSON* item = nullptr;
+            cJSON_ArrayForEach(item, json) {
+                int id;
+                if (GetReplyId(item, id)) {
+                    if (calls_.count(id) == 0 && batch_ids_.emplace(id, batch).second) {
+                        batch->pending++;
+                    } else {
+                        rejected[index] = true;
+                        rejected_ids.push_back(id);
+                    }
+                }
+                index++;
+            }
+        }
+        batch->replies.reserve(batch->pending);
+        ESP_LOGI(TAG, "Batch of %d messages, %u replies", size, (unsigned)batch->pending);
+    }
+    for (int id : rejected_ids) {
+        ESP_LOGE(TAG, "Batch: id %d is already in flight", id);
+        Application::GetInstance().SendMcpMessage(MakeErrorReply(id,
+            "Request id " + std::to_string(id) + " is already in flight"));
+    }
+
+    // Requests start in order. Main task tools run one after another, worker tools run concurrently
+    int index = 0;
+    cJSON* item = nullptr;
+    cJSON_ArrayForEach(item, json) {
+        if (rejected[index++]) {
+            continue;
+        }
+        if (cJSON_IsObject(item)) {
+            ParseRequest(item);
+        } else {
+            ESP_LOGE(TAG, "Invalid batch item");
+        }
+    }
+}
+
+void McpServer::ParseRequest(const cJSON* json) {
     // Check JSONRPC version
     auto version = cJSON_GetObjectItem(json, "jsonrpc");
     if (version == nullptr || !cJSON_IsString(version) || strcmp(version->valuestring, "2.0") != 0) {
@@ -367,6 +565,13 @@ void McpServer::ParseMessage(const cJSON* json) {
     
     auto method_str = std::string(method->valuestring);
     if (method_str.find("notifications") == 0) {
+        if (method_str == "notifications/cancelled") {
+            auto params = cJSON_GetObjectItem(json, "params");
+            auto request_id = cJSON_GetObjectItem(params, "requestId");
+            if (cJSON_IsNumber(request_id)) {
+                CancelToolCall(request_id->valueint);
+            }
+        }
         return;
     }
     
@@ -385,6 +590,7 @@ void McpServer::ParseMessage(const cJSON* json) {
     auto id_int = id->valueint;
     
     if (method_str == "initialize") {
+        pipeline_batch_replies_ = false;
         if (cJSON_IsObject(params)) {
             auto capabilities = cJSON_GetObjectItem(params, "capabilities");
             if (cJSON_IsObject(capabilities)) {
@@ -440,87 +646,137 @@ void McpServer::ReplyResult(int id, const std::string& result) {
     payload += std::to_string(id) + ",\"result\":";
     payload += result;
     payload += "}";
-    Application::GetInstance().SendMcpMessage(payload);
+    if (!AddBatchReply({id, payload, nullptr})) {
+        Application::GetInstance().SendMcpMessage(payload);
+    }
 }
 
-void McpServer::ReplyError(int id, const std::string& message) {
+std::string McpServer::MakeErrorReply(int id, const std::string& message) {
     std::string payload = "{\"jsonrpc\":\"2.0\",\"id\":";
     payload += std::to_string(id);
     payload += ",\"error\":{\"message\":\"";
     payload += message;
     payload += "\"}}";
-    Application::GetInstance().SendMcpMessage(payload);
+    return payload;
 }
 
-void McpServer::GetToolsList(int id, const std::string& cursor, bool list_user_only_tools) {
-    const int max_payload_size = 8000;
-    std::string json = "{\"tools\":[";
-    
-    bool found_cursor = cursor.empty();
-    auto it = tools_.begin();
-    std::string next_cursor = "";
-    
-    while (it != tools_.end()) {
-        // 如果我们还没有找到起始位置，继续搜索
-        if (!found_cursor) {
-            if ((*it)->name() == cursor) {
-                found_cursor = true;
-            } else {
-                ++it;
-                continue;
-            }
+void McpServer::ReplyError(int id, const std::string& message) {
+    std::string payload = MakeErrorReply(id, message);
+    if (!AddBatchReply({id, payload, nullptr})) {
+        Application::GetInstance().SendMcpMessage(payload);
+    }
+}
+
+void McpServer::ReplyImageResult(int id, ImageContent* image_content) {
+    // The base64 data is encoded into the outgoing frames, the image never exists as one JSON string
+    std::shared_ptr<ImageContent> image(image_content);
+    if (AddBatchReply({id, std::string(), image})) {
+        return;
+    }
+    Application::GetInstance().SendMcpMessageStream([id, image](const Protocol::MessageWriter& write) {
+        return WriteImageReply(id, *image, write);
+    });
+}
+
+bool McpServer::WriteImageReply(int id, const ImageContent& image, const ImageContent::Writer& write) {
+    std::string head = "{\"jsonrpc\":\"2.0\",\"id\":" + std::to_string(id) +
+        ",\"result\":{\"content\":[{\"type\":\"image\",\"mimeType\":\"" + image.mime_type() + "\",\"data\":\"";
+    static const char tail[] = "\"}],\"isError\":false}}";
+    return write(head.data(), head.size()) && image.Write(write) && write(tail, sizeof(tail) - 1);
+}
+
+bool McpServer::AddBatchReply(BatchReply&& reply) {
+    std::shared_ptr<Batch> batch;
+    {
+        std::lock_guard<std::mutex> lock(batches_mutex_);
+        auto it = batch_ids_.find(reply.id);
+        if (it == batch_ids_.end()) {
+            return false;
+        }
+        batch = std::move(it->second);
+        batch_ids_.erase(it);
+        batch->replies.push_back(std::move(reply));
+        if (--batch->pending > 0) {
+            return true;
         }
+    }
+    SendBatch(batch);
+    return true;
+}
 
-        if (!list_user_only_tools && (*it)->user_only()) {
-            ++it;
-            continue;
+void McpServer::DropBatchReply(int id) {
+    std::shared_ptr<Batch> batch;
+    {
+        std::lock_guard<std::mutex> lock(batches_mutex_);
+        auto it = batch_ids_.find(id);
+        if (it == batch_ids_.end()) {
+            return;
         }
-        
-        // 添加tool前检查大小
-        std::string tool_json = (*it)->to_json() + ",";
-        if (json.length() + tool_json.length() + 30 > max_payload_size) {
-            // 如果添加这个tool会超出大小限制，设置next_cursor并退出循环
-            next_cursor = (*it)->name();
-            break;
+        batch = std::move(it->second);
+        batch_ids_.erase(it);
+        if (--batch->pending > 0) {
+            return;
         }
-        
-        json += tool_json;
-        ++it;
     }
-    
-    if (json.back() == ',') {
-        json.pop_back();
+    SendBatch(batch);
+}
+
+void McpServer::SendBatch(const std::shared_ptr<Batch>& batch) {
+    if (batch->replies.empty()) {
+        // Every request was cancelled
+        return;
     }
-    
-    if (json.back() == '[' && !tools_.empty()) {
-        // 如果没有添加任何tool，返回错误
-        ESP_LOGE(TAG, "tools/list: Failed to add tool %s because of payload size limit", next_cursor.c_str());
-        ReplyError(id, "Failed to add tool " + next_cursor + " because of payload size limit");
+
+    bool has_image = std::any_of(batch->replies.begin(), batch->replies.end(), [](const BatchReply& reply) {
+        return reply.image != nullptr;
+    });
+    if (!has_image) {
+        std::string payload = "[";
+        for (auto& reply : batch->replies) {
+            payload += reply.json;
+            payload += ",";
+        }
+        payload.back() = ']';
+        Application::GetInstance().SendMcpMessage(payload);
         return;
     }
 
-    if (next_cursor.empty()) {
-        json += "]}";
-    } else {
-        json += "],\"nextCursor\":\"" + next_cursor + "\"}";
+    Application::GetInstance().SendMcpMessageStream([batch](const Protocol::MessageWriter& write) {
+        char separator = '[';
+        for (auto& reply : batch->replies) {
+            if (!write(&separator, 1)) {
+                return false;
+            }
+            separator = ',';
+            bool ok = reply.image != nullptr ? WriteImageReply(reply.id, *reply.image, write)
+                                             : write(reply.json.data(), reply.json.size());
+            if (!ok) {
+                return false;
+            }
+        }
+        return write("]", 1);
+    });
+}
+
+void McpServer::GetToolsList(int id, const std::string& cursor, bool list_user_only_tools) {
+    std::string json, error;
+    if (!tools_.GetToolsList(cursor, list_user_only_tools, json, error)) {
+        ESP_LOGE(TAG, "tools/list: %s", error.c_str());
+        ReplyError(id, error);
+        return;
     }
-    
     ReplyResult(id, json);
 }
 
 void McpServer::DoToolCall(int id, const std::string& tool_name, const cJSON* tool_arguments) {
-    auto tool_iter = std::find_if(tools_.begin(), tools_.end(), 
-                                 [&tool_name](const McpTool* tool) { 
-                                     return tool->name() == tool_name; 
-                                 });
-    
-    if (tool_iter == tools_.end()) {
+    McpTool* tool = tools_.Find(tool_name);
+    if (tool == nullptr) {
         ESP_LOGE(TAG, "tools/call: Unknown tool: %s", tool_name.c_str());
         ReplyError(id, "Unknown tool: " + tool_name);
         return;
     }
 
-    PropertyList arguments = (*tool_iter)->properties();
+    PropertyList arguments = tool->properties();
     try {
         for (auto& argument : arguments) {
             bool found = false;
@@ -550,14 +806,229 @@ void McpServer::DoToolCall(int id, const std::string& tool_name, const cJSON* to
         return;
     }
 
+    auto call = std::make_shared<ToolCall>();
+    call->id = id;
+    call->tool = tool;
+    call->arguments = std::move(arguments);
+    int timeout_ms = tool->options().timeout_ms;
+    call->deadline_us = timeout_ms > 0 ? esp_timer_get_time() + (int64_t)timeout_ms * 1000 : 0;
+    StartToolCall(std::move(call));
+}
+
+bool McpServer::IsToolCallCancelled() {
+    return current_call_finished != nullptr && current_call_finished->load();
+}
+
+void McpServer::StartToolCall(std::shared_ptr<ToolCall> call) {
+    std::unique_lock<std::mutex> lock(calls_mutex_);
+    if (!calls_.emplace(call->id, call).second) {
+        lock.unlock();
+        ESP_LOGE(TAG, "tools/call: id %d is already in flight", call->id);
+        // Sent on its own, a batch slot with this id belongs to the call in flight
+        Application::GetInstance().SendMcpMessage(MakeErrorReply(call->id,
+            "Request id " + std::to_string(call->id) + " is already in flight"));
+        return;
+    }
+
+    if (call->deadline_us != 0) {
+        if (timeout_timer_ == nullptr) {
+            esp_timer_create_args_t timer_args = {
+                .callback = [](void* arg) {
+                    static_cast<McpServer*>(arg)->CheckToolCallTimeouts();
+                },
+                .arg = this,
+                .dispatch_method = ESP_TIMER_TASK,
+                .name = "mcp_timeout",
+                .skip_unhandled_events = true
+            };
+            ESP_ERROR_CHECK(esp_timer_create(&timer_args, &timeout_timer_));
+        }
+        if (!esp_timer_is_active(timeout_timer_)) {
+            esp_timer_start_periodic(timeout_timer_, kTimeoutCheckIntervalUs);
+        }
+    }
+
+    if (call->tool->options().execution == kToolExecutionWorker) {
+        // Workers are created on the first call of a worker tool, most boards never need them.
+        // Workers stuck in abandoned calls do not count, they are replaced up to kMaxToolWorkers
+        while (worker_count_ - abandoned_workers_ < kToolWorkerCount && worker_count_ < kMaxToolWorkers) {
+            BaseType_t ret = xTaskCreate([](void* arg) {
+                static_cast<McpServer*>(arg)->ToolWorker();
+                vTaskDelete(NULL);
+            }, "mcp_tool", 4096 * 2, this, 2, nullptr);
+            if (ret != pdPASS) {
+                ESP_LOGE(TAG, "Failed to create MCP tool worker");
+                break;
+            }
+            worker_count_++;
+        }
+        if (worker_count_ > 0 && worker_count_ == abandoned_workers_) {
+            // Every worker is stuck, queueing would only make the call time out as well
+            calls_.erase(call->id);
+            call->finished = true;
+            lock.unlock();
+            ESP_LOGE(TAG, "tools/call: %s rejected, all %d workers are stuck in abandoned calls",
+                     call->tool->name().c_str(), worker_count_);
+            ReplyError(call->id, "Tool workers busy with timed out calls: " + call->tool->name());
+            return;
+        }
+        if (worker_count_ > 0) {
+            worker_queue_.push_back(call);
+            calls_cv_.notify_all();
+            return;
+        }
+    }
+    lock.unlock();
+
     // Use main thread to call the tool
-    auto& app = Application::GetInstance();
-    app.Schedule([this, id, tool_iter, arguments = std::move(arguments)]() {
+    Application::GetInstance().Schedule([this, call]() {
+        RunToolCall(call);
+    });
+}
+
+void McpServer::RunToolCall(const std::shared_ptr<ToolCall>& call) {
+    if (call->finished) {
+        // Cancelled or timed out before it started
+        return;
+    }
+
+    ReturnValue value;
+    std::string error;
+    bool failed = false;
+    {
+        TRACE_SCOPE_ARG("mcp:tool_call", call->id);
+        current_call_finished = &call->finished;
         try {
-            ReplyResult(id, (*tool_iter)->Call(arguments));
+            value = call->tool->Call(call->arguments);
         } catch (const std::exception& e) {
             ESP_LOGE(TAG, "tools/call: %s", e.what());
-            ReplyError(id, e.what());
+            error = e.what();
+            failed = true;
         }
-    });
+        current_call_finished = nullptr;
+    }
+
+    if (call->finished.exchange(true)) {
+        ESP_LOGW(TAG, "tools/call: %s finished after it was cancelled or timed out, result dropped",
+                 call->tool->name().c_str());
+        if (std::holds_alternative<ImageContent*>(value)) {
+            delete std::get<ImageContent*>(value);
+        } else if (std::holds_alternative<cJSON*>(value)) {
+            cJSON_Delete(std::get<cJSON*>(value));
+        }
+    } else if (failed) {
+        ReplyError(call->id, error);
+    } else if (std::holds_alternative<ImageContent*>(value)) {
+        ReplyImageResult(call->id, std::get<ImageContent*>(value));
+    } else {
+        ReplyResult(call->id, McpTool::ResultToJson(value));
+    }
+    FinishToolCall(call);
+}
+
+void McpServer::FinishToolCall(const std::shared_ptr<ToolCall>& call) {
+    std::lock_guard<std::mutex> lock(calls_mutex_);
+    auto it = calls_.find(call->id);
+    if (it != calls_.end() && it->second == call) {
+        calls_.erase(it);
+    }
+}
+
+void McpServer::CancelToolCall(int id) {
+    {
+        std::lock_guard<std::mutex> lock(calls_mutex_);
+        auto it = calls_.find(id);
+        if (it == calls_.end()) {
+            return;
+        }
+        // No reply for cancelled requests, the result of a running callback is dropped
+        ESP_LOGI(TAG, "tools/call: %s (id %d) cancelled", it->second->tool->name().c_str(), id);
+        if (!it->second->finished.exchange(true)) {
+            AbandonToolCall(*it->second);
+        }
+        calls_.erase(it);
+        calls_cv_.notify_all();
+    }
+    DropBatchReply(id);
+}
+
+void McpServer::CheckToolCallTimeouts() {
+    std::vector<std::shared_ptr<ToolCall>> expired;
+    {
+        std::lock_guard<std::mutex> lock(calls_mutex_);
+        int64_t now = esp_timer_get_time();
+        bool has_deadline = false;
+        for (auto it = calls_.begin(); it != calls_.end();) {
+            auto& call = it->second;
+            if (call->deadline_us == 0) {
+                ++it;
+            } else if (now >= call->deadline_us) {
+                if (!call->finished.exchange(true)) {
+                    AbandonToolCall(*call);
+                    expired.push_back(call);
+                }
+                it = calls_.erase(it);
+            } else {
+                has_deadline = true;
+                ++it;
+            }
+        }
+        if (!has_deadline) {
+            esp_timer_stop(timeout_timer_);
+        }
+        if (!expired.empty()) {
+            calls_cv_.notify_all();
+        }
+    }
+
+    for (auto& call : expired) {
+        ESP_LOGW(TAG, "tools/call: %s (id %d) timed out", call->tool->name().c_str(), call->id);
+        ReplyError(call->id, "Tool call timed out: " + call->tool->name());
+    }
+}
+
+void McpServer::AbandonToolCall(ToolCall& call) {
+    if (call.on_worker && !call.abandoned) {
+        call.abandoned = true;
+        abandoned_workers_++;
+        ESP_LOGW(TAG, "tools/call: %s abandoned on a worker, %d of %d workers stuck",
+                 call.tool->name().c_str(), abandoned_workers_, worker_count_);
+    }
+}
+
+void McpServer::ToolWorker() {
+    std::unique_lock<std::mutex> lock(calls_mutex_);
+    while (true) {
+        // First queued call whose tool is below its concurrency limit
+        auto it = std::find_if(worker_queue_.begin(), worker_queue_.end(), [this](const std::shared_ptr<ToolCall>& call) {
+            return call->finished || worker_running_[call->tool] < call->tool->options().max_concurrency;
+        });
+        if (it == worker_queue_.end()) {
+            calls_cv_.wait(lock);
+            continue;
+        }
+        auto call = *it;
+        worker_queue_.erase(it);
+        if (call->finished) {
+            continue;
+        }
+
+        worker_running_[call->tool]++;
+        call->on_worker = true;
+        lock.unlock();
+        RunToolCall(call);
+        lock.lock();
+        call->on_worker = false;
+        if (call->abandoned) {
+            abandoned_workers_--;
+        }
+        worker_running_[call->tool]--;
+        calls_cv_.notify_all();
+
+        // A replacement was started while this worker was stuck, one of them leaves
+        if (worker_count_ - abandoned_workers_ > kToolWorkerCount) {
+            worker_count_--;
+            return;
+        }
+    }
 }
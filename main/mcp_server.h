@@ -4,46 +4,134 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <atomic>
 #include <functional>
 #include <variant>
 #include <optional>
 #include <stdexcept>
+#include <algorithm>
+#include <cstring>
 #include <thread>
 #include <mbedtls/base64.h>
 
 #include <cJSON.h>
+#include <esp_timer.h>
 
+#include "mcp_tool_registry.h"
+
+/**
+ * Image result of a tool. The picture is never base64-encoded as a whole: Write() encodes it
+ * into the outgoing message through a small fixed window while the reply is being sent.
+ * The bytes come either from a buffer or straight from a producer such as a JPEG encoder callback.
+ */
 class ImageContent {
-private:
-    std::string encoded_data_;
-    std::string mime_type_;
+public:
+    // Consumes one piece of output, returns false to abort
+    using Writer = std::function<bool(const char* data, size_t len)>;
+    // Feeds raw image bytes to the writer it is given, returns false on failure
+    using Producer = std::function<bool(const Writer& write)>;
 
-    static std::string Base64Encode(const std::string& data) {
-        size_t dlen = 0, olen = 0;
-        mbedtls_base64_encode((unsigned char*)nullptr, 0, &dlen, (const unsigned char*)data.data(), data.size());
-        std::string result(dlen, 0);
-        mbedtls_base64_encode((unsigned char*)result.data(), result.size(), &olen, (const unsigned char*)data.data(), data.size());
-        return result;
-    }
+    static constexpr size_t kWindowSize = 1536;     // Base64 output buffered before each write, multiple of 4
 
-public:
-    ImageContent(const std::string& mime_type, const std::string& data) {
-        mime_type_ = mime_type;
-        // base64 encode data
-        encoded_data_ = Base64Encode(data);
-    }
+    ImageContent(const std::string& mime_type, std::string data)
+        : mime_type_(mime_type), data_(std::move(data)) {}
 
-    std::string to_json() const {
-        cJSON *json = cJSON_CreateObject();
-        cJSON_AddStringToObject(json, "type", "image");
-        cJSON_AddStringToObject(json, "mimeType", mime_type_.c_str());
-        cJSON_AddStringToObject(json, "data", encoded_data_.c_str());
-        char* json_str = cJSON_PrintUnformatted(json);
-        std::string result(json_str);
-        cJSON_free(json_str);
-        cJSON_Delete(json);
-        return result;
+    ImageContent(const std::string& mime_type, Producer producer)
+        : mime_type_(mime_type), producer_(std::move(producer)) {}
+
+    inline const std::string& mime_type() const { return mime_type_; }
+
+    // Writes the base64 encoded image, without quotes
+    bool Write(const Writer& write) const {
+        Base64Stream stream(write);
+        if (producer_) {
+            return producer_([&stream](const char* data, size_t len) { return stream.Update(data, len); }) &&
+                stream.Finish();
+        }
+        return stream.Update(data_.data(), data_.size()) && stream.Finish();
     }
+
+private:
+    class Base64Stream {
+    public:
+        explicit Base64Stream(const Writer& write) : write_(write) {}
+
+        bool Update(const char* data, size_t len) {
+            // Complete the 3 byte group left over from the previous chunk
+            while (pending_len_ > 0 && len > 0) {
+                pending_[pending_len_++] = (uint8_t)*data++;
+                len--;
+                if (pending_len_ == 3) {
+                    if (!Encode(pending_, 3)) {
+                        return false;
+                    }
+                    pending_len_ = 0;
+                }
+            }
+            while (len >= 3) {
+                size_t n = std::min(len / 3 * 3, (kWindowSize - used_) / 4 * 3);
+                if (n == 0) {
+                    if (!Flush()) {
+                        return false;
+                    }
+                    continue;
+                }
+                if (!Encode((const uint8_t*)data, n)) {
+                    return false;
+                }
+                data += n;
+                len -= n;
+            }
+            memcpy(pending_ + pending_len_, data, len);
+            pending_len_ += len;
+            return true;
+        }
+
+        bool Finish() {
+            if (pending_len_ > 0 && !Encode(pending_, pending_len_)) {
+                return false;
+            }
+            pending_len_ = 0;
+            return Flush();
+        }
+
+    private:
+        const Writer& write_;
+        char window_[kWindowSize + 1];     // mbedtls_base64_encode always adds a terminator
+        size_t used_ = 0;
+        uint8_t pending_[3];
+        size_t pending_len_ = 0;
+
+        bool Encode(const uint8_t* data, size_t len) {
+            if (kWindowSize - used_ < (len + 2) / 3 * 4 && !Flush()) {
+                return false;
+            }
+            size_t olen = 0;
+            mbedtls_base64_encode((unsigned char*)window_ + used_, kWindowSize - used_ + 1, &olen, data, len);
+            used_ += olen;
+            if (used_ == kWindowSize) {
+                return Flush();
+            }
+            return true;
+        }
+
+        bool Flush() {
+            if (used_ == 0) {
+                return true;
+            }
+            bool ok = write_(window_, used_);
+            used_ = 0;
+            return ok;
+        }
+    };
+
+    std::string mime_type_;
+    std::string data_;
+    Producer producer_;
 };
 
 // 添加类型别名
@@ -205,6 +293,18 @@ public:
     }
 };
 
+// Where a tool callback runs
+enum ToolExecution {
+    kToolExecutionMainTask,     // Default, serialized with state changes and audio events on the main task
+    kToolExecutionWorker,       // MCP worker pool, for slow tools (capture + upload, servo sweeps) that lock what they touch
+};
+
+struct McpToolOptions {
+    ToolExecution execution = kToolExecutionMainTask;
+    int max_concurrency = 1;    // Worker tools only, further calls wait in the queue
+    int timeout_ms = 0;         // 0 for no timeout. On timeout an error is replied and the late result dropped
+};
+
 class McpTool {
 private:
     std::string name_;
@@ -212,24 +312,10 @@ private:
     PropertyList properties_;
     std::function<ReturnValue(const PropertyList&)> callback_;
     bool user_only_ = false;
+    McpToolOptions options_;
+    mutable std::string json_;  // Serialized descriptor, tools do not change after registration
 
-public:
-    McpTool(const std::string& name, 
-            const std::string& description, 
-            const PropertyList& properties, 
-            std::function<ReturnValue(const PropertyList&)> callback)
-        : name_(name), 
-        description_(description), 
-        properties_(properties), 
-        callback_(callback) {}
-
-    void set_user_only(bool user_only) { user_only_ = user_only; }
-    inline const std::string& name() const { return name_; }
-    inline const std::string& description() const { return description_; }
-    inline const PropertyList& properties() const { return properties_; }
-    inline bool user_only() const { return user_only_; }
-
-    std::string to_json() const {
+    std::string BuildJson() const {
         std::vector<std::string> required = properties_.GetRequired();
         
         cJSON *json = cJSON_CreateObject();
@@ -269,37 +355,56 @@ public:
         return result;
     }
 
-    std::string Call(const PropertyList& properties) {
-        ReturnValue return_value = callback_(properties);
-        // 返回结果
+public:
+    McpTool(const std::string& name, 
+            const std::string& description, 
+            const PropertyList& properties, 
+            std::function<ReturnValue(const PropertyList&)> callback)
+        : name_(name), 
+        description_(description), 
+        properties_(properties), 
+        callback_(callback) {}
+
+    void set_user_only(bool user_only) { user_only_ = user_only; json_.clear(); }
+    inline const std::string& name() const { return name_; }
+    inline const std::string& description() const { return description_; }
+    inline const PropertyList& properties() const { return properties_; }
+    inline bool user_only() const { return user_only_; }
+    void set_options(const McpToolOptions& options) { options_ = options; }
+    inline const McpToolOptions& options() const { return options_; }
+
+    const std::string& to_json() const {
+        if (json_.empty()) {
+            json_ = BuildJson();
+        }
+        return json_;
+    }
+
+    ReturnValue Call(const PropertyList& properties) {
+        return callback_(properties);
+    }
+
+    // Result object for every return type except ImageContent, which McpServer streams
+    static std::string ResultToJson(const ReturnValue& return_value) {
         cJSON* result = cJSON_CreateObject();
         cJSON* content = cJSON_CreateArray();
 
-        if (std::holds_alternative<ImageContent*>(return_value)) {
-            auto image_content = std::get<ImageContent*>(return_value);
-            cJSON* image = cJSON_CreateObject();
-            cJSON_AddStringToObject(image, "type", "image");
-            cJSON_AddStringToObject(image, "image", image_content->to_json().c_str());
-            cJSON_AddItemToArray(content, image);
-            delete image_content;
-        } else {
-            cJSON* text = cJSON_CreateObject();
-            cJSON_AddStringToObject(text, "type", "text");
-            if (std::holds_alternative<std::string>(return_value)) {
-                cJSON_AddStringToObject(text, "text", std::get<std::string>(return_value).c_str());
-            } else if (std::holds_alternative<bool>(return_value)) {
-                cJSON_AddStringToObject(text, "text", std::get<bool>(return_value) ? "true" : "false");
-            } else if (std::holds_alternative<int>(return_value)) {
-                cJSON_AddStringToObject(text, "text", std::to_string(std::get<int>(return_value)).c_str());
-            } else if (std::holds_alternative<cJSON*>(return_value)) {
-                cJSON* json = std::get<cJSON*>(return_value);
-                char* json_str = cJSON_PrintUnformatted(json);
-                cJSON_AddStringToObject(text, "text", json_str);
-                cJSON_free(json_str);
-                cJSON_Delete(json);
-            }
-            cJSON_AddItemToArray(content, text);
+        cJSON* text = cJSON_CreateObject();
+        cJSON_AddStringToObject(text, "type", "text");
+        if (std::holds_alternative<std::string>(return_value)) {
+            cJSON_AddStringToObject(text, "text", std::get<std::string>(return_value).c_str());
+        } else if (std::holds_alternative<bool>(return_value)) {
+            cJSON_AddStringToObject(text, "text", std::get<bool>(return_value) ? "true" : "false");
+        } else if (std::holds_alternative<int>(return_value)) {
+            cJSON_AddStringToObject(text, "text", std::to_string(std::get<int>(return_value)).c_str());
+        } else if (std::holds_alternative<cJSON*>(return_value)) {
+            cJSON* json = std::get<cJSON*>(return_value);
+            char* json_str = cJSON_PrintUnformatted(json);
+            cJSON_AddStringToObject(text, "text", json_str);
+            cJSON_free(json_str);
+            cJSON_Delete(json);
         }
+        cJSON_AddItemToArray(content, text);
         cJSON_AddItemToObject(result, "content", content);
         cJSON_AddBoolToObject(result, "isError", false);
 
@@ -321,24 +426,95 @@ public:
     void AddCommonTools();
     void AddUserOnlyTools();
     void AddTool(McpTool* tool);
-    void AddTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback);
-    void AddUserOnlyTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback);
+    void AddTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback, const McpToolOptions& options = {});
+    void AddUserOnlyTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback, const McpToolOptions& options = {});
     void ParseMessage(const cJSON* json);
     void ParseMessage(const std::string& message);
 
+    // For long running tools to poll: true once the server cancelled the call or it timed out
+    static bool IsToolCallCancelled();
+
 private:
     McpServer();
     ~McpServer();
 
+    struct ToolCall {
+        int id;
+        McpTool* tool;
+        PropertyList arguments;
+        int64_t deadline_us;                // 0 for no timeout
+        std::atomic<bool> finished{false};  // Replied, timed out or cancelled, later results are dropped
+        // Guarded by calls_mutex_
+        bool on_worker = false;             // Running on a pool worker
+        bool abandoned = false;             // Timed out or cancelled while on_worker, the worker is stuck in it
+    };
+
+    static constexpr int kToolWorkerCount = 2;
+    // Workers stuck in abandoned calls are replaced up to this many tasks in total, then worker calls are
+    // rejected until one of the stuck callbacks returns
+    static constexpr int kMaxToolWorkers = 4;
+    static constexpr int64_t kTimeoutCheckIntervalUs = 100 * 1000;
+
+    // One reply of a JSON-RPC batch, either a complete response object or an image result to stream
+    struct BatchReply {
+        int id;
+        std::string json;
+        std::shared_ptr<ImageContent> image;
+    };
+
+    // A JSON-RPC batch collecting the replies of its requests, sent as one array when `pending` reaches 0
+    struct Batch {
+        size_t pending = 0;
+        std::vector<BatchReply> replies;
+    };
+
     void ParseCapabilities(const cJSON* capabilities);
+    void ParseRequest(const cJSON* json);
+    void ParseBatch(const cJSON* json);
+    static bool GetReplyId(const cJSON* json, int& id);
 
     void ReplyResult(int id, const std::string& result);
     void ReplyError(int id, const std::string& message);
+    static std::string MakeErrorReply(int id, const std::string& message);
+    // Takes ownership of the image
+    void ReplyImageResult(int id, ImageContent* image_content);
+    static bool WriteImageReply(int id, const ImageContent& image, const ImageContent::Writer& write);
+
+    // Returns false if the request is not part of a batch and the reply has to be sent on its own
+    bool AddBatchReply(BatchReply&& reply);
+    // The request will not reply (cancelled), stop waiting for it
+    void DropBatchReply(int id);
+    void SendBatch(const std::shared_ptr<Batch>& batch);
 
     void GetToolsList(int id, const std::string& cursor, bool list_user_only_tools);
     void DoToolCall(int id, const std::string& tool_name, const cJSON* tool_arguments);
 
-    std::vector<McpTool*> tools_;
+    McpToolRegistry tools_;
+
+    // Tool calls that have not replied yet, keyed by request id
+    std::mutex calls_mutex_;
+    std::condition_variable calls_cv_;
+    std::map<int, std::shared_ptr<ToolCall>> calls_;
+    std::deque<std::shared_ptr<ToolCall>> worker_queue_;
+    std::map<const McpTool*, int> worker_running_;     // Calls of each tool running on the pool
+    int worker_count_ = 0;
+    int abandoned_workers_ = 0;     // Workers still running a call that timed out or was cancelled
+    esp_timer_handle_t timeout_timer_ = nullptr;
+
+    // Request id -> the batch it belongs to, until the request has replied
+    std::mutex batches_mutex_;
+    std::map<int, std::shared_ptr<Batch>> batch_ids_;
+    // Set by the server in initialize capabilities: send batch replies one by one as they complete
+    std::atomic<bool> pipeline_batch_replies_{false};
+
+    void StartToolCall(std::shared_ptr<ToolCall> call);
+    void RunToolCall(const std::shared_ptr<ToolCall>& call);
+    void FinishToolCall(const std::shared_ptr<ToolCall>& call);
+    void CancelToolCall(int id);
+    // With calls_mutex_ held, after `call` was marked finished by a timeout or cancel
+    void AbandonToolCall(ToolCall& call);
+    void CheckToolCallTimeouts();
+    void ToolWorker();
 };
 
 #endif // MCP_SERVER_H
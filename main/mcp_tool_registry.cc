@@ -0,0 +1,148 @@
+#include "mcp_tool_registry.h"
+#include "mcp_server.h"
+
+#include <algorithm>
+#include <cstring>
+
+McpToolRegistry::~McpToolRegistry() {
+    for (auto tool : tools_) {
+        delete tool;
+    }
+}
+
+bool McpToolRegistry::Add(McpTool* tool) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (index_.find(tool->name()) != index_.end()) {
+        return false;
+    }
+    // Serialize the descriptor now, tools/list only concatenates the cached strings
+    tool->to_json();
+    index_[tool->name()] = tools_.size();
+    tools_.push_back(tool);
+    pages_valid_ = false;
+    return true;
+}
+
+McpTool* McpToolRegistry::Find(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(name);
+    return it != index_.end() ? tools_[it->second] : nullptr;
+}
+
+std::vector<McpTool*> McpToolRegistry::TakeAll() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<McpTool*> tools = std::move(tools_);
+    tools_.clear();
+    RebuildIndex();
+    return tools;
+}
+
+void McpToolRegistry::Append(const std::vector<McpTool*>& tools) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tools_.insert(tools_.end(), tools.begin(), tools.end());
+    RebuildIndex();
+}
+
+void McpToolRegistry::RebuildIndex() {
+    index_.clear();
+    index_.reserve(tools_.size());
+    for (size_t i = 0; i < tools_.size(); i++) {
+        index_.emplace(tools_[i]->name(), i);
+    }
+    pages_valid_ = false;
+}
+
+McpToolRegistry::Page McpToolRegistry::Paginate(size_t begin, bool list_user_only_tools) const {
+    size_t length = strlen("{\"tools\":[");
+    size_t i = begin;
+    for (; i < tools_.size(); i++) {
+        if (!list_user_only_tools && tools_[i]->user_only()) {
+            continue;
+        }
+        // 添加tool前检查大小, 预留 nextCursor 的空间
+        size_t tool_length = tools_[i]->to_json().length() + 1;
+        if (length + tool_length + 30 > kMaxPayloadSize) {
+            break;
+        }
+        length += tool_length;
+    }
+    return {begin, i};
+}
+
+void McpToolRegistry::BuildPages() {
+    for (int with_user = 0; with_user < 2; with_user++) {
+        auto& pages = pages_[with_user];
+        pages.clear();
+        size_t begin = 0;
+        while (begin < tools_.size()) {
+            auto page = Paginate(begin, with_user == 1);
+            if (page.end == page.begin) {
+                // A single tool exceeds the payload size, GetToolsList reports it
+                break;
+            }
+            pages.push_back(page);
+            begin = page.end;
+        }
+    }
+    pages_valid_ = true;
+}
+
+bool McpToolRegistry::GetToolsList(const std::string& cursor, bool list_user_only_tools, std::string& json,
+    std::string& error) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!pages_valid_) {
+        BuildPages();
+    }
+
+    size_t begin = 0;
+    if (!cursor.empty()) {
+        auto it = index_.find(cursor);
+        if (it == index_.end()) {
+            error = "Unknown cursor: " + cursor;
+            return false;
+        }
+        begin = it->second;
+    }
+
+    // Cursors we handed out start a cached page, anything else is paginated on the fly
+    auto& pages = pages_[list_user_only_tools ? 1 : 0];
+    auto page_it = std::lower_bound(pages.begin(), pages.end(), begin,
+        [](const Page& page, size_t index) { return page.begin < index; });
+    Page page = (page_it != pages.end() && page_it->begin == begin) ?
+        *page_it : Paginate(begin, list_user_only_tools);
+
+    std::string next_cursor = page.end < tools_.size() ? tools_[page.end]->name() : "";
+    size_t length = 0;
+    for (size_t i = page.begin; i < page.end; i++) {
+        length += tools_[i]->to_json().length() + 1;
+    }
+
+    json.clear();
+    json.reserve(length + next_cursor.length() + 32);
+    json = "{\"tools\":[";
+    for (size_t i = page.begin; i < page.end; i++) {
+        if (!list_user_only_tools && tools_[i]->user_only()) {
+            continue;
+        }
+        json += tools_[i]->to_json();
+        json += ',';
+    }
+    lock.unlock();
+
+    if (json.back() == ',') {
+        json.pop_back();
+    }
+
+    if (json.back() == '[' && !next_cursor.empty()) {
+        // 如果没有添加任何tool，返回错误
+        error = "Failed to add tool " + next_cursor + " because of payload size limit";
+        return false;
+    }
+
+    if (next_cursor.empty()) {
+        json += "]}";
+    } else {
+        json += "],\"nextCursor\":\"" + next_cursor + "\"}";
+    }
+    return true;
+}
@@ -0,0 +1,60 @@
+#ifndef MCP_TOOL_REGISTRY_H
+#define MCP_TOOL_REGISTRY_H
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class McpTool;
+
+/**
+ * The tools of McpServer, in the order tools/list reports them. Owns the tools.
+ * tools/call finds a tool through a name index, tools/list concatenates the descriptors each
+ * McpTool caches into pages whose boundaries are computed once after tools change.
+ * Safe to call from the protocol task while boards are still adding tools.
+ */
+class McpToolRegistry {
+public:
+    McpToolRegistry() = default;
+    ~McpToolRegistry();
+    McpToolRegistry(const McpToolRegistry&) = delete;
+    McpToolRegistry& operator=(const McpToolRegistry&) = delete;
+
+    // Returns false if a tool of the same name is already registered, the caller keeps the tool then
+    bool Add(McpTool* tool);
+    McpTool* Find(const std::string& name);
+
+    // Removes all tools and hands them back, Append() puts them after the ones added in between
+    std::vector<McpTool*> TakeAll();
+    void Append(const std::vector<McpTool*>& tools);
+
+    // The result of a tools/list request. `cursor` is empty for the first page, else a tool name
+    // from a previous nextCursor. On failure `error` says why and nothing should be listed
+    bool GetToolsList(const std::string& cursor, bool list_user_only_tools, std::string& json, std::string& error);
+
+private:
+    static constexpr size_t kMaxPayloadSize = 8000;
+
+    struct Page {
+        size_t begin;   // Index in tools_ of the first tool, the cursor that leads here is its name
+        size_t end;     // Index of the first tool on the next page, tools_.size() on the last page
+    };
+
+    // With mutex_ held
+    void RebuildIndex();
+    Page Paginate(size_t begin, bool list_user_only_tools) const;
+    void BuildPages();
+
+    std::mutex mutex_;
+    std::vector<McpTool*> tools_;
+    std::unordered_map<std::string_view, size_t> index_;   // Keys view McpTool::name()
+    // Page boundaries of tools/list, [0] without and [1] with user only tools.
+    // Built on the first tools/list after tools were added
+    std::vector<Page> pages_[2];
+    bool pages_valid_ = false;
+};
+
+#endif // MCP_TOOL_REGISTRY_H
@@ -2,6 +2,7 @@
 #include "board.h"
 #include "application.h"
 #include "settings.h"
+#include "trace.h"
 
 #include <esp_log.h>
 #include <cstring>
@@ -59,6 +60,7 @@ bool MqttProtocol::Start() {
 bool MqttProtocol::StartMqttClient(bool report_error) {
     if (mqtt_ != nullptr) {
         ESP_LOGW(TAG, "Mqtt client already started");
+        std::lock_guard<std::mutex> lock(mqtt_mutex_);
         mqtt_.reset();
     }
 
@@ -79,7 +81,10 @@ bool MqttProtocol::StartMqttClient(bool report_error) {
     }
 
     auto network = Board::GetInstance().GetNetwork();
-    mqtt_ = network->CreateMqtt(0);
+    {
+        std::lock_guard<std::mutex> lock(mqtt_mutex_);
+        mqtt_ = network->CreateMqtt(0);
+    }
     mqtt_->SetKeepAlive(keepalive_interval);
 
     mqtt_->OnDisconnected([this]() {
@@ -98,6 +103,12 @@ bool MqttProtocol::StartMqttClient(bool report_error) {
     });
 
     mqtt_->OnMessage([this](const std::string& topic, const std::string& payload) {
+        TRACE_SCOPE("mqtt:message");
+        RecordDownlink(payload.size());
+        if (DispatchServerMessage(payload.data(), payload.size())) {
+            last_incoming_time_ = std::chrono::steady_clock::now();
+            return;
+        }
         cJSON* root = cJSON_Parse(payload.c_str());
         if (root == nullptr) {
             ESP_LOGE(TAG, "Failed to parse json message %s", payload.c_str());
@@ -121,7 +132,7 @@ bool MqttProtocol::StartMqttClient(bool report_error) {
                     if (*alive) {
                         CloseAudioChannel();
                     }
-                });
+                }, kSchedulePriorityCritical);
             }
         } else if (on_incoming_json_ != nullptr) {
             on_incoming_json_(root);
@@ -154,17 +165,20 @@ bool MqttProtocol::SendText(const std::string& text) {
     if (publish_topic_.empty()) {
         return false;
     }
-    if (!mqtt_->Publish(publish_topic_, text)) {
+    std::lock_guard<std::mutex> lock(mqtt_mutex_);
+    if (mqtt_ == nullptr || !mqtt_->Publish(publish_topic_, text)) {
         ESP_LOGE(TAG, "Failed to publish message: %s", text.c_str());
         SetError(Lang::Strings::SERVER_ERROR);
         return false;
     }
+    RecordUplink(text.size());
     return true;
 }
 
 bool MqttProtocol::SendAudio(std::unique_ptr<AudioStreamPacket> packet) {
     std::lock_guard<std::mutex> lock(channel_mutex_);
     if (udp_ == nullptr) {
+        RecordAudioSent(*packet, false);
         return false;
     }
 
@@ -182,10 +196,16 @@ bool MqttProtocol::SendAudio(std::unique_ptr<AudioStreamPacket> packet) {
     if (mbedtls_aes_crypt_ctr(&aes_ctx_, packet->payload.size(), &nc_off, (uint8_t*)nonce.c_str(), stream_block,
         (uint8_t*)packet->payload.data(), (uint8_t*)&encrypted[nonce.size()]) != 0) {
         ESP_LOGE(TAG, "Failed to encrypt audio data");
+        RecordAudioSent(*packet, false);
         return false;
     }
 
-    return udp_->Send(encrypted) > 0;
+    bool success = udp_->Send(encrypted) > 0;
+    if (success) {
+        RecordUplink(encrypted.size());
+    }
+    RecordAudioSent(*packet, success);
+    return success;
 }
 
 void MqttProtocol::CloseAudioChannel() {
@@ -215,6 +235,7 @@ bool MqttProtocol::OpenAudioChannel() {
 
     error_occurred_ = false;
     session_id_ = "";
+    ping_enabled_ = false;
     xEventGroupClearBits(event_group_handle_, MQTT_PROTOCOL_SERVER_HELLO_EVENT);
 
     auto message = GetHelloMessage();
@@ -234,6 +255,8 @@ bool MqttProtocol::OpenAudioChannel() {
     auto network = Board::GetInstance().GetNetwork();
     udp_ = network->CreateUdp(2);
     udp_->OnMessage([this](const std::string& data) {
+        TRACE_SCOPE("udp:message");
+        RecordDownlink(data.size());
         /*
          * UDP Encrypted OPUS Packet Format:
          * |type 1u|flags 1u|payload_len 2u|ssrc 4u|timestamp 4u|sequence 4u|
@@ -298,6 +321,7 @@ std::string MqttProtocol::GetHelloMessage() {
     cJSON_AddBoolToObject(features, "aec", true);
 #endif
     cJSON_AddBoolToObject(features, "mcp", true);
+    cJSON_AddBoolToObject(features, "ping", true);
     cJSON_AddItemToObject(root, "features", features);
     cJSON* audio_params = cJSON_CreateObject();
     cJSON_AddStringToObject(audio_params, "format", "opus");
@@ -325,6 +349,11 @@ void MqttProtocol::ParseServerHello(const cJSON* root) {
         ESP_LOGI(TAG, "Session ID: %s", session_id_.c_str());
     }
 
+    auto features = cJSON_GetObjectItem(root, "features");
+    if (cJSON_IsObject(features)) {
+        ping_enabled_ = cJSON_IsTrue(cJSON_GetObjectItem(features, "ping"));
+    }
+
     // Get sample rate from hello message
     auto audio_params = cJSON_GetObjectItem(root, "audio_params");
     if (cJSON_IsObject(audio_params)) {
@@ -0,0 +1,608 @@
+#include "msgpack_codec.h"
+
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+constexpr int kMaxDepth = 32;
+
+inline void PutU16(std::string& out, uint16_t v) {
+    out.push_back((char)(v >> 8));
+    out.push_back((char)v);
+}
+
+inline void PutU32(std::string& out, uint32_t v) {
+    PutU16(out, (uint16_t)(v >> 16));
+    PutU16(out, (uint16_t)v);
+}
+
+inline void PutU64(std::string& out, uint64_t v) {
+    PutU32(out, (uint32_t)(v >> 32));
+    PutU32(out, (uint32_t)v);
+}
+
+inline int HexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+bool ParseHex4(const char* p, const char* end, uint32_t& value) {
+    if (end - p < 4) {
+        return false;
+    }
+    value = 0;
+    for (int i = 0; i < 4; i++) {
+        int v = HexValue(p[i]);
+        if (v < 0) {
+            return false;
+        }
+        value = (value << 4) | v;
+    }
+    return true;
+}
+
+void AppendUtf8(std::string& out, uint32_t code) {
+    if (code < 0x80) {
+        out.push_back((char)code);
+    } else if (code < 0x800) {
+        out.push_back((char)(0xC0 | (code >> 6)));
+        out.push_back((char)(0x80 | (code & 0x3F)));
+    } else if (code < 0x10000) {
+        out.push_back((char)(0xE0 | (code >> 12)));
+        out.push_back((char)(0x80 | ((code >> 6) & 0x3F)));
+        out.push_back((char)(0x80 | (code & 0x3F)));
+    } else {
+        out.push_back((char)(0xF0 | (code >> 18)));
+        out.push_back((char)(0x80 | ((code >> 12) & 0x3F)));
+        out.push_back((char)(0x80 | ((code >> 6) & 0x3F)));
+        out.push_back((char)(0x80 | (code & 0x3F)));
+    }
+}
+
+// JSON text -> MessagePack in a single pass. Container and string lengths are
+// not known up front, so a one byte header is reserved and widened afterwards.
+class JsonToMsgPackWriter {
+public:
+    JsonToMsgPackWriter(const char* json, size_t len, std::string& out)
+        : p_(json), end_(json + len), out_(out) {}
+
+    bool Run() {
+        SkipWhitespace();
+        if (!Value(0)) {
+            return false;
+        }
+        SkipWhitespace();
+        return p_ == end_;
+    }
+
+private:
+    const char* p_;
+    const char* end_;
+    std::string& out_;
+
+    void SkipWhitespace() {
+        while (p_ < end_ && (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' || *p_ == '\r')) {
+            p_++;
+        }
+    }
+
+    bool Value(int depth) {
+        if (p_ >= end_ || depth > kMaxDepth) {
+            return false;
+        }
+        switch (*p_) {
+            case '{': return Object(depth);
+            case '[': return Array(depth);
+            case '"': return String();
+            case 't': return Literal("true", 0xc3);
+            case 'f': return Literal("false", 0xc2);
+            case 'n': return Literal("null", 0xc0);
+            default: return Number();
+        }
+    }
+
+    void PatchContainerHeader(size_t pos, uint32_t count, uint8_t fix_base, uint8_t code16, uint8_t code32) {
+        if (count <= 15) {
+            out_[pos] = (char)(fix_base | count);
+        } else if (count <= 0xFFFF) {
+            out_.insert(pos + 1, 2, '\0');
+            out_[pos] = (char)code16;
+            out_[pos + 1] = (char)(count >> 8);
+            out_[pos + 2] = (char)count;
+        } else {
+            out_.insert(pos + 1, 4, '\0');
+            out_[pos] = (char)code32;
+            for (int i = 0; i < 4; i++) {
+                out_[pos + 1 + i] = (char)(count >> (24 - 8 * i));
+            }
+        }
+    }
+
+    bool Object(int depth) {
+        size_t header = out_.size();
+        out_.push_back('\0');
+        p_++;
+        uint32_t count = 0;
+        SkipWhitespace();
+        if (p_ < end_ && *p_ == '}') {
+            p_++;
+            PatchContainerHeader(header, 0, 0x80, 0xde, 0xdf);
+            return true;
+        }
+        while (true) {
+            SkipWhitespace();
+            if (p_ >= end_ || *p_ != '"' || !String()) {
+                return false;
+            }
+            SkipWhitespace();
+            if (p_ >= end_ || *p_ != ':') {
+                return false;
+            }
+            p_++;
+            SkipWhitespace();
+            if (!Value(depth + 1)) {
+                return false;
+            }
+            count++;
+            SkipWhitespace();
+            if (p_ >= end_) {
+                return false;
+            }
+            if (*p_ == ',') {
+                p_++;
+                continue;
+            }
+            if (*p_ == '}') {
+                p_++;
+                break;
+            }
+            return false;
+        }
+        PatchContainerHeader(header, count, 0x80, 0xde, 0xdf);
+        return true;
+    }
+
+    bool Array(int depth) {
+        size_t header = out_.size();
+        out_.push_back('\0');
+        p_++;
+        uint32_t count = 0;
+        SkipWhitespace();
+        if (p_ < end_ && *p_ == ']') {
+            p_++;
+            PatchContainerHeader(header, 0, 0x90, 0xdc, 0xdd);
+            return true;
+        }
+        while (true) {
+            SkipWhitespace();
+            if (!Value(depth + 1)) {
+                return false;
+            }
+            count++;
+            SkipWhitespace();
+            if (p_ >= end_) {
+                return false;
+            }
+            if (*p_ == ',') {
+                p_++;
+                continue;
+            }
+            if (*p_ == ']') {
+                p_++;
+                break;
+            }
+            return false;
+        }
+        PatchContainerHeader(header, count, 0x90, 0xdc, 0xdd);
+        return true;
+    }
+
+    bool String() {
+        size_t header = out_.size();
+        out_.push_back('\0');
+        size_t start = out_.size();
+        p_++;
+
+        while (true) {
+            // Copy plain runs in one go, most strings have no escapes at all
+            const char* run = p_;
+            while (p_ < end_ && *p_ != '"' && *p_ != '\\') {
+                p_++;
+            }
+            out_.append(run, p_ - run);
+            if (p_ >= end_) {
+                return false;
+            }
+            if (*p_ == '"') {
+                p_++;
+                break;
+            }
+            if (++p_ >= end_) {
+                return false;
+            }
+            char ch = *p_++;
+            switch (ch) {
+                case '"': out_.push_back('"'); break;
+                case '\\': out_.push_back('\\'); break;
+                case '/': out_.push_back('/'); break;
+                case 'b': out_.push_back('\b'); break;
+                case 'f': out_.push_back('\f'); break;
+                case 'n': out_.push_back('\n'); break;
+                case 'r': out_.push_back('\r'); break;
+                case 't': out_.push_back('\t'); break;
+                case 'u': {
+                    uint32_t code;
+                    if (!ParseHex4(p_, end_, code)) {
+                        return false;
+                    }
+                    p_ += 4;
+                    // Surrogate pair
+                    if (code >= 0xD800 && code <= 0xDBFF) {
+                        uint32_t low;
+                        if (end_ - p_ < 6 || p_[0] != '\\' || p_[1] != 'u' || !ParseHex4(p_ + 2, end_, low) ||
+                            low < 0xDC00 || low > 0xDFFF) {
+                            return false;
+                        }
+                        p_ += 6;
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    AppendUtf8(out_, code);
+                    break;
+                }
+                default:
+                    return false;
+            }
+        }
+
+        uint32_t len = out_.size() - start;
+        if (len <= 31) {
+            out_[header] = (char)(0xa0 | len);
+        } else if (len <= 0xFF) {
+            out_.insert(header + 1, 1, (char)len);
+            out_[header] = (char)0xd9;
+        } else if (len <= 0xFFFF) {
+            out_.insert(header + 1, 2, '\0');
+            out_[header] = (char)0xda;
+            out_[header + 1] = (char)(len >> 8);
+            out_[header + 2] = (char)len;
+        } else {
+            out_.insert(header + 1, 4, '\0');
+            out_[header] = (char)0xdb;
+            for (int i = 0; i < 4; i++) {
+                out_[header + 1 + i] = (char)(len >> (24 - 8 * i));
+            }
+        }
+        return true;
+    }
+
+    bool Literal(const char* text, uint8_t code) {
+        size_t len = strlen(text);
+        if ((size_t)(end_ - p_) < len || memcmp(p_, text, len) != 0) {
+            return false;
+        }
+        p_ += len;
+        out_.push_back((char)code);
+        return true;
+    }
+
+    void PutInt(int64_t v) {
+        if (v >= 0) {
+            uint64_t u = (uint64_t)v;
+            if (u <= 0x7F) {
+                out_.push_back((char)u);
+            } else if (u <= 0xFF) {
+                out_.push_back((char)0xcc);
+                out_.push_back((char)u);
+            } else if (u <= 0xFFFF) {
+                out_.push_back((char)0xcd);
+                PutU16(out_, (uint16_t)u);
+            } else if (u <= 0xFFFFFFFF) {
+                out_.push_back((char)0xce);
+                PutU32(out_, (uint32_t)u);
+            } else {
+                out_.push_back((char)0xcf);
+                PutU64(out_, u);
+            }
+        } else if (v >= -32) {
+            out_.push_back((char)(int8_t)v);
+        } else if (v >= INT8_MIN) {
+            out_.push_back((char)0xd0);
+            out_.push_back((char)(int8_t)v);
+        } else if (v >= INT16_MIN) {
+            out_.push_back((char)0xd1);
+            PutU16(out_, (uint16_t)(int16_t)v);
+        } else if (v >= INT32_MIN) {
+            out_.push_back((char)0xd2);
+            PutU32(out_, (uint32_t)(int32_t)v);
+        } else {
+            out_.push_back((char)0xd3);
+            PutU64(out_, (uint64_t)v);
+        }
+    }
+
+    bool Number() {
+        char buffer[40];
+        size_t len = 0;
+        bool integer = true;
+        while (p_ < end_ && len < sizeof(buffer) - 1) {
+            char ch = *p_;
+            // JSON allows a sign only in front of the number ('-') and right after the exponent marker
+            bool after_exponent = len > 0 && (buffer[len - 1] == 'e' || buffer[len - 1] == 'E');
+            if (ch == '.' || ch == 'e' || ch == 'E') {
+                integer = false;
+            } else if (ch == '-') {
+                if (len > 0 && !after_exponent) {
+                    return false;
+                }
+            } else if (ch == '+') {
+                if (!after_exponent) {
+                    return false;
+                }
+            } else if (!(ch >= '0' && ch <= '9')) {
+                break;
+            }
+            buffer[len++] = ch;
+            p_++;
+        }
+        if (len == 0) {
+            return false;
+        }
+        buffer[len] = '\0';
+
+        char* parse_end;
+        if (integer) {
+            errno = 0;
+            long long v = strtoll(buffer, &parse_end, 10);
+            if (errno == 0 && *parse_end == '\0') {
+                PutInt(v);
+                return true;
+            }
+        }
+
+        double d = strtod(buffer, &parse_end);
+        if (*parse_end != '\0') {
+            return false;
+        }
+        float f = (float)d;
+        if ((double)f == d) {
+            uint32_t bits;
+            memcpy(&bits, &f, sizeof(bits));
+            out_.push_back((char)0xca);
+            PutU32(out_, bits);
+        } else {
+            uint64_t bits;
+            memcpy(&bits, &d, sizeof(bits));
+            out_.push_back((char)0xcb);
+            PutU64(out_, bits);
+        }
+        return true;
+    }
+};
+
+// MessagePack -> compact JSON text, the inverse of the writer above
+class MsgPackToJsonReader {
+public:
+    MsgPackToJsonReader(const uint8_t* data, size_t len, std::string& out)
+        : p_(data), end_(data + len), out_(out) {}
+
+    bool Run() {
+        return Value(0) && p_ == end_;
+    }
+
+private:
+    const uint8_t* p_;
+    const uint8_t* end_;
+    std::string& out_;
+
+    bool Need(size_t n) const {
+        return (size_t)(end_ - p_) >= n;
+    }
+
+    uint16_t U16() {
+        uint16_t v = (uint16_t)((p_[0] << 8) | p_[1]);
+        p_ += 2;
+        return v;
+    }
+
+    uint32_t U32() {
+        uint32_t v = ((uint32_t)p_[0] << 24) | ((uint32_t)p_[1] << 16) | ((uint32_t)p_[2] << 8) | p_[3];
+        p_ += 4;
+        return v;
+    }
+
+    uint64_t U64() {
+        uint64_t high = U32();
+        return (high << 32) | U32();
+    }
+
+    void PutDouble(double v, bool single) {
+        if (std::isnan(v) || std::isinf(v)) {
+            out_ += "null";
+            return;
+        }
+        // Shortest representation that survives a round trip, same idea as cJSON
+        char buffer[32];
+        if (single) {
+            snprintf(buffer, sizeof(buffer), "%1.7g", v);
+            if ((float)strtod(buffer, nullptr) != (float)v) {
+                snprintf(buffer, sizeof(buffer), "%1.9g", v);
+            }
+        } else {
+            snprintf(buffer, sizeof(buffer), "%1.15g", v);
+            if (strtod(buffer, nullptr) != v) {
+                snprintf(buffer, sizeof(buffer), "%1.17g", v);
+            }
+        }
+        out_ += buffer;
+    }
+
+    bool String(uint32_t len) {
+        if (!Need(len)) {
+            return false;
+        }
+        const uint8_t* end = p_ + len;
+        out_.push_back('"');
+        while (p_ < end) {
+            const uint8_t* run = p_;
+            while (p_ < end && *p_ >= 0x20 && *p_ != '"' && *p_ != '\\') {
+                p_++;
+            }
+            out_.append((const char*)run, p_ - run);
+            if (p_ >= end) {
+                break;
+            }
+            uint8_t ch = *p_++;
+            switch (ch) {
+                case '"': out_ += "\\\""; break;
+                case '\\': out_ += "\\\\"; break;
+                case '\b': out_ += "\\b"; break;
+                case '\f': out_ += "\\f"; break;
+                case '\n': out_ += "\\n"; break;
+                case '\r': out_ += "\\r"; break;
+                case '\t': out_ += "\\t"; break;
+                default: {
+                    char escaped[8];
+                    snprintf(escaped, sizeof(escaped), "\\u%04x", ch);
+                    out_ += escaped;
+                    break;
+                }
+            }
+        }
+        out_.push_back('"');
+        return true;
+    }
+
+    bool Key() {
+        if (!Need(1)) {
+            return false;
+        }
+        uint8_t type = *p_++;
+        if ((type & 0xe0) == 0xa0) {
+            return String(type & 0x1f);
+        }
+        switch (type) {
+            case 0xd9: return Need(1) && String(*p_++);
+            case 0xda: return Need(2) && String(U16());
+            case 0xdb: return Need(4) && String(U32());
+            default: return false;  // JSON only allows string keys
+        }
+    }
+
+    bool Map(uint32_t count, int depth) {
+        out_.push_back('{');
+        for (uint32_t i = 0; i < count; i++) {
+            if (i > 0) {
+                out_.push_back(',');
+            }
+            if (!Key()) {
+                return false;
+            }
+            out_.push_back(':');
+            if (!Value(depth + 1)) {
+                return false;
+            }
+        }
+        out_.push_back('}');
+        return true;
+    }
+
+    bool Array(uint32_t count, int depth) {
+        out_.push_back('[');
+        for (uint32_t i = 0; i < count; i++) {
+            if (i > 0) {
+                out_.push_back(',');
+            }
+            if (!Value(depth + 1)) {
+                return false;
+            }
+        }
+        out_.push_back(']');
+        return true;
+    }
+
+    bool Value(int depth) {
+        if (!Need(1) || depth > kMaxDepth) {
+            return false;
+        }
+        uint8_t type = *p_++;
+        if (type <= 0x7f) {
+            out_ += std::to_string(type);
+            return true;
+        }
+        if (type >= 0xe0) {
+            out_ += std::to_string((int8_t)type);
+            return true;
+        }
+        if ((type & 0xf0) == 0x80) {
+            return Map(type & 0x0f, depth);
+        }
+        if ((type & 0xf0) == 0x90) {
+            return Array(type & 0x0f, depth);
+        }
+        if ((type & 0xe0) == 0xa0) {
+            return String(type & 0x1f);
+        }
+
+        switch (type) {
+            case 0xc0: out_ += "null"; return true;
+            case 0xc2: out_ += "false"; return true;
+            case 0xc3: out_ += "true"; return true;
+            case 0xca: {
+                if (!Need(4)) return false;
+                uint32_t bits = U32();
+                float f;
+                memcpy(&f, &bits, sizeof(f));
+                PutDouble(f, true);
+                return true;
+            }
+            case 0xcb: {
+                if (!Need(8)) return false;
+                uint64_t bits = U64();
+                double d;
+                memcpy(&d, &bits, sizeof(d));
+                PutDouble(d, false);
+                return true;
+            }
+            case 0xcc: if (!Need(1)) return false; out_ += std::to_string(*p_++); return true;
+            case 0xcd: if (!Need(2)) return false; out_ += std::to_string(U16()); return true;
+            case 0xce: if (!Need(4)) return false; out_ += std::to_string(U32()); return true;
+            case 0xcf: if (!Need(8)) return false; out_ += std::to_string(U64()); return true;
+            case 0xd0: if (!Need(1)) return false; out_ += std::to_string((int8_t)*p_++); return true;
+            case 0xd1: if (!Need(2)) return false; out_ += std::to_string((int16_t)U16()); return true;
+            case 0xd2: if (!Need(4)) return false; out_ += std::to_string((int32_t)U32()); return true;
+            case 0xd3: if (!Need(8)) return false; out_ += std::to_string((int64_t)U64()); return true;
+            case 0xd9: return Need(1) && String(*p_++);
+            case 0xda: return Need(2) && String(U16());
+            case 0xdb: return Need(4) && String(U32());
+            case 0xdc: return Need(2) && Array(U16(), depth);
+            case 0xdd: return Need(4) && Array(U32(), depth);
+            case 0xde: return Need(2) && Map(U16(), depth);
+            case 0xdf: return Need(4) && Map(U32(), depth);
+            default:
+                // bin / ext have no JSON equivalent
+                return false;
+        }
+    }
+};
+
+} // namespace
+
+bool JsonToMsgPack(const char* json, size_t len, std::string& out) {
+    out.clear();
+    out.reserve(len);
+    JsonToMsgPackWriter writer(json, len, out);
+    return writer.Run();
+}
+
+bool MsgPackToJson(const uint8_t* data, size_t len, std::string& out) {
+    out.clear();
+    out.reserve(len + len / 4);
+    MsgPackToJsonReader reader(data, len, out);
+    return reader.Run();
+}
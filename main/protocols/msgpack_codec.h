@@ -0,0 +1,24 @@
+#ifndef MSGPACK_CODEC_H
+#define MSGPACK_CODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+ * Control and MCP messages are built as JSON text all over the code base.
+ * When the server agrees on "msgpack" in the hello features, the websocket
+ * transport transcodes that text straight into MessagePack (no cJSON tree)
+ * and sends it as a binary frame of type 1. Incoming type 1 frames are
+ * turned back into JSON text so they reuse the normal text message path.
+ * Only wire bytes are saved: the JSON text is still built and parsed, so the
+ * transcoding is extra CPU time on both sides (host_test/test_msgpack_codec).
+ */
+
+// Returns false if the input is not valid JSON, `out` is cleared first
+bool JsonToMsgPack(const char* json, size_t len, std::string& out);
+
+// Returns false if the input is truncated or uses types JSON can not express (bin, ext)
+bool MsgPackToJson(const uint8_t* data, size_t len, std::string& out);
+
+#endif // MSGPACK_CODEC_H
@@ -1,6 +1,8 @@
 #include "protocol.h"
 
 #include <esp_log.h>
+#include <esp_timer.h>
+#include <algorithm>
 
 #define TAG "Protocol"
 
@@ -8,6 +10,10 @@ void Protocol::OnIncomingJson(std::function<void(const cJSON* root)> callback) {
     on_incoming_json_ = callback;
 }
 
+void Protocol::OnIncomingMessage(std::function<void(const ServerMessage& message)> callback) {
+    on_incoming_message_ = callback;
+}
+
 void Protocol::OnIncomingAudio(std::function<void(std::unique_ptr<AudioStreamPacket> packet)> callback) {
     on_incoming_audio_ = callback;
 }
@@ -39,6 +45,110 @@ void Protocol::SetError(const std::string& message) {
     }
 }
 
+bool Protocol::DispatchServerMessage(const char* data, size_t len) {
+    ServerMessage message;
+    if (!message_scanner_.Scan(data, len, message)) {
+        return false;
+    }
+    if (message.type == kServerMessagePong) {
+        HandlePong(message.timestamp);
+        return true;
+    }
+    if (on_incoming_message_ == nullptr) {
+        return false;
+    }
+    on_incoming_message_(message);
+    return true;
+}
+
+void Protocol::RecordAudioSent(const AudioStreamPacket& packet, bool success) {
+    if (!success) {
+        audio_packets_dropped_++;
+        return;
+    }
+    audio_packets_sent_++;
+    if (packet.enqueue_time_us == 0) {
+        return;
+    }
+    uint32_t delay_ms = (uint32_t)((esp_timer_get_time() - packet.enqueue_time_us) / 1000);
+    // Exponential moving average with 1/8 weight, same as TCP SRTT
+    uint32_t avg = queue_delay_avg_ms_.load();
+    queue_delay_avg_ms_ = avg == 0 ? delay_ms : avg - avg / 8 + delay_ms / 8;
+    if (delay_ms > queue_delay_window_max_ms_.load()) {
+        queue_delay_window_max_ms_ = delay_ms;
+    }
+}
+
+void Protocol::SendPing() {
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"ping\",\"timestamp\":";
+    message += std::to_string(now_ms) + "}";
+    SendText(message);
+}
+
+void Protocol::HandlePong(uint32_t timestamp) {
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    int rtt = (int)(now_ms - timestamp);
+    if (rtt < 0 || rtt > 60000) {
+        ESP_LOGW(TAG, "Ignore pong with invalid timestamp %lu", (unsigned long)timestamp);
+        return;
+    }
+    rtt_ms_ = rtt;
+    int avg = rtt_avg_ms_.load();
+    rtt_avg_ms_ = avg < 0 ? rtt : avg - avg / 8 + rtt / 8;
+}
+
+void Protocol::UpdateMetrics() {
+    const int kPingIntervalSeconds = 5;
+
+    uint32_t uplink = uplink_bytes_.load();
+    uint32_t downlink = downlink_bytes_.load();
+    uplink_bps_ = (uplink - last_uplink_bytes_) * 8;
+    downlink_bps_ = (downlink - last_downlink_bytes_) * 8;
+    last_uplink_bytes_ = uplink;
+    last_downlink_bytes_ = downlink;
+    queue_delay_max_ms_ = queue_delay_window_max_ms_.exchange(0);
+
+    if (++metrics_ticks_ >= kPingIntervalSeconds) {
+        metrics_ticks_ = 0;
+        if (ping_enabled_ && IsAudioChannelOpened()) {
+            SendPing();
+        }
+    }
+}
+
+ProtocolMetrics Protocol::GetMetrics() const {
+    ProtocolMetrics metrics;
+    metrics.rtt_ms = rtt_ms_.load();
+    metrics.rtt_avg_ms = rtt_avg_ms_.load();
+    metrics.uplink_bps = uplink_bps_.load();
+    metrics.downlink_bps = downlink_bps_.load();
+    metrics.uplink_bytes = uplink_bytes_.load();
+    metrics.downlink_bytes = downlink_bytes_.load();
+    metrics.audio_packets_sent = audio_packets_sent_.load();
+    metrics.audio_packets_dropped = audio_packets_dropped_.load();
+    metrics.send_queue_delay_avg_ms = queue_delay_avg_ms_.load();
+    metrics.send_queue_delay_max_ms = queue_delay_max_ms_.load();
+    return metrics;
+}
+
+std::string Protocol::GetMetricsJson() const {
+    auto metrics = GetMetrics();
+    std::string json = "{";
+    json += "\"rtt_ms\":" + std::to_string(metrics.rtt_ms) + ",";
+    json += "\"rtt_avg_ms\":" + std::to_string(metrics.rtt_avg_ms) + ",";
+    json += "\"uplink_bps\":" + std::to_string(metrics.uplink_bps) + ",";
+    json += "\"downlink_bps\":" + std::to_string(metrics.downlink_bps) + ",";
+    json += "\"uplink_bytes\":" + std::to_string(metrics.uplink_bytes) + ",";
+    json += "\"downlink_bytes\":" + std::to_string(metrics.downlink_bytes) + ",";
+    json += "\"audio_packets_sent\":" + std::to_string(metrics.audio_packets_sent) + ",";
+    json += "\"audio_packets_dropped\":" + std::to_string(metrics.audio_packets_dropped) + ",";
+    json += "\"send_queue_delay_avg_ms\":" + std::to_string(metrics.send_queue_delay_avg_ms) + ",";
+    json += "\"send_queue_delay_max_ms\":" + std::to_string(metrics.send_queue_delay_max_ms);
+    json += "}";
+    return json;
+}
+
 void Protocol::SendAbortSpeaking(AbortReason reason) {
     std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"abort\"";
     if (reason == kAbortReasonWakeWordDetected) {
@@ -78,6 +188,19 @@ void Protocol::SendMcpMessage(const std::string& payload) {
     SendText(message);
 }
 
+bool Protocol::SendMcpMessageStream(const std::function<bool(const MessageWriter& write)>& payload) {
+    std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"mcp\",\"payload\":";
+    bool produced = payload([&message](const char* data, size_t len) {
+        message.append(data, len);
+        return true;
+    });
+    if (!produced) {
+        return false;
+    }
+    message += "}";
+    return SendText(message);
+}
+
 bool Protocol::IsTimeout() const {
     const int kTimeoutSeconds = 120;
     auto now = std::chrono::steady_clock::now();
@@ -3,20 +3,25 @@
 
 #include <cJSON.h>
 #include <string>
+#include <memory>
 #include <functional>
 #include <chrono>
 #include <vector>
+#include <atomic>
+
+#include "server_message.h"
 
 struct AudioStreamPacket {
     int sample_rate = 0;
     int frame_duration = 0;
     uint32_t timestamp = 0;
     std::vector<uint8_t> payload;
+    int64_t enqueue_time_us = 0;    // Set when the packet enters the send queue, 0 if unknown
 };
 
 struct BinaryProtocol2 {
     uint16_t version;
-    uint16_t type;          // Message type (0: OPUS, 1: JSON)
+    uint16_t type;          // Message type (0: OPUS, 1: MessagePack encoded JSON message)
     uint32_t reserved;      // Reserved for future use
     uint32_t timestamp;     // Timestamp in milliseconds (used for server-side AEC)
     uint32_t payload_size;  // Payload size in bytes
@@ -24,12 +29,26 @@ struct BinaryProtocol2 {
 } __attribute__((packed));
 
 struct BinaryProtocol3 {
-    uint8_t type;
+    uint8_t type;           // Same as BinaryProtocol2::type
     uint8_t reserved;
     uint16_t payload_size;
     uint8_t payload[];
 } __attribute__((packed));
 
+// Snapshot of the link health, refreshed once per second by UpdateMetrics()
+struct ProtocolMetrics {
+    int rtt_ms = -1;                        // Last timestamp-echo round trip, -1 if never measured
+    int rtt_avg_ms = -1;                    // Smoothed round trip time
+    uint32_t uplink_bps = 0;
+    uint32_t downlink_bps = 0;
+    uint32_t uplink_bytes = 0;
+    uint32_t downlink_bytes = 0;
+    uint32_t audio_packets_sent = 0;
+    uint32_t audio_packets_dropped = 0;
+    uint32_t send_queue_delay_avg_ms = 0;   // Time spent in the audio send queue
+    uint32_t send_queue_delay_max_ms = 0;   // Worst case in the last second
+};
+
 enum AbortReason {
     kAbortReasonNone,
     kAbortReasonWakeWordDetected
@@ -57,6 +76,7 @@ public:
 
     void OnIncomingAudio(std::function<void(std::unique_ptr<AudioStreamPacket> packet)> callback);
     void OnIncomingJson(std::function<void(const cJSON* root)> callback);
+    void OnIncomingMessage(std::function<void(const ServerMessage& message)> callback);
     void OnAudioChannelOpened(std::function<void()> callback);
     void OnAudioChannelClosed(std::function<void()> callback);
     void OnNetworkError(std::function<void(const std::string& message)> callback);
@@ -74,8 +94,26 @@ public:
     virtual void SendAbortSpeaking(AbortReason reason);
     virtual void SendMcpMessage(const std::string& message);
 
+    // Receives the payload of a streamed message piece by piece, returns false to abort
+    using MessageWriter = std::function<bool(const char* data, size_t len)>;
+    /**
+     * Sends an MCP message whose payload is produced in pieces (e.g. base64 image results) so it
+     * never has to exist as one string. The default assembles the message and calls SendText,
+     * transports that support fragmented frames override it to send through a fixed window.
+     * May be called from any task, the other send methods wait until the message is out.
+     */
+    virtual bool SendMcpMessageStream(const std::function<bool(const MessageWriter& write)>& payload);
+    // True while a streamed message holds the connection, audio is better kept queued meanwhile
+    bool IsStreaming() const { return streaming_; }
+
+    // Called once per second from the main loop to roll the rate windows and send pings
+    void UpdateMetrics();
+    ProtocolMetrics GetMetrics() const;
+    std::string GetMetricsJson() const;
+
 protected:
     std::function<void(const cJSON* root)> on_incoming_json_;
+    std::function<void(const ServerMessage& message)> on_incoming_message_;
     std::function<void(std::unique_ptr<AudioStreamPacket> packet)> on_incoming_audio_;
     std::function<void()> on_audio_channel_opened_;
     std::function<void()> on_audio_channel_closed_;
@@ -88,10 +126,39 @@ protected:
     bool error_occurred_ = false;
     std::string session_id_;
     std::chrono::time_point<std::chrono::steady_clock> last_incoming_time_;
+    ServerMessageScanner message_scanner_;
+    // Set from the server hello "features.ping", pings are only sent to servers that answer them
+    std::atomic<bool> ping_enabled_{false};
+    std::atomic<bool> streaming_{false};
 
+    // Returns true if the text frame was a hot message and has been dispatched without cJSON
+    bool DispatchServerMessage(const char* data, size_t len);
+    void RecordUplink(size_t bytes) { uplink_bytes_ += bytes; }
+    void RecordDownlink(size_t bytes) { downlink_bytes_ += bytes; }
+    void RecordAudioSent(const AudioStreamPacket& packet, bool success);
+    virtual void SendPing();
     virtual bool SendText(const std::string& text) = 0;
     virtual void SetError(const std::string& message);
     virtual bool IsTimeout() const;
+
+private:
+    std::atomic<uint32_t> uplink_bytes_{0};
+    std::atomic<uint32_t> downlink_bytes_{0};
+    std::atomic<uint32_t> audio_packets_sent_{0};
+    std::atomic<uint32_t> audio_packets_dropped_{0};
+    std::atomic<uint32_t> queue_delay_avg_ms_{0};
+    std::atomic<uint32_t> queue_delay_window_max_ms_{0};
+    std::atomic<int> rtt_ms_{-1};
+    std::atomic<int> rtt_avg_ms_{-1};
+    uint32_t last_uplink_bytes_ = 0;
+    uint32_t last_downlink_bytes_ = 0;
+    // Written by UpdateMetrics() in the main task, read by GetMetrics() from the web and MCP tasks
+    std::atomic<uint32_t> uplink_bps_{0};
+    std::atomic<uint32_t> downlink_bps_{0};
+    std::atomic<uint32_t> queue_delay_max_ms_{0};
+    int metrics_ticks_ = 0;
+
+    void HandlePong(uint32_t timestamp);
 };
 
 #endif // PROTOCOL_H
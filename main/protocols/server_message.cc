@@ -0,0 +1,293 @@
+#include "server_message.h"
+
+#include <cstdint>
+#include <cstring>
+
+namespace {
+
+struct Cursor {
+    const char* p;
+    const char* end;
+};
+
+inline void SkipWhitespace(Cursor& c) {
+    while (c.p < c.end && (*c.p == ' ' || *c.p == '\t' || *c.p == '\n' || *c.p == '\r')) {
+        c.p++;
+    }
+}
+
+// Cursor must point at the opening quote. On success `raw` is the content between the quotes.
+bool ScanString(Cursor& c, std::string_view& raw, bool& escaped) {
+    if (c.p >= c.end || *c.p != '"') {
+        return false;
+    }
+    const char* start = ++c.p;
+    escaped = false;
+    while (c.p < c.end) {
+        char ch = *c.p;
+        if (ch == '\\') {
+            escaped = true;
+            c.p += 2;
+            continue;
+        }
+        if (ch == '"') {
+            raw = std::string_view(start, c.p - start);
+            c.p++;
+            return true;
+        }
+        c.p++;
+    }
+    return false;
+}
+
+// Skip a number, literal, object or array. Strings inside nested values are honoured.
+bool SkipValue(Cursor& c) {
+    int depth = 0;
+    while (c.p < c.end) {
+        char ch = *c.p;
+        if (ch == '"') {
+            std::string_view unused;
+            bool escaped;
+            if (!ScanString(c, unused, escaped)) {
+                return false;
+            }
+            if (depth == 0) {
+                return true;
+            }
+            continue;
+        }
+        if (ch == '{' || ch == '[') {
+            depth++;
+        } else if (ch == '}' || ch == ']') {
+            if (depth == 0) {
+                // End of the enclosing object, leave it for the caller
+                return true;
+            }
+            depth--;
+            if (depth == 0) {
+                c.p++;
+                return true;
+            }
+        } else if (ch == ',' && depth == 0) {
+            return true;
+        }
+        c.p++;
+    }
+    return false;
+}
+
+inline int HexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+bool ParseHex4(const char* p, const char* end, uint32_t& value) {
+    if (end - p < 4) {
+        return false;
+    }
+    value = 0;
+    for (int i = 0; i < 4; i++) {
+        int v = HexValue(p[i]);
+        if (v < 0) {
+            return false;
+        }
+        value = (value << 4) | v;
+    }
+    return true;
+}
+
+} // namespace
+
+bool ServerMessageScanner::Unescape(std::string_view raw, std::string_view& out) {
+    char* dst = scratch_ + scratch_used_;
+    char* dst_end = scratch_ + kScratchSize;
+    char* begin = dst;
+    const char* p = raw.data();
+    const char* end = raw.data() + raw.size();
+
+    while (p < end) {
+        if (dst_end - dst < 4) {
+            return false;
+        }
+        if (*p != '\\') {
+            *dst++ = *p++;
+            continue;
+        }
+        if (++p >= end) {
+            return false;
+        }
+        char ch = *p++;
+        switch (ch) {
+            case '"': *dst++ = '"'; break;
+            case '\\': *dst++ = '\\'; break;
+            case '/': *dst++ = '/'; break;
+            case 'b': *dst++ = '\b'; break;
+            case 'f': *dst++ = '\f'; break;
+            case 'n': *dst++ = '\n'; break;
+            case 'r': *dst++ = '\r'; break;
+            case 't': *dst++ = '\t'; break;
+            case 'u': {
+                uint32_t code;
+                if (!ParseHex4(p, end, code)) {
+                    return false;
+                }
+                p += 4;
+                // Surrogate pair
+                if (code >= 0xD800 && code <= 0xDBFF) {
+                    uint32_t low;
+                    if (end - p < 6 || p[0] != '\\' || p[1] != 'u' || !ParseHex4(p + 2, end, low) ||
+                        low < 0xDC00 || low > 0xDFFF) {
+                        return false;
+                    }
+                    p += 6;
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                }
+                if (code < 0x80) {
+                    *dst++ = (char)code;
+                } else if (code < 0x800) {
+                    *dst++ = (char)(0xC0 | (code >> 6));
+                    *dst++ = (char)(0x80 | (code & 0x3F));
+                } else if (code < 0x10000) {
+                    *dst++ = (char)(0xE0 | (code >> 12));
+                    *dst++ = (char)(0x80 | ((code >> 6) & 0x3F));
+                    *dst++ = (char)(0x80 | (code & 0x3F));
+                } else {
+                    *dst++ = (char)(0xF0 | (code >> 18));
+                    *dst++ = (char)(0x80 | ((code >> 12) & 0x3F));
+                    *dst++ = (char)(0x80 | ((code >> 6) & 0x3F));
+                    *dst++ = (char)(0x80 | (code & 0x3F));
+                }
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+
+    out = std::string_view(begin, dst - begin);
+    scratch_used_ += dst - begin;
+    return true;
+}
+
+bool ServerMessageScanner::Scan(const char* data, size_t len, ServerMessage& message) {
+    message = ServerMessage();
+    scratch_used_ = 0;
+
+    Cursor c{data, data + len};
+    SkipWhitespace(c);
+    if (c.p >= c.end || *c.p != '{') {
+        return false;
+    }
+    c.p++;
+
+    std::string_view state;
+    std::string_view text;
+    std::string_view emotion;
+    bool text_escaped = false;
+    bool emotion_escaped = false;
+
+    while (true) {
+        SkipWhitespace(c);
+        if (c.p >= c.end) {
+            return false;
+        }
+        if (*c.p == '}') {
+            break;
+        }
+
+        std::string_view key;
+        bool key_escaped;
+        if (!ScanString(c, key, key_escaped)) {
+            return false;
+        }
+        SkipWhitespace(c);
+        if (c.p >= c.end || *c.p != ':') {
+            return false;
+        }
+        c.p++;
+        SkipWhitespace(c);
+        if (c.p >= c.end) {
+            return false;
+        }
+
+        if (*c.p == '"') {
+            std::string_view value;
+            bool escaped;
+            if (!ScanString(c, value, escaped)) {
+                return false;
+            }
+            if (key == "type") {
+                if (value == "tts") {
+                    message.type = kServerMessageTts;
+                } else if (value == "stt") {
+                    message.type = kServerMessageStt;
+                } else if (value == "llm") {
+                    message.type = kServerMessageLlm;
+                } else if (value == "pong") {
+                    message.type = kServerMessagePong;
+                } else {
+                    // Not a hot message, no need to look any further
+                    return false;
+                }
+            } else if (key == "state") {
+                state = value;
+            } else if (key == "text") {
+                text = value;
+                text_escaped = escaped;
+            } else if (key == "emotion") {
+                emotion = value;
+                emotion_escaped = escaped;
+            }
+        } else if (key == "timestamp" && *c.p >= '0' && *c.p <= '9') {
+            uint32_t value = 0;
+            while (c.p < c.end && *c.p >= '0' && *c.p <= '9') {
+                value = value * 10 + (*c.p - '0');
+                c.p++;
+            }
+            message.timestamp = value;
+        } else if (!SkipValue(c)) {
+            return false;
+        }
+
+        SkipWhitespace(c);
+        if (c.p < c.end && *c.p == ',') {
+            c.p++;
+        }
+    }
+
+    if (message.type == kServerMessageUnknown) {
+        return false;
+    }
+
+    if (message.type == kServerMessageTts) {
+        if (state == "start") {
+            message.tts_state = kTtsStateStart;
+        } else if (state == "stop") {
+            message.tts_state = kTtsStateStop;
+        } else if (state == "sentence_start") {
+            message.tts_state = kTtsStateSentenceStart;
+        }
+    }
+
+    if (text.data() != nullptr) {
+        if (text_escaped) {
+            if (!Unescape(text, message.text)) {
+                return false;
+            }
+        } else {
+            message.text = text;
+        }
+    }
+    if (emotion.data() != nullptr) {
+        if (emotion_escaped) {
+            if (!Unescape(emotion, message.emotion)) {
+                return false;
+            }
+        } else {
+            message.emotion = emotion;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,57 @@
+#ifndef SERVER_MESSAGE_H
+#define SERVER_MESSAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/*
+ * Hot server messages (tts / stt / llm / pong) arrive many times per conversation turn.
+ * They only carry a few flat string fields, so instead of building a cJSON tree
+ * we scan the top level object in place and hand out views into the frame buffer.
+ * Everything else (hello, goodbye, mcp, system, alert, custom) falls back to cJSON.
+ */
+
+enum ServerMessageType {
+    kServerMessageUnknown,
+    kServerMessageTts,
+    kServerMessageStt,
+    kServerMessageLlm,
+    kServerMessagePong,
+};
+
+enum TtsState {
+    kTtsStateNone,
+    kTtsStateStart,
+    kTtsStateStop,
+    kTtsStateSentenceStart,
+};
+
+struct ServerMessage {
+    ServerMessageType type = kServerMessageUnknown;
+    TtsState tts_state = kTtsStateNone;
+    uint32_t timestamp = 0;     // Echoed ping timestamp in milliseconds
+    // Views are only valid during the callback, copy them if they are needed later
+    std::string_view text;
+    std::string_view emotion;
+};
+
+class ServerMessageScanner {
+public:
+    /*
+     * Scan a JSON text frame without allocating.
+     * Returns true if the frame is a hot message and `message` is filled,
+     * false if the caller should parse the frame with cJSON instead.
+     */
+    bool Scan(const char* data, size_t len, ServerMessage& message);
+
+private:
+    // Only used when a string value contains escape sequences
+    static constexpr size_t kScratchSize = 1024;
+    char scratch_[kScratchSize];
+    size_t scratch_used_ = 0;
+
+    bool Unescape(std::string_view raw, std::string_view& out);
+};
+
+#endif // SERVER_MESSAGE_H
@@ -3,7 +3,10 @@
 #include "system_info.h"
 #include "application.h"
 #include "settings.h"
+#include "trace.h"
+#include "msgpack_codec.h"
 
+#include <algorithm>
 #include <cstring>
 #include <cJSON.h>
 #include <esp_log.h>
@@ -26,10 +29,14 @@ bool WebsocketProtocol::Start() {
 }
 
 bool WebsocketProtocol::SendAudio(std::unique_ptr<AudioStreamPacket> packet) {
+    std::lock_guard<std::mutex> lock(send_mutex_);
     if (websocket_ == nullptr || !websocket_->IsConnected()) {
+        RecordAudioSent(*packet, false);
         return false;
     }
 
+    bool success;
+    size_t sent_bytes;
     if (version_ == 2) {
         std::string serialized;
         serialized.resize(sizeof(BinaryProtocol2) + packet->payload.size());
@@ -41,7 +48,8 @@ bool WebsocketProtocol::SendAudio(std::unique_ptr<AudioStreamPacket> packet) {
         bp2->payload_size = htonl(packet->payload.size());
         memcpy(bp2->payload, packet->payload.data(), packet->payload.size());
 
-        return websocket_->Send(serialized.data(), serialized.size(), true);
+        sent_bytes = serialized.size();
+        success = websocket_->Send(serialized.data(), serialized.size(), true);
     } else if (version_ == 3) {
         std::string serialized;
         serialized.resize(sizeof(BinaryProtocol3) + packet->payload.size());
@@ -51,31 +59,138 @@ bool WebsocketProtocol::SendAudio(std::unique_ptr<AudioStreamPacket> packet) {
         bp3->payload_size = htons(packet->payload.size());
         memcpy(bp3->payload, packet->payload.data(), packet->payload.size());
 
-        return websocket_->Send(serialized.data(), serialized.size(), true);
+        sent_bytes = serialized.size();
+        success = websocket_->Send(serialized.data(), serialized.size(), true);
     } else {
-        return websocket_->Send(packet->payload.data(), packet->payload.size(), true);
+        sent_bytes = packet->payload.size();
+        success = websocket_->Send(packet->payload.data(), packet->payload.size(), true);
     }
+
+    if (success) {
+        RecordUplink(sent_bytes);
+    }
+    RecordAudioSent(*packet, success);
+    return success;
+}
+
+bool WebsocketProtocol::SendBinaryMessage(const std::string& encoded) {
+    std::string serialized;
+    if (version_ == 2) {
+        serialized.resize(sizeof(BinaryProtocol2) + encoded.size());
+        auto bp2 = (BinaryProtocol2*)serialized.data();
+        bp2->version = htons(version_);
+        bp2->type = htons(1);
+        bp2->reserved = 0;
+        bp2->timestamp = 0;
+        bp2->payload_size = htonl(encoded.size());
+        memcpy(bp2->payload, encoded.data(), encoded.size());
+    } else {
+        serialized.resize(sizeof(BinaryProtocol3) + encoded.size());
+        auto bp3 = (BinaryProtocol3*)serialized.data();
+        bp3->type = 1;
+        bp3->reserved = 0;
+        bp3->payload_size = htons(encoded.size());
+        memcpy(bp3->payload, encoded.data(), encoded.size());
+    }
+
+    if (!websocket_->Send(serialized.data(), serialized.size(), true)) {
+        ESP_LOGE(TAG, "Failed to send binary message, size: %u", (unsigned)serialized.size());
+        SetError(Lang::Strings::SERVER_ERROR);
+        return false;
+    }
+
+    RecordUplink(serialized.size());
+    return true;
 }
 
 bool WebsocketProtocol::SendText(const std::string& text) {
+    std::lock_guard<std::mutex> lock(send_mutex_);
     if (websocket_ == nullptr || !websocket_->IsConnected()) {
         return false;
     }
 
+    if (msgpack_enabled_) {
+        std::string encoded;
+        // Version 3 carries a 16-bit payload size, larger messages stay as text
+        if (JsonToMsgPack(text.data(), text.size(), encoded) && (version_ == 2 || encoded.size() <= UINT16_MAX)) {
+            return SendBinaryMessage(encoded);
+        }
+        ESP_LOGW(TAG, "Failed to encode message, send as text");
+    }
+
     if (!websocket_->Send(text)) {
         ESP_LOGE(TAG, "Failed to send text: %s", text.c_str());
         SetError(Lang::Strings::SERVER_ERROR);
         return false;
     }
 
+    RecordUplink(text.size());
     return true;
 }
 
+bool WebsocketProtocol::SendMcpMessageStream(const std::function<bool(const MessageWriter& write)>& payload) {
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    if (websocket_ == nullptr || !websocket_->IsConnected()) {
+        return false;
+    }
+
+    // Always a text message, even with msgpack, the frames are continuations of one JSON document.
+    // send_mutex_ keeps every other frame off the socket until the last fragment is out.
+    streaming_ = true;
+    std::string fragment;
+    fragment.reserve(kStreamFragmentSize);
+    size_t total = 0;
+    bool started = false;
+    bool send_failed = false;
+    auto send_fragment = [&](bool fin) {
+        if (!websocket_->Send(fragment.data(), fragment.size(), false, fin)) {
+            send_failed = true;
+            return false;
+        }
+        started = true;
+        total += fragment.size();
+        fragment.clear();
+        return true;
+    };
+    MessageWriter write = [&](const char* data, size_t len) {
+        while (len > 0) {
+            size_t n = std::min(len, kStreamFragmentSize - fragment.size());
+            fragment.append(data, n);
+            data += n;
+            len -= n;
+            if (fragment.size() == kStreamFragmentSize && !send_fragment(false)) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    std::string head = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"mcp\",\"payload\":";
+    bool produced = write(head.data(), head.size()) && payload(write) && write("}", 1);
+    if (!send_failed && (produced || started)) {
+        // A started message has to be closed even if the payload failed, the server drops the broken JSON
+        send_fragment(true);
+    }
+    streaming_ = false;
+    if (send_failed) {
+        ESP_LOGE(TAG, "Failed to send streamed message after %u bytes", (unsigned)total);
+        SetError(Lang::Strings::SERVER_ERROR);
+        return false;
+    }
+
+    RecordUplink(total);
+    if (!produced) {
+        ESP_LOGE(TAG, "Streamed message payload failed after %u bytes", (unsigned)total);
+    }
+    return produced;
+}
+
 bool WebsocketProtocol::IsAudioChannelOpened() const {
     return websocket_ != nullptr && websocket_->IsConnected() && !error_occurred_ && !IsTimeout();
 }
 
 void WebsocketProtocol::CloseAudioChannel() {
+    std::lock_guard<std::mutex> lock(send_mutex_);
     websocket_.reset();
 }
 
@@ -89,9 +204,14 @@ bool WebsocketProtocol::OpenAudioChannel() {
     }
 
     error_occurred_ = false;
+    msgpack_enabled_ = false;
+    ping_enabled_ = false;
 
     auto network = Board::GetInstance().GetNetwork();
-    websocket_ = network->CreateWebSocket(1);
+    {
+        std::lock_guard<std::mutex> lock(send_mutex_);
+        websocket_ = network->CreateWebSocket(1);
+    }
     if (websocket_ == nullptr) {
         ESP_LOGE(TAG, "Failed to create websocket");
         return false;
@@ -109,15 +229,31 @@ bool WebsocketProtocol::OpenAudioChannel() {
     websocket_->SetHeader("Client-Id", Board::GetInstance().GetUuid().c_str());
 
     websocket_->OnData([this](const char* data, size_t len, bool binary) {
+        TRACE_SCOPE("ws:data");
+        RecordDownlink(len);
         if (binary) {
             if (on_incoming_audio_ != nullptr) {
                 if (version_ == 2) {
+                    if (len < sizeof(BinaryProtocol2)) {
+                        ESP_LOGW(TAG, "Binary frame too short: %u bytes", (unsigned)len);
+                        return;
+                    }
                     BinaryProtocol2* bp2 = (BinaryProtocol2*)data;
                     bp2->version = ntohs(bp2->version);
                     bp2->type = ntohs(bp2->type);
                     bp2->timestamp = ntohl(bp2->timestamp);
                     bp2->payload_size = ntohl(bp2->payload_size);
+                    if (bp2->payload_size > len - sizeof(BinaryProtocol2)) {
+                        ESP_LOGW(TAG, "Binary frame payload size %lu exceeds frame length %u",
+                            (unsigned long)bp2->payload_size, (unsigned)len);
+                        return;
+                    }
                     auto payload = (uint8_t*)bp2->payload;
+                    if (bp2->type == 1) {
+                        HandleBinaryMessage(payload, bp2->payload_size);
+                        last_incoming_time_ = std::chrono::steady_clock::now();
+                        return;
+                    }
                     on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
                         .sample_rate = server_sample_rate_,
                         .frame_duration = server_frame_duration_,
@@ -125,10 +261,24 @@ bool WebsocketProtocol::OpenAudioChannel() {
                         .payload = std::vector<uint8_t>(payload, payload + bp2->payload_size)
                     }));
                 } else if (version_ == 3) {
+                    if (len < sizeof(BinaryProtocol3)) {
+                        ESP_LOGW(TAG, "Binary frame too short: %u bytes", (unsigned)len);
+                        return;
+                    }
                     BinaryProtocol3* bp3 = (BinaryProtocol3*)data;
                     bp3->type = bp3->type;
                     bp3->payload_size = ntohs(bp3->payload_size);
+                    if (bp3->payload_size > len - sizeof(BinaryProtocol3)) {
+                        ESP_LOGW(TAG, "Binary frame payload size %u exceeds frame length %u",
+                            (unsigned)bp3->payload_size, (unsigned)len);
+                        return;
+                    }
                     auto payload = (uint8_t*)bp3->payload;
+                    if (bp3->type == 1) {
+                        HandleBinaryMessage(payload, bp3->payload_size);
+                        last_incoming_time_ = std::chrono::steady_clock::now();
+                        return;
+                    }
                     on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
                         .sample_rate = server_sample_rate_,
                         .frame_duration = server_frame_duration_,
@@ -145,21 +295,7 @@ bool WebsocketProtocol::OpenAudioChannel() {
                 }
             }
         } else {
-            // Parse JSON data
-            auto root = cJSON_Parse(data);
-            auto type = cJSON_GetObjectItem(root, "type");
-            if (cJSON_IsString(type)) {
-                if (strcmp(type->valuestring, "hello") == 0) {
-                    ParseServerHello(root);
-                } else {
-                    if (on_incoming_json_ != nullptr) {
-                        on_incoming_json_(root);
-                    }
-                }
-            } else {
-                ESP_LOGE(TAG, "Missing message type, data: %s", data);
-            }
-            cJSON_Delete(root);
+            HandleTextMessage(data, len);
         }
         last_incoming_time_ = std::chrono::steady_clock::now();
     });
@@ -199,6 +335,37 @@ bool WebsocketProtocol::OpenAudioChannel() {
     return true;
 }
 
+void WebsocketProtocol::HandleTextMessage(const char* data, size_t len) {
+    if (DispatchServerMessage(data, len)) {
+        return;
+    }
+
+    // Parse JSON data
+    auto root = cJSON_ParseWithLength(data, len);
+    auto type = cJSON_GetObjectItem(root, "type");
+    if (cJSON_IsString(type)) {
+        if (strcmp(type->valuestring, "hello") == 0) {
+            ParseServerHello(root);
+        } else {
+            if (on_incoming_json_ != nullptr) {
+                on_incoming_json_(root);
+            }
+        }
+    } else {
+        ESP_LOGE(TAG, "Missing message type, data: %.*s", (int)len, data);
+    }
+    cJSON_Delete(root);
+}
+
+void WebsocketProtocol::HandleBinaryMessage(const uint8_t* data, size_t len) {
+    std::string json;
+    if (!MsgPackToJson(data, len, json)) {
+        ESP_LOGE(TAG, "Failed to decode binary message, size: %u", (unsigned)len);
+        return;
+    }
+    HandleTextMessage(json.data(), json.size());
+}
+
 std::string WebsocketProtocol::GetHelloMessage() {
     // keys: message type, version, audio_params (format, sample_rate, channels)
     cJSON* root = cJSON_CreateObject();
@@ -209,6 +376,11 @@ std::string WebsocketProtocol::GetHelloMessage() {
     cJSON_AddBoolToObject(features, "aec", true);
 #endif
     cJSON_AddBoolToObject(features, "mcp", true);
+    cJSON_AddBoolToObject(features, "ping", true);
+    // Binary control frames need the type field of protocol version 2 or 3
+    if (version_ >= 2) {
+        cJSON_AddBoolToObject(features, "msgpack", true);
+    }
     cJSON_AddItemToObject(root, "features", features);
     cJSON_AddStringToObject(root, "transport", "websocket");
     cJSON* audio_params = cJSON_CreateObject();
@@ -237,6 +409,17 @@ void WebsocketProtocol::ParseServerHello(const cJSON* root) {
         ESP_LOGI(TAG, "Session ID: %s", session_id_.c_str());
     }
 
+    auto features = cJSON_GetObjectItem(root, "features");
+    if (cJSON_IsObject(features)) {
+        ping_enabled_ = cJSON_IsTrue(cJSON_GetObjectItem(features, "ping"));
+    }
+    if (cJSON_IsObject(features) && version_ >= 2) {
+        msgpack_enabled_ = cJSON_IsTrue(cJSON_GetObjectItem(features, "msgpack"));
+        if (msgpack_enabled_) {
+            ESP_LOGI(TAG, "Control messages use MessagePack");
+        }
+    }
+
     auto audio_params = cJSON_GetObjectItem(root, "audio_params");
     if (cJSON_IsObject(audio_params)) {
         auto sample_rate = cJSON_GetObjectItem(audio_params, "sample_rate");
@@ -5,6 +5,7 @@
 #include "protocol.h"
 
 #include <web_socket.h>
+#include <mutex>
 #include <freertos/FreeRTOS.h>
 #include <freertos/event_groups.h>
 
@@ -20,14 +21,26 @@ public:
     bool OpenAudioChannel() override;
     void CloseAudioChannel() override;
     bool IsAudioChannelOpened() const override;
+    bool SendMcpMessageStream(const std::function<bool(const MessageWriter& write)>& payload) override;
 
 private:
+    // Size of one continuation frame when a message is streamed
+    static constexpr size_t kStreamFragmentSize = 4096;
+
     EventGroupHandle_t event_group_handle_;
+    // Streamed messages are sent from MCP worker tasks, the lock keeps other frames and the
+    // socket teardown away until their last fragment is out
+    std::mutex send_mutex_;
     std::unique_ptr<WebSocket> websocket_;
     int version_ = 1;
+    // Server accepted "msgpack" in hello, control messages go as binary type 1 frames
+    bool msgpack_enabled_ = false;
 
     void ParseServerHello(const cJSON* root);
+    void HandleTextMessage(const char* data, size_t len);
+    void HandleBinaryMessage(const uint8_t* data, size_t len);
     bool SendText(const std::string& text) override;
+    bool SendBinaryMessage(const std::string& encoded);
     std::string GetHelloMessage();
 };
 
@@ -0,0 +1,158 @@
+#include "trace.h"
+
+#if CONFIG_USE_EVENT_TRACE
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#define TAG "Trace"
+
+Trace::Trace() {
+}
+
+Trace::~Trace() {
+    if (events_ != nullptr) {
+        heap_caps_free(events_);
+    }
+}
+
+void Trace::Start() {
+    std::lock_guard<std::mutex> lock(control_mutex_);
+    // head_ is only reset with no writer in the ring
+    StopAndDrain();
+    if (events_ == nullptr) {
+        // The ring is only allocated the first time tracing is used, preferably in PSRAM
+        size_t size = CONFIG_EVENT_TRACE_BUFFER_SIZE * sizeof(TraceEvent);
+        events_ = (TraceEvent*)heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+        if (events_ == nullptr) {
+            events_ = (TraceEvent*)heap_caps_malloc(size, MALLOC_CAP_8BIT);
+        }
+        if (events_ == nullptr) {
+            ESP_LOGE(TAG, "Failed to allocate trace buffer (%u bytes)", (unsigned)size);
+            return;
+        }
+        capacity_ = CONFIG_EVENT_TRACE_BUFFER_SIZE;
+    }
+    head_ = 0;
+    start_time_us_ = esp_timer_get_time();
+    recording_ = true;
+    ESP_LOGI(TAG, "Trace recording started, capacity %lu events", (unsigned long)capacity_);
+}
+
+void Trace::Stop() {
+    std::lock_guard<std::mutex> lock(control_mutex_);
+    StopAndDrain();
+}
+
+void Trace::StopAndDrain() {
+    // Sequentially consistent with the increment in Record(): either the writer sees recording_
+    // cleared and backs out, or writers_ shows it here
+    recording_.store(false);
+    while (writers_.load() != 0) {
+        vTaskDelay(1);
+    }
+}
+
+uint8_t Trace::CurrentTaskId() {
+    static thread_local int task_id = -1;
+    if (task_id < 0) {
+        int id = task_count_.fetch_add(1);
+        if (id >= kMaxTasks - 1) {
+            // Out of slots, the last one is shared by every remaining task
+            id = kMaxTasks - 1;
+            strcpy(task_names_[id], "other");
+        } else {
+            strncpy(task_names_[id], pcTaskGetName(nullptr), sizeof(task_names_[id]) - 1);
+        }
+        task_id = id;
+    }
+    return (uint8_t)task_id;
+}
+
+void Trace::Record(char phase, const char* name, uintptr_t arg) {
+    writers_.fetch_add(1);
+    // The macros checked IsRecording() without being counted, check again now that we are
+    if (!recording_.load()) {
+        writers_.fetch_sub(1);
+        return;
+    }
+    uint32_t index = head_.fetch_add(1, std::memory_order_relaxed);
+    TraceEvent& event = events_[index % capacity_];
+    event.timestamp_us = esp_timer_get_time();
+    event.name = name;
+    event.arg = arg;
+    event.task_id = CurrentTaskId();
+    event.phase = phase;
+    writers_.fetch_sub(1, std::memory_order_release);
+}
+
+bool Trace::ExportJson(const Writer& write) {
+    std::lock_guard<std::mutex> lock(control_mutex_);
+    StopAndDrain();
+
+    uint32_t head = head_.load();
+    uint32_t count = head < capacity_ ? head : capacity_;
+    int task_count = task_count_.load();
+    if (task_count > kMaxTasks) {
+        task_count = kMaxTasks;
+    }
+
+    // Events are formatted into buffer and collected in chunk, which is written whenever it is full
+    char chunk[1024];
+    size_t used = 0;
+    auto append = [&](const char* data, size_t len) {
+        if (used + len > sizeof(chunk)) {
+            if (!write(chunk, used)) {
+                return false;
+            }
+            used = 0;
+        }
+        memcpy(chunk + used, data, len);
+        used += len;
+        return true;
+    };
+
+    static const char kHead[] = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    if (!append(kHead, sizeof(kHead) - 1)) {
+        return false;
+    }
+
+    char buffer[160];
+    bool first = true;
+    for (int i = 0; i < task_count; i++) {
+        snprintf(buffer, sizeof(buffer), "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+            first ? "" : ",", i, task_names_[i]);
+        if (!append(buffer, strlen(buffer))) {
+            return false;
+        }
+        first = false;
+    }
+
+    for (uint32_t i = head - count; i != head; i++) {
+        const TraceEvent& event = events_[i % capacity_];
+        int len = snprintf(buffer, sizeof(buffer), "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%lld,\"pid\":1,\"tid\":%u",
+            first ? "" : ",", event.name, event.phase, (long long)(event.timestamp_us - start_time_us_),
+            (unsigned)event.task_id);
+        if (event.phase == 'i') {
+            len += snprintf(buffer + len, sizeof(buffer) - len, ",\"s\":\"t\"");
+        }
+        if (event.arg != 0) {
+            // Resolve with addr2line against the firmware ELF
+            len += snprintf(buffer + len, sizeof(buffer) - len, ",\"args\":{\"addr\":\"0x%08lx\"}", (unsigned long)event.arg);
+        }
+        snprintf(buffer + len, sizeof(buffer) - len, "}");
+        if (!append(buffer, strlen(buffer))) {
+            return false;
+        }
+        first = false;
+    }
+    return append("]}", 2) && (used == 0 || write(chunk, used));
+}
+
+#endif // CONFIG_USE_EVENT_TRACE
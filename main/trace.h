@@ -0,0 +1,120 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+ * Lightweight event-loop tracer.
+ *
+ * A fixed ring of begin / end / instant events (name, task, timestamp) that can be
+ * dumped as Chrome trace_event JSON and opened in chrome://tracing or Perfetto.
+ * Event names must be string literals, only the pointer is stored.
+ *
+ * With CONFIG_USE_EVENT_TRACE disabled every macro compiles to nothing. When it is
+ * enabled but not recording, each macro costs one relaxed atomic load.
+ */
+
+#include <sdkconfig.h>
+#include <cstddef>
+#include <cstdint>
+
+#if CONFIG_USE_EVENT_TRACE
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+
+struct TraceEvent {
+    int64_t timestamp_us;
+    const char* name;
+    uintptr_t arg;      // Optional, e.g. the address of a scheduled callback
+    uint8_t task_id;
+    char phase;         // 'B', 'E' or 'i'
+};
+
+class Trace {
+public:
+    static Trace& GetInstance() {
+        static Trace instance;
+        return instance;
+    }
+
+    // Consumes one piece of the export, returns false to abort
+    using Writer = std::function<bool(const char* data, size_t len)>;
+
+    Trace(const Trace&) = delete;
+    Trace& operator=(const Trace&) = delete;
+
+    // Clears the ring and starts recording, restarts if already recording
+    void Start();
+    void Stop();
+    bool IsRecording() const { return recording_.load(std::memory_order_relaxed); }
+
+    void Record(char phase, const char* name, uintptr_t arg = 0);
+
+    // Writes the ring as Chrome trace_event JSON in pieces of up to 1 KB. Stops recording first,
+    // call Start() again to resume
+    bool ExportJson(const Writer& write);
+
+private:
+    Trace();
+    ~Trace();
+
+    static constexpr int kMaxTasks = 32;
+
+    std::atomic<bool> recording_{false};
+    // Record() calls between claiming a slot and finishing it. With recording_ cleared, zero means
+    // no writer can touch the ring any more
+    std::atomic<int> writers_{0};
+    std::atomic<uint32_t> head_{0};
+    std::mutex control_mutex_;     // Start, Stop and ExportJson
+    TraceEvent* events_ = nullptr;
+    uint32_t capacity_ = 0;
+    int64_t start_time_us_ = 0;
+
+    // Task names are captured the first time a task records an event
+    char task_names_[kMaxTasks][16] = {};
+    std::atomic<int> task_count_{0};
+
+    uint8_t CurrentTaskId();
+    // Clears recording_ and waits until every writer has left the ring
+    void StopAndDrain();
+};
+
+class TraceScope {
+public:
+    explicit TraceScope(const char* name, uintptr_t arg = 0) : name_(nullptr) {
+        auto& trace = Trace::GetInstance();
+        if (trace.IsRecording()) {
+            name_ = name;
+            trace.Record('B', name, arg);
+        }
+    }
+    ~TraceScope() {
+        if (name_ != nullptr) {
+            Trace::GetInstance().Record('E', name_);
+        }
+    }
+
+private:
+    const char* name_;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define TRACE_SCOPE_ARG(name, arg) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name, (uintptr_t)(arg))
+#define TRACE_BEGIN(name) do { if (Trace::GetInstance().IsRecording()) Trace::GetInstance().Record('B', name); } while (0)
+#define TRACE_END(name) do { if (Trace::GetInstance().IsRecording()) Trace::GetInstance().Record('E', name); } while (0)
+#define TRACE_INSTANT(name) do { if (Trace::GetInstance().IsRecording()) Trace::GetInstance().Record('i', name); } while (0)
+
+#else
+
+#define TRACE_SCOPE(name) do {} while (0)
+#define TRACE_SCOPE_ARG(name, arg) do {} while (0)
+#define TRACE_BEGIN(name) do {} while (0)
+#define TRACE_END(name) do {} while (0)
+#define TRACE_INSTANT(name) do {} while (0)
+
+#endif // CONFIG_USE_EVENT_TRACE
+
+#endif // TRACE_H
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * 车辆UDP遥控协议（版本1）
+ *
+ * 每个数据报是一个16字节的包头加上按类型确定的包体，所有字段为小端：
+ *
+ *   0  'V' 'T'        魔数
+ *   2  u8  version    kVersion
+ *   3  u8  type       PacketType
+ *   4  u32 session    协商时由 GET /api/vehicle/teleop 返回，不匹配的包被丢弃
+ *   8  u32 sequence   发送方递增，服务端丢弃不比上一条新的指令（停车除外）
+ *  12  u32 time_ms    发送方时钟，Pong原样返回用于测量往返时间
+ *
+ * 客户端 -> 车辆：
+ *   kDrive  i16 x, i16 y (千分比 -1000..1000), u8 flags (kDriveStop: 立即制动)
+ *   kServo  u8 count (1..4), 然后count组 u8 channel, u8 angle (0..180)
+ *   kPing   无包体，同时订阅遥测
+ * 车辆 -> 客户端：
+ *   kTelemetry  见 TeleopTelemetry，按固定周期发送给最后一个发来有效包的地址
+ *   kPong       u32 设备时间 (ms)，包头的time_ms为Ping中的值
+ */
+namespace teleop {
+
+constexpr uint8_t kMagic0 = 'V';
+constexpr uint8_t kMagic1 = 'T';
+constexpr uint8_t kVersion = 1;
+constexpr size_t kHeaderSize = 16;
+constexpr size_t kMaxPacketSize = 64;
+constexpr int kMaxServos = 4;
+constexpr uint8_t kDriveStop = 0x01;
+// 遥测中距离未知时的取值
+constexpr uint16_t kDistanceUnknown = 0xFFFF;
+
+enum class PacketType : uint8_t {
+    kDrive = 0x01,
+    kServo = 0x02,
+    kPing = 0x03,
+    kTelemetry = 0x81,
+    kPong = 0x83,
+};
+
+struct Header {
+    PacketType type = PacketType::kPing;
+    uint32_t session = 0;
+    uint32_t sequence = 0;
+    uint32_t time_ms = 0;
+};
+
+struct DriveCommand {
+    float x = 0.0f;     // -1..1
+    float y = 0.0f;     // -1..1
+    bool stop = false;
+};
+
+struct ServoCommand {
+    int count = 0;
+    uint8_t channel[kMaxServos] = {};
+    uint8_t angle[kMaxServos] = {};
+};
+
+struct TeleopTelemetry {
+    uint32_t ack_sequence = 0;                      // 最后一条被接受的指令
+    uint16_t front_distance_mm = kDistanceUnknown;
+    uint16_t rear_distance_mm = kDistanceUnknown;
+    uint8_t forward_scale = 100;                    // 避障限速，百分比，0为禁止
+    uint8_t backward_scale = 100;
+    int16_t speed = 0;                              // 当前电机速度
+    uint8_t steering_angle = 90;
+    uint8_t throttle_position = 90;
+    uint16_t latency_100us = 0;                     // 最近一条指令到电机输出的延迟，0.1 ms
+    uint16_t deadman_stops = 0;
+};
+constexpr size_t kTelemetrySize = 20;
+
+inline void Put16(uint8_t* p, uint16_t v) {
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+inline void Put32(uint8_t* p, uint32_t v) {
+    Put16(p, v & 0xFFFF);
+    Put16(p + 2, v >> 16);
+}
+
+inline uint16_t Get16(const uint8_t* p) {
+    return p[0] | (p[1] << 8);
+}
+
+inline uint32_t Get32(const uint8_t* p) {
+    return Get16(p) | (static_cast<uint32_t>(Get16(p + 2)) << 16);
+}
+
+// 序号回绕后仍按发送顺序比较
+inline bool IsNewer(uint32_t sequence, uint32_t last) {
+    return static_cast<int32_t>(sequence - last) > 0;
+}
+
+/**
+ * @brief 解析包头，魔数或版本不对、长度不足时返回false
+ */
+inline bool ParseHeader(const uint8_t* data, size_t length, Header& header) {
+    if (length < kHeaderSize || data[0] != kMagic0 || data[1] != kMagic1 || data[2] != kVersion) {
+        return false;
+    }
+    header.type = static_cast<PacketType>(data[3]);
+    header.session = Get32(data + 4);
+    header.sequence = Get32(data + 8);
+    header.time_ms = Get32(data + 12);
+    return true;
+}
+
+inline size_t WriteHeader(uint8_t* out, const Header& header) {
+    out[0] = kMagic0;
+    out[1] = kMagic1;
+    out[2] = kVersion;
+    out[3] = static_cast<uint8_t>(header.type);
+    Put32(out + 4, header.session);
+    Put32(out + 8, header.sequence);
+    Put32(out + 12, header.time_ms);
+    return kHeaderSize;
+}
+
+inline bool ParseDrive(const uint8_t* body, size_t length, DriveCommand& command) {
+    if (length < 5) {
+        return false;
+    }
+    auto axis = [](uint16_t raw) {
+        int value = static_cast<int16_t>(raw);
+        value = value < -1000 ? -1000 : (value > 1000 ? 1000 : value);
+        return value / 1000.0f;
+    };
+    command.x = axis(Get16(body));
+    command.y = axis(Get16(body + 2));
+    command.stop = (body[4] & kDriveStop) != 0;
+    return true;
+}
+
+inline bool ParseServo(const uint8_t* body, size_t length, ServoCommand& command) {
+    if (length < 1 || body[0] < 1 || body[0] > kMaxServos || length < 1 + body[0] * 2u) {
+        return false;
+    }
+    command.count = body[0];
+    for (int i = 0; i < command.count; i++) {
+        command.channel[i] = body[1 + i * 2];
+        command.angle[i] = body[2 + i * 2] > 180 ? 180 : body[2 + i * 2];
+    }
+    return true;
+}
+
+/**
+ * @brief 写入完整的遥测包，out至少kHeaderSize + kTelemetrySize字节
+ */
+inline size_t WriteTelemetry(uint8_t* out, const Header& header, const TeleopTelemetry& t) {
+    uint8_t* p = out + WriteHeader(out, header);
+    Put32(p, t.ack_sequence);
+    Put16(p + 4, t.front_distance_mm);
+    Put16(p + 6, t.rear_distance_mm);
+    p[8] = t.forward_scale;
+    p[9] = t.backward_scale;
+    Put16(p + 10, static_cast<uint16_t>(t.speed));
+    p[12] = t.steering_angle;
+    p[13] = t.throttle_position;
+    Put16(p + 14, t.latency_100us);
+    Put16(p + 16, t.deadman_stops);
+    Put16(p + 18, 0);   // 保留
+    return kHeaderSize + kTelemetrySize;
+}
+
+inline size_t WritePong(uint8_t* out, const Header& header, uint32_t device_time_ms) {
+    size_t length = WriteHeader(out, header);
+    Put32(out + length, device_time_ms);
+    return length + 4;
+}
+
+} // namespace teleop
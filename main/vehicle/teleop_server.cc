@@ -0,0 +1,274 @@
+#include "teleop_server.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <unistd.h>
+#include <cJSON.h>
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+
+#define TAG "TeleopServer"
+
+// 客户端停止发包这么久后不再发送遥测
+static constexpr int64_t kPeerTimeoutUs = 2000000;
+// DSCP EF，Wi-Fi上映射到WMM语音队列
+static constexpr int kLowLatencyTos = 0xB8;
+
+TeleopServer::TeleopServer(Handlers handlers) : handlers_(std::move(handlers)) {
+    stopped_ = xSemaphoreCreateBinary();
+}
+
+TeleopServer::~TeleopServer() {
+    Stop();
+    vSemaphoreDelete(stopped_);
+}
+
+bool TeleopServer::Start(int port, int telemetry_ms) {
+    if (task_ != nullptr) {
+        return true;
+    }
+
+    socket_ = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (socket_ < 0) {
+        ESP_LOGE(TAG, "Failed to create UDP socket: %d", errno);
+        return false;
+    }
+    int tos = kLowLatencyTos;
+    setsockopt(socket_, IPPROTO_IP, IP_TOS, &tos, sizeof(tos));
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if (bind(socket_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        ESP_LOGE(TAG, "Failed to bind UDP port %d: %d", port, errno);
+        close(socket_);
+        socket_ = -1;
+        return false;
+    }
+
+    port_ = port;
+    telemetry_ms_ = std::max(telemetry_ms, 10);
+    session_ = esp_random();
+    {
+        std::lock_guard<std::mutex> lock(peer_mutex_);
+        has_peer_ = false;
+        has_sequence_ = false;
+    }
+    stop_requested_ = false;
+
+    // 高于HTTP服务器任务，遥控包不用排在网页请求后面
+    TaskHandle_t task = nullptr;
+    if (xTaskCreate([](void* arg) {
+        static_cast<TeleopServer*>(arg)->Run();
+    }, "teleop_udp", 4096, this, 6, &task) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create teleop task");
+        close(socket_);
+        socket_ = -1;
+        return false;
+    }
+    task_ = task;
+    ESP_LOGI(TAG, "UDP teleop on port %d, telemetry every %d ms", port_, telemetry_ms_);
+    return true;
+}
+
+void TeleopServer::Stop() {
+    if (task_ == nullptr) {
+        return;
+    }
+    stop_requested_ = true;
+    // 任务最多一个遥测周期后检查停止标志；必须等到它退出，之后本对象才能被释放
+    xSemaphoreTake(stopped_, portMAX_DELAY);
+}
+
+void TeleopServer::Run() {
+    uint8_t buffer[teleop::kMaxPacketSize];
+    int64_t next_telemetry_us = esp_timer_get_time();
+
+    while (!stop_requested_) {
+        int64_t wait_us = std::max<int64_t>(next_telemetry_us - esp_timer_get_time(), 0);
+        fd_set read_fds;
+        FD_ZERO(&read_fds);
+        FD_SET(socket_, &read_fds);
+        timeval timeout = {
+            .tv_sec = static_cast<time_t>(wait_us / 1000000),
+            .tv_usec = static_cast<suseconds_t>(wait_us % 1000000),
+        };
+        int ready = select(socket_ + 1, &read_fds, nullptr, nullptr, &timeout);
+        if (ready > 0) {
+            sockaddr_in from = {};
+            socklen_t from_length = sizeof(from);
+            int length = recvfrom(socket_, buffer, sizeof(buffer), 0, reinterpret_cast<sockaddr*>(&from), &from_length);
+            if (length > 0) {
+                HandlePacket(buffer, length, from);
+            }
+        } else if (ready < 0 && errno != EINTR) {
+            ESP_LOGE(TAG, "select failed: %d", errno);
+            vTaskDelay(pdMS_TO_TICKS(100));
+        }
+
+        int64_t now = esp_timer_get_time();
+        if (now >= next_telemetry_us) {
+            SendTelemetry();
+            next_telemetry_us = now + telemetry_ms_ * 1000LL;
+        }
+    }
+
+    close(socket_);
+    socket_ = -1;
+    ESP_LOGI(TAG, "UDP teleop stopped");
+    task_ = nullptr;
+    // 给出信号后Stop()可能立即返回并释放本对象，之后不能再访问成员
+    xSemaphoreGive(stopped_);
+    vTaskDelete(nullptr);
+}
+
+bool TeleopServer::AcceptSequence(const teleop::Header& header) {
+    std::lock_guard<std::mutex> lock(peer_mutex_);
+    if (has_sequence_ && !teleop::IsNewer(header.sequence, last_sequence_)) {
+        return false;
+    }
+    last_sequence_ = header.sequence;
+    has_sequence_ = true;
+    return true;
+}
+
+void TeleopServer::HandlePacket(const uint8_t* data, size_t length, const sockaddr_in& from) {
+    teleop::Header header;
+    if (!teleop::ParseHeader(data, length, header) || header.session != session_) {
+        invalid_++;
+        return;
+    }
+    received_++;
+
+    {
+        std::lock_guard<std::mutex> lock(peer_mutex_);
+        bool same_peer = has_peer_ && peer_.sin_addr.s_addr == from.sin_addr.s_addr && peer_.sin_port == from.sin_port;
+        if (!same_peer) {
+            // 最后连上的客户端接管，序号从它的第一条包重新开始
+            peer_ = from;
+            has_peer_ = true;
+            has_sequence_ = false;
+            char address[16];
+            inet_ntoa_r(from.sin_addr, address, sizeof(address));
+            ESP_LOGI(TAG, "Teleop client %s:%d", address, ntohs(from.sin_port));
+        }
+        last_rx_us_ = esp_timer_get_time();
+    }
+
+    const uint8_t* body = data + teleop::kHeaderSize;
+    size_t body_length = length - teleop::kHeaderSize;
+    switch (header.type) {
+        case teleop::PacketType::kDrive: {
+            teleop::DriveCommand command;
+            if (!teleop::ParseDrive(body, body_length, command)) {
+                invalid_++;
+                return;
+            }
+            bool fresh = AcceptSequence(header);
+            // 停车指令即使乱序到达也执行
+            if (command.stop) {
+                if (handlers_.stop) {
+                    handlers_.stop();
+                }
+                return;
+            }
+            if (!fresh) {
+                stale_++;
+                return;
+            }
+            if (handlers_.drive) {
+                handlers_.drive(command.x, command.y);
+            }
+            break;
+        }
+        case teleop::PacketType::kServo: {
+            teleop::ServoCommand command;
+            if (!teleop::ParseServo(body, body_length, command)) {
+                invalid_++;
+                return;
+            }
+            if (!AcceptSequence(header)) {
+                stale_++;
+                return;
+            }
+            if (handlers_.servo) {
+                for (int i = 0; i < command.count; i++) {
+                    handlers_.servo(command.channel[i], command.angle[i]);
+                }
+            }
+            break;
+        }
+        case teleop::PacketType::kPing: {
+            uint8_t reply[teleop::kHeaderSize + 4];
+            teleop::Header pong = header;
+            pong.type = teleop::PacketType::kPong;
+            size_t reply_length = teleop::WritePong(reply, pong, static_cast<uint32_t>(esp_timer_get_time() / 1000));
+            sendto(socket_, reply, reply_length, 0, reinterpret_cast<const sockaddr*>(&from), sizeof(from));
+            break;
+        }
+        default:
+            invalid_++;
+            break;
+    }
+}
+
+void TeleopServer::SendTelemetry() {
+    sockaddr_in peer;
+    teleop::TeleopTelemetry telemetry;
+    {
+        std::lock_guard<std::mutex> lock(peer_mutex_);
+        if (!has_peer_ || esp_timer_get_time() - last_rx_us_ > kPeerTimeoutUs) {
+            return;
+        }
+        peer = peer_;
+        telemetry.ack_sequence = last_sequence_;
+    }
+    if (handlers_.telemetry) {
+        handlers_.telemetry(telemetry);
+    }
+
+    teleop::Header header;
+    header.type = teleop::PacketType::kTelemetry;
+    header.session = session_;
+    header.sequence = ++telemetry_sequence_;
+    header.time_ms = static_cast<uint32_t>(esp_timer_get_time() / 1000);
+    uint8_t packet[teleop::kHeaderSize + teleop::kTelemetrySize];
+    size_t length = teleop::WriteTelemetry(packet, header, telemetry);
+    if (sendto(socket_, packet, length, 0, reinterpret_cast<const sockaddr*>(&peer), sizeof(peer)) == static_cast<int>(length)) {
+        telemetry_sent_++;
+    }
+}
+
+std::string TeleopServer::GetNegotiationJson() const {
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddBoolToObject(root, "enabled", task_ != nullptr);
+    cJSON_AddStringToObject(root, "transport", "udp");
+    cJSON_AddNumberToObject(root, "port", port_);
+    cJSON_AddNumberToObject(root, "session", session_);
+    cJSON_AddNumberToObject(root, "version", teleop::kVersion);
+    cJSON_AddNumberToObject(root, "telemetry_ms", telemetry_ms_);
+    {
+        std::lock_guard<std::mutex> lock(peer_mutex_);
+        if (has_peer_ && esp_timer_get_time() - last_rx_us_ <= kPeerTimeoutUs) {
+            char address[16];
+            inet_ntoa_r(peer_.sin_addr, address, sizeof(address));
+            cJSON_AddStringToObject(root, "client", (std::string(address) + ":" + std::to_string(ntohs(peer_.sin_port))).c_str());
+        } else {
+            cJSON_AddNullToObject(root, "client");
+        }
+    }
+    cJSON* stats = cJSON_CreateObject();
+    cJSON_AddNumberToObject(stats, "received", received_);
+    cJSON_AddNumberToObject(stats, "stale", stale_);
+    cJSON_AddNumberToObject(stats, "invalid", invalid_);
+    cJSON_AddNumberToObject(stats, "telemetry", telemetry_sent_);
+    cJSON_AddItemToObject(root, "stats", stats);
+
+    char* json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
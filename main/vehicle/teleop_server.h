@@ -0,0 +1,80 @@
+#pragma once
+
+#include "teleop_protocol.h"
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <lwip/sockets.h>
+
+/**
+ * UDP遥控通道：绕过HTTP服务器和TCP，直接在独立任务里收发 teleop_protocol.h 定义的二进制包
+ *
+ * 只服务一个客户端：最后一个发来有效包的地址成为遥测目标，换地址时重新开始序号比较。
+ * 过期（序号不更新）的行驶和舵机指令被丢弃，停车指令总是执行。行驶指令交给Vehicle的运动循环，
+ * 所以死区定时器同样生效，客户端需要持续发送当前摇杆位置。
+ */
+class TeleopServer {
+public:
+    struct Handlers {
+        std::function<void(float x, float y)> drive;         // 摇杆向量，-1..1
+        std::function<void()> stop;                          // 立即制动
+        std::function<void(int channel, int angle)> servo;
+        std::function<void(teleop::TeleopTelemetry& telemetry)> telemetry;  // 填写除ack_sequence外的字段
+    };
+
+    explicit TeleopServer(Handlers handlers);
+    ~TeleopServer();
+
+    TeleopServer(const TeleopServer&) = delete;
+    TeleopServer& operator=(const TeleopServer&) = delete;
+
+    /**
+     * @brief 绑定UDP端口并启动收发任务，生成新的会话号
+     * @param telemetry_ms 遥测周期
+     */
+    bool Start(int port, int telemetry_ms);
+
+    /**
+     * @brief 停止收发任务并等待它退出，最多阻塞一个遥测周期；不能在处理回调里调用
+     */
+    void Stop();
+    bool IsRunning() const { return task_ != nullptr; }
+
+    /**
+     * @brief 网页协商用的JSON：端口、会话号、协议版本和收包统计
+     */
+    std::string GetNegotiationJson() const;
+
+private:
+    Handlers handlers_;
+    int port_ = 0;
+    int telemetry_ms_ = 50;
+    uint32_t session_ = 0;
+    int socket_ = -1;
+    std::atomic<TaskHandle_t> task_{nullptr};    // 任务退出时自己清空
+    std::atomic<bool> stop_requested_{false};
+    SemaphoreHandle_t stopped_ = nullptr;       // 任务退出前给出，Stop()据此等待
+
+    mutable std::mutex peer_mutex_;
+    sockaddr_in peer_ = {};
+    bool has_peer_ = false;
+    int64_t last_rx_us_ = 0;
+    uint32_t last_sequence_ = 0;
+    bool has_sequence_ = false;
+    uint32_t telemetry_sequence_ = 0;
+
+    std::atomic<uint32_t> received_{0};
+    std::atomic<uint32_t> stale_{0};
+    std::atomic<uint32_t> invalid_{0};
+    std::atomic<uint32_t> telemetry_sent_{0};
+
+    void Run();
+    void HandlePacket(const uint8_t* data, size_t length, const sockaddr_in& from);
+    bool AcceptSequence(const teleop::Header& header);
+    void SendTelemetry();
+};
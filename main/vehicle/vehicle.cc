@@ -4,7 +4,10 @@
 #include "board.h"
 #include "esp_log.h"
 #include "settings.h"
+#include "hardware/obstacle_supervisor.h"
 
+#include <algorithm>
+#include <cmath>
 #include <vector>
 #include <cJSON.h>
 #include <driver/gpio.h>
@@ -187,11 +190,32 @@ bool Vehicle::Start() {
     InitGPIO();
     InitServos();
     
+    // 摇杆指令经过运动循环输出，连接断开后由死区定时器停车
+    if (!motion_controller_) {
+        motion_controller_ = std::make_unique<MotionController>("vehicle_motion", [this](float x, float y) {
+            ApplyMotion(x, y);
+        });
+        motion_controller_->Start();
+    }
+    
+    StartTeleop();
+    
     // 注册Web处理器
     if (webserver_) {
         InitHandlers();
     }
     
+    // 前进或后退中遇到障碍物时由避障监控任务停车
+    if (!obstacle_listener_added_) {
+        obstacle_listener_added_ = true;
+        ObstacleSupervisor::GetInstance().AddListener([this](float forward_scale, float backward_scale) {
+            int motion = motion_;
+            if ((motion == 1 && forward_scale == 0.0f) || (motion == -1 && backward_scale == 0.0f)) {
+                Stop(true);
+            }
+        });
+    }
+    
     running_ = true;
     return true;
 }
@@ -203,6 +227,13 @@ void Vehicle::Stop() {
     
     ESP_LOGI(TAG, "Stopping vehicle component");
     
+    if (teleop_) {
+        teleop_->Stop();
+    }
+    if (motion_controller_) {
+        motion_controller_->Cancel();
+    }
+    
     // 停止所有运动
     Stop(true);
     
@@ -251,12 +282,94 @@ void Vehicle::SetControlParams(float distance, int dirX, int dirY) {
     SetSpeed(DEFAULT_SPEED * distance_percent_);
 }
 
+// 运动循环的输出：x/y为摇杆方向乘以拖动距离，(0,0)停车
+void Vehicle::ApplyMotion(float x, float y) {
+    SetControlParams(std::hypot(x, y), (int)std::lround(x * 100.0f), (int)std::lround(y * 100.0f));
+}
+
+// 舵机通道：0转向，1油门，2云台水平，3云台垂直
+void Vehicle::ControlServoChannel(int channel, int angle) {
+    switch (channel) {
+        case 0:
+            SetSteeringAngle(angle);
+            break;
+        case 1:
+            SetThrottlePosition(angle);
+            break;
+        case 2:
+            if (camera_h_servo_pin_ >= 0) {
+                ControlServoWithLU9685(2, angle);
+            }
+            break;
+        case 3:
+            if (camera_v_servo_pin_ >= 0) {
+                ControlServoWithLU9685(3, angle);
+            }
+            break;
+        default:
+            ESP_LOGW(TAG, "Unknown servo channel %d", channel);
+            break;
+    }
+}
+
+void Vehicle::FillTelemetry(teleop::TeleopTelemetry& telemetry) {
+    auto& supervisor = ObstacleSupervisor::GetInstance();
+    auto to_mm = [](float cm) -> uint16_t {
+        if (!std::isfinite(cm) || cm < 0.0f) {
+            return teleop::kDistanceUnknown;
+        }
+        return static_cast<uint16_t>(std::min(cm * 10.0f, 65534.0f));
+    };
+    telemetry.front_distance_mm = to_mm(supervisor.GetDistance(MotionDirection::kForward));
+    telemetry.rear_distance_mm = to_mm(supervisor.GetDistance(MotionDirection::kBackward));
+    telemetry.forward_scale = static_cast<uint8_t>(std::lround(supervisor.GetScale(MotionDirection::kForward) * 100.0f));
+    telemetry.backward_scale = static_cast<uint8_t>(std::lround(supervisor.GetScale(MotionDirection::kBackward) * 100.0f));
+    telemetry.speed = static_cast<int16_t>(motor_speed_.load());
+    telemetry.steering_angle = static_cast<uint8_t>(steering_angle_.load());
+    telemetry.throttle_position = static_cast<uint8_t>(throttle_position_.load());
+    if (motion_controller_) {
+        MotionStats stats = motion_controller_->GetStats();
+        telemetry.latency_100us = static_cast<uint16_t>(std::min<int64_t>(stats.last_latency_us / 100, 0xFFFF));
+        telemetry.deadman_stops = static_cast<uint16_t>(std::min<uint32_t>(stats.deadman_stops, 0xFFFF));
+    }
+}
+
+// UDP遥控通道和WebSocket共用运动循环，死区定时器和避障限制同样生效
+void Vehicle::StartTeleop() {
+#ifdef CONFIG_VEHICLE_TELEOP_UDP
+    if (!teleop_) {
+        TeleopServer::Handlers handlers;
+        handlers.drive = [this](float x, float y) {
+            motion_controller_->Post(x, y);
+        };
+        handlers.stop = [this]() {
+            motion_controller_->Cancel();
+            Stop(true);
+        };
+        handlers.servo = [this](int channel, int angle) {
+            ControlServoChannel(channel, angle);
+        };
+        handlers.telemetry = [this](teleop::TeleopTelemetry& telemetry) {
+            FillTelemetry(telemetry);
+        };
+        teleop_ = std::make_unique<TeleopServer>(std::move(handlers));
+    }
+    teleop_->Start(CONFIG_VEHICLE_TELEOP_UDP_PORT, CONFIG_VEHICLE_TELEOP_TELEMETRY_MS);
+#endif
+}
+
 // 电机控制方法
 void Vehicle::Forward(int speed) {
     if (vehicle_type_ == VEHICLE_TYPE_MOTOR || vehicle_type_ == VEHICLE_TYPE_MOTOR_CAMERA) {
+        // 使能引脚只有开关量，避障监控只能阻止，不能按比例限速
+        if (ObstacleSupervisor::GetInstance().LimitDuty(speed, "Vehicle") == 0) {
+            Stop(true);
+            return;
+        }
         // 电机控制
         ControlMotor(1, 0, 1, 0); // 双电机正转
         motor_speed_ = speed;
+        motion_ = 1;
     } else {
         // 舵机控制
         if (throttle_servo_pin_ >= 0) {
@@ -267,9 +380,14 @@ void Vehicle::Forward(int speed) {
 
 void Vehicle::Backward(int speed) {
     if (vehicle_type_ == VEHICLE_TYPE_MOTOR || vehicle_type_ == VEHICLE_TYPE_MOTOR_CAMERA) {
+        if (ObstacleSupervisor::GetInstance().LimitDuty(-speed, "Vehicle") == 0) {
+            Stop(true);
+            return;
+        }
         // 电机控制
         ControlMotor(0, 1, 0, 1); // 双电机反转
         motor_speed_ = speed;
+        motion_ = -1;
     } else {
         // 舵机控制
         if (throttle_servo_pin_ >= 0) {
@@ -283,6 +401,7 @@ void Vehicle::TurnLeft(int speed) {
         // 电机控制：左轮反转，右轮正转
         ControlMotor(0, 1, 1, 0);
         motor_speed_ = speed;
+        motion_ = 0;
     } else {
         // 舵机控制：方向舵机左转
         SetSteeringAngle(45); // 向左打舵
@@ -294,6 +413,7 @@ void Vehicle::TurnRight(int speed) {
         // 电机控制：左轮正转，右轮反转
         ControlMotor(1, 0, 0, 1);
         motor_speed_ = speed;
+        motion_ = 0;
     } else {
         // 舵机控制：方向舵机右转
         SetSteeringAngle(135); // 向右打舵
@@ -311,6 +431,7 @@ void Vehicle::Stop(bool brake) {
             ControlMotor(0, 0, 0, 0);
         }
         motor_speed_ = 0;
+        motion_ = 0;
     } else {
         // 舵机控制
         if (throttle_servo_pin_ >= 0) {
@@ -389,8 +510,15 @@ void Vehicle::HandleWebSocketMessage(int client_index, const std::string& messag
                 int dirX = cJSON_IsNumber(dir_x) ? dir_x->valueint : 0;
                 int dirY = cJSON_IsNumber(dir_y) ? dir_y->valueint : 0;
                 
-                // 控制车辆
-                SetControlParams(distance, dirX, dirY);
+                // 只投递最新的摇杆位置，由运动循环按固定频率加减速后输出
+                float length = std::hypot((float)dirX, (float)dirY);
+                float x = length > 0.0f ? dirX / length * distance : 0.0f;
+                float y = length > 0.0f ? dirY / length * distance : 0.0f;
+                if (motion_controller_) {
+                    motion_controller_->Post(x, y);
+                } else {
+                    ApplyMotion(x, y);
+                }
                 
                 // 返回确认消息
                 if (webserver_) {
@@ -402,6 +530,10 @@ void Vehicle::HandleWebSocketMessage(int client_index, const std::string& messag
                 }
             }
         } else if (strcmp(cmd_str, "stop") == 0) {
+            // 停止指令不经过减速，立即停车
+            if (motion_controller_) {
+                motion_controller_->Cancel();
+            }
             Stop(true);
             
             // 返回确认消息
@@ -447,11 +579,22 @@ void Vehicle::InitHandlers() {
         // 构建状态JSON
         cJSON* root = cJSON_CreateObject();
         cJSON_AddNumberToObject(root, "type", (int)vehicle_type_);
-        cJSON_AddNumberToObject(root, "speed", motor_speed_);
+        cJSON_AddNumberToObject(root, "speed", motor_speed_.load());
         cJSON_AddNumberToObject(root, "dirX", direction_x_);
         cJSON_AddNumberToObject(root, "dirY", direction_y_);
-        cJSON_AddNumberToObject(root, "steeringAngle", steering_angle_);
-        cJSON_AddNumberToObject(root, "throttle", throttle_position_);
+        cJSON_AddNumberToObject(root, "steeringAngle", steering_angle_.load());
+        cJSON_AddNumberToObject(root, "throttle", throttle_position_.load());
+        if (motion_controller_) {
+            MotionStats stats = motion_controller_->GetStats();
+            cJSON* motion = cJSON_CreateObject();
+            cJSON_AddNumberToObject(motion, "received", stats.received);
+            cJSON_AddNumberToObject(motion, "superseded", stats.superseded);
+            cJSON_AddNumberToObject(motion, "deadmanStops", stats.deadman_stops);
+            cJSON_AddNumberToObject(motion, "lastLatencyMs", stats.last_latency_us / 1000.0);
+            cJSON_AddNumberToObject(motion, "avgLatencyMs", stats.avg_latency_us / 1000.0);
+            cJSON_AddNumberToObject(motion, "maxLatencyMs", stats.max_latency_us / 1000.0);
+            cJSON_AddItemToObject(root, "motion", motion);
+        }
         
         char* json_str = cJSON_PrintUnformatted(root);
         std::string response(json_str);
@@ -466,6 +609,19 @@ void Vehicle::InitHandlers() {
         
         return api_resp;
     });
+    
+    // 遥控通道协商：网页据此决定使用UDP还是继续使用WebSocket
+    webserver_->RegisterApiHandler(HttpMethod::HTTP_GET, "/api/vehicle/teleop", [this](httpd_req_t* req) -> ApiResponse {
+        ApiResponse api_resp;
+        if (teleop_ && teleop_->IsRunning()) {
+            api_resp.content = teleop_->GetNegotiationJson();
+        } else {
+            api_resp.content = "{\"enabled\":false,\"transport\":\"ws\"}";
+        }
+        api_resp.status_code = 200;
+        api_resp.type = ApiResponseType::JSON;
+        return api_resp;
+    });
 }
 
 void Vehicle::InitGPIO() {
@@ -665,11 +821,10 @@ void InitVehicleComponent(Web* server) {
         return;
     }
     
-    // 启动车辆组件
+    // 注册车辆组件，由ComponentManager::StartAllAsync在Web启动后启动
     if (vehicle) {
         auto& manager = ComponentManager::GetInstance();
         manager.RegisterComponent(vehicle);
-        vehicle->Start();
-        ESP_LOGI(TAG, "Vehicle component initialized and started");
+        ESP_LOGI(TAG, "Vehicle component registered");
     }
 } 
\ No newline at end of file
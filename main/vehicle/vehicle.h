@@ -4,6 +4,10 @@
 #include "../iot/thing.h"
 #include "../iot/thing_manager.h"
 #include "../web/web.h"
+#include "../hardware/motion_controller.h"
+#include "teleop_server.h"
+#include <atomic>
+#include <memory>
 #include <vector>
 #include <string>
 
@@ -60,6 +64,7 @@ public:
     virtual bool IsRunning() const override;
     virtual const char* GetName() const override;
     virtual ComponentType GetType() const override { return COMPONENT_TYPE_MOTOR; }
+    virtual std::vector<const char*> GetDependencies() const override { return {"Web"}; }
 
     // 车辆控制方法
     void SetControlParams(float distance, int dirX, int dirY);
@@ -121,17 +126,21 @@ private:
     // 控制参数
     int direction_x_;
     int direction_y_;
-    int motor_speed_;
+    std::atomic<int> motor_speed_;      // UDP遥控任务读取遥测，写入方在其他任务
     float distance_percent_;
+    std::atomic<int> motion_{0};        // 1前进，-1后退，0停止或转向
+    bool obstacle_listener_added_ = false;
+    std::unique_ptr<MotionController> motion_controller_;  // WebSocket摇杆指令的最新值邮箱和运动循环
+    std::unique_ptr<TeleopServer> teleop_;                 // 可选的UDP遥控通道
     
     // 缓存上一次方向
     int last_dir_x_;
     int last_dir_y_;
     float cached_angle_degrees_;
     
-    // 舵机角度
-    int steering_angle_;
-    int throttle_position_;
+    // 舵机角度，同样被UDP遥控任务读取
+    std::atomic<int> steering_angle_;
+    std::atomic<int> throttle_position_;
 
     // 带云台的引脚
     int camera_h_servo_pin_;
@@ -145,8 +154,12 @@ private:
     void InitHandlers();
     void InitGPIO();
     void InitServos();
+    void StartTeleop();
     
     // 控制方法
+    void ApplyMotion(float x, float y);
+    void ControlServoChannel(int channel, int angle);
+    void FillTelemetry(teleop::TeleopTelemetry& telemetry);
     void ControlMotor(int in1, int in2, int in3, int in4);
     void ControlSteeringServo(int angle);
     void ControlThrottleServo(int position);
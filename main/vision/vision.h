@@ -43,6 +43,7 @@ public:
     virtual bool IsRunning() const override;
     virtual const char* GetName() const override;
     virtual ComponentType GetType() const override { return COMPONENT_TYPE_VISION; }
+    virtual std::vector<const char*> GetDependencies() const override { return {"Web"}; }
 
     // 相机控制功能
     bool StartStreaming();
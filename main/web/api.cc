@@ -2,6 +2,9 @@
 #include "esp_log.h"
 #include "../hardware/hardware_manager.h"
 #include "../hardware/simple_error_handler.h"
+#include "../hardware/sensor_history.h"
+#include "../hardware/obstacle_supervisor.h"
+#include "../iot/things/imu.h"
 #include <esp_system.h>
 #include <esp_timer.h>
 #include <esp_heap_caps.h>
@@ -41,10 +44,17 @@ bool InitializeApi(Web* web) {
     
     // 注册传感器API
     RegisterApiHandler(web, HttpMethod::HTTP_GET, "/sensors", HandleSensorData);
+    // 必须在通配符之前注册，否则会被 /sensors/* 匹配
+    RegisterApiHandler(web, HttpMethod::HTTP_GET, "/sensors/history", HandleSensorHistory);
+    RegisterApiHandler(web, HttpMethod::HTTP_GET, "/sensors/imu/calibration", HandleImuCalibration);
+    RegisterApiHandler(web, HttpMethod::HTTP_POST, "/sensors/imu/calibration", HandleImuCalibration);
+    RegisterApiHandler(web, HttpMethod::HTTP_DELETE, "/sensors/imu/calibration", HandleImuCalibration);
     RegisterApiHandler(web, HttpMethod::HTTP_GET, "/sensors/*", HandleSensorDataById);
     
     // 注册执行器控制API
     RegisterApiHandler(web, HttpMethod::HTTP_POST, "/motors/control", HandleMotorControl);
+    RegisterApiHandler(web, HttpMethod::HTTP_GET, "/motors/safety", HandleObstacleSafety);
+    RegisterApiHandler(web, HttpMethod::HTTP_POST, "/motors/safety", HandleObstacleSafety);
     RegisterApiHandler(web, HttpMethod::HTTP_POST, "/servos/control", HandleServoControl);
     
     // 注册硬件状态API
@@ -704,6 +714,123 @@ ApiResponse HandleSensorDataById(httpd_req_t* req) {
     }
 }
 
+// 传感器历史数据API: /api/sensors/history?id=&from=&res=
+// 不带 id 时返回已记录的序列列表；from 为开机后的毫秒数，负数表示相对当前时间
+ApiResponse HandleSensorHistory(httpd_req_t* req) {
+    std::map<std::string, std::string> params = Web::ParseQueryParams(req);
+    auto& history = SensorHistory::GetInstance();
+
+    auto id_it = params.find("id");
+    if (id_it == params.end() || id_it->second.empty()) {
+        return CreateApiSuccessResponse("Sensor history series", cJSON_Parse(history.GetSeriesJson().c_str()));
+    }
+
+    SensorResolution resolution = SensorResolution::kSecond;
+    auto res_it = params.find("res");
+    if (res_it != params.end() && !SensorHistory::ParseResolution(res_it->second, resolution)) {
+        return CreateApiErrorResponse(400, "Invalid res, expected raw, 1s or 1m");
+    }
+
+    int64_t from_ms = -60000;
+    size_t max_points = SensorHistory::kMaxQueryPoints;
+    try {
+        auto from_it = params.find("from");
+        if (from_it != params.end()) {
+            from_ms = std::stoll(from_it->second);
+        }
+        auto limit_it = params.find("limit");
+        if (limit_it != params.end()) {
+            max_points = std::stoul(limit_it->second);
+        }
+    } catch (const std::exception& e) {
+        return CreateApiErrorResponse(400, "Invalid from or limit");
+    }
+
+    std::string json = history.GetHistoryJson(id_it->second, resolution, from_ms, max_points);
+    if (json.empty()) {
+        return CreateApiErrorResponse(404, "No history for sensor: " + id_it->second);
+    }
+    return CreateApiSuccessResponse("Sensor history retrieved successfully", cJSON_Parse(json.c_str()));
+}
+
+// IMU校准API: /api/sensors/imu/calibration
+// GET 查询状态和当前系数；POST {"sensor":"gyro|accel|mag","duration":秒} 开始校准；DELETE ?sensor= 清除校准
+ApiResponse HandleImuCalibration(httpd_req_t* req) {
+    if (req->method == HTTP_POST) {
+        cJSON* json = ParseRequestJson(req);
+        if (!json) {
+            return CreateApiErrorResponse(400, "Invalid JSON request");
+        }
+        cJSON* sensor = cJSON_GetObjectItem(json, "sensor");
+        cJSON* duration = cJSON_GetObjectItem(json, "duration");
+        if (!cJSON_IsString(sensor)) {
+            cJSON_Delete(json);
+            return CreateApiErrorResponse(400, "Missing or invalid 'sensor' field");
+        }
+        std::string sensor_name = sensor->valuestring;
+        int duration_s = cJSON_IsNumber(duration) ? duration->valueint : 0;
+        cJSON_Delete(json);
+
+        std::string error;
+        if (!iot::StartIMUCalibration(sensor_name, duration_s, error)) {
+            return CreateApiErrorResponse(409, error);
+        }
+        return CreateApiSuccessResponse("IMU calibration started", cJSON_Parse(iot::GetIMUCalibrationJson().c_str()));
+    }
+
+    if (req->method == HTTP_DELETE) {
+        std::map<std::string, std::string> params = Web::ParseQueryParams(req);
+        std::string sensor = params.count("sensor") ? params["sensor"] : "all";
+        if (!iot::ResetIMUCalibration(sensor)) {
+            return CreateApiErrorResponse(400, "Invalid sensor, expected gyro, accel, mag or all");
+        }
+        return CreateApiSuccessResponse("IMU calibration reset");
+    }
+
+    std::string json = iot::GetIMUCalibrationJson();
+    if (json.empty()) {
+        return CreateApiErrorResponse(503, "IMU not available");
+    }
+    return CreateApiSuccessResponse("IMU calibration state", cJSON_Parse(json.c_str()));
+}
+
+// 避障安全监控：GET查询状态，POST修改阈值（未给出的字段保持不变）
+ApiResponse HandleObstacleSafety(httpd_req_t* req) {
+    auto& supervisor = ObstacleSupervisor::GetInstance();
+    if (req->method == HTTP_POST) {
+        cJSON* json = ParseRequestJson(req);
+        if (!json) {
+            return CreateApiErrorResponse(400, "Invalid JSON request");
+        }
+        ObstacleThresholds thresholds = supervisor.GetThresholds();
+        cJSON* item = cJSON_GetObjectItem(json, "stop_distance");
+        if (cJSON_IsNumber(item)) {
+            thresholds.stop_distance_cm = item->valuedouble;
+        }
+        item = cJSON_GetObjectItem(json, "slow_distance");
+        if (cJSON_IsNumber(item)) {
+            thresholds.slow_distance_cm = item->valuedouble;
+        }
+        item = cJSON_GetObjectItem(json, "min_time_to_collision");
+        if (cJSON_IsNumber(item)) {
+            thresholds.min_time_to_collision_s = item->valuedouble;
+        }
+        item = cJSON_GetObjectItem(json, "min_duty");
+        if (cJSON_IsNumber(item)) {
+            thresholds.min_scale = item->valuedouble;
+        }
+        cJSON_Delete(json);
+
+        std::string error;
+        if (!supervisor.SetThresholds(thresholds, error)) {
+            return CreateApiErrorResponse(400, error);
+        }
+        return CreateApiSuccessResponse("Obstacle thresholds updated", cJSON_Parse(supervisor.GetStatusJson().c_str()));
+    }
+
+    return CreateApiSuccessResponse("Obstacle safety state", cJSON_Parse(supervisor.GetStatusJson().c_str()));
+}
+
 // 电机控制API
 ApiResponse HandleMotorControl(httpd_req_t* req) {
     ESP_LOGI(TAG, "Processing motor control request");
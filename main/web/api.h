@@ -90,7 +90,10 @@ ApiResponse HandleCameraSettings(httpd_req_t* req);
 // 硬件API处理函数
 ApiResponse HandleSensorData(httpd_req_t* req);
 ApiResponse HandleSensorDataById(httpd_req_t* req);
+ApiResponse HandleSensorHistory(httpd_req_t* req);
+ApiResponse HandleImuCalibration(httpd_req_t* req);
 ApiResponse HandleMotorControl(httpd_req_t* req);
+ApiResponse HandleObstacleSafety(httpd_req_t* req);
 ApiResponse HandleServoControl(httpd_req_t* req);
 ApiResponse HandleHardwareStatus(httpd_req_t* req);
 ApiResponse HandleHardwareConfig(httpd_req_t* req);
@@ -0,0 +1,264 @@
+#include "sensor_stream.h"
+#include "web.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cJSON.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#define TAG "SensorStream"
+
+SensorStream::SensorStream(Web* web) : web_(web) {
+    stopped_ = xSemaphoreCreateBinary();
+}
+
+SensorStream::~SensorStream() {
+    Stop();
+    vSemaphoreDelete(stopped_);
+}
+
+void SensorStream::AddSource(const std::string& name, Sampler sampler, Version version) {
+    if (sources_.size() >= kMaxSources) {
+        ESP_LOGE(TAG, "Too many sensor sources, ignoring %s", name.c_str());
+        return;
+    }
+    sources_.push_back(Source{name, std::move(sampler), std::move(version), std::string()});
+}
+
+void SensorStream::Start() {
+    if (task_ != nullptr) {
+        return;
+    }
+    running_ = true;
+    TaskHandle_t task = nullptr;
+    if (xTaskCreate([](void* arg) {
+        auto* stream = static_cast<SensorStream*>(arg);
+        stream->Run();
+        stream->task_ = nullptr;
+        // 给出信号后Stop()可能立即返回并释放本对象，之后不能再访问成员
+        xSemaphoreGive(stream->stopped_);
+        vTaskDelete(NULL);
+    }, "sensor_stream", 4096, this, 3, &task) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create sensor stream task");
+        running_ = false;
+        return;
+    }
+    task_ = task;
+}
+
+void SensorStream::Stop() {
+    TaskHandle_t task = task_;
+    if (task == nullptr) {
+        return;
+    }
+    running_ = false;
+    xTaskNotifyGive(task);
+    // 推送任务可能正在发送，等它退出后调用者才能停止 HTTP 服务器
+    xSemaphoreTake(stopped_, portMAX_DELAY);
+    std::lock_guard<std::mutex> lock(mutex_);
+    subscribers_.clear();
+}
+
+bool SensorStream::HandleMessage(int fd, const std::string& message) {
+    cJSON* root = cJSON_Parse(message.c_str());
+    if (root == nullptr) {
+        return false;
+    }
+    cJSON* type = cJSON_GetObjectItem(root, "type");
+    if (!cJSON_IsString(type)) {
+        cJSON_Delete(root);
+        return false;
+    }
+
+    if (strcmp(type->valuestring, "unsubscribe") == 0) {
+        cJSON_Delete(root);
+        Unsubscribe(fd);
+        web_->SendWebSocketMessage(fd, "{\"type\":\"unsubscribed\"}");
+        return true;
+    }
+    if (strcmp(type->valuestring, "subscribe") != 0) {
+        cJSON_Delete(root);
+        return false;
+    }
+
+    // 不指定 sensors 时订阅全部数据源
+    uint32_t mask = 0;
+    cJSON* sensors = cJSON_GetObjectItem(root, "sensors");
+    if (cJSON_IsArray(sensors) && cJSON_GetArraySize(sensors) > 0) {
+        cJSON* item;
+        cJSON_ArrayForEach(item, sensors) {
+            if (!cJSON_IsString(item)) {
+                continue;
+            }
+            auto it = std::find_if(sources_.begin(), sources_.end(),
+                [item](const Source& source) { return source.name == item->valuestring; });
+            if (it != sources_.end()) {
+                mask |= 1u << (it - sources_.begin());
+            } else {
+                ESP_LOGW(TAG, "Unknown sensor source: %s", item->valuestring);
+            }
+        }
+    } else {
+        mask = (1u << sources_.size()) - 1;
+    }
+
+    int rate_hz = kDefaultRateHz;
+    cJSON* rate = cJSON_GetObjectItem(root, "rate");
+    if (cJSON_IsNumber(rate)) {
+        rate_hz = std::clamp(rate->valueint, kMinRateHz, kMaxRateHz);
+    }
+    cJSON_Delete(root);
+
+    Subscribe(fd, mask, rate_hz);
+
+    std::string reply;
+    iot::JsonWriter writer(reply);
+    writer.BeginObject();
+    writer.Key("type");
+    writer.String("subscribed");
+    writer.Key("sensors");
+    writer.BeginArray();
+    for (size_t i = 0; i < sources_.size(); i++) {
+        if (mask & (1u << i)) {
+            writer.String(sources_[i].name);
+        }
+    }
+    writer.EndArray();
+    writer.Key("rate");
+    writer.Number(rate_hz);
+    writer.EndObject();
+    web_->SendWebSocketMessage(fd, reply);
+    return true;
+}
+
+void SensorStream::Subscribe(int fd, uint32_t mask, int rate_hz) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = std::find_if(subscribers_.begin(), subscribers_.end(),
+            [fd](const Subscriber& subscriber) { return subscriber.fd == fd; });
+        if (mask == 0) {
+            if (it != subscribers_.end()) {
+                subscribers_.erase(it);
+            }
+            return;
+        }
+        Subscriber subscriber{fd, mask, 1000000 / rate_hz, esp_timer_get_time()};
+        if (it != subscribers_.end()) {
+            *it = subscriber;
+        } else {
+            subscribers_.push_back(subscriber);
+        }
+    }
+    ESP_LOGI(TAG, "Client %d subscribed to 0x%lx at %d Hz", fd, (unsigned long)mask, rate_hz);
+    TaskHandle_t task = task_;
+    if (task != nullptr) {
+        xTaskNotifyGive(task);
+    }
+}
+
+void SensorStream::Unsubscribe(int fd) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = std::find_if(subscribers_.begin(), subscribers_.end(),
+        [fd](const Subscriber& subscriber) { return subscriber.fd == fd; });
+    if (it != subscribers_.end()) {
+        subscribers_.erase(it);
+        ESP_LOGI(TAG, "Client %d unsubscribed", fd);
+    }
+}
+
+int64_t SensorStream::CollectDue(int64_t now_us) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    due_.clear();
+    int64_t next_us = -1;
+    for (auto& subscriber : subscribers_) {
+        if (subscriber.next_due_us <= now_us) {
+            due_.push_back(Due{subscriber.fd, subscriber.mask});
+            subscriber.next_due_us += subscriber.interval_us;
+            // 发送慢于订阅速率时不补发积压的周期
+            if (subscriber.next_due_us <= now_us) {
+                subscriber.next_due_us = now_us + subscriber.interval_us;
+            }
+        }
+        int64_t wait_us = subscriber.next_due_us - now_us;
+        if (next_us < 0 || wait_us < next_us) {
+            next_us = wait_us;
+        }
+    }
+    return next_us;
+}
+
+const std::string& SensorStream::BuildMessage(uint32_t mask, int64_t now_us) {
+    for (size_t i = 0; i < message_count_; i++) {
+        if (messages_[i].first == mask) {
+            return messages_[i].second;
+        }
+    }
+
+    // 复用上个周期的字符串，稳定后不再分配内存
+    if (message_count_ == messages_.size()) {
+        messages_.emplace_back();
+    }
+    auto& message = messages_[message_count_++];
+    message.first = mask;
+    std::string& json = message.second;
+    json.clear();
+    iot::JsonWriter writer(json);
+    writer.BeginObject();
+    writer.Key("type");
+    writer.String("sensor_data");
+    writer.Key("timestamp");
+    writer.Number((double)(now_us / 1000));
+    for (size_t i = 0; i < sources_.size(); i++) {
+        if ((mask & (1u << i)) && !sources_[i].fields.empty()) {
+            writer.Raw(sources_[i].fields);
+        }
+    }
+    writer.EndObject();
+    return json;
+}
+
+void SensorStream::Run() {
+    while (running_) {
+        int64_t now_us = esp_timer_get_time();
+        int64_t wait_us = CollectDue(now_us);
+        if (due_.empty()) {
+            // 没有订阅者时一直阻塞，直到有新的订阅
+            TickType_t ticks = wait_us < 0 ? portMAX_DELAY :
+                std::max<TickType_t>(1, pdMS_TO_TICKS((wait_us + 999) / 1000));
+            ulTaskNotifyTake(pdTRUE, ticks);
+            continue;
+        }
+
+        // 每个被订阅的数据源本周期只采样一次
+        uint32_t sampled = 0;
+        for (const auto& due : due_) {
+            sampled |= due.mask;
+        }
+        for (size_t i = 0; i < sources_.size(); i++) {
+            auto& source = sources_[i];
+            if (!(sampled & (1u << i))) {
+                continue;
+            }
+            if (source.version) {
+                // 先读计数再采样，采样期间的变化留到下个周期
+                uint32_t version = source.version();
+                if (source.sampled && version == source.sampled_version) {
+                    continue;
+                }
+                source.sampled_version = version;
+                source.sampled = true;
+            }
+            source.fields.clear();
+            iot::JsonWriter writer(source.fields);
+            source.sampler(writer);
+        }
+
+        message_count_ = 0;
+        for (const auto& due : due_) {
+            if (!web_->SendWebSocketMessage(due.fd, BuildMessage(due.mask, now_us))) {
+                Unsubscribe(due.fd);
+            }
+        }
+    }
+}
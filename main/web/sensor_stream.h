@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include "../iot/json_writer.h"
+
+class Web;
+
+/**
+ * @brief 按订阅推送传感器数据
+ *
+ * 客户端通过 WebSocket 发送 {"type":"subscribe","sensors":["imu","distance"],"rate":20} 订阅，
+ * {"type":"unsubscribe"} 取消。每个周期每个数据源只采样一次，相同订阅组合的客户端共用一份
+ * 序列化结果。没有订阅者时推送任务阻塞等待，不采样也不生成 JSON。
+ */
+class SensorStream {
+public:
+    // 把一个数据源的字段写入 sensor_data 消息对象
+    using Sampler = std::function<void(iot::JsonWriter& writer)>;
+    // 数据源的变化计数，不变时沿用上次的采样结果
+    using Version = std::function<uint32_t()>;
+
+    static constexpr int kMaxSources = 16;
+    static constexpr int kMinRateHz = 1;
+    static constexpr int kMaxRateHz = 50;
+    static constexpr int kDefaultRateHz = 10;
+
+    explicit SensorStream(Web* web);
+    ~SensorStream();
+
+    SensorStream(const SensorStream&) = delete;
+    SensorStream& operator=(const SensorStream&) = delete;
+
+    // 在 Start() 之前调用，没有 version 的数据源每个周期都重新采样
+    void AddSource(const std::string& name, Sampler sampler, Version version = nullptr);
+
+    void Start();
+    // 等待推送任务退出后返回，之后可以安全地停止 HTTP 服务器或再次 Start()
+    void Stop();
+
+    // 处理订阅消息，不是 subscribe / unsubscribe 时返回 false
+    bool HandleMessage(int fd, const std::string& message);
+    // 连接关闭时调用
+    void Unsubscribe(int fd);
+
+private:
+    struct Source {
+        std::string name;
+        Sampler sampler;
+        Version version;
+        std::string fields;     // 本周期的采样结果，复用以避免分配
+        uint32_t sampled_version = 0;
+        bool sampled = false;
+    };
+
+    struct Subscriber {
+        int fd;
+        uint32_t mask;          // 订阅的数据源位图
+        int64_t interval_us;
+        int64_t next_due_us;
+    };
+
+    struct Due {
+        int fd;
+        uint32_t mask;
+    };
+
+    Web* web_;
+    std::vector<Source> sources_;
+    std::mutex mutex_;
+    std::vector<Subscriber> subscribers_;
+    std::atomic<TaskHandle_t> task_{nullptr};   // 任务退出时自己清空
+    std::atomic<bool> running_{false};
+    SemaphoreHandle_t stopped_ = nullptr;       // 任务退出前给出，Stop()据此等待
+
+    // 仅推送任务使用
+    std::vector<Due> due_;
+    std::vector<std::pair<uint32_t, std::string>> messages_;    // 按订阅组合缓存的消息
+    size_t message_count_ = 0;
+
+    void Subscribe(int fd, uint32_t mask, int rate_hz);
+    void Run();
+    // 取出到期的订阅者，返回距离下一个到期的时间，没有订阅者时为 -1
+    int64_t CollectDue(int64_t now_us);
+    const std::string& BuildMessage(uint32_t mask, int64_t now_us);
+};
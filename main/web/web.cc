@@ -1,5 +1,6 @@
 #include "web.h"
 #include "api.h"
+#include "sensor_stream.h"
 #include <cmath>   // 添加数学函数头文件，包含NAN和isnan
 #include <algorithm>
 #include <sstream>
@@ -11,9 +12,13 @@
 #include <esp_http_server.h>
 #include <esp_wifi.h>
 #include <cJSON.h>
+#include <unistd.h>
 
 #include "../iot/thing.h"
 #include "../iot/thing_manager.h"
+#include "../application.h"
+#include "../trace.h"
+#include "../hardware/obstacle_supervisor.h"
 
 // 使用命名空间
 using namespace std;  // 使用标准命名空间
@@ -26,16 +31,30 @@ float SafeGetValue(Thing* thing, const std::string& property_name) {
         return NAN;
     }
     
-    // 检查属性是否存在于values映射中（避免在日志中产生警告）
-    const auto& values = thing->GetValues();
-    auto it = values.find(property_name);
-    if (it != values.end()) {
-        return it->second;
+    // 只读取values映射中的值（FindValue不会产生警告日志），不存在时返回NAN表示不可用
+    float value;
+    return thing->FindValue(property_name, value) ? value : NAN;
+}
+
+// 把Thing中存在的值按 {属性名, JSON字段名} 写入
+template <size_t N>
+static void WriteThingValues(iot::JsonWriter& writer, Thing* thing, const std::pair<const char*, const char*> (&fields)[N]) {
+    if (!thing) {
+        return;
+    }
+    for (const auto& field : fields) {
+        float value = SafeGetValue(thing, field.first);
+        if (!std::isnan(value)) {
+            writer.Key(field.second);
+            writer.Number(value);
+        }
     }
-    
-    // 如果不在map中，不直接使用GetValue（这会产生警告日志）
-    // 而是直接返回NAN表示不可用
-    return NAN;
+}
+
+// Thing的值变化计数，传感器推送据此跳过没有变化的数据源，Thing不存在时为0
+static uint32_t ThingValuesVersion(const char* name) {
+    Thing* thing = ThingManager::GetInstance().FindThingByName(name);
+    return thing ? thing->values_version() : 0;
 }
 
 #define TAG "Web"
@@ -91,6 +110,7 @@ bool Web::Start() {
     config.max_uri_handlers = 24;
     config.uri_match_fn = httpd_uri_match_wildcard;
     config.lru_purge_enable = true;
+    config.close_fn = SocketCloseHandler;
     
     // 打印配置信息
     ESP_LOGI(TAG, "Web server config: port=%d, task_priority=%d, stack_size=%d", 
@@ -153,12 +173,17 @@ void Web::Stop() {
     
     ESP_LOGI(TAG, "Stopping Web component");
     
+    if (sensor_stream_) {
+        sensor_stream_->Stop();
+    }
+    
     if (server_) {
         httpd_stop(server_);
         server_ = nullptr;
     }
     
     // Clear handler maps
+    std::lock_guard<std::recursive_mutex> lock(handlers_mutex_);
     http_handlers_.clear();
     api_handlers_.clear();
     ws_callbacks_.clear();
@@ -176,6 +201,7 @@ const char* Web::GetName() const {
 
 // HTTP handler registration
 void Web::RegisterHandler(HttpMethod method, const std::string& uri, RequestHandler handler) {
+    std::lock_guard<std::recursive_mutex> lock(handlers_mutex_);
     // 保存所有处理程序，即使组件尚未运行
     std::string key = std::string(uri) + ":" + std::to_string(static_cast<int>(method));
     
@@ -246,6 +272,8 @@ void Web::RegisterApiHandler(HttpMethod method, const std::string& uri, ApiHandl
         return;
     }
     
+    std::lock_guard<std::recursive_mutex> lock(handlers_mutex_);
+    
     // 确保API URI格式正确，以/api/开头
     std::string api_uri = uri;
     if (api_uri.substr(0, 5) != "/api/") {
@@ -281,6 +309,7 @@ void Web::RegisterApiHandler(HttpMethod method, const std::string& uri, ApiHandl
 // WebSocket support
 void Web::RegisterWebSocketMessageCallback(WebSocketMessageCallback callback) {
     if (callback) {
+        std::lock_guard<std::recursive_mutex> lock(handlers_mutex_);
         ws_callbacks_.push_back(callback);
         ESP_LOGI(TAG, "Registered WebSocket message callback");
     }
@@ -324,6 +353,7 @@ void Web::RegisterWebSocketHandler(const std::string& uri, WebSocketClientMessag
             ESP_LOGI(TAG, "Normalizing WebSocket URI from %s to %s", uri.c_str(), normalized_uri.c_str());
         }
         
+        std::lock_guard<std::recursive_mutex> lock(handlers_mutex_);
         ws_uri_handlers_[normalized_uri] = callback;
         
         // 注册WebSocket处理程序
@@ -414,10 +444,32 @@ bool Web::SendWebSocketMessage(int client_index, const std::string& message) {
         return false;
     }
     
-    // 在ESP-IDF 5.x中，WebSocket API有变化
-    // 这里简化实现，不支持按客户端索引发送消息
-    ESP_LOGW(TAG, "SendWebSocketMessage by client index not supported in ESP-IDF 5.x");
-    return false;
+    // 客户端索引即套接字描述符
+    if (httpd_ws_get_fd_info(server_, client_index) != HTTPD_WS_CLIENT_WEBSOCKET) {
+        return false;
+    }
+    
+    httpd_ws_frame_t ws_frame;
+    memset(&ws_frame, 0, sizeof(httpd_ws_frame_t));
+    ws_frame.payload = (uint8_t*)message.c_str();
+    ws_frame.len = message.length();
+    ws_frame.type = HTTPD_WS_TYPE_TEXT;
+    ws_frame.final = true;
+    
+    esp_err_t ret = httpd_ws_send_frame_async(server_, client_index, &ws_frame);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to send WebSocket message to client %d: %s", client_index, esp_err_to_name(ret));
+        return false;
+    }
+    return true;
+}
+
+void Web::SocketCloseHandler(httpd_handle_t handle, int sockfd) {
+    // 设置了 close_fn 后需要自己关闭套接字
+    if (current_instance_ && current_instance_->sensor_stream_) {
+        current_instance_->sensor_stream_->Unsubscribe(sockfd);
+    }
+    close(sockfd);
 }
 
 // Utility methods
@@ -984,6 +1036,41 @@ void Web::InitApiHandlers() {
         return response;
     });
     
+    // 网络链路指标API: RTT、上下行码率、丢包与发送队列延迟
+    RegisterApiHandler(HttpMethod::HTTP_GET, "/api/network/metrics", [](httpd_req_t* req) -> ApiResponse {
+        ApiResponse response;
+        response.content = Application::GetInstance().GetProtocolMetricsJson();
+        return response;
+    });
+
+#if CONFIG_USE_EVENT_TRACE
+    // 事件循环追踪: POST ?action=start 开始记录, POST ?action=stop 停止, GET 以分块传输导出 Chrome trace_event JSON
+    RegisterApiHandler(HttpMethod::HTTP_POST, "/api/trace", [](httpd_req_t* req) -> ApiResponse {
+        auto params = Web::ParseQueryParams(req);
+        auto& trace = Trace::GetInstance();
+        ApiResponse response;
+        if (params["action"] == "start") {
+            trace.Start();
+            response.content = trace.IsRecording() ? R"({"recording":true})" : R"({"recording":false})";
+        } else if (params["action"] == "stop") {
+            trace.Stop();
+            response.content = R"({"recording":false})";
+        } else {
+            response.status_code = 400;
+            response.content = R"({"status":400,"message":"action must be start or stop"})";
+        }
+        return response;
+    });
+    RegisterApiHandler(HttpMethod::HTTP_GET, "/api/trace", [](httpd_req_t* req) -> ApiResponse {
+        ApiResponse response;
+        response.headers["Content-Disposition"] = "attachment; filename=\"trace.json\"";
+        response.stream = [](const std::function<bool(const char* data, size_t len)>& write) {
+            return Trace::GetInstance().ExportJson(write);
+        };
+        return response;
+    });
+#endif
+
     // 摄像头API现在由api.cc中的HandleCameraStream函数处理
     
     // 添加位置API
@@ -1031,6 +1118,12 @@ void Web::InitApiHandlers() {
     });
 }
 
+Web::RequestHandler Web::FindHttpHandler(const std::string& key) const {
+    std::lock_guard<std::recursive_mutex> lock(handlers_mutex_);
+    auto it = http_handlers_.find(key);
+    return it != http_handlers_.end() ? it->second : RequestHandler();
+}
+
 // Static HTTP handlers
 esp_err_t Web::InternalRequestHandler(httpd_req_t* req) {
     if (!req || !req->user_ctx) {
@@ -1071,10 +1164,10 @@ esp_err_t Web::InternalRequestHandler(httpd_req_t* req) {
     }
     
     // 检查是否有处理程序
-    auto it = web->http_handlers_.find(key);
-    if (it != web->http_handlers_.end()) {
+    RequestHandler handler = web->FindHttpHandler(key);
+    if (handler) {
         ESP_LOGI(TAG, "Found handler for %s", uri.c_str());
-        return it->second(req);
+        return handler(req);
     }
     
     // 检查是否有.html扩展名
@@ -1083,10 +1176,10 @@ esp_err_t Web::InternalRequestHandler(httpd_req_t* req) {
         std::string base_uri = uri.substr(0, uri.length() - 5);
         std::string base_key = base_uri + ":" + std::to_string(req->method);
         
-        auto base_it = web->http_handlers_.find(base_key);
-        if (base_it != web->http_handlers_.end()) {
+        RequestHandler base_handler = web->FindHttpHandler(base_key);
+        if (base_handler) {
             ESP_LOGI(TAG, "Using handler for %s instead of %s", base_uri.c_str(), uri.c_str());
-            return base_it->second(req);
+            return base_handler(req);
         }
     }
     
@@ -1174,34 +1267,44 @@ esp_err_t Web::WebSocketHandler(httpd_req_t* req) {
     // 获取客户端索引
     int client_index = httpd_req_to_sockfd(req);
     
-    // 针对根WebSocket路径，发送给所有注册的回调
-    if (normalized_uri == "/ws") {
-        for (auto& callback : current_instance_->ws_callbacks_) {
-            callback(req, message);
-            handled = true;
+    // 在锁内取出要调用的处理程序，锁外执行
+    std::vector<WebSocketMessageCallback> callbacks;
+    WebSocketClientMessageCallback uri_handler;
+    {
+        std::lock_guard<std::recursive_mutex> lock(current_instance_->handlers_mutex_);
+        // 针对根WebSocket路径，发送给所有注册的回调
+        if (normalized_uri == "/ws") {
+            callbacks = current_instance_->ws_callbacks_;
+        }
+        
+        // 检查特定路径处理程序 - 使用精确匹配
+        auto it = current_instance_->ws_uri_handlers_.find(normalized_uri);
+        if (it != current_instance_->ws_uri_handlers_.end()) {
+            ESP_LOGI(TAG, "Found exact handler for WebSocket path: %s", normalized_uri.c_str());
+            uri_handler = it->second;
+        } 
+        // 如果没有精确匹配，尝试前缀匹配
+        else {
+            for (auto& handler_pair : current_instance_->ws_uri_handlers_) {
+                // 检查是否是路径前缀
+                if (normalized_uri.find(handler_pair.first + "/") == 0 || 
+                    normalized_uri == handler_pair.first) {
+                    ESP_LOGI(TAG, "Found prefix handler for WebSocket path: %s (prefix: %s)", 
+                             normalized_uri.c_str(), handler_pair.first.c_str());
+                    uri_handler = handler_pair.second;
+                    break;
+                }
+            }
         }
     }
     
-    // 检查特定路径处理程序 - 使用精确匹配
-    auto it = current_instance_->ws_uri_handlers_.find(normalized_uri);
-    if (it != current_instance_->ws_uri_handlers_.end()) {
-        ESP_LOGI(TAG, "Found exact handler for WebSocket path: %s", normalized_uri.c_str());
-        it->second(client_index, message);
+    for (auto& callback : callbacks) {
+        callback(req, message);
+        handled = true;
+    }
+    if (uri_handler) {
+        uri_handler(client_index, message);
         handled = true;
-    } 
-    // 如果没有精确匹配，尝试前缀匹配
-    else {
-        for (auto& handler_pair : current_instance_->ws_uri_handlers_) {
-            // 检查是否是路径前缀
-            if (normalized_uri.find(handler_pair.first + "/") == 0 || 
-                normalized_uri == handler_pair.first) {
-                ESP_LOGI(TAG, "Found prefix handler for WebSocket path: %s (prefix: %s)", 
-                         normalized_uri.c_str(), handler_pair.first.c_str());
-                handler_pair.second(client_index, message);
-                handled = true;
-                break;
-            }
-        }
     }
     
     // 如果没有任何处理程序处理消息，记录警告
@@ -1211,6 +1314,7 @@ esp_err_t Web::WebSocketHandler(httpd_req_t* req) {
         
         // 列出所有已注册的处理程序供调试
         ESP_LOGW(TAG, "Registered WebSocket handlers:");
+        std::lock_guard<std::recursive_mutex> lock(current_instance_->handlers_mutex_);
         for (const auto& h : current_instance_->ws_uri_handlers_) {
             ESP_LOGW(TAG, "  - %s", h.first.c_str());
         }
@@ -1226,10 +1330,21 @@ esp_err_t Web::HandleApiRequest(httpd_req_t* req, const std::string& uri) {
     // 确保URI格式正确 - 必须以/api/开头
     std::string normalized_uri = uri;
     
-    // 直接使用请求的URI作为键，不做任何修改
-    std::string key = uri + ":" + std::to_string(req->method);
+    // 键由不带查询参数的路径和HttpMethod组成，与RegisterApiHandler一致
+    normalized_uri = normalized_uri.substr(0, normalized_uri.find('?'));
+    HttpMethod method;
+    switch (req->method) {
+        case HTTP_POST:   method = HttpMethod::HTTP_POST; break;
+        case HTTP_PUT:    method = HttpMethod::HTTP_PUT; break;
+        case HTTP_DELETE: method = HttpMethod::HTTP_DELETE; break;
+        case HTTP_PATCH:  method = HttpMethod::HTTP_PATCH; break;
+        default:          method = HttpMethod::HTTP_GET; break;
+    }
+    std::string method_key = std::to_string(static_cast<int>(method));
+    std::string key = normalized_uri + ":" + method_key;
     ESP_LOGI(TAG, "Looking for API handler with key: %s", key.c_str());
     
+    std::unique_lock<std::recursive_mutex> lock(handlers_mutex_);
     auto it = api_handlers_.find(key);
     
     // 如果找不到，尝试检查是否存在路径问题
@@ -1241,7 +1356,7 @@ esp_err_t Web::HandleApiRequest(httpd_req_t* req, const std::string& uri) {
             } else {
                 normalized_uri = "/api/" + (normalized_uri.front() == '/' ? normalized_uri.substr(1) : normalized_uri);
             }
-            key = normalized_uri + ":" + std::to_string(req->method);
+            key = normalized_uri + ":" + method_key;
             ESP_LOGI(TAG, "Trying with normalized URI: %s", normalized_uri.c_str());
             it = api_handlers_.find(key);
         }
@@ -1254,7 +1369,7 @@ esp_err_t Web::HandleApiRequest(httpd_req_t* req, const std::string& uri) {
             } else {
                 alt_uri += "/";
             }
-            std::string alt_key = alt_uri + ":" + std::to_string(req->method);
+            std::string alt_key = alt_uri + ":" + method_key;
             ESP_LOGI(TAG, "Trying alternative key: %s", alt_key.c_str());
             it = api_handlers_.find(alt_key);
         }
@@ -1269,7 +1384,7 @@ esp_err_t Web::HandleApiRequest(httpd_req_t* req, const std::string& uri) {
             // 再尝试一次最后的修复 - 查找不带方法的匹配项
             for (const auto& h : api_handlers_) {
                 std::string handler_path = h.first.substr(0, h.first.find_last_of(":"));
-                if (handler_path == normalized_uri || handler_path == uri) {
+                if (handler_path == normalized_uri) {
                     ESP_LOGI(TAG, "Found handler with matching path but different method: %s", h.first.c_str());
                 }
             }
@@ -1277,6 +1392,7 @@ esp_err_t Web::HandleApiRequest(httpd_req_t* req, const std::string& uri) {
     }
     
     if (it == api_handlers_.end()) {
+        lock.unlock();
         ESP_LOGW(TAG, "API handler not found for %s [method %d]", uri.c_str(), req->method);
         httpd_resp_set_status(req, "404 Not Found");
         httpd_resp_set_type(req, "application/json");
@@ -1285,7 +1401,9 @@ esp_err_t Web::HandleApiRequest(httpd_req_t* req, const std::string& uri) {
     }
     
     // Call API handler
-    ApiResponse response = it->second(req);
+    ApiHandler handler = it->second;
+    lock.unlock();
+    ApiResponse response = handler(req);
     
     // Set response headers
     httpd_resp_set_type(req, 
@@ -1304,6 +1422,17 @@ esp_err_t Web::HandleApiRequest(httpd_req_t* req, const std::string& uri) {
     sprintf(status_str, "%d", response.status_code);
     httpd_resp_set_status(req, status_str);
     
+    if (response.stream) {
+        bool ok = response.stream([req](const char* data, size_t len) {
+            return httpd_resp_send_chunk(req, data, len) == ESP_OK;
+        });
+        if (!ok) {
+            ESP_LOGW(TAG, "Streamed response for %s aborted", normalized_uri.c_str());
+            return ESP_FAIL;
+        }
+        return httpd_resp_send_chunk(req, nullptr, 0);
+    }
+    
     // Send response
     httpd_resp_send(req, response.content.c_str(), response.content.length());
     return ESP_OK;
@@ -1743,127 +1872,101 @@ void Web::InitVehicleWebSocketHandlers() {
 void Web::InitSensorHandlers() {
     ESP_LOGI(TAG, "Initializing sensor WebSocket handlers");
     
-    // 设置定期广播传感器数据的计时器
-    esp_timer_handle_t sensor_timer;
-    esp_timer_create_args_t timer_args = {
-        .callback = [](void* arg) {
-            if (!Web::current_instance_ || !Web::current_instance_->IsRunning()) {
+    // 客户端按需订阅，没有订阅者时不采样也不生成消息
+    if (!sensor_stream_) {
+        sensor_stream_ = std::make_unique<SensorStream>(this);
+        
+        // 从IMU传感器读取数据
+        sensor_stream_->AddSource("imu", [](iot::JsonWriter& writer) {
+            static const std::pair<const char*, const char*> kFields[] = {
+                {"accel_x", "accelX"}, {"accel_y", "accelY"}, {"accel_z", "accelZ"},
+                {"gyro_x", "gyroX"}, {"gyro_y", "gyroY"}, {"gyro_z", "gyroZ"},
+                {"mag_x", "magX"}, {"mag_y", "magY"}, {"mag_z", "magZ"},
+                {"temperature", "temperature"}, {"pressure", "pressure"}, {"altitude", "altitude"},
+            };
+            WriteThingValues(writer, ThingManager::GetInstance().FindThingByName("imu"), kFields);
+        }, []() { return ThingValuesVersion("imu"); });
+        
+        // IMU 姿态融合结果
+        sensor_stream_->AddSource("orientation", [](iot::JsonWriter& writer) {
+            static const std::pair<const char*, const char*> kFields[] = {
+                {"roll", "roll"}, {"pitch", "pitch"}, {"yaw", "yaw"},
+                {"quat_w", "quatW"}, {"quat_x", "quatX"}, {"quat_y", "quatY"}, {"quat_z", "quatZ"},
+                {"linear_accel_x", "linearAccelX"}, {"linear_accel_y", "linearAccelY"},
+                {"linear_accel_z", "linearAccelZ"},
+            };
+            WriteThingValues(writer, ThingManager::GetInstance().FindThingByName("imu"), kFields);
+        }, []() { return ThingValuesVersion("imu"); });
+        
+        // 从超声波传感器读取数据
+        // 限速状态随时间变化（传感器超时），这个数据源每个周期都采样
+        sensor_stream_->AddSource("distance", [](iot::JsonWriter& writer) {
+            Thing* us_thing = ThingManager::GetInstance().FindThingByName("UltrasonicSensor");
+            if (!us_thing) {
                 return;
             }
-            
-            // 创建传感器数据JSON
-            cJSON* sensor_data = cJSON_CreateObject();
-            cJSON_AddStringToObject(sensor_data, "type", "sensor_data");
-            
-            // 从IMU传感器读取数据
-            Thing* imu_thing = ThingManager::GetInstance().FindThingByName("IMU");
-            if (imu_thing) {
-                // 获取IMU数据
-                float accel_x = SafeGetValue(imu_thing, "accel_x");
-                if (!std::isnan(accel_x)) cJSON_AddNumberToObject(sensor_data, "accelX", accel_x);
-                
-                float accel_y = SafeGetValue(imu_thing, "accel_y");
-                if (!std::isnan(accel_y)) cJSON_AddNumberToObject(sensor_data, "accelY", accel_y);
-                
-                float accel_z = SafeGetValue(imu_thing, "accel_z");
-                if (!std::isnan(accel_z)) cJSON_AddNumberToObject(sensor_data, "accelZ", accel_z);
-                
-                float gyro_x = SafeGetValue(imu_thing, "gyro_x");
-                if (!std::isnan(gyro_x)) cJSON_AddNumberToObject(sensor_data, "gyroX", gyro_x);
-                
-                float gyro_y = SafeGetValue(imu_thing, "gyro_y");
-                if (!std::isnan(gyro_y)) cJSON_AddNumberToObject(sensor_data, "gyroY", gyro_y);
-                
-                float gyro_z = SafeGetValue(imu_thing, "gyro_z");
-                if (!std::isnan(gyro_z)) cJSON_AddNumberToObject(sensor_data, "gyroZ", gyro_z);
-                
-                float mag_x = SafeGetValue(imu_thing, "mag_x");
-                if (!std::isnan(mag_x)) cJSON_AddNumberToObject(sensor_data, "magX", mag_x);
-                
-                float mag_y = SafeGetValue(imu_thing, "mag_y");
-                if (!std::isnan(mag_y)) cJSON_AddNumberToObject(sensor_data, "magY", mag_y);
-                
-                float mag_z = SafeGetValue(imu_thing, "mag_z");
-                if (!std::isnan(mag_z)) cJSON_AddNumberToObject(sensor_data, "magZ", mag_z);
-                
-                float temperature = SafeGetValue(imu_thing, "temperature");
-                if (!std::isnan(temperature)) cJSON_AddNumberToObject(sensor_data, "temperature", temperature);
-                
-                float pressure = SafeGetValue(imu_thing, "pressure");
-                if (!std::isnan(pressure)) cJSON_AddNumberToObject(sensor_data, "pressure", pressure);
-                
-                float altitude = SafeGetValue(imu_thing, "altitude");
-                if (!std::isnan(altitude)) cJSON_AddNumberToObject(sensor_data, "altitude", altitude);
+            float front_distance = SafeGetValue(us_thing, "front_distance");
+            float rear_distance = SafeGetValue(us_thing, "rear_distance");
+            if (std::isnan(front_distance) && std::isnan(rear_distance)) {
+                return;
             }
             
-            // 从超声波传感器读取数据
-            Thing* us_thing = ThingManager::GetInstance().FindThingByName("UltrasonicSensor");
-            if (us_thing) {
-                // 获取超声波数据
-                float front_distance = SafeGetValue(us_thing, "front_distance");
-                float rear_distance = SafeGetValue(us_thing, "rear_distance");
-                
-                if (!std::isnan(front_distance) || !std::isnan(rear_distance)) {
-                    // 如果至少有一个距离值可用，创建距离对象
-                    cJSON* distances = cJSON_CreateObject();
-                    
-                    if (!std::isnan(front_distance)) {
-                        cJSON_AddNumberToObject(distances, "front", front_distance);
-                    }
-                    
-                    if (!std::isnan(rear_distance)) {
-                        cJSON_AddNumberToObject(distances, "rear", rear_distance);
-                    }
-                    
-                    cJSON_AddItemToObject(sensor_data, "distances", distances);
-                    
-                    // 计算平均距离（如果两个传感器都有值）
-                    if (!std::isnan(front_distance) && !std::isnan(rear_distance)) {
-                        cJSON_AddNumberToObject(sensor_data, "distance", (front_distance + rear_distance) / 2);
-                    } else if (!std::isnan(front_distance)) {
-                        cJSON_AddNumberToObject(sensor_data, "distance", front_distance);
-                    } else if (!std::isnan(rear_distance)) {
-                        cJSON_AddNumberToObject(sensor_data, "distance", rear_distance);
-                    }
-                    
-                    // 添加安全距离（固定值）
-                    cJSON_AddNumberToObject(sensor_data, "safeDistance", 20.0f);
-                    
-                    // 障碍物检测 - 假设超声波Thing有这些布尔值属性
-                    // 如果没有，可以根据距离计算
-                    bool front_obstacle = (front_distance < 20.0f) && !std::isnan(front_distance);
-                    bool rear_obstacle = (rear_distance < 20.0f) && !std::isnan(rear_distance);
-                    
-                    cJSON_AddBoolToObject(sensor_data, "frontObstacle", front_obstacle);
-                    cJSON_AddBoolToObject(sensor_data, "rearObstacle", rear_obstacle);
-                }
+            writer.Key("distances");
+            writer.BeginObject();
+            if (!std::isnan(front_distance)) {
+                writer.Key("front");
+                writer.Number(front_distance);
             }
-            
-            // 从光线传感器读取数据
-            Thing* light_thing = ThingManager::GetInstance().FindThingByName("Light");
-            if (light_thing) {
-                float light = SafeGetValue(light_thing, "light");
-                if (!std::isnan(light)) {
-                    cJSON_AddNumberToObject(sensor_data, "light", light);
-                }
+            if (!std::isnan(rear_distance)) {
+                writer.Key("rear");
+                writer.Number(rear_distance);
             }
+            writer.EndObject();
             
-            // 转换为字符串并广播
-            char* sensor_str = cJSON_PrintUnformatted(sensor_data);
-            if (sensor_str) {
-                Web::current_instance_->BroadcastWebSocketMessage(sensor_str);
-                free(sensor_str);
+            // 计算平均距离（如果两个传感器都有值）
+            writer.Key("distance");
+            if (!std::isnan(front_distance) && !std::isnan(rear_distance)) {
+                writer.Number((front_distance + rear_distance) / 2);
+            } else {
+                writer.Number(std::isnan(front_distance) ? rear_distance : front_distance);
             }
             
-            cJSON_Delete(sensor_data);
-        },
-        .arg = nullptr,
-        .name = "sensor_data"
-    };
+            // 安全距离和障碍物状态来自避障安全监控，与电机实际受到的限制一致
+            auto& supervisor = ObstacleSupervisor::GetInstance();
+            writer.Key("safeDistance");
+            writer.Number((double)supervisor.GetThresholds().stop_distance_cm);
+            float front_scale = supervisor.GetScale(MotionDirection::kForward);
+            float rear_scale = supervisor.GetScale(MotionDirection::kBackward);
+            writer.Key("frontObstacle");
+            writer.Bool(front_scale == 0.0f);
+            writer.Key("rearObstacle");
+            writer.Bool(rear_scale == 0.0f);
+            writer.Key("frontLimit");
+            writer.Number((double)front_scale);
+            writer.Key("rearLimit");
+            writer.Number((double)rear_scale);
+        });
+        
+        // 从光线传感器读取数据
+        sensor_stream_->AddSource("light", [](iot::JsonWriter& writer) {
+            float light = SafeGetValue(ThingManager::GetInstance().FindThingByName("Light"), "light");
+            if (!std::isnan(light)) {
+                writer.Key("light");
+                writer.Number(light);
+            }
+        }, []() { return ThingValuesVersion("Light"); });
+    }
+    sensor_stream_->Start();
     
-    // 创建并启动计时器，每秒发送一次传感器数据
-    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &sensor_timer));
-    ESP_ERROR_CHECK(esp_timer_start_periodic(sensor_timer, 1000000)); // 1秒 = 1000000微秒
+    // 订阅消息可以发到专用的 /ws/sensors，也可以发到主页面使用的 /ws
+    RegisterWebSocketHandler("/ws/sensors", [this](int client_index, const std::string& message) {
+        if (!sensor_stream_->HandleMessage(client_index, message)) {
+            ESP_LOGW(TAG, "Unsupported sensor WebSocket message: %s", message.c_str());
+        }
+    });
+    RegisterWebSocketMessageCallback([this](httpd_req_t* req, const std::string& message) {
+        sensor_stream_->HandleMessage(httpd_req_to_sockfd(req), message);
+    });
     
     ESP_LOGI(TAG, "Sensor WebSocket handlers initialized");
 }
\ No newline at end of file
@@ -7,6 +7,9 @@
 #include <vector>
 #include <functional>
 #include <memory>
+#include <mutex>
+
+class SensorStream;
 
 // HTTP方法枚举
 enum class HttpMethod {
@@ -31,6 +34,8 @@ struct ApiResponse {
     int status_code;
     std::string content;
     std::map<std::string, std::string> headers;
+    // 设置后忽略content，以分块传输发送stream写出的内容，write在客户端断开后返回false
+    std::function<bool(const std::function<bool(const char* data, size_t len)>& write)> stream;
 
     ApiResponse() : type(ApiResponseType::JSON), status_code(200) {}
     ApiResponse(const std::string& json_content) : type(ApiResponseType::JSON), status_code(200), content(json_content) {}
@@ -106,6 +111,13 @@ protected:
     // WebSocket回调
     std::vector<WebSocketMessageCallback> ws_callbacks_;
     
+    // 组件在启动线程上并行注册处理器，httpd任务查找时只在锁内复制处理器，不在锁内执行
+    mutable std::recursive_mutex handlers_mutex_;
+    RequestHandler FindHttpHandler(const std::string& key) const;
+    
+    // 传感器订阅推送
+    std::unique_ptr<SensorStream> sensor_stream_;
+    
     // 内部方法
     void InitDefaultHandlers();
     void InitApiHandlers();
@@ -115,6 +127,7 @@ protected:
     // 内部静态HTTP处理器
     static esp_err_t InternalRequestHandler(httpd_req_t* req);
     static esp_err_t WebSocketHandler(httpd_req_t* req);
+    static void SocketCloseHandler(httpd_handle_t handle, int sockfd);
     static esp_err_t RootHandler(httpd_req_t* req);
     static esp_err_t CarHandler(httpd_req_t* req);
     static esp_err_t VisionHandler(httpd_req_t* req);
@@ -0,0 +1,179 @@
+# 设备端模拟压测客户端
+#
+# 按固件的 WebSocket 协议连接服务器 (默认连接本地 simulator.py)，
+# 循环执行 hello -> listen start -> 实时上传音频 -> listen stop -> 等待 TTS，
+# 统计各阶段延迟和下行音频抖动，可在 CI 中设定阈值。
+import argparse
+import asyncio
+import json
+import struct
+import sys
+import time
+
+from common import SILENT_OPUS_FRAME, load_p3_frames, summarize, percentile
+
+
+class BenchResult:
+    def __init__(self):
+        self.hello = []
+        self.stt = []
+        self.tts_start = []
+        self.first_audio = []
+        self.first_sentence = []
+        self.frame_gap = []
+        self.ping_rtt = []
+        self.failures = 0
+
+    def report(self):
+        print(summarize("hello round trip", self.hello))
+        print(summarize("listen stop -> stt", self.stt))
+        print(summarize("listen stop -> tts start", self.tts_start))
+        print(summarize("listen stop -> first sentence", self.first_sentence))
+        print(summarize("listen stop -> first audio", self.first_audio))
+        print(summarize("downlink frame interval", self.frame_gap))
+        print(summarize("ping rtt", self.ping_rtt))
+        print(f"failures: {self.failures}")
+
+
+def pack_audio(version, payload, timestamp):
+    if version == 2:
+        return struct.pack('>HHIII', 2, 0, 0, timestamp, len(payload)) + payload
+    if version == 3:
+        return struct.pack('>BBH', 0, 0, len(payload)) + payload
+    return payload
+
+
+async def run_turn(websocket, args, frames, result):
+    session_id = ""
+    # hello
+    start = time.monotonic()
+    await websocket.send(json.dumps({
+        "type": "hello",
+        "version": args.version,
+        "features": {"mcp": True, "ping": True},
+        "transport": "websocket",
+        "audio_params": {"format": "opus", "sample_rate": 16000, "channels": 1, "frame_duration": args.frame_duration},
+    }))
+    while True:
+        message = json.loads(await asyncio.wait_for(websocket.recv(), args.timeout))
+        if message.get("type") == "hello":
+            session_id = message.get("session_id", "")
+            result.hello.append((time.monotonic() - start) * 1000.0)
+            break
+
+    # ping
+    ping_start = time.monotonic()
+    await websocket.send(json.dumps({"session_id": session_id, "type": "ping", "timestamp": int(ping_start * 1000) & 0xFFFFFFFF}))
+
+    # 实时上传音频
+    await websocket.send(json.dumps({"session_id": session_id, "type": "listen", "state": "start", "mode": "manual"}))
+    frame_interval = args.frame_duration / 1000.0
+    upload_start = time.monotonic()
+    for index, frame in enumerate(frames):
+        await websocket.send(pack_audio(args.version, frame, index * args.frame_duration))
+        delay = upload_start + (index + 1) * frame_interval - time.monotonic()
+        if delay > 0:
+            await asyncio.sleep(delay)
+    stop_time = time.monotonic()
+    await websocket.send(json.dumps({"session_id": session_id, "type": "listen", "state": "stop"}))
+
+    # 等待回复直到 tts stop
+    last_frame = None
+    got_audio = False
+    got_sentence = False
+    while True:
+        data = await asyncio.wait_for(websocket.recv(), args.timeout)
+        now = time.monotonic()
+        elapsed = (now - stop_time) * 1000.0
+        if isinstance(data, bytes):
+            if not got_audio:
+                result.first_audio.append(elapsed)
+                got_audio = True
+            if last_frame is not None:
+                result.frame_gap.append((now - last_frame) * 1000.0)
+            last_frame = now
+            continue
+
+        message = json.loads(data)
+        msg_type = message.get("type")
+        if msg_type == "pong":
+            result.ping_rtt.append((now - ping_start) * 1000.0)
+        elif msg_type == "stt":
+            result.stt.append(elapsed)
+        elif msg_type == "mcp":
+            # 对服务器发起的 MCP 请求给出最小应答，便于服务器统计往返时间
+            payload = message.get("payload", {})
+            reply = {"jsonrpc": "2.0", "id": payload.get("id"), "result": {}}
+            if payload.get("method") == "tools/list":
+                reply["result"] = {"tools": []}
+            await websocket.send(json.dumps({"session_id": session_id, "type": "mcp", "payload": reply}))
+        elif msg_type == "tts":
+            state = message.get("state")
+            if state == "start":
+                result.tts_start.append(elapsed)
+            elif state == "sentence_start" and not got_sentence:
+                result.first_sentence.append(elapsed)
+                got_sentence = True
+            elif state == "stop":
+                break
+
+
+async def run_client(args, frames, result):
+    import websockets
+
+    headers = {
+        "Authorization": f"Bearer {args.token}",
+        "Protocol-Version": str(args.version),
+        "Device-Id": args.device_id,
+        "Client-Id": args.client_id,
+    }
+    try:
+        connect = websockets.connect(args.url, additional_headers=headers)
+    except TypeError:
+        connect = websockets.connect(args.url, extra_headers=headers)
+
+    async with connect as websocket:
+        for _ in range(args.turns):
+            try:
+                await run_turn(websocket, args, frames, result)
+            except asyncio.TimeoutError:
+                result.failures += 1
+                print("turn timed out")
+
+
+def main():
+    parser = argparse.ArgumentParser(description='模拟设备进行端到端延迟压测')
+    parser.add_argument('--url', default='ws://127.0.0.1:8000/')
+    parser.add_argument('--token', default='test-token')
+    parser.add_argument('--device-id', default='00:00:00:00:00:00')
+    parser.add_argument('--client-id', default='bench-client')
+    parser.add_argument('--version', type=int, choices=[1, 2, 3], default=1, help='二进制协议版本')
+    parser.add_argument('--audio', help='上传的音频 (p3 格式)，不指定时上传静音帧')
+    parser.add_argument('--frames', type=int, default=30, help='未指定 --audio 时上传的静音帧数')
+    parser.add_argument('--frame-duration', type=int, default=60)
+    parser.add_argument('--turns', type=int, default=10, help='每个连接的对话轮数')
+    parser.add_argument('--clients', type=int, default=1, help='并发连接数')
+    parser.add_argument('--timeout', type=float, default=10.0)
+    parser.add_argument('--max-tts-start-p90', type=float, default=None,
+                        help='listen stop -> tts start 的 p90 上限 (ms)，超过时返回非零，用于 CI')
+    args = parser.parse_args()
+
+    frames = load_p3_frames(args.audio) if args.audio else [SILENT_OPUS_FRAME] * args.frames
+    result = BenchResult()
+
+    async def run_all():
+        await asyncio.gather(*[run_client(args, frames, result) for _ in range(args.clients)])
+
+    asyncio.run(run_all())
+    result.report()
+
+    if result.failures > 0:
+        return 1
+    if args.max_tts_start_p90 is not None and percentile(result.tts_start, 90) > args.max_tts_start_p90:
+        print(f"tts start p90 exceeds {args.max_tts_start_p90}ms")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,167 @@
+# 服务器模拟器与压测客户端共用的工具: 网络劣化、P3 音频读取、逐消息计时日志
+import asyncio
+import random
+import struct
+import time
+
+
+# 60ms CELT 静音帧（TOC=0xF8 | code 0），在没有提供 TTS 文件时作为占位音频
+SILENT_OPUS_FRAME = b'\xf8\xff\xfe'
+
+
+def load_p3_frames(path):
+    """
+    读取 p3 文件，返回 Opus 包列表
+    p3格式: [1字节类型, 1字节保留, 2字节长度, Opus数据]
+    """
+    frames = []
+    with open(path, 'rb') as f:
+        while True:
+            header = f.read(4)
+            if len(header) < 4:
+                break
+            _, _, data_len = struct.unpack('>BBH', header)
+            data = f.read(data_len)
+            if len(data) < data_len:
+                break
+            frames.append(data)
+    return frames
+
+
+class NetworkImpairment:
+    """
+    对单方向的消息注入固定延迟、随机抖动和丢包
+    delay_ms + uniform(-jitter_ms, jitter_ms)，丢包按 loss 概率独立发生
+    ordered=True 时模拟 TCP：投递时间单调不减，消息不会乱序；ordered=False 时模拟 UDP，抖动可以导致乱序
+    投递在后台按到期时间执行，deliver 立即返回，不会阻塞调用方的发送节奏或接收循环
+    """
+
+    def __init__(self, delay_ms=0, jitter_ms=0, loss=0.0, seed=None, ordered=True):
+        self.delay_ms = delay_ms
+        self.jitter_ms = jitter_ms
+        self.loss = loss
+        self.ordered = ordered
+        self.random = random.Random(seed)
+        self.dropped = 0
+        self.passed = 0
+        self.last_due = 0.0
+        self.queue = None
+        self.worker = None
+        self.pending = set()
+
+    def enabled(self):
+        return self.delay_ms > 0 or self.jitter_ms > 0 or self.loss > 0
+
+    def should_drop(self):
+        if self.loss > 0 and self.random.random() < self.loss:
+            self.dropped += 1
+            return True
+        self.passed += 1
+        return False
+
+    def next_delay(self):
+        delay = self.delay_ms
+        if self.jitter_ms > 0:
+            delay += self.random.uniform(-self.jitter_ms, self.jitter_ms)
+        return max(0.0, delay) / 1000.0
+
+    async def deliver(self, send_coro_factory, droppable=True):
+        """
+        按劣化参数投递一条消息
+        控制消息 (droppable=False) 只加延迟不丢弃，和 TCP 上的 JSON 行为一致
+        """
+        if droppable and self.should_drop():
+            return
+        delay = self.next_delay()
+        if not self.enabled():
+            await send_coro_factory()
+            return
+        loop = asyncio.get_running_loop()
+        due = loop.time() + delay
+        if not self.ordered:
+            now = loop.time()
+            self.pending = {h for h in self.pending if h.when() > now}
+            self.pending.add(loop.call_later(delay, self._spawn, send_coro_factory))
+            return
+        # 按到期时间排队，单个 worker 依次投递，保证同一方向的消息顺序
+        due = max(due, self.last_due)
+        self.last_due = due
+        if self.queue is None:
+            self.queue = asyncio.Queue()
+            self.worker = asyncio.ensure_future(self._run())
+        self.queue.put_nowait((due, send_coro_factory))
+
+    def _spawn(self, send_coro_factory):
+        task = asyncio.ensure_future(send_coro_factory())
+        task.add_done_callback(self._report)
+
+    @staticmethod
+    def _report(task):
+        if not task.cancelled() and task.exception() is not None:
+            print(f"Delayed delivery failed: {task.exception()!r}")
+
+    async def _run(self):
+        loop = asyncio.get_running_loop()
+        while True:
+            due, send_coro_factory = await self.queue.get()
+            wait = due - loop.time()
+            if wait > 0:
+                await asyncio.sleep(wait)
+            try:
+                await send_coro_factory()
+            except Exception as e:
+                print(f"Delayed delivery failed: {e!r}")
+
+    def close(self):
+        """丢弃尚未投递的消息，连接关闭时调用"""
+        for handle in self.pending:
+            handle.cancel()
+        self.pending.clear()
+        if self.worker:
+            self.worker.cancel()
+            self.worker = None
+            self.queue = None
+
+
+class TimingLog:
+    """逐消息计时日志，时间相对会话开始，可选输出 CSV"""
+
+    def __init__(self, name, csv_file=None, quiet_audio=True):
+        self.name = name
+        self.start = time.monotonic()
+        self.csv_file = csv_file
+        self.quiet_audio = quiet_audio
+        self.audio_in = 0
+        self.audio_out = 0
+
+    def now_ms(self):
+        return (time.monotonic() - self.start) * 1000.0
+
+    def log(self, direction, kind, size, detail=''):
+        t = self.now_ms()
+        if kind == 'audio':
+            if direction == 'in':
+                self.audio_in += 1
+            else:
+                self.audio_out += 1
+        if kind != 'audio' or not self.quiet_audio:
+            print(f"[{self.name} {t:10.1f}ms] {direction:>3} {kind:<10} {size:6d}B {detail}")
+        if self.csv_file:
+            self.csv_file.write(f"{self.name},{t:.3f},{direction},{kind},{size},{detail}\n")
+
+
+def percentile(values, p):
+    if not values:
+        return float('nan')
+    values = sorted(values)
+    k = (len(values) - 1) * p / 100.0
+    f = int(k)
+    c = min(f + 1, len(values) - 1)
+    return values[f] + (values[c] - values[f]) * (k - f)
+
+
+def summarize(name, values):
+    if not values:
+        return f"{name}: n=0"
+    return (f"{name}: n={len(values)} min={min(values):.1f} p50={percentile(values, 50):.1f} "
+            f"p90={percentile(values, 90):.1f} p99={percentile(values, 99):.1f} max={max(values):.1f} ms")
@@ -0,0 +1,439 @@
+# 本地小智服务器模拟器
+#
+# 支持 docs/websocket.md 中的 WebSocket 流程 (hello / listen / abort / tts / mcp / ping)
+# 以及 docs/mqtt-udp.md 中的 MQTT 控制 + AES-CTR 加密 UDP 音频通道。
+# 可下发预置的 Opus TTS (p3 文件) 或回放上行音频，并注入延迟、抖动与丢包。
+import argparse
+import asyncio
+import json
+import os
+import struct
+import sys
+import time
+import uuid
+
+from common import NetworkImpairment, TimingLog, SILENT_OPUS_FRAME, load_p3_frames, summarize
+
+
+class Conversation:
+    """
+    与传输层无关的会话逻辑
+    transport 需要实现 send_json(dict) 和 send_audio(bytes, timestamp)
+    """
+
+    def __init__(self, args, transport, log):
+        self.args = args
+        self.transport = transport
+        self.log = log
+        self.session_id = str(uuid.uuid4())
+        self.uplink = []
+        self.listen_mode = None
+        self.listening = False
+        self.tts_task = None
+        self.mcp_pending = {}
+        self.mcp_next_id = 1
+        self.mcp_latencies = []
+        self.listen_to_tts = []
+        self.listen_stop_time = None
+
+    def server_hello(self, transport_name, extra=None):
+        hello = {
+            "type": "hello",
+            "transport": transport_name,
+            "session_id": self.session_id,
+            "audio_params": {
+                "format": "opus",
+                "sample_rate": self.args.tts_sample_rate,
+                "channels": 1,
+                "frame_duration": self.args.frame_duration,
+            },
+            "features": {"ping": True},
+        }
+        if extra:
+            hello.update(extra)
+        return hello
+
+    async def start_mcp(self):
+        if not self.args.mcp:
+            return
+        await self.send_mcp("initialize", {"capabilities": {}})
+        await self.send_mcp("tools/list", {})
+
+    async def send_mcp(self, method, params):
+        request_id = self.mcp_next_id
+        self.mcp_next_id += 1
+        self.mcp_pending[request_id] = (method, time.monotonic())
+        await self.transport.send_json({
+            "session_id": self.session_id,
+            "type": "mcp",
+            "payload": {"jsonrpc": "2.0", "method": method, "params": params, "id": request_id},
+        })
+
+    async def on_json(self, message):
+        msg_type = message.get("type")
+        if msg_type == "listen":
+            state = message.get("state")
+            if state == "start":
+                self.listen_mode = message.get("mode", "auto")
+                self.listening = True
+                self.uplink = []
+            elif state == "stop":
+                self.listening = False
+                self.listen_stop_time = time.monotonic()
+                self.start_reply()
+            elif state == "detect":
+                self.log.log('in', 'wake_word', 0, message.get("text", ""))
+        elif msg_type == "abort":
+            await self.stop_tts()
+        elif msg_type == "ping":
+            await self.transport.send_json({"type": "pong", "timestamp": message.get("timestamp", 0)})
+        elif msg_type == "mcp":
+            payload = message.get("payload", {})
+            pending = self.mcp_pending.pop(payload.get("id"), None)
+            if pending:
+                method, sent = pending
+                latency = (time.monotonic() - sent) * 1000.0
+                self.mcp_latencies.append(latency)
+                self.log.log('in', 'mcp_reply', 0, f"{method} {latency:.1f}ms")
+                result = payload.get("result", {})
+                if method == "tools/list" and "nextCursor" in result:
+                    await self.send_mcp("tools/list", {"cursor": result["nextCursor"]})
+        elif msg_type == "goodbye":
+            await self.stop_tts()
+
+    async def on_audio(self, payload):
+        if not self.listening:
+            return
+        self.uplink.append(payload)
+        # 自动模式下收满一句话即认为用户说完
+        if self.listen_mode in ("auto", "realtime") and len(self.uplink) >= self.args.utterance_frames:
+            self.listen_stop_time = time.monotonic()
+            self.listening = self.listen_mode == "realtime"
+            self.start_reply()
+
+    def start_reply(self):
+        if self.tts_task and not self.tts_task.done():
+            return
+        frames = list(self.uplink) if self.args.echo else None
+        self.uplink = []
+        self.tts_task = asyncio.ensure_future(self.reply(frames))
+
+    async def stop_tts(self):
+        if self.tts_task and not self.tts_task.done():
+            self.tts_task.cancel()
+            await self.transport.send_json({"session_id": self.session_id, "type": "tts", "state": "stop"})
+
+    async def reply(self, echo_frames):
+        sid = self.session_id
+        await self.transport.send_json({"session_id": sid, "type": "stt", "text": "模拟识别结果"})
+        await self.transport.send_json({"session_id": sid, "type": "llm", "emotion": "happy", "text": "😀"})
+        await self.transport.send_json({"session_id": sid, "type": "tts", "state": "start"})
+        if self.listen_stop_time is not None:
+            self.listen_to_tts.append((time.monotonic() - self.listen_stop_time) * 1000.0)
+
+        frames = echo_frames if echo_frames else self.args.tts_frames
+        frame_interval = self.args.frame_duration / 1000.0
+        sentence = 0
+        start = time.monotonic()
+        for index, frame in enumerate(frames):
+            if index % self.args.sentence_frames == 0:
+                sentence += 1
+                await self.transport.send_json({
+                    "session_id": sid, "type": "tts", "state": "sentence_start",
+                    "text": f"第 {sentence} 句模拟回复",
+                })
+            await self.transport.send_audio(frame, index * self.args.frame_duration)
+            # 按实时节奏发送，保持与真实服务器一致的下行码率
+            next_time = start + (index + 1) * frame_interval
+            delay = next_time - time.monotonic()
+            if delay > 0:
+                await asyncio.sleep(delay)
+        await self.transport.send_json({"session_id": sid, "type": "tts", "state": "stop"})
+
+    def report(self):
+        print(summarize(f"[{self.log.name}] listen->tts_start", self.listen_to_tts))
+        print(summarize(f"[{self.log.name}] mcp round trip", self.mcp_latencies))
+        print(f"[{self.log.name}] audio frames in={self.log.audio_in} out={self.log.audio_out}")
+
+
+class WebsocketTransport:
+    def __init__(self, websocket, version, args, log):
+        self.websocket = websocket
+        self.version = version
+        self.log = log
+        self.downlink = NetworkImpairment(args.delay, args.jitter, args.loss, args.seed)
+
+    async def send_json(self, message):
+        text = json.dumps(message, ensure_ascii=False)
+        self.log.log('out', message.get("type", "?"), len(text), message.get("state", ""))
+        await self.downlink.deliver(lambda: self.websocket.send(text), droppable=False)
+
+    async def send_audio(self, payload, timestamp):
+        if self.version == 2:
+            data = struct.pack('>HHIII', 2, 0, 0, timestamp, len(payload)) + payload
+        elif self.version == 3:
+            data = struct.pack('>BBH', 0, 0, len(payload)) + payload
+        else:
+            data = payload
+        self.log.log('out', 'audio', len(data))
+        # WebSocket 跑在 TCP 上不会真的丢包，丢包参数用来模拟应用层丢帧
+        await self.downlink.deliver(lambda: self.websocket.send(data))
+
+    def parse_audio(self, data):
+        if self.version == 2:
+            _, _, _, _, size = struct.unpack('>HHIII', data[:16])
+            return data[16:16 + size]
+        if self.version == 3:
+            _, _, size = struct.unpack('>BBH', data[:4])
+            return data[4:4 + size]
+        return data
+
+
+def request_headers(websocket):
+    # 兼容 websockets 新旧两套 API
+    request = getattr(websocket, "request", None)
+    if request is not None:
+        return request.headers
+    return websocket.request_headers
+
+
+async def websocket_session(websocket, args, csv_file):
+    import websockets
+
+    headers = request_headers(websocket)
+    version = int(headers.get("Protocol-Version", "1"))
+    device_id = headers.get("Device-Id", "unknown")
+    log = TimingLog(f"ws:{device_id}", csv_file, quiet_audio=not args.verbose)
+    transport = WebsocketTransport(websocket, version, args, log)
+    conversation = Conversation(args, transport, log)
+    uplink = NetworkImpairment(args.delay, args.jitter, args.loss, args.seed)
+    print(f"Device {device_id} connected, protocol version {version}")
+
+    async def handle(data):
+        if isinstance(data, bytes):
+            payload = transport.parse_audio(data)
+            log.log('in', 'audio', len(data))
+            await conversation.on_audio(payload)
+            return
+
+        message = json.loads(data)
+        log.log('in', message.get("type", "?"), len(data), message.get("state", ""))
+        if message.get("type") == "hello":
+            await transport.send_json(conversation.server_hello("websocket"))
+            await conversation.start_mcp()
+        else:
+            await conversation.on_json(message)
+
+    try:
+        # 上行同样经过延迟队列，接收循环本身不等待，只有音频帧参与丢包
+        async for data in websocket:
+            await uplink.deliver(lambda data=data: handle(data), droppable=isinstance(data, bytes))
+    except websockets.exceptions.ConnectionClosed:
+        pass
+    finally:
+        uplink.close()
+        transport.downlink.close()
+        print(f"Device {device_id} disconnected, dropped downlink={transport.downlink.dropped} uplink={uplink.dropped}")
+        conversation.report()
+
+
+class UdpAudioChannel(asyncio.DatagramProtocol):
+    """
+    AES-128-CTR 加密的 UDP 音频通道
+    |type 1u|flags 1u|payload_len 2u|ssrc 4u|timestamp 4u|sequence 4u|payload|
+    """
+
+    def __init__(self, key, nonce, args):
+        from cryptography.hazmat.primitives.ciphers import Cipher, algorithms, modes
+        self.Cipher, self.algorithms, self.modes = Cipher, algorithms, modes
+        self.key = key
+        self.nonce = nonce
+        self.args = args
+        self.transport = None
+        self.peer = None
+        self.sequence = 0
+        self.conversation = None
+        self.log = None
+        self.downlink = NetworkImpairment(args.delay, args.jitter, args.loss, args.seed, ordered=False)
+        self.uplink = NetworkImpairment(args.delay, args.jitter, args.loss, args.seed, ordered=False)
+
+    def crypt(self, nonce, data):
+        cipher = self.Cipher(self.algorithms.AES(self.key), self.modes.CTR(nonce))
+        ctx = cipher.encryptor()
+        return ctx.update(data) + ctx.finalize()
+
+    def connection_made(self, transport):
+        self.transport = transport
+
+    def datagram_received(self, data, addr):
+        self.peer = addr
+        if len(data) < 16 or data[0] != 0x01:
+            return
+        asyncio.ensure_future(self.uplink.deliver(lambda: self._receive(data)))
+
+    async def _receive(self, data):
+        payload = self.crypt(data[:16], data[16:])
+        if self.log:
+            self.log.log('in', 'audio', len(data))
+        if self.conversation:
+            await self.conversation.on_audio(payload)
+
+    async def send_audio(self, payload, timestamp):
+        if self.peer is None:
+            return
+        self.sequence += 1
+        nonce = bytearray(self.nonce)
+        struct.pack_into('>H', nonce, 2, len(payload))
+        struct.pack_into('>II', nonce, 8, timestamp & 0xFFFFFFFF, self.sequence)
+        packet = bytes(nonce) + self.crypt(bytes(nonce), payload)
+        if self.log:
+            self.log.log('out', 'audio', len(packet))
+        await self.downlink.deliver(lambda: self._send(packet))
+
+    async def _send(self, packet):
+        self.transport.sendto(packet, self.peer)
+
+
+class MqttTransport:
+    def __init__(self, client, topic, udp, log, args):
+        self.client = client
+        self.topic = topic
+        self.udp = udp
+        self.log = log
+        self.downlink = NetworkImpairment(args.delay, args.jitter, 0.0, args.seed)
+
+    async def send_json(self, message):
+        text = json.dumps(message, ensure_ascii=False)
+        self.log.log('out', message.get("type", "?"), len(text), message.get("state", ""))
+        await self.downlink.deliver(lambda: self._publish(text), droppable=False)
+
+    async def _publish(self, text):
+        self.client.publish(self.topic, text)
+
+    async def send_audio(self, payload, timestamp):
+        await self.udp.send_audio(payload, timestamp)
+
+
+async def run_mqtt(args, csv_file):
+    import paho.mqtt.client as mqtt
+
+    loop = asyncio.get_running_loop()
+    key = os.urandom(16)
+    nonce = bytearray(os.urandom(16))
+    nonce[0] = 0x01
+    nonce = bytes(nonce)
+
+    udp_transport, udp = await loop.create_datagram_endpoint(
+        lambda: UdpAudioChannel(key, nonce, args), local_addr=("0.0.0.0", args.udp_port))
+
+    client = mqtt.Client()
+    if args.mqtt_username:
+        client.username_pw_set(args.mqtt_username, args.mqtt_password)
+    queue = asyncio.Queue()
+    client.on_message = lambda c, u, msg: loop.call_soon_threadsafe(queue.put_nowait, msg.payload)
+    client.connect(args.mqtt_broker, args.mqtt_port)
+    client.subscribe(args.device_topic)
+    client.loop_start()
+    print(f"MQTT simulator subscribed to {args.device_topic}, replying on {args.server_topic}, UDP port {args.udp_port}")
+
+    conversation = None
+    try:
+        while True:
+            payload = await queue.get()
+            message = json.loads(payload)
+            msg_type = message.get("type")
+            if msg_type == "hello":
+                if conversation:
+                    conversation.report()
+                    transport.downlink.close()
+                log = TimingLog("mqtt", csv_file, quiet_audio=not args.verbose)
+                transport = MqttTransport(client, args.server_topic, udp, log, args)
+                conversation = Conversation(args, transport, log)
+                udp.conversation = conversation
+                udp.log = log
+                udp.sequence = 0
+                log.log('in', 'hello', len(payload))
+                await transport.send_json(conversation.server_hello("udp", {
+                    "udp": {
+                        "server": args.udp_host,
+                        "port": args.udp_port,
+                        "key": key.hex().upper(),
+                        "nonce": nonce.hex().upper(),
+                        "encryption": "aes-128-ctr",
+                    }
+                }))
+                await conversation.start_mcp()
+            elif conversation:
+                conversation.log.log('in', msg_type or "?", len(payload), message.get("state", ""))
+                await conversation.on_json(message)
+    finally:
+        client.loop_stop()
+        udp.uplink.close()
+        udp.downlink.close()
+        udp_transport.close()
+        if conversation:
+            conversation.report()
+
+
+async def run_websocket(args, csv_file):
+    import websockets
+
+    async def handler(websocket, path=None):
+        await websocket_session(websocket, args, csv_file)
+
+    async with websockets.serve(handler, args.host, args.port, max_size=None):
+        print(f"WebSocket simulator listening on ws://{args.host}:{args.port}/")
+        await asyncio.Future()
+
+
+def main():
+    parser = argparse.ArgumentParser(description='本地小智服务器模拟器，用于端到端延迟压测')
+    parser.add_argument('--mode', choices=['websocket', 'mqtt'], default='websocket')
+    parser.add_argument('--host', default='0.0.0.0')
+    parser.add_argument('--port', type=int, default=8000, help='WebSocket 端口 (默认: 8000)')
+    parser.add_argument('--tts', help='下发的 TTS 音频 (p3 格式)，不指定时发送静音帧')
+    parser.add_argument('--tts-sample-rate', type=int, default=16000)
+    parser.add_argument('--frame-duration', type=int, default=60)
+    parser.add_argument('--tts-length', type=int, default=50, help='未指定 --tts 时静音帧数量')
+    parser.add_argument('--echo', action='store_true', help='把上行音频作为 TTS 回放')
+    parser.add_argument('--utterance-frames', type=int, default=30, help='自动模式下多少帧视为一句话结束')
+    parser.add_argument('--sentence-frames', type=int, default=25, help='每隔多少帧发送一次 sentence_start')
+    parser.add_argument('--mcp', action='store_true', help='hello 之后发起 initialize 和 tools/list')
+    parser.add_argument('--delay', type=float, default=0, help='单向延迟 (ms)')
+    parser.add_argument('--jitter', type=float, default=0, help='抖动幅度 (ms)')
+    parser.add_argument('--loss', type=float, default=0, help='音频丢包率 0~1')
+    parser.add_argument('--seed', type=int, default=None)
+    parser.add_argument('--csv', help='逐消息计时日志输出文件')
+    parser.add_argument('--verbose', '-v', action='store_true', help='打印每一个音频包')
+    parser.add_argument('--mqtt-broker', default='127.0.0.1')
+    parser.add_argument('--mqtt-port', type=int, default=1883)
+    parser.add_argument('--mqtt-username')
+    parser.add_argument('--mqtt-password')
+    parser.add_argument('--device-topic', default='device-server', help='设备 publish_topic')
+    parser.add_argument('--server-topic', default='devices/p2p/device', help='发往设备的 topic (设备的 subscribe_topic)')
+    parser.add_argument('--udp-host', default='127.0.0.1', help='hello 中下发给设备的 UDP 地址')
+    parser.add_argument('--udp-port', type=int, default=8888)
+    args = parser.parse_args()
+
+    if args.tts:
+        args.tts_frames = load_p3_frames(args.tts)
+    else:
+        args.tts_frames = [SILENT_OPUS_FRAME] * args.tts_length
+
+    csv_file = open(args.csv, 'w') if args.csv else None
+    if csv_file:
+        csv_file.write("session,time_ms,direction,kind,bytes,detail\n")
+    try:
+        if args.mode == 'websocket':
+            asyncio.run(run_websocket(args, csv_file))
+        else:
+            asyncio.run(run_mqtt(args, csv_file))
+    except KeyboardInterrupt:
+        pass
+    finally:
+        if csv_file:
+            csv_file.close()
+
+
+if __name__ == "__main__":
+    sys.exit(main())